@@ -1,45 +1,56 @@
 #pragma once
 
 #include <cassert>
-#include <set>
-#include <string>
-#include <unordered_map>
+#include <cstdint>
+#include <ostream>
+#include <vector>
 
 #include "koopa.h"
+#include "value_numbering.h"
 
+// 生成代码时用到的寄存器
+enum class Reg : uint8_t {
+  X0,
+  T0,
+  T1,
+  T2,
+  T3,
+  T4,
+  T5,
+  T6,
+  A0,
+  A1,
+  A2,
+  A3,
+  A4,
+  A5,
+  A6,
+  A7,
+  NONE,
+};
+
+const char *reg_name(Reg reg);
+inline Reg arg_reg(int index) { return Reg((int)Reg::A0 + index); }
+std::ostream &operator<<(std::ostream &os, Reg reg);
+
+// 指令内临时寄存器的分配: 值的寄存器按编号保存在数组中,
+// 空闲寄存器用位集表示
 class AddrManager {
 public:
-  std::string getAddr(const koopa_raw_binary_t &binary);
-  std::string getAddr(const koopa_raw_load_t &load);
-  std::string getAddr(const koopa_raw_store_t &store);
-  std::string getAddr(const koopa_raw_value_t &value);
-  std::string getAddr(const koopa_raw_get_ptr_t &get_ptr);
-  std::string getAddr(const koopa_raw_get_elem_ptr_t &get_elem_ptr);
-  void freeReg(const std::string &reg);
-  void freeId(const koopa_raw_binary_t &binary);
-  void freeId(const koopa_raw_load_t &load);
-  void freeId(const koopa_raw_store_t &store);
+  explicit AddrManager(const ValueNumbering *values = nullptr);
+  Reg getAddr(const koopa_raw_value_t &value);
+  void freeReg(Reg reg);
   void freeId(const koopa_raw_value_t &value);
-  void freeId(const koopa_raw_get_elem_ptr_t &get_elem_ptr);
-  void freeId(const koopa_raw_get_ptr_t &get_ptr);
-private:
-  std::string getReg();
-  int getNextId();
-  std::string idToAddr(int id);
-  template <typename T>
-  std::string getAddrImpl(const T &obj,
-                          std::unordered_map<const T *, int> &map);
-
-  std::unordered_map<const koopa_raw_binary_t *, int> raw_bin_id_map;
-  std::unordered_map<const koopa_raw_value_t *, int> raw_val_id_map;
-  std::unordered_map<const koopa_raw_load_t *, int> raw_load_id_map;
-  std::unordered_map<const koopa_raw_store_t *, int> raw_store_id_map;
-  std::unordered_map<const koopa_raw_get_elem_ptr_t *, int> raw_get_elem_ptr_id_map;
-  std::unordered_map<const koopa_raw_get_ptr_t *, int> raw_get_ptr_id_map;
 
-  std::unordered_map<int, std::string> id_addr_map;
-  std::unordered_map<std::string, int> addr_id_map;
+private:
+  Reg getReg();
 
-  std::set<std::string> regs = {"t0", "t1", "t2", "t3", "t4", "t5", "t6"};
-  int id_counter = 0;
+  const ValueNumbering *values;
+  // 编号 -> 寄存器, 未分配为 NONE
+  std::vector<Reg> value_regs;
+  // t5/t6 作为计算栈地址的临时寄存器, 不参与分配
+  static constexpr uint32_t kAllocatable =
+      1u << (int)Reg::T0 | 1u << (int)Reg::T1 | 1u << (int)Reg::T2 |
+      1u << (int)Reg::T3 | 1u << (int)Reg::T4;
+  uint32_t free_regs = kAllocatable;
 };
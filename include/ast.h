@@ -3,11 +3,15 @@
 #ifndef AST_H
 #define AST_H
 
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <set>
 #include <string>
 #include <vector>
 
+#include "source_map.h"
+#include "type_table.h"
 #include "util.h"
 
 enum class UnaryOpKind { Plus, Minus, Not };
@@ -31,6 +35,16 @@ class DefAST;
 #include "symbol_table.h"
 
 void decl_lib_symbols();
+void decl_lib_functions(std::ostream &os);
+// 建立全局符号表并登记库函数, 只在第一次调用时生效.
+// 编译服务器在 fork 前调用, 子进程直接继承
+void init_global_symbols();
+// 把归约出的顶层定义加入列表; 设置了 top_level_sink 时直接交给它
+std::vector<std::unique_ptr<BaseAST>> *
+add_top_level(std::vector<std::unique_ptr<BaseAST>> *list, BaseAST *item);
+// 对维度表达式求值并取得对应的数组类型
+const ArrayType *
+intern_array_type(std::vector<std::unique_ptr<ExpAST>> *array_dims);
 
 class IRManager {
 public:
@@ -53,11 +67,48 @@ public:
     is_in_while = true;
   }
   void reset() { reg_counter = 0; }
-  std::map<std::streampos, bool> is_return_map;
+  // 输出基本块标签并开始一个新块
+  void begin_block(std::ostream &os, const std::string &label) {
+    os << label << ":\n";
+    current_block = label;
+    block_terminated = false;
+    if (source_map != nullptr) {
+      source_map->add_block(label);
+    }
+  }
+  // 之后生成的 IR 来自源码的 line 行
+  void set_line(int line) {
+    if (source_map != nullptr) {
+      source_map->set_line(reg_counter, line);
+    }
+  }
+  // 输出终结指令并结束当前块, 之后的语句不可达
+  void emit_ret(std::ostream &os, const std::string &value = "") {
+    os << "  ret" << (value.empty() ? "" : " ") << value << "\n";
+    end_block();
+  }
+  void emit_br(std::ostream &os, const std::string &cond,
+               const std::string &true_label, const std::string &false_label) {
+    os << "  br " << cond << ", " << true_label << ", " << false_label << "\n";
+    end_block();
+  }
+  void emit_jump(std::ostream &os, const std::string &label) {
+    os << "  jump " << label << "\n";
+    end_block();
+  }
+  // 正在输出的基本块的标签
+  const std::string &get_current_block() const { return current_block; }
+  bool is_block_terminated() const { return block_terminated; }
   bool is_in_if = false;
   bool is_in_if_else = false;
   bool is_in_while = false;
   bool need_addr = false;
+  // 编译缓存命中的函数, 只输出 decl 不生成函数体
+  std::set<std::string> cached_funcs;
+  // 流水线模式: 顶层的函数定义和声明一经归约就交给它处理, 不再留在 AST 中
+  std::function<void(std::unique_ptr<BaseAST>)> top_level_sink;
+  // 需要优化报告时记录源码行和 IR 的对应, 否则为 nullptr
+  SourceMap *source_map = nullptr;
 
 private:
   IRManager()
@@ -66,6 +117,14 @@ private:
   int if_counter;
   int while_counter;
   int now_while_count;
+  std::string current_block;
+  bool block_terminated = false;
+  void end_block() {
+    block_terminated = true;
+    if (source_map != nullptr) {
+      source_map->end_block();
+    }
+  }
 };
 
 class BaseAST {
@@ -77,24 +136,30 @@ public:
 
 class CompUnitAST : public BaseAST {
 public:
+  ~CompUnitAST() override { delete func_def_list; }
   std::unique_ptr<BaseAST> func_def;
-  std::vector<std::unique_ptr<BaseAST>> *func_def_list;
+  std::vector<std::unique_ptr<BaseAST>> *func_def_list = nullptr;
   void print(std::ostream &os) override;
 };
 
 class FuncDefAST : public BaseAST {
 public:
+  ~FuncDefAST() override { delete func_fparam_list; }
   std::string func_type;
   std::string ident;
+  int line = 0;
   std::unique_ptr<BaseAST> block;
   std::vector<FuncFParamAST> *func_fparam_list;
   void print(std::ostream &os) override;
+  void print_signature(std::ostream &os, bool with_names);
+  void print_decl(std::ostream &os);
 };
 
 class DeclAST : public BaseAST {
 public:
   enum Kind { CONST_DECL, VAR_DECL };
   Kind kind;
+  int line = 0;
   std::unique_ptr<BaseAST> const_decl;
   std::unique_ptr<BaseAST> var_decl;
   void print(std::ostream &os) override;
@@ -102,6 +167,7 @@ public:
 
 class ConstDeclAST : public BaseAST {
 public:
+  ~ConstDeclAST() override { delete const_def_list; }
   std::string b_type;
   std::vector<std::unique_ptr<DefAST>> *const_def_list;
   void print(std::ostream &os) override;
@@ -118,6 +184,7 @@ public:
   enum Kind { CONST_DEF, VAR_DEF, VAR_IDENT, VAR_ARRAY_DEF, VAR_ARRAY_IDENT };
   Kind kind;
   std::string ident;
+  const ArrayType *array_type = nullptr; // 数组类型, 非数组时为 i32
   void print(std::ostream &os) override {};
 };
 
@@ -131,11 +198,14 @@ public:
   std::string b_type;
   std::string ident;
   std::vector<std::unique_ptr<ExpAST>> *array_dims;
+  // 数组参数省略第一维后的类型
+  const ArrayType *array_type = nullptr;
   void print(std::ostream &os) override;
 };
 
 class VarDeclAST : public BaseAST {
 public:
+  ~VarDeclAST() override { delete var_def_list; }
   std::string b_type;
   std::vector<std::unique_ptr<DefAST>> *var_def_list;
   void print(std::ostream &os) override;
@@ -143,6 +213,7 @@ public:
 
 class InitValAST : public BaseAST {
 public:
+  ~InitValAST() override { delete list; }
   enum Kind { EXP, LIST };
   Kind kind;
   std::unique_ptr<ExpAST> exp;                              // EXP
@@ -152,6 +223,7 @@ public:
 
 class ConstInitValAST : public BaseAST {
 public:
+  ~ConstInitValAST() override { delete list; }
   enum Kind { EXP, LIST };
   Kind kind;
   std::unique_ptr<ExpAST> exp;
@@ -161,6 +233,7 @@ public:
 
 class VarDefAST : public DefAST {
 public:
+  ~VarDefAST() override { delete array_dims; }
   std::unique_ptr<InitValAST> init_val;
   std::vector<std::unique_ptr<ExpAST>> *array_dims = nullptr; // 多维数组尺寸
   void print(std::ostream &os) override;
@@ -169,14 +242,14 @@ public:
 class ConstDefAST : public DefAST {
 public:
   int const_init_val = 0;
-  std::vector<int> array_dims; // 多维数组尺寸
   std::unique_ptr<ConstInitValAST> const_init_val_ast;
   void print(std::ostream &os) override;
 };
 
 class BlockAST : public BaseAST {
 public:
-  std::vector<std::unique_ptr<BaseAST>> *block_item_list;
+  ~BlockAST() override { delete block_item_list; }
+  std::vector<std::unique_ptr<BaseAST>> *block_item_list = nullptr;
   void print(std::ostream &os) override;
 };
 
@@ -193,6 +266,7 @@ class ExpAST;
 
 class LValAST : public BaseAST {
 public:
+  ~LValAST() override { delete array_index_list; }
   enum Kind { IDENT, ARRAY_ACCESS };
   Kind kind;
   std::string ident;
@@ -216,114 +290,163 @@ public:
     CONTINUE_STMT
   };
   Kind kind;
+  int line = 0;
+  // 各类语句共用的成员, 按 kind 解释:
+  // exp 是返回值, 表达式语句, 赋值的右值或 if/while 的条件;
+  // body 是语句块, if 的 then 分支或 while 的循环体
   std::unique_ptr<ExpAST> exp;
-  std::unique_ptr<LValAST> l_val;
-  std::unique_ptr<ExpAST> r_exp;
-  std::unique_ptr<BaseAST> block;
-  std::unique_ptr<ExpAST> if_exp;
-  std::unique_ptr<BaseAST> if_stmt;
-  std::unique_ptr<BaseAST> else_stmt;
-  std::unique_ptr<ExpAST> while_exp;
-  std::unique_ptr<BaseAST> while_stmt;
+  std::unique_ptr<LValAST> l_val;     // ASSIGN_STMT
+  std::unique_ptr<BaseAST> body;
+  std::unique_ptr<BaseAST> else_stmt; // IF_ELSE_STMT
   void print(std::ostream &os) override;
 };
 
+// 表达式遍历中的一层. 生成 IR 和编译期求值都用显式栈代替递归,
+// 很长的运算链和很深的括号嵌套不会耗尽本机栈.
+// step 记录节点做到哪一步, 其余字段保存跨步骤的中间结果
+struct ExpFrame {
+  ExpAST *node;
+  int step = 0;
+  size_t index = 0;
+  int reg = -1;
+  int last_reg = -1;
+  bool use_getptr = false;
+  std::string last_ptr;
+  std::vector<std::string> args;
+  std::vector<bool> ptr_args;
+};
+
+// 把子表达式交给最外层的析构逐个释放, 长运算链析构时也不会递归过深
+void release_exp(std::unique_ptr<ExpAST> &exp);
+
+// 表达式节点只有叶子 (数字, 左值), 一元运算, 函数调用和二元运算.
+// 文法中只包了一层的产生式 (Exp ::= LOrExp, AddExp ::= MulExp, 括号等)
+// 在语法分析时直接沿用子节点, 不再单独建节点
 class ExpAST : public BaseAST {
 public:
   enum Kind {
-    EXP,
     NUMBER,
-    PRIMARY_EXP,
+    L_VAL,
     UNARY_OP_EXP,
-    REL_EXP,
+    FUNC_CALL_WITHOUT_PARAMS,
+    FUNC_CALL_WITH_PARAMS,
+    MUL_EXP,
     ADD_EXP,
+    REL_EXP,
     EQ_EXP,
     L_AND_EXP,
-    L_OR_EXP,
-    MUL_EXP,
-    UNARY_EXP,
-    L_VAL,
-    FUNC_CALL_WITHOUT_PARAMS,
-    FUNC_CALL_WITH_PARAMS
+    L_OR_EXP
   };
+  ~ExpAST() override;
   Kind kind;
   int number;
-  std::unique_ptr<ExpAST> l_or_exp;
   void print(std::ostream &os) override;
   int get_reg() const { return reg; }
   bool is_number() const { return kind == Kind::NUMBER; }
   int get_number() const { return number; }
   void set_reg(int reg) { this->reg = reg; }
-  virtual int calc_number();
+  int calc_number();
+  // 从 frame.step 继续生成 IR; 需要先处理子表达式时返回它, 完成时返回 nullptr
+  virtual ExpAST *print_step(std::ostream &os, ExpFrame &frame) = 0;
+  // 同上, 完成时结果在 number 中
+  virtual ExpAST *calc_step(ExpFrame &frame) = 0;
 
 protected:
   int reg = -1;
 };
 
+// 数字或左值
 class PrimaryExpAST : public ExpAST {
 public:
-  std::unique_ptr<ExpAST> exp;
   std::unique_ptr<LValAST> l_val;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class UnaryExpAST : public ExpAST {
 public:
-  std::unique_ptr<ExpAST> primary_exp, unary_exp;
+  ~UnaryExpAST() override {
+    release_exp(unary_exp);
+    delete func_rparam_list;
+  }
+  std::unique_ptr<ExpAST> unary_exp;
   UnaryOpKind unary_op;
   std::string ident;
-  std::vector<std::unique_ptr<ExpAST>> *func_rparam_list;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  std::vector<std::unique_ptr<ExpAST>> *func_rparam_list = nullptr;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class AddExpAST : public ExpAST {
 public:
+  ~AddExpAST() override {
+    release_exp(add_exp);
+    release_exp(mul_exp);
+  }
   std::unique_ptr<ExpAST> add_exp, mul_exp;
   AddOpKind add_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class MulExpAST : public ExpAST {
 public:
+  ~MulExpAST() override {
+    release_exp(mul_exp);
+    release_exp(unary_exp);
+  }
   std::unique_ptr<ExpAST> mul_exp, unary_exp;
   MulOpKind mul_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class LOrExpAST : public ExpAST {
 public:
+  ~LOrExpAST() override {
+    release_exp(l_or_exp);
+    release_exp(l_and_exp);
+  }
   std::unique_ptr<ExpAST> l_or_exp, l_and_exp;
   LogicalOpKind logical_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class LAndExpAST : public ExpAST {
 public:
+  ~LAndExpAST() override {
+    release_exp(l_and_exp);
+    release_exp(eq_exp);
+  }
   std::unique_ptr<ExpAST> l_and_exp, eq_exp;
   LogicalOpKind logical_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class EqExpAST : public ExpAST {
 public:
+  ~EqExpAST() override {
+    release_exp(eq_exp);
+    release_exp(rel_exp);
+  }
   std::unique_ptr<ExpAST> eq_exp, rel_exp;
   LogicalOpKind logical_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 class RelExpAST : public ExpAST {
 public:
+  ~RelExpAST() override {
+    release_exp(rel_exp);
+    release_exp(add_exp);
+  }
   std::unique_ptr<ExpAST> rel_exp, add_exp;
   LogicalOpKind logical_op;
-  void print(std::ostream &os) override;
-  int calc_number() override;
+  ExpAST *print_step(std::ostream &os, ExpFrame &frame) override;
+  ExpAST *calc_step(ExpFrame &frame) override;
 };
 
 #endif // AST_H
\ No newline at end of file
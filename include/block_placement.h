@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cfg.h"
+#include "koopa.h"
+
+// 基本块布局: 用静态分支预测估计每条边的权重, 把热路径串成
+// 可以直接落入的链, 循环体保持连续, 冷块 (提前返回/不可达) 放到最后.
+// 给出 profile 中的块计数时改用实际执行次数, 没有执行过的块作为冷块
+class BlockPlacement {
+public:
+  // tail_returns 标出可以直接落入共用尾声的 return 块 (按 func->bbs 下标),
+  // 只在使用 profile 时用来挑选最后一条链
+  explicit BlockPlacement(const Cfg &cfg,
+                          const std::vector<uint32_t> *counts = nullptr,
+                          std::vector<bool> tail_returns = {});
+  std::vector<koopa_raw_basic_block_t> layout();
+
+private:
+  struct Edge {
+    size_t from;
+    size_t to;
+    double prob;
+    double weight;
+    bool back;
+    // 以下只在使用 profile 时计算: 同时包含两端的循环个数,
+    // 以及这条边落入时省下的周期数
+    int depth;
+    double gain;
+  };
+
+  void estimate_probs();
+  void estimate_freqs();
+  void use_counts(const std::vector<uint32_t> &counts);
+  std::vector<std::vector<size_t>> build_chains();
+
+  const Cfg &cfg;
+  std::vector<Edge> edges;
+  std::vector<double> freq;
+  std::vector<bool> tail_returns;
+  size_t tail_block = SIZE_MAX;
+  bool profiled = false;
+};
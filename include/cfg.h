@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "koopa.h"
+
+// 函数的控制流图: 后继/前驱, 逆后序, 支配树与自然循环.
+// 基本块用其在 func->bbs 中的下标表示, 入口块为 0
+class Cfg {
+public:
+  explicit Cfg(const koopa_raw_function_t &func);
+  size_t size() const { return blocks.size(); }
+  size_t index(koopa_raw_basic_block_t bb) const { return block_idx.at(bb); }
+  bool is_back_edge(size_t from, size_t to) const;
+  bool in_loop(size_t header, size_t idx) const;
+  bool in_any_loop(size_t idx) const { return loop_depth[idx] > 0; }
+  bool dominates(size_t lhs, size_t rhs) const;
+  size_t common_dominator(size_t lhs, size_t rhs) const;
+  bool ends_with_return(size_t idx) const;
+
+  std::vector<koopa_raw_basic_block_t> blocks;
+  std::vector<std::vector<size_t>> succs;
+  std::vector<std::vector<size_t>> preds;
+  std::vector<bool> reachable;
+  // 逆后序, 只包含从入口可达的块
+  std::vector<size_t> rpo;
+  // 直接支配者, 入口和不可达块为自身
+  std::vector<size_t> idom;
+  // 循环头 -> 循环体 (自然循环)
+  std::map<size_t, std::vector<bool>> loops;
+  std::vector<int> loop_depth;
+
+private:
+  void build_edges();
+  void find_loops();
+  void build_dominators();
+
+  std::unordered_map<koopa_raw_basic_block_t, size_t> block_idx;
+  std::set<std::pair<size_t, size_t>> back_edges;
+  std::vector<size_t> rpo_idx;
+};
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// 一个函数生成代码的静态开销 (-emit-stats), 用于比较不同版本的代码质量
+struct FunctionStats {
+  std::string name;
+  // 函数在汇编中的入口标签, 一般和 name 相同
+  std::string label;
+  int frame_size = 0;
+  // 后端没有寄存器分配: 每个有结果的指令把结果写回栈上的位置一次,
+  // 每次使用这样的结果都要从栈上重新读取
+  int spill_stores = 0;
+  int reloads = 0;
+  // 以下按最终的汇编 (所有汇编遍之后) 统计, 伪指令按一条计
+  int insts = 0;
+  int memory = 0;
+  int alu = 0;
+  int mul_div = 0;
+  // 条件跳转, j 和 ret
+  int branch = 0;
+  int calls = 0;
+  // 最长基本块的指令数; 标签和跳转之后开始新的基本块
+  int longest_block = 0;
+};
+
+// 在 asm_text 中找到 stats 中各个函数的代码, 填入按汇编统计的各项
+void count_asm_stats(const std::string &asm_text,
+                     std::vector<FunctionStats> &stats);
+// 输出 JSON, file 是源文件名
+void write_function_stats(std::ostream &os, const std::string &file,
+                          const std::vector<FunctionStats> &stats);
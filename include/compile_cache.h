@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 缓存中一个函数生成的汇编, 以及它会写的全局变量
+// (决定全局变量放在 .data 还是 .rodata)
+struct CachedFunction {
+  std::string asm_text;
+  std::set<std::string> written_globals;
+};
+
+// 按函数缓存生成的 RISC-V 汇编. key 由函数的 token 序列, 它 (传递地)
+// 引用的全局声明, 调用的函数签名以及编译选项共同决定,
+// 因此只改空白/注释或无关函数时可以直接复用
+class CompileCache {
+public:
+  CompileCache(const std::string &dir, const std::string &flags);
+  // 把源码切分成顶层声明和函数, 计算每个函数的 key.
+  // ir_names 是全局变量在 IR 中的名字, 它取决于前面同名声明的个数
+  void scan(std::string_view source,
+            const std::map<std::string, std::string> &ir_names);
+  bool lookup(const std::string &func, CachedFunction &entry);
+  // 用缓存内容替换 asm_text 中命中的函数, 并把新生成的函数写入缓存.
+  // asm_text 中只含未命中函数的函数体, funcs 给出源码中的函数顺序
+  std::string merge(const std::string &asm_text,
+                    const std::vector<std::string> &funcs,
+                    const std::map<std::string, std::set<std::string>> &written);
+  int hits = 0;
+  int misses = 0;
+
+private:
+  struct Item {
+    uint64_t hash = 0;
+    uint64_t signature_hash = 0;
+    bool is_func = false;
+    std::set<std::string> refs;
+  };
+
+  std::string path(const std::string &func) const;
+  void store(const std::string &func, const CachedFunction &entry);
+
+  std::string dir;
+  std::string flags;
+  std::vector<Item> items;
+  std::map<std::string, size_t> item_of;
+  std::map<std::string, uint64_t> keys;
+  std::map<std::string, CachedFunction> hit_entries;
+};
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "riscv_codegen.h"
+
+// 一次编译的模式和选项, 命令行和编译服务器共用
+struct DriverOptions {
+  std::string mode;
+  CodeGenOptions codegen;
+  bool fast_lex = false;
+  bool lex_bench = false;
+  std::string cache_dir;
+  // 流水线模式: 每个函数解析完就生成代码并写出, 见 compile_stream
+  bool stream = false;
+  // -fprofile-use 指定的 profile 文件
+  std::string profile_use;
+  // 是否把生成的 IR/汇编回显到标准输出
+  bool echo = true;
+  // -remarks= 指定的优化报告文件, 为空时不记录
+  std::string remarks_path;
+  // -emit-stats= 指定的静态开销报告文件 (JSON), 为空时不记录
+  std::string stats_path;
+  // 源文件名, 写进优化报告和静态开销报告
+  std::string source_name;
+};
+
+// 解析输出文件之后的选项, 遇到未知选项时返回 false
+bool parse_driver_options(const std::vector<std::string> &args,
+                          DriverOptions &options);
+// 编译一个源文件: flex 从 input 读取, 手写词法分析器和编译缓存使用 source.
+// 结果 (IR, 汇编或目标文件) 写入 output, 返回 0 表示成功
+int compile(const DriverOptions &options, FILE *input, std::string_view source,
+            std::string &output);// 流水线模式的编译: 每个函数归约后立即生成 IR/汇编写入 out 并释放,
+// 内存只和最大的函数成正比. 全局变量的数据在最后统一输出.
+// 只支持 -koopa 和 -riscv, 不能和编译缓存一起使用
+int compile_stream(const DriverOptions &options, FILE *input,
+                   std::string_view source, std::ostream &out);
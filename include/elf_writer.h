@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "riscv_asm.h"
+
+// 把 CodeGen 生成的 RV32IM 汇编直接编码成 ELF32 可重定位目标文件,
+// 省去外部汇编器. 只支持后端会用到的指令, 伪指令和汇编伪操作
+class ElfWriter {
+public:
+  explicit ElfWriter(const std::string &asm_text);
+  std::string write();
+
+private:
+  struct Section {
+    std::string name;
+    uint32_t type;
+    uint32_t flags;
+    uint32_t align = 1;
+    std::string data;
+    // .bss 只记录大小
+    uint32_t size = 0;
+    bool used = false;
+  };
+  struct Symbol {
+    std::string name;
+    int section = -1; // -1 表示未定义
+    uint32_t value = 0;
+    bool global = false;
+    bool referenced = false;
+  };
+  struct Reloc {
+    int section;
+    uint32_t offset;
+    std::string symbol;
+    uint32_t type;
+  };
+  // 跳转目标在汇编结束后才知道, 先记下来再回填
+  struct Fixup {
+    int section;
+    uint32_t offset;
+    std::string symbol;
+    uint32_t type;
+  };
+
+  void assemble(const std::vector<AsmLine> &lines);
+  void directive(const AsmLine &line);
+  void instruction(const AsmLine &line);
+  void define_label(const std::string &name);
+  void emit32(uint32_t word);
+  void emit_li(int rd, int32_t imm);
+  void emit_pcrel_hi(int rd, const std::string &symbol);
+  void emit_branch(uint32_t funct3, int rs1, int rs2, const std::string &label);
+  void emit_jal(int rd, const std::string &label);
+  void add_reloc(const std::string &symbol, uint32_t type);
+  void resolve_fixups();
+  Symbol &symbol(const std::string &name);
+  uint32_t offset() const;
+  bool is_local_label(const std::string &name) const;
+
+  std::vector<Section> sections;
+  int cur_section = 0;
+  std::map<std::string, Symbol> symbols;
+  std::vector<std::string> symbol_order;
+  std::set<std::string> globals;
+  std::vector<Reloc> relocs;
+  std::vector<Fixup> fixups;
+  int pcrel_counter = 0;
+};
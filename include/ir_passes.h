@@ -0,0 +1,55 @@
+#pragma once
+
+#include "pass_manager.h"
+
+// 控制流化简: 条件为常数的 br 改成 jump, 跳到只含一条 jump 的块时直接
+// 跳到它的目标, 删除不可达的块, 再把只有一个前驱的块合并到以 jump 结尾的前驱中
+class SimplifyCfg : public FunctionPass {
+public:
+  const char *name() const override { return "simplify-cfg"; }
+
+protected:
+  bool run_on_function(const koopa_raw_function_t &func,
+                       PassContext &ctx) override;
+};
+
+// 冗余 load 删除: 位置上一次 store 的值或上一次 load 的结果在所有路径上
+// 都还有效时, 后面的 load 直接使用它. 不同的 alloc 和全局变量互不重叠,
+// 调用和经由参数指针的写入只影响全局变量和地址逃逸的局部数组
+class LoadElim : public FunctionPass {
+public:
+  const char *name() const override { return "load-elim"; }
+
+protected:
+  bool run_on_function(const koopa_raw_function_t &func,
+                       PassContext &ctx) override;
+};
+
+// 死存储删除: 标量 (不逃逸的局部变量和 i32 全局变量) 写入后在被覆盖或
+// 函数返回前都没有被读的 store, 从未被读的局部数组的所有写入, 以及局部数组
+// 初始化中随后在同一块内被覆盖的元素. 删除 store 后不再使用的纯指令一并删除
+class DeadStoreElim : public FunctionPass {
+public:
+  const char *name() const override { return "dse"; }
+
+protected:
+  bool run_on_function(const koopa_raw_function_t &func,
+                       PassContext &ctx) override;
+};
+
+// 过程间常量传播: 所有调用处都传同一个常数的参数直接换成常数;
+// 否则为循环中 (或参数在递归中不变) 的常数实参调用克隆出特化版本
+// foo_spec_N, 把对应的调用改到克隆上. 只在能看到全部调用时运行
+class Ipcp : public IRPass {
+public:
+  const char *name() const override { return "ipcp"; }
+  bool run(koopa_raw_program_t &program, PassContext &ctx) override;
+};
+
+// 删除从 main 出发调用不到的函数 (包括运行时库的声明) 和用不到的全局变量.
+// 只在能看到全部函数时运行
+class GlobalDce : public IRPass {
+public:
+  const char *name() const override { return "globaldce"; }
+  bool run(koopa_raw_program_t &program, PassContext &ctx) override;
+};
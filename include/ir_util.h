@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "koopa.h"
+
+// 原地修改 raw program 的工具. libkoopa 的 raw 结构通过 const 指针给出,
+// 变换时用 mut 去掉 const. 变换后的 slice 缓冲区由 IRArena 持有,
+// 它要比 raw program 的所有使用者活得更久
+
+template <typename T> T *mut(const T *ptr) { return const_cast<T *>(ptr); }
+
+class IRArena {
+public:
+  // 用 items 构造新的 slice, 缓冲区归 arena 所有
+  koopa_raw_slice_t slice(const std::vector<const void *> &items,
+                          koopa_raw_slice_item_kind_t kind);
+  // 新建的值, 基本块, 函数和名字, 同样归 arena 所有
+  koopa_raw_value_data_t *value();
+  koopa_raw_basic_block_data_t *block();
+  koopa_raw_function_data_t *function();
+  const char *name(const std::string &name);
+
+private:
+  std::vector<std::unique_ptr<const void *[]>> buffers;
+  std::vector<std::unique_ptr<koopa_raw_value_data_t>> values;
+  std::vector<std::unique_ptr<koopa_raw_basic_block_data_t>> blocks;
+  std::vector<std::unique_ptr<koopa_raw_function_data_t>> functions;
+  std::vector<std::unique_ptr<std::string>> names;
+};
+
+// 依次对指令的每个值操作数 (不含跳转目标) 调用 fn, 同一个值可能出现多次
+template <typename Fn>
+void for_each_operand(const koopa_raw_value_t &inst, Fn &&fn) {
+  const auto &kind = inst->kind;
+  auto each = [&](const koopa_raw_slice_t &slice) {
+    for (size_t i = 0; i < slice.len; ++i) {
+      fn(reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]));
+    }
+  };
+  switch (kind.tag) {
+  case KOOPA_RVT_RETURN:
+    if (kind.data.ret.value != nullptr) {
+      fn(kind.data.ret.value);
+    }
+    break;
+  case KOOPA_RVT_BINARY:
+    fn(kind.data.binary.lhs);
+    fn(kind.data.binary.rhs);
+    break;
+  case KOOPA_RVT_LOAD:
+    fn(kind.data.load.src);
+    break;
+  case KOOPA_RVT_STORE:
+    fn(kind.data.store.value);
+    fn(kind.data.store.dest);
+    break;
+  case KOOPA_RVT_BRANCH:
+    fn(kind.data.branch.cond);
+    each(kind.data.branch.true_args);
+    each(kind.data.branch.false_args);
+    break;
+  case KOOPA_RVT_JUMP:
+    each(kind.data.jump.args);
+    break;
+  case KOOPA_RVT_CALL:
+    each(kind.data.call.args);
+    break;
+  case KOOPA_RVT_GET_ELEM_PTR:
+    fn(kind.data.get_elem_ptr.src);
+    fn(kind.data.get_elem_ptr.index);
+    break;
+  case KOOPA_RVT_GET_PTR:
+    fn(kind.data.get_ptr.src);
+    fn(kind.data.get_ptr.index);
+    break;
+  default:
+    break;
+  }
+}
+
+// 指令的值是否需要在函数内保存: 参数, 块参数和有返回值的指令
+bool is_local_value(const koopa_raw_value_t &value);
+// 终结指令跳转到的基本块
+std::vector<koopa_raw_basic_block_t>
+branch_targets(const koopa_raw_value_t &inst);
+// 把终结指令中跳转到 from 的目标改成 to, 同时更新两个块的 used_by
+void retarget(IRArena &arena, const koopa_raw_value_t &inst,
+              koopa_raw_basic_block_t from, koopa_raw_basic_block_t to);
+// 删除一批指令前调用: 从它们用到的值和跳转目标的 used_by 中去掉它们.
+// 指令本身由调用者从基本块中移除
+void drop_uses(IRArena &arena, const std::vector<koopa_raw_value_t> &insts);
+// 在指令用到的值和跳转目标的 used_by 中登记它
+void add_uses(IRArena &arena, const koopa_raw_value_t &inst);
+// 把所有对 from 的使用改成 to, 同时更新两者的 used_by
+void replace_all_uses(IRArena &arena, const koopa_raw_value_t &from,
+                      const koopa_raw_value_t &to);
+// 一次替换一批 (from, to). 每个 used_by 只重建一次, 替换大量值时用它
+// 代替逐个 replace_all_uses. to 不能是另一项的 from
+using Replacements =
+    std::vector<std::pair<koopa_raw_value_t, koopa_raw_value_t>>;
+void replace_uses(IRArena &arena, const Replacements &replacements);
+// 新建类型为 ty 的整数常量
+koopa_raw_value_t make_integer(IRArena &arena, int32_t value,
+                               koopa_raw_type_t ty);
+// 从函数的基本块中删除 dead 中的指令, 并从它们用到的值的 used_by 中去掉
+void remove_insts(IRArena &arena, const koopa_raw_function_t &func,
+                  const std::vector<koopa_raw_value_t> &dead);
+// 没有副作用的指令 (alloc, load, 运算, 取地址): 结果没人用时可以删除
+bool is_pure(const koopa_raw_value_t &inst);
+// 删除 dead 中的指令, 以及因此不再被使用的纯指令
+void remove_with_operands(IRArena &arena, const koopa_raw_function_t &func,
+                          std::vector<koopa_raw_value_t> dead);
+// 折叠两个操作数都是常数的二元运算 (按补码回绕, 除零和溢出的除法不折叠),
+// 直到不再变化. 返回是否折叠了指令
+bool fold_constants(const koopa_raw_function_t &func, IRArena &arena);
+// 指针类型指向的类型
+koopa_raw_type_t pointee(const koopa_raw_type_t &type);
+// 类型占的字数
+size_t type_words(const koopa_raw_type_t &type);
+// 是否是 getelemptr/getptr, 以及它们的源指针
+bool is_address(const koopa_raw_value_t &value);
+koopa_raw_value_t address_src(const koopa_raw_value_t &value);
+// 程序中所有函数的指令总数
+size_t count_insts(const koopa_raw_program_t &program);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+// 手写词法分析器的 token 种类, 在 sysy.l 中映射成 Bison 的 token
+enum class TokenKind {
+  END,
+  VOID,
+  INT,
+  RETURN,
+  CONST,
+  IF,
+  ELSE,
+  WHILE,
+  BREAK,
+  CONTINUE,
+  IDENT,
+  INT_CONST,
+  GREATER_EQUAL,
+  LESS_EQUAL,
+  EQUAL,
+  NOT_EQUAL,
+  OR,
+  AND,
+  GREATER,
+  LESS,
+  CHAR
+};
+
+// text 直接指向输入缓冲区, 不做拷贝
+struct Token {
+  TokenKind kind = TokenKind::END;
+  std::string_view text;
+  int value = 0;
+};
+
+// 只读映射整个输入文件; mmap 失败时退化为读入内存
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile();
+  bool open(const char *path);
+  std::string_view data() const { return {base, size}; }
+
+private:
+  const char *base = nullptr;
+  size_t size = 0;
+  bool mapped = false;
+  std::string buffer;
+};
+
+// 与 sysy.l 规则等价的手写词法分析器. 空白, 注释和标识符
+// 在支持 SSE2 时每次扫描 16 字节
+class Lexer {
+public:
+  explicit Lexer(std::string_view source)
+      : pos(source.data()), end(source.data() + source.size()) {}
+  Token next();
+  // 上一个 token 所在的行, 从 1 开始
+  int line() const { return cur_line; }
+
+private:
+  void skip_space_and_comments();
+  const char *pos;
+  const char *end;
+  // 换行只出现在空白和注释中, 跳过它们时计数
+  int cur_line = 1;
+};
+
+// 以下定义在 sysy.l 中
+// 让 yylex 从手写词法分析器取 token, 传 nullptr 恢复使用 flex
+void use_fast_lexer(Lexer *lexer);
+// 用 flex 扫描整个文件, 返回 token 数, 供 -lex-bench 使用
+size_t flex_count_tokens(FILE *file);
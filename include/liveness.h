@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+#include "cfg.h"
+#include "koopa.h"
+
+// 函数中局部值 (参数, 块参数和有返回值的指令, 见 is_local_value) 的活跃性.
+// 对每个在定义块之外使用的值, 从使用处沿前驱向上标记直到定义块,
+// 代价只和跨块的活跃范围成正比. 块内的活跃范围由指令顺序决定, 不在这里记录
+class Liveness {
+public:
+  Liveness(const koopa_raw_function_t &func, const Cfg &cfg);
+  // 在块入口/出口活跃的值, 按指针排序
+  const std::vector<koopa_raw_value_t> &live_in(size_t block) const {
+    return ins[block];
+  }
+  const std::vector<koopa_raw_value_t> &live_out(size_t block) const {
+    return outs[block];
+  }
+  // 值是否在某个块的边界上活跃; 否则它只在定义它的块内活跃
+  bool crosses_blocks(koopa_raw_value_t value) const {
+    return crossing.count(value) != 0;
+  }
+
+private:
+  std::vector<std::vector<koopa_raw_value_t>> ins;
+  std::vector<std::vector<koopa_raw_value_t>> outs;
+  std::unordered_set<koopa_raw_value_t> crossing;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cfg.h"
+#include "ir_util.h"
+#include "koopa.h"
+#include "liveness.h"
+#include "remarks.h"
+#include "scheduler.h"
+
+// 一次编译运行的遍, 分三个阶段:
+//   IR 遍: 在 raw program 上原地变换, 按列出的顺序运行
+//   代码生成: 生成汇编时的可选变换, 由开关控制
+//   汇编遍: 在生成的汇编文本上运行, 按列出的顺序; 分支松弛总在最后
+struct PassPipeline {
+  std::vector<std::string> ir_passes;
+  bool fuse_branch = false;
+  bool block_placement = false;
+  bool shrink_wrap = false;
+  bool stack_coloring = false;
+  std::vector<std::string> asm_passes;
+  // 输出每个遍的耗时和指令数变化
+  bool time_passes = false;
+
+  // -O0/-O1/-O2 的流水线, 默认是 -O2
+  static PassPipeline level(int level);
+  // 由 "simplify-cfg,fuse-branch,sched" 形式的遍名列表构造流水线.
+  // 各阶段按固定顺序运行, 列表只决定哪些遍运行和同一阶段内的顺序.
+  // 有未知的遍名时输出诊断并返回 false
+  static bool parse(const std::string &spec, PassPipeline &pipeline);
+  // 按运行顺序列出启用的遍, 也用作编译缓存的键
+  std::string str() const;
+};
+
+// 按函数缓存的分析结果. 改动函数的遍运行后使它的分析失效
+class AnalysisManager {
+public:
+  // CFG, 支配树和循环
+  const Cfg &cfg(const koopa_raw_function_t &func);
+  const Liveness &liveness(const koopa_raw_function_t &func);
+  void invalidate(const koopa_raw_function_t &func);
+  void clear() { entries.clear(); }
+
+private:
+  struct Entry {
+    std::unique_ptr<Cfg> cfg;
+    std::unique_ptr<Liveness> liveness;
+  };
+  std::unordered_map<koopa_raw_function_t, Entry> entries;
+};
+
+// IR 遍运行时可用的分析缓存, 新 slice 的缓冲区和优化报告
+struct PassContext {
+  AnalysisManager analyses;
+  IRArena arena;
+  Remarks remarks;
+  // 程序中的所有函数和调用都可见; 流水线模式和编译缓存下只能看到一部分,
+  // 过程间的遍不能运行
+  bool whole_program = true;
+};
+
+class IRPass {
+public:
+  virtual ~IRPass() = default;
+  virtual const char *name() const = 0;
+  // 变换整个程序, 返回是否改动了 IR. 改动的函数要自行使分析失效
+  virtual bool run(koopa_raw_program_t &program, PassContext &ctx) = 0;
+};
+
+// 逐个变换有函数体的函数, 改动后自动使该函数的分析失效
+class FunctionPass : public IRPass {
+public:
+  bool run(koopa_raw_program_t &program, PassContext &ctx) override;
+
+protected:
+  virtual bool run_on_function(const koopa_raw_function_t &func,
+                               PassContext &ctx) = 0;
+};
+
+class AsmPass {
+public:
+  virtual ~AsmPass() = default;
+  virtual const char *name() const = 0;
+  virtual std::string run(const std::string &asm_text) = 0;
+};
+
+// 一个遍 (或代码生成) 的累计耗时, 以及运行前后的指令数:
+// IR 遍统计 IR 指令, 汇编遍统计汇编指令, 代码生成从前者变成后者
+struct PassStat {
+  std::string name;
+  double seconds = 0;
+  size_t before = 0;
+  size_t after = 0;
+};
+
+// 把 stats 累加到 total 中同名的项 (流水线模式下每个函数各运行一次)
+void merge_pass_stats(std::vector<PassStat> &total,
+                      const std::vector<PassStat> &stats);
+void print_pass_stats(std::ostream &os, const std::vector<PassStat> &stats);
+
+// 解析 Koopa IR 文本, 运行流水线中的 IR 遍, 再输出为文本 (-koopa 模式).
+// 统计写入 stats; remarks 启用时把各遍的优化报告追加进去.
+// IR 只是程序的一部分时 whole_program 为 false (-stream)
+std::string run_ir_passes(const std::string &koopa_ir,
+                          const PassPipeline &pipeline,
+                          std::vector<PassStat> &stats, Remarks &remarks,
+                          bool whole_program = true);
+
+class PassManager {
+public:
+  PassManager(const PassPipeline &pipeline, const LatencyTable &latency);
+  void run_ir(koopa_raw_program_t &program);
+  std::string run_asm(std::string asm_text);
+  // 记录不是独立的遍的步骤, 如代码生成
+  void record(const std::string &name, double seconds, size_t before,
+              size_t after);
+  void set_whole_program(bool whole) { ctx.whole_program = whole; }
+  AnalysisManager &analyses() { return ctx.analyses; }
+  Remarks &remarks() { return ctx.remarks; }
+  bool timing() const { return time_passes; }
+  const std::vector<PassStat> &stats() const { return pass_stats; }
+
+private:
+  std::vector<std::unique_ptr<IRPass>> ir_passes;
+  std::vector<std::unique_ptr<AsmPass>> asm_passes;
+  PassContext ctx;
+  bool time_passes;
+  std::vector<PassStat> pass_stats;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+
+// -fprofile-generate 生成的程序在 main 返回后写出的基本块计数.
+// 文件由 32 位小端字组成:
+//   magic, 函数个数, 然后每个函数: 指纹, 基本块数, 每个块的执行次数
+// 块按 func->bbs 中的顺序排列, 与布局无关
+class Profile {
+public:
+  static constexpr uint32_t kMagic = 0x46504b53; // "SKPF"
+
+  // 读取 profile 文件, 格式错误时输出诊断并返回 false
+  bool load(const std::string &path);
+  // 函数的块计数; 没有记录或 IR 已经改变时返回 nullptr
+  const std::vector<uint32_t> *find(const koopa_raw_function_t &func) const;
+  // 函数入口执行过 (或没有记录) 时为真
+  bool is_hot(const koopa_raw_function_t &func) const;
+
+private:
+  std::unordered_map<uint32_t, std::vector<uint32_t>> counts;
+};
+
+// 函数的指纹: 函数名, 基本块数和每个块的指令数.
+// 插桩和使用 profile 的两次编译要得到相同的 IR, 指纹不同的函数不使用计数
+uint32_t profile_hash(const koopa_raw_function_t &func);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "koopa.h"
+#include "source_map.h"
+
+// 优化报告 (-remarks=FILE) 中的一条记录: 某个遍做了 (PASSED)
+// 或没能做 (MISSED) 的变换, 以及帮助理解代码的分析结果 (ANALYSIS)
+struct Remark {
+  enum Kind { PASSED, MISSED, ANALYSIS };
+  Kind kind;
+  std::string pass;
+  // 记录的类别, 如 BranchFolded
+  std::string name;
+  std::string function;
+  int line = 0;
+  std::string message;
+};
+
+// 各个遍记录优化报告的入口. 没有源码对应时不记录, 遍在拼接消息前
+// 先检查 enabled(), 不需要报告时没有额外开销
+class Remarks {
+public:
+  void enable(std::shared_ptr<const SourceMap> source_map) {
+    source = std::move(source_map);
+  }
+  bool enabled() const { return source != nullptr; }
+  // 源码行: 有 value 时优先取它的行 (终结指令取所在块结束的行),
+  // 其次基本块的行, 最后是函数的行
+  int line(const koopa_raw_function_t &func,
+           const koopa_raw_basic_block_t &bb = nullptr,
+           const koopa_raw_value_t &value = nullptr) const;
+  void emit(Remark::Kind kind, const char *pass, const char *name,
+            const koopa_raw_function_t &func, int line,
+            const std::string &message);
+  const std::vector<Remark> &list() const { return remarks; }
+  void append(const std::vector<Remark> &other);
+
+private:
+  std::shared_ptr<const SourceMap> source;
+  std::vector<Remark> remarks;
+};
+
+// 按 LLVM 优化记录 (-fsave-optimization-record) 的 YAML 格式输出,
+// file 是源文件名
+void write_remarks(std::ostream &os, const std::string &file,
+                   const std::vector<Remark> &remarks);
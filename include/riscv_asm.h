@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// 生成的 RISC-V 汇编中的一行, 供汇编层面的优化/统计使用
+struct AsmLine {
+  enum class Kind { EMPTY, LABEL, DIRECTIVE, INST };
+  Kind kind = Kind::EMPTY;
+  std::string text;
+  std::string op;
+  std::vector<std::string> args;
+};
+
+AsmLine parse_asm_line(const std::string &line);
+std::vector<AsmLine> parse_asm(const std::string &asm_text);
+// 解析 "off(base)" 形式的访存操作数
+bool parse_mem_operand(const std::string &operand, int &offset,
+                       std::string &base);
+// 汇编文本中的指令条数 (不含标签和伪操作), 用于遍的统计
+size_t count_asm_insts(const std::string &asm_text);
+// 条件跳转只能跳 ±4 KiB. 按每条 (伪) 指令展开后的最大长度估计距离,
+// 可能超出范围的条件跳转改写成反向条件跳过一条 j
+std::string relax_branches(const std::string &asm_text);
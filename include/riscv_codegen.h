@@ -1,20 +1,87 @@
 #pragma once
 
+#include <map>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <string>
+#include <unordered_set>
 #include <vector>
 
 #include "addr_manager.h"
+#include "cfg.h"
+#include "codegen_stats.h"
 #include "stack_offset_manager.h"
 #include "koopa.h"
+#include "pass_manager.h"
+#include "profile.h"
+#include "remarks.h"
+#include "scheduler.h"
+#include "source_map.h"
+#include "value_numbering.h"
+
+// 当前函数的栈帧安排: ra 在哪里保存/恢复, 多个 return 是否共用尾声
+struct FramePlan {
+  koopa_raw_basic_block_t ra_save_bb = nullptr;
+  std::unordered_set<koopa_raw_basic_block_t> ra_restore_bbs;
+  bool shared_epilogue = false;
+  bool epilogue_used = false;
+  bool epilogue_ra_used = false;
+  std::string epilogue_label;
+  std::string epilogue_ra_label;
+};
+
+struct CodeGenOptions {
+  // 运行的遍, 默认是 -O2
+  PassPipeline passes = PassPipeline::level(2);
+  // 指令调度 (sched 遍) 使用的延迟
+  LatencyTable latency;
+  // 另外视为可写的全局变量名, 用于本次没有生成函数体的函数
+  std::set<std::string> writable_globals;
+  // 是否输出全局变量的数据. 流水线模式下每个函数单独生成代码,
+  // 其中的全局变量只是声明, 数据在所有函数生成完后统一输出
+  bool emit_globals = true;
+  // 插桩: 每个基本块入口给计数器加一, main 返回后把计数写入 profile_path
+  bool profile_generate = false;
+  std::string profile_path;
+  // 插桩程序运行得到的计数, 用于基本块布局和函数的冷热排布
+  std::shared_ptr<const Profile> profile;
+  // 前端记录的源码行; 给出时各个遍记录优化报告 (-remarks)
+  std::shared_ptr<const SourceMap> source_map;
+  // 记录每个函数的静态开销 (-emit-stats)
+  bool collect_stats = false;
+  // IR 中是完整的程序, 可以运行过程间的遍
+  bool whole_program = true;
+};
 
 class CodeGen {
 public:
-  CodeGen(const std::string &koopa_ir);
+  CodeGen(const std::string &koopa_ir,
+          const CodeGenOptions &options = CodeGenOptions());
   ~CodeGen();
   std::string gererate();
+  // 每个函数可能写的全局变量 (store 目标或地址逃逸), 按函数名索引
+  const std::map<std::string, std::set<std::string>> &written_globals() const {
+    return func_written_globals;
+  }
+  // 各个遍的统计, 只在 PassPipeline::time_passes 时记录
+  const std::vector<PassStat> &pass_stats() const { return passes.stats(); }
+  // 优化报告, 只在 CodeGenOptions::source_map 给出时记录
+  const std::vector<Remark> &remarks() { return passes.remarks().list(); }
+  // 本次生成的函数的静态开销, 只在 CodeGenOptions::collect_stats 时记录
+  const std::vector<FunctionStats> &function_stats() const {
+    return func_stats;
+  }
 
 private:
   void AllocateStack(const koopa_raw_function_t &func);
+  void PlanFrame(const koopa_raw_function_t &func, const Cfg &cfg);
+  void EmitEpilogue(bool restore_ra);
+  void EmitSharedEpilogue();
+  void EmitProfileCounter(int index);
+  void EmitProfileRuntime(bool has_main);
+  void EmitLoopRemarks(const koopa_raw_function_t &func, const Cfg &cfg,
+                       const std::vector<koopa_raw_basic_block_t> &layout);
   void Visit(const koopa_raw_program_t &);
   void Visit(const koopa_raw_slice_t &);
   void Visit(const koopa_raw_function_t &);
@@ -26,12 +93,13 @@ private:
   void Visit(const koopa_raw_load_t &);
   void Visit(const koopa_raw_store_t &);
   void Visit(const koopa_raw_branch_t &);
+  void Visit(const koopa_raw_binary_t &, const koopa_raw_branch_t &);
   void Visit(const koopa_raw_jump_t &);
   void Visit(const koopa_raw_call_t &);
-  void Visit(const koopa_raw_global_alloc_t &, std::string var_name);
+  void Visit(const koopa_raw_global_alloc_t &, const koopa_raw_value_t &);
   void Visit(const koopa_raw_get_elem_ptr_t &);
   void Visit(const koopa_raw_get_ptr_t &);
-  void cmd_li(const koopa_raw_value_t &value, std::string &res_addr);
+  void cmd_li(const koopa_raw_value_t &value, Reg &res_addr);
   int32_t get_value(const koopa_raw_value_t);
   void init_global_var(const koopa_raw_value_t &value);
   void print_num(int num);
@@ -41,13 +109,50 @@ private:
   void pop_stack_offset_manager();
   AddrManager &get_addr_manager();
   StackOffsetManager &get_stack_offset_manager();
-  int store_aggregate(const koopa_raw_value_t &value, int dest_offset);
+  void store_aggregate(const koopa_raw_value_t &value, int dest_offset);
+  void collect_nonzero_words(const koopa_raw_value_t &value, int offset,
+                             std::vector<std::pair<int, int>> &words);
+  void emit_zero_fill(int offset, int size);
   void alloc_aggregate(const koopa_raw_value_t &value);
+  void flush_zero();
+  bool is_zero_init(const koopa_raw_value_t &value);
+  void find_writable_globals(const koopa_raw_program_t &program);
   int get_elem_size(const koopa_raw_type_t &type);
+  bool is_fused_with_branch(const koopa_raw_basic_block_t &bb, size_t idx);
+  bool is_fusible_compare(const koopa_raw_value_t &value);
+  void emit_ra_access(const std::string &op);
+  void emit_branch(koopa_raw_binary_op_t op, Reg lhs, Reg rhs,
+                   koopa_raw_basic_block_t true_bb,
+                   koopa_raw_basic_block_t false_bb);
+  koopa_raw_binary_op_t invert_compare(koopa_raw_binary_op_t op);
+  std::string bb_label(const koopa_raw_basic_block_t &bb);
 
   std::stringstream oss;
+  CodeGenOptions options;
+  PassManager passes;
   koopa_raw_program_builder_t builder;
   koopa_raw_program_t raw;
+  // 当前函数中值的编号, 栈偏移和寄存器都按编号保存
+  ValueNumbering value_numbering;
   std::vector<AddrManager> addr_managers;
   std::vector<StackOffsetManager> stack_offset_managers;
+  // 当前函数中紧跟在正在生成的基本块之后的基本块, 用于落入优化
+  koopa_raw_basic_block_t next_bb = nullptr;
+  koopa_raw_basic_block_t cur_bb = nullptr;
+  // 正在生成的指令
+  koopa_raw_value_t cur_value = nullptr;
+  FramePlan frame;
+  // 数据段输出状态: 当前所在的节, 以及尚未输出的连续 0 字节数
+  std::string cur_data_section;
+  int pending_zero_bytes = 0;
+  int zero_fill_counter = 0;
+  std::unordered_set<koopa_raw_value_t> writable_globals;
+  std::map<std::string, std::set<std::string>> func_written_globals;
+  std::string cur_func;
+  koopa_raw_function_t cur_raw_func = nullptr;
+  // 插桩时每个函数的指纹和基本块数, 按输出顺序
+  std::vector<std::pair<uint32_t, size_t>> profiled_funcs;
+  // 正在生成的基本块在 func->bbs 中的下标, 即它的计数器
+  int cur_bb_counter = -1;
+  std::vector<FunctionStats> func_stats;
 };
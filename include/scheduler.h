@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+
+// 各类指令结果可用前的周期数, 可通过 "load=3,mul=3,div=20" 形式配置
+struct LatencyTable {
+  int alu = 1;
+  int load = 3;
+  int mul = 3;
+  int div = 20;
+
+  // 在 table 的基础上解析配置, 出错时输出原因并返回 false.
+  // 每项的值是 1 到 kMaxLatency 的整数
+  static bool parse(const std::string &spec, LatencyTable &table);
+  static constexpr int kMaxLatency = 1000;
+};
+
+// 对每个基本块内 (标签/跳转/调用之间) 的指令做表调度, 在保持
+// 寄存器与访存依赖的前提下把相互独立的指令插入到长延迟指令之后
+std::string schedule_asm(const std::string &asm_text,
+                         const LatencyTable &latency);
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// 编译服务器与客户端之间的消息: 字段个数, 然后每个字段是长度加内容,
+// 整数都是 4 字节小端.
+// 请求: 模式, 源码, 客户端的工作目录, 选项...
+// 响应: 退出码, 输出, 诊断信息
+bool write_message(int fd, const std::vector<std::string> &fields);
+bool read_message(int fd, std::vector<std::string> &fields);
@@ -0,0 +1,6 @@
+#pragma once
+
+// 常驻编译服务器: 在 Unix 域套接字上接受编译请求.
+// 进程启动, 动态库加载和全局符号表初始化只做一次,
+// 每个请求在 fork 出的子进程中编译, 拥有独立的全局状态
+int serve(const char *socket_path);
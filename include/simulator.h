@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "scheduler.h"
+
+// 运行 ElfWriter 生成的目标文件的 RV32IM 模拟器, 用于 -run 和性能测试.
+// 各节依次放进同一块内存并完成重定位, SysY 运行时库的函数由模拟器实现,
+// fopen/fwrite/fclose 读写宿主机上的文件.
+// 周期数按顺序单发射估计: 指令等到操作数就绪才发射 (延迟取自
+// LatencyTable), 跳转成功时多两个周期
+class Simulator {
+public:
+  explicit Simulator(const LatencyTable &latency = LatencyTable());
+  ~Simulator();
+  Simulator(const Simulator &) = delete;
+  Simulator &operator=(const Simulator &) = delete;
+  // 载入并重定位目标文件, 失败时输出原因并返回 false
+  bool load(const std::string &object);
+  // 从 main 开始执行直到它返回, exit_code 是 main 的返回值的低 8 位.
+  // 执行非法指令或越界访存时输出原因并返回 false
+  bool run(std::istream &in, std::ostream &out, int &exit_code);
+  uint64_t instructions() const { return instret; }
+  uint64_t cycles() const { return cycle; }
+
+private:
+  bool call_runtime(int index, std::istream &in, std::ostream &out);
+  bool valid(uint32_t addr, uint32_t size) const;
+  uint32_t read32(uint32_t addr) const;
+  void write32(uint32_t addr, uint32_t value);
+  // 读出 addr 处以 0 结尾的字符串, 越界时返回 false
+  bool read_string(uint32_t addr, std::string &str) const;
+
+  LatencyTable latency;
+  std::vector<uint8_t> memory;
+  uint32_t entry = 0;
+  uint32_t regs[32] = {};
+  // 每个寄存器的值可用的周期
+  uint64_t ready[32] = {};
+  // 每条 auipc 的地址 -> 它 %pcrel_hi 指向的地址, 供 %pcrel_lo 使用
+  std::unordered_map<uint32_t, uint32_t> pcrel_targets;
+  // 程序打开的文件, 按 fopen 返回的句柄索引
+  std::unordered_map<uint32_t, FILE *> files;
+  uint32_t next_file = 1;
+  uint64_t instret = 0;
+  uint64_t cycle = 0;
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// SysY 源码行和生成的 Koopa IR 的对应, 由前端在输出 IR 时记录.
+// Koopa IR 文本不带位置信息, 这里按名字对应: 函数名, 基本块标签
+// 和 %N 形式的值. 行号为 0 表示未知
+class SourceMap {
+public:
+  // 前端: 开始输出一个函数
+  void begin_function(const std::string &name, int line);
+  void end_function() {
+    cur = nullptr;
+    cur_block = nullptr;
+  }
+  // 前端: 之后生成的值 (编号从 next_reg 开始) 来自 line 行
+  void set_line(int next_reg, int line);
+  // 前端: 开始一个基本块, 它属于当前行
+  void add_block(const std::string &label);
+  // 前端: 当前块以当前行的 ret/br/jump 结束
+  void end_block();
+
+  int function_line(const std::string &func) const;
+  // label 形如 %then_3. 块的开始行, 或者它的终结指令所在的行
+  int block_line(const std::string &func, const std::string &label) const;
+  int terminator_line(const std::string &func,
+                      const std::string &label) const;
+  // name 形如 %12, 其他名字返回 0
+  int value_line(const std::string &func, const std::string &name) const;
+
+private:
+  struct FunctionLines {
+    int line = 0;
+    // 标签 -> (开始行, 终结指令的行)
+    std::unordered_map<std::string, std::pair<int, int>> blocks;
+    // (起始编号, 行), 按编号递增; 编号在两个起点之间的值属于前一个
+    std::vector<std::pair<int, int>> values;
+  };
+  const FunctionLines *find(const std::string &func) const;
+
+  std::unordered_map<std::string, FunctionLines> funcs;
+  FunctionLines *cur = nullptr;
+  std::pair<int, int> *cur_block = nullptr;
+  int cur_line = 0;
+};
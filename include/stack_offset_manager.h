@@ -1,24 +1,19 @@
 #pragma once
 
 #include <cassert>
-#include <string>
-#include <unordered_map>
+#include <vector>
 
 #include "koopa.h"
+#include "value_numbering.h"
 
+// 函数中每个值在栈上的偏移, 按值的编号保存在数组中
 class StackOffsetManager {
 public:
+  explicit StackOffsetManager(const ValueNumbering *values = nullptr);
   void setOffset(const koopa_raw_value_t &value);
-  void setOffset(int idx, int offset);
-  int getOffset(const koopa_raw_binary_t &binary);
-  int getOffset(const koopa_raw_call_t &call);
-  int getOffset(const koopa_raw_func_arg_ref_t &func_arg_ref);
-  int getOffset(const koopa_raw_load_t &load);
-  int getOffset(const std::string &alloc_name);
+  // 把值放在已经分配的位置 (栈上着色时不同时活跃的值共用位置)
+  void setOffset(const koopa_raw_value_t &value, int offset);
   int getOffset(const koopa_raw_value_t &value);
-  int getOffset(const koopa_raw_get_elem_ptr_t &get_elem_ptr);
-  int getOffset(const koopa_raw_get_ptr_t &get_ptr);
-  int getOffset(const koopa_raw_aggregate_t &aggregate);
   void clear();
 
   int current_stack_offset = 0;
@@ -27,17 +22,7 @@ public:
   int final_stack_size = 0;
 
 private:
-  int id_to_offset(int id);
-  int getNextId();
-  std::unordered_map<const koopa_raw_load_t *, int> load_id_map;
-  std::unordered_map<const koopa_raw_binary_t *, int> binary_id_map;
-  std::unordered_map<std::string, int> alloc_name_id_map;
-  std::unordered_map<int, int> func_arg_idx_id_map;
-  std::unordered_map<const koopa_raw_call_t *, int> call_id_map;
-  std::unordered_map<int, int> id_to_offset_map;
-  std::unordered_map<const koopa_raw_get_elem_ptr_t *, int> get_elem_ptr_id_map;
-  std::unordered_map<const koopa_raw_get_ptr_t *, int> get_ptr_id_map;
-  std::unordered_map<const koopa_raw_aggregate_t *, int> aggregate_id_map;
-
-  int id_counter = 0;
+  const ValueNumbering *values;
+  // 编号 -> 偏移, 未分配为 -1
+  std::vector<int> offsets;
 };
@@ -6,6 +6,7 @@
 
 class BaseAST;
 class FuncFParamAST;
+struct ArrayType;
 
 class SymbolTable {
 public:
@@ -13,7 +14,7 @@ public:
 
   std::map<std::string, int> val_map;
   std::map<std::string, std::vector<int>> const_array_val_map;
-  std::map<std::string, std::vector<int>> array_dims_map;
+  std::map<std::string, const ArrayType *> array_type_map;
   std::map<std::string, std::string> type_map;
   std::map<std::string, DefType> def_type_map;
 
@@ -38,8 +39,8 @@ public:
   std::string get_lval_ident(const std::string &ident);
   SymbolTable::DefType get_def_type(const std::string &ident);
   std::vector<int> get_const_array_val(const std::string &ident);
-  std::vector<int> get_array_dims(const std::string &ident);
-  void set_array_dims(const std::string &ident, const std::vector<int> &dims);
+  const std::vector<int> &get_array_dims(const std::string &ident);
+  void set_array_type(const std::string &ident, const ArrayType *type);
   bool has_array_dims(const std::string &ident);
   std::vector<FuncFParamAST> get_func_fparams(const std::string &ident);
 
@@ -51,6 +52,9 @@ public:
   void use_stmt_table(BaseAST *stmt);
   void push_symbol_table();
   void pop_symbol_table();
+  // 释放所有局部作用域的符号表, 只能在全局作用域中调用.
+  // 流水线模式下每个函数输出 IR 后调用, 符号表不随文件增长
+  void release_local_tables();
 
   bool is_var_defined(const std::string &ident);
   bool is_func_has_fparams(const std::string &ident);
@@ -68,5 +72,6 @@ private:
 
   std::vector<SymbolTable *> symbol_table_stack;
   std::map<BaseAST *, SymbolTable *> stmt_table_map;
+  std::vector<SymbolTable *> local_tables;
   std::map<std::string, int> ident_count_map;
 };
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "koopa.h"
+
+// 规范化的 i32 (多维) 数组类型, dims 为空时表示 i32.
+// 元素个数, 每一维的步长和 Koopa 文本在创建时算好, 之后查询都是 O(1)
+struct ArrayType {
+  std::vector<int> dims;
+  // sub_sizes[i] 是 dims[i..] 构成的子数组的元素个数,
+  // 也就是第 i - 1 维的步长; sub_sizes[dims.size()] == 1
+  std::vector<int> sub_sizes;
+  // 例如 "[[i32, 3], 2]"
+  std::string text;
+  // 作为函数参数时的指针类型, 例如 "*[i32, 3]"
+  std::string ptr_text;
+  // 去掉最外层一维后的类型, i32 的 elem 是 nullptr
+  const ArrayType *elem = nullptr;
+
+  int total() const { return sub_sizes[0]; }
+  int size_bytes() const { return sub_sizes[0] * 4; }
+  // 第 dim 维下标加一时地址增加的字节数
+  int stride_bytes(size_t dim) const { return sub_sizes[dim + 1] * 4; }
+};
+
+// 前后端共用的类型表: 相同维度的数组类型只创建一次
+class TypeTable {
+public:
+  static TypeTable &getInstance();
+  const ArrayType *get(const std::vector<int> &dims);
+  // koopa 类型对应的数组类型, 指针类型取其指向的类型. 按类型指针缓存
+  const ArrayType *of(koopa_raw_type_t type);
+  // raw program 释放后类型指针可能被复用, 需要清掉按指针的缓存
+  void forget_raw_types() { raw_types.clear(); }
+
+private:
+  TypeTable() = default;
+  std::map<std::vector<int>, std::unique_ptr<ArrayType>> types;
+  std::unordered_map<koopa_raw_type_t, const ArrayType *> raw_types;
+};
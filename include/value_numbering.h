@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "koopa.h"
+
+// 函数内 IR 值的稠密编号: 指令和它们用到的操作数 (参数, 常量, 全局变量)
+// 依次编号为 0..size()-1. 后端按编号在数组中保存栈偏移和寄存器,
+// 每次查询只需在开放定址表中找一次编号
+class ValueNumbering {
+public:
+  void build(const koopa_raw_function_t &func);
+  // 值的编号, 值必须已经编号
+  int id(koopa_raw_value_t value) const;
+  int size() const { return (int)values.size(); }
+
+private:
+  void add(koopa_raw_value_t value);
+  void add_operands(koopa_raw_value_t inst);
+  size_t find_slot(koopa_raw_value_t value) const;
+  void grow();
+
+  // 编号 -> 值
+  std::vector<koopa_raw_value_t> values;
+  // 值 -> 编号, 容量是 2 的幂, 空位为 nullptr
+  std::vector<koopa_raw_value_t> keys;
+  std::vector<int> ids;
+  int shift = 64;
+};
@@ -0,0 +1,356 @@
+// block_placement.cpp
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <utility>
+
+#include "block_placement.h"
+
+namespace {
+// 静态预测: 循环继续的概率, 以及跳向 return 块的概率
+constexpr double kLoopTakenProb = 0.88;
+constexpr double kReturnProb = 0.28;
+// 循环头的频率放大倍数, 约等于预测的迭代次数
+constexpr double kLoopScale = 1.0 / (1.0 - kLoopTakenProb);
+// 以 return 结尾且频率低于入口这一比例的链视为冷链
+constexpr double kColdRatio = 0.5;
+constexpr double kEpsilon = 1e-9;
+// 使用 profile 时的代价: 跳转 (j) 和条件跳转成立的额外周期
+constexpr double kJumpCost = 3.0;
+constexpr double kTakenCost = 2.0;
+
+bool weight_equal(double lhs, double rhs) {
+  return std::fabs(lhs - rhs) <= kEpsilon * std::max(1.0, std::fabs(lhs));
+}
+} // namespace
+
+BlockPlacement::BlockPlacement(const Cfg &cfg,
+                               const std::vector<uint32_t> *counts,
+                               std::vector<bool> tail_returns)
+    : cfg(cfg), tail_returns(std::move(tail_returns)) {
+  for (size_t from = 0; from < cfg.size(); ++from) {
+    for (size_t to : cfg.succs[from]) {
+      edges.push_back({from, to, 0.0, 0.0, cfg.is_back_edge(from, to), 0, 0.0});
+    }
+  }
+  // 函数没有执行过时计数不提供信息, 仍用静态估计
+  if (counts != nullptr && (*counts)[0] != 0) {
+    use_counts(*counts);
+    return;
+  }
+  estimate_probs();
+  estimate_freqs();
+}
+
+// 为每条边估计跳转概率: 回边/留在循环内的边更可能,
+// 走向 return 的分支 (提前返回) 不太可能, 其余对半
+void BlockPlacement::estimate_probs() {
+  std::vector<std::vector<size_t>> out_edges(cfg.size());
+  for (size_t i = 0; i < edges.size(); ++i) {
+    out_edges[edges[i].from].push_back(i);
+  }
+  for (size_t bb = 0; bb < cfg.size(); ++bb) {
+    auto &out = out_edges[bb];
+    if (out.size() == 1) {
+      edges[out[0]].prob = 1.0;
+      continue;
+    }
+    if (out.size() != 2) {
+      continue;
+    }
+    Edge &lhs = edges[out[0]];
+    Edge &rhs = edges[out[1]];
+    lhs.prob = rhs.prob = 0.5;
+    // 回边和离开这个循环的边: 预测继续循环. 另一条边仍在循环内时
+    // (如循环末尾的 if 直接跳回循环头) 回边不说明哪条更可能
+    if (lhs.back != rhs.back) {
+      const Edge &back = lhs.back ? lhs : rhs;
+      const Edge &other = lhs.back ? rhs : lhs;
+      if (!cfg.in_loop(back.to, other.to)) {
+        lhs.prob = lhs.back ? kLoopTakenProb : 1.0 - kLoopTakenProb;
+        rhs.prob = 1.0 - lhs.prob;
+        continue;
+      }
+    }
+    bool decided = false;
+    for (const auto &loop : cfg.loops) {
+      if (!loop.second[bb]) {
+        continue;
+      }
+      bool lhs_in = cfg.in_loop(loop.first, lhs.to);
+      bool rhs_in = cfg.in_loop(loop.first, rhs.to);
+      if (lhs_in != rhs_in) {
+        lhs.prob = lhs_in ? kLoopTakenProb : 1.0 - kLoopTakenProb;
+        rhs.prob = 1.0 - lhs.prob;
+        decided = true;
+        break;
+      }
+    }
+    if (decided) {
+      continue;
+    }
+    bool lhs_ret = cfg.ends_with_return(lhs.to);
+    bool rhs_ret = cfg.ends_with_return(rhs.to);
+    if (lhs_ret != rhs_ret) {
+      lhs.prob = lhs_ret ? kReturnProb : 1.0 - kReturnProb;
+      rhs.prob = 1.0 - lhs.prob;
+    }
+  }
+}
+
+// 按逆后序沿前向边传播频率, 循环头按预测迭代次数放大
+void BlockPlacement::estimate_freqs() {
+  freq.assign(cfg.size(), 0.0);
+  std::vector<std::vector<size_t>> in_edges(cfg.size());
+  for (size_t i = 0; i < edges.size(); ++i) {
+    in_edges[edges[i].to].push_back(i);
+  }
+  for (size_t bb : cfg.rpo) {
+    double f = bb == 0 ? 1.0 : 0.0;
+    for (size_t i : in_edges[bb]) {
+      const Edge &edge = edges[i];
+      if (!edge.back && cfg.reachable[edge.from]) {
+        f += freq[edge.from] * edge.prob;
+      }
+    }
+    if (cfg.loops.count(bb)) {
+      f *= kLoopScale;
+    }
+    freq[bb] = f;
+  }
+  for (auto &edge : edges) {
+    edge.weight = cfg.reachable[edge.from] ? freq[edge.from] * edge.prob : 0.0;
+  }
+}
+
+// 由块计数推出边计数: 先把已知的边定下来, 再反复利用流守恒
+// (流入 = 块计数 = 流出) 求出只剩一条未知边的块; 仍然无法确定的边
+// 平分剩余的计数
+void BlockPlacement::use_counts(const std::vector<uint32_t> &counts) {
+  profiled = true;
+  size_t n = cfg.size();
+  freq.assign(n, 0.0);
+  for (size_t bb = 0; bb < n; ++bb) {
+    freq[bb] = cfg.reachable[bb] ? counts[bb] : 0.0;
+  }
+  std::vector<std::vector<size_t>> out_edges(n), in_edges(n);
+  for (size_t i = 0; i < edges.size(); ++i) {
+    out_edges[edges[i].from].push_back(i);
+    in_edges[edges[i].to].push_back(i);
+  }
+  // 执行最多的可以落入尾声的 return 块, 布局时放在最后
+  for (size_t bb = 0; bb < tail_returns.size(); ++bb) {
+    if (tail_returns[bb] && freq[bb] > 0.0 &&
+        (tail_block == SIZE_MAX || freq[bb] > freq[tail_block])) {
+      tail_block = bb;
+    }
+  }
+  std::vector<bool> known(edges.size(), false);
+  auto solve = [&](const std::vector<size_t> &group, double total,
+                   bool split) {
+    double rest = total;
+    std::vector<size_t> unknown;
+    for (size_t i : group) {
+      if (known[i]) {
+        rest -= edges[i].weight;
+      } else {
+        unknown.push_back(i);
+      }
+    }
+    if (unknown.empty() || (unknown.size() > 1 && !split)) {
+      return false;
+    }
+    for (size_t i : unknown) {
+      edges[i].weight = std::max(0.0, rest) / unknown.size();
+      known[i] = true;
+    }
+    return true;
+  };
+  for (size_t i = 0; i < edges.size(); ++i) {
+    if (!cfg.reachable[edges[i].from] || freq[edges[i].from] == 0.0) {
+      known[i] = true;
+    }
+  }
+  auto propagate = [&]() {
+    bool changed = true;
+    while (changed) {
+      changed = false;
+      for (size_t bb = 0; bb < n; ++bb) {
+        changed |= solve(out_edges[bb], freq[bb], false);
+        if (bb != 0) {
+          changed |= solve(in_edges[bb], freq[bb], false);
+        }
+      }
+    }
+  };
+  propagate();
+  for (size_t bb = 0; bb < n; ++bb) {
+    if (solve(out_edges[bb], freq[bb], true)) {
+      propagate();
+    }
+  }
+  for (auto &edge : edges) {
+    edge.prob = freq[edge.from] > 0.0 ? edge.weight / freq[edge.from] : 0.0;
+    for (const auto &loop : cfg.loops) {
+      edge.depth += loop.second[edge.from] && loop.second[edge.to];
+    }
+    // 无条件边落入省掉一条 j; 条件边落入只省掉跳转成立的代价.
+    // 最后一个块落入后还要跳到尾声, 不如作为跳转目标, 这样的边最后考虑
+    if (cfg.succs[edge.from].size() == 1) {
+      edge.gain = edge.weight * kJumpCost;
+    } else if (edge.to == tail_block) {
+      edge.gain = -edge.weight;
+    } else {
+      edge.gain = edge.weight * kTakenCost;
+    }
+  }
+}
+
+// 按边权从大到小把 "尾 -> 头" 的链连起来; 权重相同时优先回边,
+// 这样 while 循环会被旋转成条件跳转在循环底部的形式. 实际计数中
+// 循环出口可能比循环体更重, 使用 profile 时先连内层循环中的边,
+// 再按落入省下的周期数排序
+std::vector<std::vector<size_t>> BlockPlacement::build_chains() {
+  size_t n = cfg.size();
+  std::vector<std::vector<size_t>> chains(n);
+  std::vector<size_t> chain_of(n);
+  for (size_t i = 0; i < n; ++i) {
+    chains[i] = {i};
+    chain_of[i] = i;
+  }
+  std::vector<size_t> order(edges.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+    const Edge &l = edges[lhs];
+    const Edge &r = edges[rhs];
+    if (profiled) {
+      if (l.depth != r.depth) {
+        return l.depth > r.depth;
+      }
+      if (!weight_equal(l.gain, r.gain)) {
+        return l.gain > r.gain;
+      }
+      return l.back && !r.back;
+    }
+    if (!weight_equal(l.weight, r.weight)) {
+      return l.weight > r.weight;
+    }
+    if (l.back != r.back) {
+      return l.back;
+    }
+    // 无条件跳转落入时整条 j 都省掉, 比条件跳转落入收益大
+    return cfg.succs[l.from].size() == 1 && cfg.succs[r.from].size() != 1;
+  });
+  for (size_t i : order) {
+    const Edge &edge = edges[i];
+    if (!cfg.reachable[edge.from] || edge.to == 0) {
+      continue;
+    }
+    size_t from_chain = chain_of[edge.from];
+    size_t to_chain = chain_of[edge.to];
+    if (from_chain == to_chain || chains[from_chain].back() != edge.from ||
+        chains[to_chain].front() != edge.to) {
+      continue;
+    }
+    for (size_t bb : chains[to_chain]) {
+      chains[from_chain].push_back(bb);
+      chain_of[bb] = from_chain;
+    }
+    chains[to_chain].clear();
+  }
+  std::vector<std::vector<size_t>> result;
+  for (auto &chain : chains) {
+    if (!chain.empty()) {
+      result.push_back(std::move(chain));
+    }
+  }
+  return result;
+}
+
+// 入口链在最前; 之后每次选与已放置块连接最紧的链, 使循环保持连续;
+// 冷链 (低频的提前返回) 最后放, 不可达的块按原顺序放在末尾
+std::vector<koopa_raw_basic_block_t> BlockPlacement::layout() {
+  std::vector<koopa_raw_basic_block_t> result;
+  if (cfg.size() == 0) {
+    return result;
+  }
+  auto chains = build_chains();
+  std::vector<size_t> chain_of(cfg.size());
+  for (size_t i = 0; i < chains.size(); ++i) {
+    for (size_t bb : chains[i]) {
+      chain_of[bb] = i;
+    }
+  }
+  std::vector<bool> placed(chains.size(), false);
+  std::vector<bool> cold(chains.size(), false);
+  std::vector<bool> dead(chains.size(), false);
+  for (size_t i = 0; i < chains.size(); ++i) {
+    double max_freq = 0.0;
+    for (size_t bb : chains[i]) {
+      max_freq = std::max(max_freq, freq[bb]);
+    }
+    dead[i] = !cfg.reachable[chains[i].front()];
+    if (profiled) {
+      cold[i] = chain_of[0] != i && max_freq == 0.0;
+    } else {
+      cold[i] = chain_of[0] != i && cfg.ends_with_return(chains[i].back()) &&
+                max_freq < kColdRatio * freq[0];
+    }
+  }
+
+  // 使用 profile 时, 以 tail_block 结尾的链放在最后, 直接落入共用的尾声
+  size_t last = chains.size();
+  if (tail_block < cfg.size() && chain_of[tail_block] != chain_of[0] &&
+      chains[chain_of[tail_block]].back() == tail_block) {
+    last = chain_of[tail_block];
+  }
+
+  auto place = [&](size_t chain) {
+    placed[chain] = true;
+    for (size_t bb : chains[chain]) {
+      result.push_back(cfg.blocks[bb]);
+    }
+  };
+  auto place_greedy = [&](bool want_cold) {
+    while (true) {
+      size_t best = chains.size();
+      double best_weight = -1.0;
+      for (size_t i = 0; i < chains.size(); ++i) {
+        if (placed[i] || dead[i] || cold[i] != want_cold || i == last) {
+          continue;
+        }
+        double weight = 0.0;
+        for (const auto &edge : edges) {
+          if (chain_of[edge.to] == i && placed[chain_of[edge.from]]) {
+            weight += edge.weight;
+          }
+        }
+        if (best == chains.size() ||
+            (weight > best_weight && !weight_equal(weight, best_weight))) {
+          best = i;
+          best_weight = weight;
+        }
+      }
+      if (best == chains.size()) {
+        return;
+      }
+      place(best);
+    }
+  };
+
+  place(chain_of[0]);
+  place_greedy(false);
+  place_greedy(true);
+  for (size_t i = 0; i < chains.size(); ++i) {
+    if (!placed[i] && i != last) {
+      place(i);
+    }
+  }
+  if (last != chains.size()) {
+    place(last);
+  }
+  assert(result.size() == cfg.size());
+  return result;
+}
@@ -0,0 +1,186 @@
+// cfg.cpp
+#include <algorithm>
+
+#include "cfg.h"
+
+Cfg::Cfg(const koopa_raw_function_t &func) {
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    block_idx[bb] = blocks.size();
+    blocks.push_back(bb);
+  }
+  build_edges();
+  find_loops();
+  build_dominators();
+}
+
+// 由每个基本块的终结指令建立控制流边
+void Cfg::build_edges() {
+  succs.assign(blocks.size(), {});
+  preds.assign(blocks.size(), {});
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    auto bb = blocks[i];
+    if (bb->insts.len == 0) {
+      continue;
+    }
+    auto last = reinterpret_cast<koopa_raw_value_t>(
+        bb->insts.buffer[bb->insts.len - 1]);
+    std::vector<koopa_raw_basic_block_t> targets;
+    if (last->kind.tag == KOOPA_RVT_BRANCH) {
+      targets.push_back(last->kind.data.branch.true_bb);
+      targets.push_back(last->kind.data.branch.false_bb);
+    } else if (last->kind.tag == KOOPA_RVT_JUMP) {
+      targets.push_back(last->kind.data.jump.target);
+    }
+    for (auto target : targets) {
+      size_t to = block_idx.at(target);
+      if (std::find(succs[i].begin(), succs[i].end(), to) != succs[i].end()) {
+        continue;
+      }
+      succs[i].push_back(to);
+      preds[to].push_back(i);
+    }
+  }
+}
+
+// 深度优先遍历找回边, 再由回边求自然循环
+void Cfg::find_loops() {
+  size_t n = blocks.size();
+  reachable.assign(n, false);
+  loop_depth.assign(n, 0);
+  if (n == 0) {
+    return;
+  }
+  std::vector<int> state(n, 0); // 0 未访问, 1 在栈上, 2 已完成
+  std::vector<size_t> post_order;
+  std::vector<std::pair<size_t, size_t>> stack = {{0, 0}};
+  state[0] = 1;
+  reachable[0] = true;
+  while (!stack.empty()) {
+    auto &top = stack.back();
+    size_t bb = top.first;
+    if (top.second < succs[bb].size()) {
+      size_t to = succs[bb][top.second++];
+      if (state[to] == 0) {
+        state[to] = 1;
+        reachable[to] = true;
+        stack.push_back({to, 0});
+      } else if (state[to] == 1) {
+        back_edges.insert({bb, to});
+      }
+    } else {
+      state[bb] = 2;
+      post_order.push_back(bb);
+      stack.pop_back();
+    }
+  }
+  rpo.assign(post_order.rbegin(), post_order.rend());
+
+  for (const auto &edge : back_edges) {
+    auto &body = loops[edge.second];
+    if (body.empty()) {
+      body.assign(n, false);
+      body[edge.second] = true;
+    }
+    std::vector<size_t> worklist = {edge.first};
+    while (!worklist.empty()) {
+      size_t bb = worklist.back();
+      worklist.pop_back();
+      if (body[bb]) {
+        continue;
+      }
+      body[bb] = true;
+      for (size_t pred : preds[bb]) {
+        if (reachable[pred]) {
+          worklist.push_back(pred);
+        }
+      }
+    }
+  }
+  for (const auto &loop : loops) {
+    for (size_t i = 0; i < n; ++i) {
+      if (loop.second[i]) {
+        ++loop_depth[i];
+      }
+    }
+  }
+}
+
+// Cooper-Harvey-Kennedy 迭代求支配树
+void Cfg::build_dominators() {
+  size_t n = blocks.size();
+  idom.resize(n);
+  rpo_idx.assign(n, n);
+  for (size_t i = 0; i < n; ++i) {
+    idom[i] = i;
+  }
+  for (size_t i = 0; i < rpo.size(); ++i) {
+    rpo_idx[rpo[i]] = i;
+  }
+  std::vector<bool> done(n, false);
+  if (n > 0) {
+    done[0] = true;
+  }
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (size_t bb : rpo) {
+      if (bb == 0) {
+        continue;
+      }
+      size_t new_idom = n;
+      for (size_t pred : preds[bb]) {
+        if (!done[pred]) {
+          continue;
+        }
+        new_idom = new_idom == n ? pred : common_dominator(pred, new_idom);
+      }
+      if (new_idom != n && (!done[bb] || idom[bb] != new_idom)) {
+        idom[bb] = new_idom;
+        done[bb] = true;
+        changed = true;
+      }
+    }
+  }
+}
+
+bool Cfg::is_back_edge(size_t from, size_t to) const {
+  return back_edges.count({from, to}) != 0;
+}
+
+bool Cfg::in_loop(size_t header, size_t idx) const {
+  auto loop = loops.find(header);
+  return loop != loops.end() && loop->second[idx];
+}
+
+bool Cfg::dominates(size_t lhs, size_t rhs) const {
+  if (!reachable[rhs]) {
+    return false;
+  }
+  while (rhs != lhs && rhs != 0) {
+    rhs = idom[rhs];
+  }
+  return rhs == lhs;
+}
+
+size_t Cfg::common_dominator(size_t lhs, size_t rhs) const {
+  while (lhs != rhs) {
+    while (rpo_idx[lhs] > rpo_idx[rhs]) {
+      lhs = idom[lhs];
+    }
+    while (rpo_idx[rhs] > rpo_idx[lhs]) {
+      rhs = idom[rhs];
+    }
+  }
+  return lhs;
+}
+
+bool Cfg::ends_with_return(size_t idx) const {
+  auto bb = blocks[idx];
+  if (bb->insts.len == 0) {
+    return false;
+  }
+  auto last = reinterpret_cast<koopa_raw_value_t>(
+      bb->insts.buffer[bb->insts.len - 1]);
+  return last->kind.tag == KOOPA_RVT_RETURN;
+}
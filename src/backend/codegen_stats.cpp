@@ -0,0 +1,125 @@
+// codegen_stats.cpp
+#include <algorithm>
+#include <unordered_map>
+
+#include "codegen_stats.h"
+#include "riscv_asm.h"
+
+namespace {
+enum class InstClass { MEMORY, ALU, MUL_DIV, BRANCH, CALL };
+
+bool starts_with(const std::string &str, const char *prefix) {
+  return str.rfind(prefix, 0) == 0;
+}
+
+InstClass classify(const std::string &op) {
+  if (op == "lw" || op == "sw" || op == "lb" || op == "lbu" || op == "lh" ||
+      op == "lhu" || op == "sb" || op == "sh") {
+    return InstClass::MEMORY;
+  }
+  if (starts_with(op, "mul") || starts_with(op, "div") ||
+      starts_with(op, "rem")) {
+    return InstClass::MUL_DIV;
+  }
+  if (op == "call" || op == "tail" || op == "jal" || op == "jalr") {
+    return InstClass::CALL;
+  }
+  // RV32IM 中 b 开头的都是条件跳转
+  if (op[0] == 'b' || op == "j" || op == "jr" || op == "ret") {
+    return InstClass::BRANCH;
+  }
+  return InstClass::ALU;
+}
+
+// JSON 字符串, 函数名和文件名中只需转义引号, 反斜杠和控制字符
+std::string quote(const std::string &text) {
+  std::string result = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+      result += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      result += ' ';
+    } else {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+} // namespace
+
+void count_asm_stats(const std::string &asm_text,
+                     std::vector<FunctionStats> &stats) {
+  std::unordered_map<std::string, FunctionStats *> by_label;
+  for (auto &func : stats) {
+    by_label[func.label] = &func;
+  }
+  FunctionStats *cur = nullptr;
+  int block = 0;
+  for (const auto &line : parse_asm(asm_text)) {
+    if (line.kind == AsmLine::Kind::LABEL) {
+      auto it = by_label.find(line.op);
+      if (it != by_label.end()) {
+        cur = it->second;
+      }
+      block = 0;
+      continue;
+    }
+    // 切换节或声明新的全局符号时当前函数结束
+    if (line.kind == AsmLine::Kind::DIRECTIVE &&
+        (line.op == ".text" || line.op == ".data" || line.op == ".bss" ||
+         line.op == ".section" || line.op == ".globl")) {
+      cur = nullptr;
+      continue;
+    }
+    if (line.kind != AsmLine::Kind::INST || cur == nullptr) {
+      continue;
+    }
+    ++cur->insts;
+    cur->longest_block = std::max(cur->longest_block, ++block);
+    switch (classify(line.op)) {
+    case InstClass::MEMORY:
+      ++cur->memory;
+      break;
+    case InstClass::ALU:
+      ++cur->alu;
+      break;
+    case InstClass::MUL_DIV:
+      ++cur->mul_div;
+      break;
+    case InstClass::BRANCH:
+      ++cur->branch;
+      block = 0;
+      break;
+    case InstClass::CALL:
+      ++cur->calls;
+      break;
+    }
+  }
+}
+
+void write_function_stats(std::ostream &os, const std::string &file,
+                          const std::vector<FunctionStats> &stats) {
+  os << "{\n";
+  os << "  \"file\": " << quote(file) << ",\n";
+  os << "  \"functions\": [";
+  for (size_t i = 0; i < stats.size(); ++i) {
+    const auto &func = stats[i];
+    os << (i == 0 ? "\n" : ",\n");
+    os << "    {\n";
+    os << "      \"name\": " << quote(func.name) << ",\n";
+    os << "      \"frame_size\": " << func.frame_size << ",\n";
+    os << "      \"spill_stores\": " << func.spill_stores << ",\n";
+    os << "      \"reloads\": " << func.reloads << ",\n";
+    os << "      \"insts\": " << func.insts << ",\n";
+    os << "      \"memory\": " << func.memory << ",\n";
+    os << "      \"alu\": " << func.alu << ",\n";
+    os << "      \"mul_div\": " << func.mul_div << ",\n";
+    os << "      \"branch\": " << func.branch << ",\n";
+    os << "      \"calls\": " << func.calls << ",\n";
+    os << "      \"longest_block\": " << func.longest_block << "\n";
+    os << "    }";
+  }
+  os << (stats.empty() ? "]\n" : "\n  ]\n");
+  os << "}\n";
+}
@@ -0,0 +1,577 @@
+// elf_writer.cpp
+#include <cassert>
+#include <iostream>
+#include <unordered_map>
+
+#include "elf_writer.h"
+
+namespace {
+constexpr uint32_t SHT_PROGBITS = 1;
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_STRTAB = 3;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHF_WRITE = 0x1;
+constexpr uint32_t SHF_ALLOC = 0x2;
+constexpr uint32_t SHF_EXECINSTR = 0x4;
+constexpr uint32_t SHF_INFO_LINK = 0x40;
+constexpr uint16_t EM_RISCV = 243;
+
+constexpr uint32_t R_RISCV_32 = 1;
+constexpr uint32_t R_RISCV_BRANCH = 16;
+constexpr uint32_t R_RISCV_JAL = 17;
+constexpr uint32_t R_RISCV_CALL = 18;
+constexpr uint32_t R_RISCV_PCREL_HI20 = 23;
+constexpr uint32_t R_RISCV_PCREL_LO12_I = 24;
+constexpr uint32_t R_RISCV_PCREL_LO12_S = 25;
+
+enum SectionId { TEXT = 0, DATA, BSS, RODATA };
+
+const std::unordered_map<std::string, int> kRegs = {
+    {"zero", 0}, {"ra", 1},  {"sp", 2},   {"gp", 3},   {"tp", 4},  {"t0", 5},
+    {"t1", 6},   {"t2", 7},  {"s0", 8},   {"fp", 8},   {"s1", 9},  {"a0", 10},
+    {"a1", 11},  {"a2", 12}, {"a3", 13},  {"a4", 14},  {"a5", 15}, {"a6", 16},
+    {"a7", 17},  {"s2", 18}, {"s3", 19},  {"s4", 20},  {"s5", 21}, {"s6", 22},
+    {"s7", 23},  {"s8", 24}, {"s9", 25},  {"s10", 26}, {"s11", 27},
+    {"t3", 28},  {"t4", 29}, {"t5", 30},  {"t6", 31}};
+
+// R 型指令: {funct7, funct3}
+const std::unordered_map<std::string, std::pair<uint32_t, uint32_t>> kRType = {
+    {"add", {0x00, 0}},  {"sub", {0x20, 0}},   {"sll", {0x00, 1}},
+    {"slt", {0x00, 2}},  {"sltu", {0x00, 3}},  {"xor", {0x00, 4}},
+    {"srl", {0x00, 5}},  {"sra", {0x20, 5}},   {"or", {0x00, 6}},
+    {"and", {0x00, 7}},  {"mul", {0x01, 0}},   {"mulh", {0x01, 1}},
+    {"mulhsu", {0x01, 2}}, {"mulhu", {0x01, 3}}, {"div", {0x01, 4}},
+    {"divu", {0x01, 5}}, {"rem", {0x01, 6}},   {"remu", {0x01, 7}}};
+const std::unordered_map<std::string, uint32_t> kIType = {
+    {"addi", 0}, {"slti", 2}, {"sltiu", 3}, {"xori", 4}, {"ori", 6},
+    {"andi", 7}};
+const std::unordered_map<std::string, uint32_t> kShiftImm = {
+    {"slli", 1}, {"srli", 5}, {"srai", 5}};
+const std::unordered_map<std::string, uint32_t> kLoads = {
+    {"lb", 0}, {"lh", 1}, {"lw", 2}, {"lbu", 4}, {"lhu", 5}};
+const std::unordered_map<std::string, uint32_t> kStores = {
+    {"sb", 0}, {"sh", 1}, {"sw", 2}};
+const std::unordered_map<std::string, uint32_t> kBranches = {
+    {"beq", 0}, {"bne", 1}, {"blt", 4}, {"bge", 5}, {"bltu", 6}, {"bgeu", 7}};
+
+int reg(const std::string &name) {
+  if (name.size() > 1 && name[0] == 'x' && isdigit((unsigned char)name[1])) {
+    return std::stoi(name.substr(1));
+  }
+  auto it = kRegs.find(name);
+  if (it == kRegs.end()) {
+    std::cerr << "Unknown register: " << name << std::endl;
+    assert(false);
+  }
+  return it->second;
+}
+
+int32_t imm(const std::string &str) { return (int32_t)std::stoll(str, nullptr, 0); }
+
+uint32_t r_type(uint32_t funct7, int rs2, int rs1, uint32_t funct3, int rd,
+                uint32_t opcode) {
+  return funct7 << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 | rd << 7 | opcode;
+}
+
+uint32_t i_type(int32_t imm, int rs1, uint32_t funct3, int rd,
+                uint32_t opcode) {
+  return ((uint32_t)imm & 0xfff) << 20 | rs1 << 15 | funct3 << 12 | rd << 7 |
+         opcode;
+}
+
+uint32_t s_type(int32_t imm, int rs2, int rs1, uint32_t funct3) {
+  uint32_t u = (uint32_t)imm;
+  return ((u >> 5) & 0x7f) << 25 | rs2 << 20 | rs1 << 15 | funct3 << 12 |
+         (u & 0x1f) << 7 | 0x23;
+}
+
+uint32_t b_imm(int32_t imm) {
+  uint32_t u = (uint32_t)imm;
+  return ((u >> 12) & 1) << 31 | ((u >> 5) & 0x3f) << 25 |
+         ((u >> 1) & 0xf) << 8 | ((u >> 11) & 1) << 7;
+}
+
+uint32_t j_imm(int32_t imm) {
+  uint32_t u = (uint32_t)imm;
+  return ((u >> 20) & 1) << 31 | ((u >> 1) & 0x3ff) << 21 |
+         ((u >> 11) & 1) << 20 | ((u >> 12) & 0xff) << 12;
+}
+
+void put16(std::string &out, uint16_t value) {
+  out.push_back((char)(value & 0xff));
+  out.push_back((char)(value >> 8));
+}
+
+void put32(std::string &out, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out.push_back((char)((value >> (8 * i)) & 0xff));
+  }
+}
+
+void patch32(std::string &out, uint32_t offset, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    out[offset + i] = (char)((value >> (8 * i)) & 0xff);
+  }
+}
+
+uint32_t read32(const std::string &data, uint32_t offset) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= (uint32_t)(uint8_t)data[offset + i] << (8 * i);
+  }
+  return value;
+}
+
+void align_to(std::string &out, size_t align) {
+  while (out.size() % align != 0) {
+    out.push_back('\0');
+  }
+}
+} // namespace
+
+ElfWriter::ElfWriter(const std::string &asm_text) {
+  sections = {
+      {".text", SHT_PROGBITS, SHF_ALLOC | SHF_EXECINSTR, 4},
+      {".data", SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, 1},
+      {".bss", SHT_NOBITS, SHF_ALLOC | SHF_WRITE, 1},
+      {".rodata", SHT_PROGBITS, SHF_ALLOC, 1},
+  };
+  sections[TEXT].used = true;
+  assemble(parse_asm(asm_text));
+  resolve_fixups();
+}
+
+void ElfWriter::assemble(const std::vector<AsmLine> &lines) {
+  for (const auto &line : lines) {
+    switch (line.kind) {
+    case AsmLine::Kind::EMPTY:
+      break;
+    case AsmLine::Kind::LABEL:
+      define_label(line.op);
+      break;
+    case AsmLine::Kind::DIRECTIVE:
+      directive(line);
+      break;
+    case AsmLine::Kind::INST:
+      assert(cur_section == TEXT);
+      instruction(line);
+      break;
+    }
+  }
+}
+
+ElfWriter::Symbol &ElfWriter::symbol(const std::string &name) {
+  auto it = symbols.find(name);
+  if (it == symbols.end()) {
+    symbol_order.push_back(name);
+    it = symbols.emplace(name, Symbol()).first;
+    it->second.name = name;
+  }
+  return it->second;
+}
+
+uint32_t ElfWriter::offset() const {
+  const Section &sec = sections[cur_section];
+  return sec.type == SHT_NOBITS ? sec.size : (uint32_t)sec.data.size();
+}
+
+// .L 开头的标签只在被重定位引用时才进入符号表, 与汇编器一致
+bool ElfWriter::is_local_label(const std::string &name) const {
+  return name.compare(0, 2, ".L") == 0;
+}
+
+void ElfWriter::define_label(const std::string &name) {
+  Symbol &sym = symbol(name);
+  assert(sym.section == -1);
+  sym.section = cur_section;
+  sym.value = offset();
+}
+
+void ElfWriter::directive(const AsmLine &line) {
+  const auto &op = line.op;
+  const auto &args = line.args;
+  Section &sec = sections[cur_section];
+  if (op == ".text") {
+    cur_section = TEXT;
+  } else if (op == ".data") {
+    cur_section = DATA;
+  } else if (op == ".bss") {
+    cur_section = BSS;
+  } else if (op == ".rodata" ||
+             (op == ".section" && !args.empty() && args[0] == ".rodata")) {
+    cur_section = RODATA;
+  } else if (op == ".globl" || op == ".global") {
+    globals.insert(args[0]);
+  } else if (op == ".word" || op == ".half" || op == ".byte") {
+    assert(sec.type != SHT_NOBITS);
+    for (const auto &arg : args) {
+      if (op == ".word") {
+        if (!arg.empty() && (isdigit((unsigned char)arg[0]) || arg[0] == '-')) {
+          put32(sec.data, (uint32_t)imm(arg));
+        } else {
+          add_reloc(arg, R_RISCV_32);
+          put32(sec.data, 0);
+        }
+      } else if (op == ".half") {
+        put16(sec.data, (uint16_t)imm(arg));
+      } else {
+        sec.data.push_back((char)imm(arg));
+      }
+    }
+  } else if (op == ".zero" || op == ".space") {
+    uint32_t size = (uint32_t)imm(args[0]);
+    if (sec.type == SHT_NOBITS) {
+      sec.size += size;
+    } else {
+      sec.data.append(size, '\0');
+    }
+  } else if (op == ".align" || op == ".p2align" || op == ".balign") {
+    uint32_t align = (uint32_t)imm(args[0]);
+    if (op != ".balign") {
+      align = 1u << align;
+    }
+    sec.align = std::max(sec.align, align);
+    if (sec.type == SHT_NOBITS) {
+      sec.size = (sec.size + align - 1) / align * align;
+    } else {
+      align_to(sec.data, align);
+    }
+  } else {
+    std::cerr << "Unsupported directive: " << op << std::endl;
+    assert(false);
+  }
+  sections[cur_section].used = true;
+}
+
+void ElfWriter::emit32(uint32_t word) { put32(sections[cur_section].data, word); }
+
+// li 的展开方式与汇编器相同: 12 位以内用 addi, 否则 lui (+ addi)
+void ElfWriter::emit_li(int rd, int32_t value) {
+  if (value >= -2048 && value <= 2047) {
+    emit32(i_type(value, 0, 0, rd, 0x13));
+    return;
+  }
+  int32_t lo = (int32_t)((uint32_t)value << 20) >> 20;
+  uint32_t hi = ((uint32_t)value - (uint32_t)lo) >> 12;
+  emit32(hi << 12 | rd << 7 | 0x37);
+  if (lo != 0) {
+    emit32(i_type(lo, rd, 0, rd, 0x13));
+  }
+}
+
+void ElfWriter::add_reloc(const std::string &name, uint32_t type) {
+  symbol(name).referenced = true;
+  relocs.push_back({cur_section, offset(), name, type});
+}
+
+// 在 auipc 处定义 .Lpcrel_hiN 标签, 供随后的 %pcrel_lo 重定位引用
+void ElfWriter::emit_pcrel_hi(int rd, const std::string &symbol) {
+  define_label(".Lpcrel_hi" + std::to_string(pcrel_counter++));
+  add_reloc(symbol, R_RISCV_PCREL_HI20);
+  emit32(rd << 7 | 0x17);
+}
+
+void ElfWriter::emit_branch(uint32_t funct3, int rs1, int rs2,
+                            const std::string &label) {
+  fixups.push_back({cur_section, offset(), label, R_RISCV_BRANCH});
+  emit32(rs2 << 20 | rs1 << 15 | funct3 << 12 | 0x63);
+}
+
+void ElfWriter::emit_jal(int rd, const std::string &label) {
+  fixups.push_back({cur_section, offset(), label, R_RISCV_JAL});
+  emit32(rd << 7 | 0x6f);
+}
+
+void ElfWriter::instruction(const AsmLine &line) {
+  const auto &op = line.op;
+  const auto &a = line.args;
+  if (kRType.count(op)) {
+    auto f = kRType.at(op);
+    emit32(r_type(f.first, reg(a[2]), reg(a[1]), f.second, reg(a[0]), 0x33));
+  } else if (kIType.count(op)) {
+    emit32(i_type(imm(a[2]), reg(a[1]), kIType.at(op), reg(a[0]), 0x13));
+  } else if (kShiftImm.count(op)) {
+    int32_t shamt = imm(a[2]) & 31;
+    if (op == "srai") {
+      shamt |= 0x400;
+    }
+    emit32(i_type(shamt, reg(a[1]), kShiftImm.at(op), reg(a[0]), 0x13));
+  } else if (kLoads.count(op) && a[1].find('(') == std::string::npos) {
+    // lw rd, sym: auipc rd + lw rd, 0(rd)
+    int rd = reg(a[0]);
+    emit_pcrel_hi(rd, a[1]);
+    add_reloc(".Lpcrel_hi" + std::to_string(pcrel_counter - 1),
+              R_RISCV_PCREL_LO12_I);
+    emit32(i_type(0, rd, kLoads.at(op), rd, 0x03));
+  } else if (kStores.count(op) && a.size() == 3) {
+    // sw rs, sym, rt: auipc rt + sw rs, 0(rt)
+    int rt = reg(a[2]);
+    emit_pcrel_hi(rt, a[1]);
+    add_reloc(".Lpcrel_hi" + std::to_string(pcrel_counter - 1),
+              R_RISCV_PCREL_LO12_S);
+    emit32(s_type(0, reg(a[0]), rt, kStores.at(op)));
+  } else if (kLoads.count(op) || kStores.count(op)) {
+    int offset;
+    std::string base;
+    bool ok = parse_mem_operand(a[1], offset, base);
+    assert(ok);
+    if (kLoads.count(op)) {
+      emit32(i_type(offset, reg(base), kLoads.at(op), reg(a[0]), 0x03));
+    } else {
+      emit32(s_type(offset, reg(a[0]), reg(base), kStores.at(op)));
+    }
+  } else if (kBranches.count(op)) {
+    emit_branch(kBranches.at(op), reg(a[0]), reg(a[1]), a[2]);
+  } else if (op == "bgt" || op == "ble" || op == "bgtu" || op == "bleu") {
+    // 交换操作数后用 blt/bge 实现
+    uint32_t funct3 = kBranches.at(op == "bgt"    ? "blt"
+                                   : op == "ble"  ? "bge"
+                                   : op == "bgtu" ? "bltu"
+                                                  : "bgeu");
+    emit_branch(funct3, reg(a[1]), reg(a[0]), a[2]);
+  } else if (op == "beqz" || op == "bnez" || op == "bltz" || op == "bgez") {
+    emit_branch(kBranches.at(op.substr(0, 3)), reg(a[0]), 0, a[1]);
+  } else if (op == "blez" || op == "bgtz") {
+    emit_branch(kBranches.at(op == "blez" ? "bge" : "blt"), 0, reg(a[0]), a[1]);
+  } else if (op == "j") {
+    emit_jal(0, a[0]);
+  } else if (op == "jal") {
+    emit_jal(a.size() == 1 ? 1 : reg(a[0]), a.back());
+  } else if (op == "jr") {
+    emit32(i_type(0, reg(a[0]), 0, 0, 0x67));
+  } else if (op == "ret") {
+    emit32(i_type(0, 1, 0, 0, 0x67));
+  } else if (op == "call") {
+    add_reloc(a[0], R_RISCV_CALL);
+    emit32(1 << 7 | 0x17);
+    emit32(i_type(0, 1, 0, 1, 0x67));
+  } else if (op == "la" || op == "lla") {
+    // auipc + addi, 低 12 位的重定位指向 auipc 处的标签
+    int rd = reg(a[0]);
+    emit_pcrel_hi(rd, a[1]);
+    add_reloc(".Lpcrel_hi" + std::to_string(pcrel_counter - 1),
+              R_RISCV_PCREL_LO12_I);
+    emit32(i_type(0, rd, 0, rd, 0x13));
+  } else if (op == "li") {
+    emit_li(reg(a[0]), imm(a[1]));
+  } else if (op == "lui") {
+    emit32(((uint32_t)imm(a[1]) & 0xfffff) << 12 | reg(a[0]) << 7 | 0x37);
+  } else if (op == "mv") {
+    emit32(i_type(0, reg(a[1]), 0, reg(a[0]), 0x13));
+  } else if (op == "not") {
+    emit32(i_type(-1, reg(a[1]), 4, reg(a[0]), 0x13));
+  } else if (op == "neg") {
+    emit32(r_type(0x20, reg(a[1]), 0, 0, reg(a[0]), 0x33));
+  } else if (op == "seqz") {
+    emit32(i_type(1, reg(a[1]), 3, reg(a[0]), 0x13));
+  } else if (op == "snez") {
+    emit32(r_type(0, reg(a[1]), 0, 3, reg(a[0]), 0x33));
+  } else if (op == "sltz") {
+    emit32(r_type(0, 0, reg(a[1]), 2, reg(a[0]), 0x33));
+  } else if (op == "sgtz") {
+    emit32(r_type(0, reg(a[1]), 0, 2, reg(a[0]), 0x33));
+  } else if (op == "sgt" || op == "sgtu") {
+    emit32(r_type(0, reg(a[1]), reg(a[2]), op == "sgt" ? 2 : 3, reg(a[0]),
+                  0x33));
+  } else if (op == "nop") {
+    emit32(i_type(0, 0, 0, 0, 0x13));
+  } else {
+    std::cerr << "Unsupported instruction: " << line.text << std::endl;
+    assert(false);
+  }
+}
+
+// 同一节内已定义的跳转目标直接回填偏移, 否则留给链接器重定位
+void ElfWriter::resolve_fixups() {
+  for (const auto &fixup : fixups) {
+    Symbol &sym = symbol(fixup.symbol);
+    std::string &data = sections[fixup.section].data;
+    if (sym.section != fixup.section) {
+      sym.referenced = true;
+      relocs.push_back({fixup.section, fixup.offset, fixup.symbol, fixup.type});
+      continue;
+    }
+    int32_t delta = (int32_t)sym.value - (int32_t)fixup.offset;
+    uint32_t word = read32(data, fixup.offset);
+    if (fixup.type == R_RISCV_BRANCH) {
+      assert(delta >= -4096 && delta < 4096);
+      word |= b_imm(delta);
+    } else {
+      assert(delta >= -(1 << 20) && delta < (1 << 20));
+      word |= j_imm(delta);
+    }
+    patch32(data, fixup.offset, word);
+  }
+}
+
+std::string ElfWriter::write() {
+  // 节头表中的下标: 0 为空节, 1 为 .strtab, 之后是各个内容节及其重定位节
+  std::vector<std::string> sh_names = {"", ".strtab"};
+  std::vector<int> sec_index(sections.size(), 0);
+  std::vector<int> rela_index(sections.size(), 0);
+  std::vector<bool> has_rela(sections.size(), false);
+  for (const auto &reloc : relocs) {
+    has_rela[reloc.section] = true;
+  }
+  int next_index = 2;
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (!sections[i].used) {
+      continue;
+    }
+    sec_index[i] = next_index++;
+    if (has_rela[i]) {
+      rela_index[i] = next_index++;
+    }
+  }
+  int symtab_index = next_index++;
+
+  // 符号表: 局部符号在前, 然后是全局符号 (含未定义的外部函数)
+  std::vector<std::string> ordered;
+  for (int pass = 0; pass < 2; ++pass) {
+    for (const auto &name : symbol_order) {
+      const Symbol &sym = symbols.at(name);
+      bool global = globals.count(name) || sym.section == -1;
+      if (global != (pass == 1)) {
+        continue;
+      }
+      if (!global && is_local_label(name) && !sym.referenced) {
+        continue;
+      }
+      ordered.push_back(name);
+    }
+  }
+  std::string strtab(1, '\0');
+  std::unordered_map<std::string, uint32_t> str_offset;
+  auto add_str = [&](const std::string &str) {
+    if (!str_offset.count(str)) {
+      str_offset[str] = (uint32_t)strtab.size();
+      strtab += str;
+      strtab.push_back('\0');
+    }
+    return str_offset[str];
+  };
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (sections[i].used) {
+      add_str(sections[i].name);
+      if (has_rela[i]) {
+        add_str(".rela" + sections[i].name);
+      }
+    }
+  }
+  add_str(".symtab");
+  add_str(".strtab");
+
+  std::string symtab(16, '\0');
+  std::unordered_map<std::string, uint32_t> sym_index;
+  uint32_t first_global = 1;
+  for (const auto &name : ordered) {
+    const Symbol &sym = symbols.at(name);
+    bool global = globals.count(name) || sym.section == -1;
+    sym_index[name] = (uint32_t)(symtab.size() / 16);
+    if (!global) {
+      first_global = sym_index[name] + 1;
+    }
+    put32(symtab, add_str(name));
+    put32(symtab, sym.value);
+    put32(symtab, 0);
+    symtab.push_back((char)((global ? 1 : 0) << 4)); // STB_*, STT_NOTYPE
+    symtab.push_back('\0');
+    put16(symtab, sym.section == -1 ? 0 : (uint16_t)sec_index[sym.section]);
+  }
+
+  std::vector<std::string> relas(sections.size());
+  for (const auto &reloc : relocs) {
+    std::string &rela = relas[reloc.section];
+    put32(rela, reloc.offset);
+    put32(rela, sym_index.at(reloc.symbol) << 8 | reloc.type);
+    put32(rela, 0);
+  }
+
+  // 依次放置各节内容, 最后是节头表
+  struct Header {
+    uint32_t name, type, flags, offset, size, link, info, align, entsize;
+  };
+  std::vector<Header> headers(symtab_index + 1, Header{0, 0, 0, 0, 0, 0, 0, 0, 0});
+  std::string out(52, '\0');
+  auto place = [&](int index, const std::string &data, size_t align) {
+    align_to(out, align);
+    headers[index].offset = (uint32_t)out.size();
+    headers[index].size = (uint32_t)data.size();
+    out += data;
+  };
+  for (size_t i = 0; i < sections.size(); ++i) {
+    const Section &sec = sections[i];
+    if (!sec.used) {
+      continue;
+    }
+    Header &h = headers[sec_index[i]];
+    h.name = add_str(sec.name);
+    h.type = sec.type;
+    h.flags = sec.flags;
+    h.align = sec.align;
+    if (sec.type == SHT_NOBITS) {
+      align_to(out, sec.align);
+      h.offset = (uint32_t)out.size();
+      h.size = sec.size;
+    } else {
+      place(sec_index[i], sec.data, sec.align);
+    }
+  }
+  for (size_t i = 0; i < sections.size(); ++i) {
+    if (!has_rela[i]) {
+      continue;
+    }
+    Header &h = headers[rela_index[i]];
+    place(rela_index[i], relas[i], 4);
+    h.name = add_str(".rela" + sections[i].name);
+    h.type = SHT_RELA;
+    h.flags = SHF_INFO_LINK;
+    h.link = symtab_index;
+    h.info = sec_index[i];
+    h.align = 4;
+    h.entsize = 12;
+  }
+  place(symtab_index, symtab, 4);
+  headers[symtab_index].name = add_str(".symtab");
+  headers[symtab_index].type = SHT_SYMTAB;
+  headers[symtab_index].link = 1;
+  headers[symtab_index].info = first_global;
+  headers[symtab_index].align = 4;
+  headers[symtab_index].entsize = 16;
+  place(1, strtab, 1);
+  headers[1].name = add_str(".strtab");
+  headers[1].type = SHT_STRTAB;
+  headers[1].align = 1;
+
+  align_to(out, 4);
+  uint32_t shoff = (uint32_t)out.size();
+  for (const auto &h : headers) {
+    for (uint32_t field : {h.name, h.type, h.flags, 0u, h.offset, h.size,
+                           h.link, h.info, h.align, h.entsize}) {
+      put32(out, field);
+    }
+  }
+
+  std::string ehdr = "\x7f"
+                     "ELF";
+  ehdr.push_back(1); // ELFCLASS32
+  ehdr.push_back(1); // ELFDATA2LSB
+  ehdr.push_back(1); // EV_CURRENT
+  ehdr.append(9, '\0');
+  put16(ehdr, 1); // ET_REL
+  put16(ehdr, EM_RISCV);
+  put32(ehdr, 1);
+  put32(ehdr, 0); // e_entry
+  put32(ehdr, 0); // e_phoff
+  put32(ehdr, shoff);
+  put32(ehdr, 0); // e_flags
+  put16(ehdr, 52);
+  put16(ehdr, 0);
+  put16(ehdr, 0);
+  put16(ehdr, 40);
+  put16(ehdr, (uint16_t)headers.size());
+  put16(ehdr, 1); // .strtab 同时作为节名字符串表
+  out.replace(0, 52, ehdr);
+  return out;
+}
@@ -0,0 +1,76 @@
+// liveness.cpp
+#include <algorithm>
+#include <unordered_map>
+
+#include "ir_util.h"
+#include "liveness.h"
+
+Liveness::Liveness(const koopa_raw_function_t &func, const Cfg &cfg) {
+  size_t n = cfg.size();
+  ins.assign(n, {});
+  outs.assign(n, {});
+  // 每个局部值的定义块, 以及在定义块之外使用它的块
+  std::unordered_map<koopa_raw_value_t, size_t> def_block;
+  for (size_t i = 0; i < func->params.len; ++i) {
+    def_block[reinterpret_cast<koopa_raw_value_t>(func->params.buffer[i])] = 0;
+  }
+  for (size_t b = 0; b < n; ++b) {
+    auto bb = cfg.blocks[b];
+    for (size_t i = 0; i < bb->params.len; ++i) {
+      def_block[reinterpret_cast<koopa_raw_value_t>(bb->params.buffer[i])] = b;
+    }
+    for (size_t i = 0; i < bb->insts.len; ++i) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+      if (is_local_value(inst)) {
+        def_block[inst] = b;
+      }
+    }
+  }
+  std::vector<std::pair<koopa_raw_value_t, size_t>> uses;
+  for (size_t b = 0; b < n; ++b) {
+    auto bb = cfg.blocks[b];
+    for (size_t i = 0; i < bb->insts.len; ++i) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+      for_each_operand(inst, [&](koopa_raw_value_t value) {
+        auto it = def_block.find(value);
+        if (it != def_block.end() && it->second != b) {
+          uses.push_back({value, b});
+        }
+      });
+    }
+  }
+  std::sort(uses.begin(), uses.end());
+
+  // 标记用本轮的序号区分, 不必为每个值清空
+  std::vector<size_t> in_mark(n, 0);
+  std::vector<size_t> out_mark(n, 0);
+  size_t round = 0;
+  std::vector<size_t> worklist;
+  for (size_t i = 0; i < uses.size();) {
+    auto value = uses[i].first;
+    size_t def = def_block[value];
+    ++round;
+    for (; i < uses.size() && uses[i].first == value; ++i) {
+      worklist.push_back(uses[i].second);
+    }
+    crossing.insert(value);
+    while (!worklist.empty()) {
+      size_t b = worklist.back();
+      worklist.pop_back();
+      if (in_mark[b] == round) {
+        continue;
+      }
+      in_mark[b] = round;
+      ins[b].push_back(value);
+      for (size_t pred : cfg.preds[b]) {
+        if (out_mark[pred] != round) {
+          out_mark[pred] = round;
+          outs[pred].push_back(value);
+        }
+        if (pred != def) {
+          worklist.push_back(pred);
+        }
+      }
+    }
+  }
+}
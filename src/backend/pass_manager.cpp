@@ -0,0 +1,319 @@
+// pass_manager.cpp
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+#include "ir_passes.h"
+#include "pass_manager.h"
+#include "riscv_asm.h"
+
+namespace {
+enum class Stage { IR, CODEGEN, ASM };
+
+struct PassInfo {
+  const char *name;
+  Stage stage;
+};
+
+// 所有可以在 -passes= 中使用的遍, 按各阶段内的默认顺序
+const PassInfo kPasses[] = {
+    {"ipcp", Stage::IR},
+    {"load-elim", Stage::IR},
+    {"simplify-cfg", Stage::IR},
+    {"dse", Stage::IR},
+    {"globaldce", Stage::IR},
+    {"fuse-branch", Stage::CODEGEN},
+    {"block-placement", Stage::CODEGEN},
+    {"shrink-wrap", Stage::CODEGEN},
+    {"stack-coloring", Stage::CODEGEN},
+    {"sched", Stage::ASM},
+};
+
+template <typename Pipeline>
+auto codegen_flag(Pipeline &pipeline, const std::string &name)
+    -> decltype(&pipeline.fuse_branch) {
+  if (name == "fuse-branch") {
+    return &pipeline.fuse_branch;
+  }
+  if (name == "block-placement") {
+    return &pipeline.block_placement;
+  }
+  if (name == "shrink-wrap") {
+    return &pipeline.shrink_wrap;
+  }
+  if (name == "stack-coloring") {
+    return &pipeline.stack_coloring;
+  }
+  return nullptr;
+}
+
+std::unique_ptr<IRPass> create_ir_pass(const std::string &name) {
+  if (name == "ipcp") {
+    return std::make_unique<Ipcp>();
+  }
+  if (name == "simplify-cfg") {
+    return std::make_unique<SimplifyCfg>();
+  }
+  if (name == "load-elim") {
+    return std::make_unique<LoadElim>();
+  }
+  if (name == "dse") {
+    return std::make_unique<DeadStoreElim>();
+  }
+  if (name == "globaldce") {
+    return std::make_unique<GlobalDce>();
+  }
+  return nullptr;
+}
+
+class ScheduleAsm : public AsmPass {
+public:
+  explicit ScheduleAsm(const LatencyTable &latency) : latency(latency) {}
+  const char *name() const override { return "sched"; }
+  std::string run(const std::string &asm_text) override {
+    return schedule_asm(asm_text, latency);
+  }
+
+private:
+  LatencyTable latency;
+};
+
+class RelaxBranches : public AsmPass {
+public:
+  const char *name() const override { return "relax-branches"; }
+  std::string run(const std::string &asm_text) override {
+    return relax_branches(asm_text);
+  }
+};
+
+double seconds_since(std::chrono::steady_clock::time_point begin) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - begin;
+  return elapsed.count();
+}
+} // namespace
+
+PassPipeline PassPipeline::level(int level) {
+  PassPipeline pipeline;
+  if (level >= 1) {
+    // load-elim 转发的常数由 simplify-cfg 折叠分支, 不再被读的 store 由
+    // dse 删除; simplify-cfg 删掉的调用和 ipcp 特化后不再调用的原函数都由
+    // globaldce 最后清理
+    pipeline.ir_passes = {"load-elim", "simplify-cfg", "dse", "globaldce"};
+    pipeline.fuse_branch = true;
+    pipeline.block_placement = true;
+  }
+  if (level >= 2) {
+    // 常数参数先传进函数体, 再由 simplify-cfg 折叠分支
+    pipeline.ir_passes.insert(pipeline.ir_passes.begin(), "ipcp");
+    pipeline.shrink_wrap = true;
+    pipeline.stack_coloring = true;
+    pipeline.asm_passes = {"sched"};
+  }
+  return pipeline;
+}
+
+bool PassPipeline::parse(const std::string &spec, PassPipeline &pipeline) {
+  PassPipeline result;
+  result.time_passes = pipeline.time_passes;
+  std::stringstream ss(spec);
+  std::string name;
+  while (std::getline(ss, name, ',')) {
+    if (name.empty()) {
+      continue;
+    }
+    const PassInfo *info = nullptr;
+    for (const auto &pass : kPasses) {
+      if (name == pass.name) {
+        info = &pass;
+      }
+    }
+    if (info == nullptr) {
+      std::cerr << "Unknown pass: " << name << ", available passes:";
+      for (const auto &pass : kPasses) {
+        std::cerr << " " << pass.name;
+      }
+      std::cerr << std::endl;
+      return false;
+    }
+    switch (info->stage) {
+    case Stage::IR:
+      result.ir_passes.push_back(name);
+      break;
+    case Stage::CODEGEN:
+      *codegen_flag(result, name) = true;
+      break;
+    case Stage::ASM:
+      result.asm_passes.push_back(name);
+      break;
+    }
+  }
+  pipeline = result;
+  return true;
+}
+
+std::string PassPipeline::str() const {
+  std::vector<std::string> names = ir_passes;
+  for (const auto &pass : kPasses) {
+    if (pass.stage == Stage::CODEGEN && *codegen_flag(*this, pass.name)) {
+      names.push_back(pass.name);
+    }
+  }
+  names.insert(names.end(), asm_passes.begin(), asm_passes.end());
+  std::string result;
+  for (const auto &name : names) {
+    result += (result.empty() ? "" : ",") + name;
+  }
+  return result;
+}
+
+const Cfg &AnalysisManager::cfg(const koopa_raw_function_t &func) {
+  auto &entry = entries[func];
+  if (!entry.cfg) {
+    entry.cfg = std::make_unique<Cfg>(func);
+  }
+  return *entry.cfg;
+}
+
+const Liveness &AnalysisManager::liveness(const koopa_raw_function_t &func) {
+  const Cfg &func_cfg = cfg(func);
+  auto &entry = entries[func];
+  if (!entry.liveness) {
+    entry.liveness = std::make_unique<Liveness>(func, func_cfg);
+  }
+  return *entry.liveness;
+}
+
+void AnalysisManager::invalidate(const koopa_raw_function_t &func) {
+  entries.erase(func);
+}
+
+bool FunctionPass::run(koopa_raw_program_t &program, PassContext &ctx) {
+  bool changed = false;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    if (func->bbs.len == 0) {
+      continue;
+    }
+    if (run_on_function(func, ctx)) {
+      ctx.analyses.invalidate(func);
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+void merge_pass_stats(std::vector<PassStat> &total,
+                      const std::vector<PassStat> &stats) {
+  for (const auto &stat : stats) {
+    auto it = total.begin();
+    while (it != total.end() && it->name != stat.name) {
+      ++it;
+    }
+    if (it == total.end()) {
+      total.push_back(stat);
+      continue;
+    }
+    it->seconds += stat.seconds;
+    it->before += stat.before;
+    it->after += stat.after;
+  }
+}
+
+void print_pass_stats(std::ostream &os, const std::vector<PassStat> &stats) {
+  char line[128];
+  double total = 0;
+  os << "===-- pass execution report --===\n";
+  snprintf(line, sizeof(line), "%10s %12s %12s %8s  %s\n", "time(ms)",
+           "insts before", "insts after", "delta", "pass");
+  os << line;
+  for (const auto &stat : stats) {
+    snprintf(line, sizeof(line), "%10.3f %12zu %12zu %+8lld  %s\n",
+             stat.seconds * 1000, stat.before, stat.after,
+             (long long)stat.after - (long long)stat.before,
+             stat.name.c_str());
+    os << line;
+    total += stat.seconds;
+  }
+  snprintf(line, sizeof(line), "%10.3f  total\n", total * 1000);
+  os << line;
+}
+
+PassManager::PassManager(const PassPipeline &pipeline,
+                         const LatencyTable &latency)
+    : time_passes(pipeline.time_passes) {
+  for (const auto &name : pipeline.ir_passes) {
+    ir_passes.push_back(create_ir_pass(name));
+  }
+  for (const auto &name : pipeline.asm_passes) {
+    if (name == "sched") {
+      asm_passes.push_back(std::make_unique<ScheduleAsm>(latency));
+    }
+  }
+  // 前面的遍和代码生成都不保证跳转距离, 分支松弛必须最后运行
+  asm_passes.push_back(std::make_unique<RelaxBranches>());
+}
+
+void PassManager::run_ir(koopa_raw_program_t &program) {
+  for (auto &pass : ir_passes) {
+    if (!time_passes) {
+      pass->run(program, ctx);
+      continue;
+    }
+    size_t before = count_insts(program);
+    auto begin = std::chrono::steady_clock::now();
+    pass->run(program, ctx);
+    record(pass->name(), seconds_since(begin), before, count_insts(program));
+  }
+}
+
+std::string PassManager::run_asm(std::string asm_text) {
+  std::string result = std::move(asm_text);
+  for (auto &pass : asm_passes) {
+    if (!time_passes) {
+      result = pass->run(result);
+      continue;
+    }
+    size_t before = count_asm_insts(result);
+    auto begin = std::chrono::steady_clock::now();
+    result = pass->run(result);
+    record(pass->name(), seconds_since(begin), before,
+           count_asm_insts(result));
+  }
+  return result;
+}
+
+void PassManager::record(const std::string &name, double seconds,
+                         size_t before, size_t after) {
+  merge_pass_stats(pass_stats, {{name, seconds, before, after}});
+}
+
+std::string run_ir_passes(const std::string &koopa_ir,
+                          const PassPipeline &pipeline,
+                          std::vector<PassStat> &stats, Remarks &remarks,
+                          bool whole_program) {
+  koopa_program_t program;
+  assert(koopa_parse_from_string(koopa_ir.c_str(), &program) ==
+         KOOPA_EC_SUCCESS);
+  auto builder = koopa_new_raw_program_builder();
+  auto raw = koopa_build_raw_program(builder, program);
+  koopa_delete_program(program);
+  PassManager passes(pipeline, LatencyTable());
+  passes.remarks() = remarks;
+  passes.set_whole_program(whole_program);
+  passes.run_ir(raw);
+  remarks = passes.remarks();
+  koopa_program_t result;
+  assert(koopa_generate_raw_to_koopa(&raw, &result) == KOOPA_EC_SUCCESS);
+  size_t len = 0;
+  koopa_dump_to_string(result, nullptr, &len);
+  std::vector<char> buffer(len + 1, '\0');
+  koopa_dump_to_string(result, buffer.data(), &len);
+  koopa_delete_program(result);
+  koopa_delete_raw_program_builder(builder);
+  stats = passes.stats();
+  return buffer.data();
+}
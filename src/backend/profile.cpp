@@ -0,0 +1,74 @@
+// profile.cpp
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "profile.h"
+
+namespace {
+// FNV-1a
+void mix(uint32_t &hash, uint32_t word) {
+  for (int i = 0; i < 4; ++i) {
+    hash ^= (word >> (i * 8)) & 0xff;
+    hash *= 16777619u;
+  }
+}
+} // namespace
+
+uint32_t profile_hash(const koopa_raw_function_t &func) {
+  uint32_t hash = 2166136261u;
+  for (const char *p = func->name; *p != '\0'; ++p) {
+    mix(hash, (unsigned char)*p);
+  }
+  mix(hash, func->bbs.len);
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    mix(hash, bb->insts.len);
+  }
+  return hash;
+}
+
+bool Profile::load(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (file == nullptr) {
+    std::cerr << "Cannot open profile: " << path << std::endl;
+    return false;
+  }
+  std::vector<uint32_t> words;
+  uint32_t word;
+  while (fread(&word, sizeof(word), 1, file) == 1) {
+    words.push_back(word);
+  }
+  fclose(file);
+  if (words.size() < 2 || words[0] != kMagic) {
+    std::cerr << "Not a profile file: " << path << std::endl;
+    return false;
+  }
+  size_t pos = 2;
+  for (uint32_t i = 0; i < words[1]; ++i) {
+    if (pos + 2 > words.size() || pos + 2 + words[pos + 1] > words.size()) {
+      std::cerr << "Truncated profile: " << path << std::endl;
+      return false;
+    }
+    uint32_t hash = words[pos];
+    uint32_t size = words[pos + 1];
+    counts[hash].assign(words.begin() + pos + 2,
+                        words.begin() + pos + 2 + size);
+    pos += 2 + size;
+  }
+  return true;
+}
+
+const std::vector<uint32_t> *
+Profile::find(const koopa_raw_function_t &func) const {
+  auto it = counts.find(profile_hash(func));
+  if (it == counts.end() || it->second.size() != func->bbs.len) {
+    return nullptr;
+  }
+  return &it->second;
+}
+
+bool Profile::is_hot(const koopa_raw_function_t &func) const {
+  auto block_counts = find(func);
+  return block_counts == nullptr || (*block_counts)[0] != 0;
+}
@@ -0,0 +1,76 @@
+// remarks.cpp
+#include "remarks.h"
+#include "util.h"
+
+namespace {
+// YAML 单引号字符串, 其中的单引号写两次
+std::string quote(const std::string &text) {
+  std::string result = "'";
+  for (char c : text) {
+    result += c;
+    if (c == '\'') {
+      result += c;
+    }
+  }
+  return result + "'";
+}
+
+const char *kind_tag(Remark::Kind kind) {
+  switch (kind) {
+  case Remark::PASSED:
+    return "!Passed";
+  case Remark::MISSED:
+    return "!Missed";
+  case Remark::ANALYSIS:
+    return "!Analysis";
+  }
+  return "!Analysis";
+}
+} // namespace
+
+int Remarks::line(const koopa_raw_function_t &func,
+                  const koopa_raw_basic_block_t &bb,
+                  const koopa_raw_value_t &value) const {
+  std::string name = get_label(func->name);
+  int result = 0;
+  if (value != nullptr && value->name != nullptr) {
+    result = source->value_line(name, value->name);
+  }
+  if (result == 0 && bb != nullptr && bb->name != nullptr) {
+    bool is_terminator =
+        value != nullptr && bb->insts.len != 0 &&
+        bb->insts.buffer[bb->insts.len - 1] == static_cast<const void *>(value);
+    result = is_terminator ? source->terminator_line(name, bb->name)
+                           : source->block_line(name, bb->name);
+  }
+  return result != 0 ? result : source->function_line(name);
+}
+
+void Remarks::emit(Remark::Kind kind, const char *pass, const char *name,
+                   const koopa_raw_function_t &func, int line,
+                   const std::string &message) {
+  if (enabled()) {
+    remarks.push_back({kind, pass, name, get_label(func->name), line, message});
+  }
+}
+
+void Remarks::append(const std::vector<Remark> &other) {
+  remarks.insert(remarks.end(), other.begin(), other.end());
+}
+
+void write_remarks(std::ostream &os, const std::string &file,
+                   const std::vector<Remark> &remarks) {
+  for (const auto &remark : remarks) {
+    os << "--- " << kind_tag(remark.kind) << "\n";
+    os << "Pass:            " << remark.pass << "\n";
+    os << "Name:            " << remark.name << "\n";
+    if (remark.line != 0) {
+      os << "DebugLoc:        { File: " << quote(file)
+         << ", Line: " << remark.line << ", Column: 0 }\n";
+    }
+    os << "Function:        " << remark.function << "\n";
+    os << "Args:\n";
+    os << "  - String:          " << quote(remark.message) << "\n";
+    os << "...\n";
+  }
+}
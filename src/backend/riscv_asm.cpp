@@ -0,0 +1,250 @@
+// riscv_asm.cpp
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <unordered_map>
+
+#include "riscv_asm.h"
+
+namespace {
+std::string trim(const std::string &str) {
+  size_t begin = str.find_first_not_of(" \t");
+  if (begin == std::string::npos) {
+    return "";
+  }
+  size_t end = str.find_last_not_of(" \t");
+  return str.substr(begin, end - begin + 1);
+}
+
+const std::map<std::string, std::string> kInverseBranch = {
+    {"beq", "bne"},   {"bne", "beq"},   {"blt", "bge"},   {"bge", "blt"},
+    {"bltu", "bgeu"}, {"bgeu", "bltu"}, {"bgt", "ble"},   {"ble", "bgt"},
+    {"bgtu", "bleu"}, {"bleu", "bgtu"}, {"beqz", "bnez"}, {"bnez", "beqz"},
+    {"bltz", "bgez"}, {"bgez", "bltz"}, {"blez", "bgtz"}, {"bgtz", "blez"}};
+
+// 指令展开后的最大字节数: li/la/call 和按符号访存最多两条
+int max_size(const char *op, size_t len, const char *args, const char *end) {
+  switch (op[0]) {
+  case 'c':
+  case 't':
+    return len == 4 && (memcmp(op, "call", 4) == 0 || memcmp(op, "tail", 4) == 0)
+               ? 8
+               : 4;
+  case 'l':
+    if (len == 2 && (op[1] == 'i' || op[1] == 'a')) {
+      return 8;
+    }
+    if (len == 3 && memcmp(op, "lla", 3) == 0) {
+      return 8;
+    }
+    break;
+  case 's':
+    break;
+  default:
+    return 4;
+  }
+  // lb/lh/lw/lbu/lhu/sb/sh/sw 以符号为操作数时展开成两条
+  bool mem = (len == 2 && (op[1] == 'b' || op[1] == 'h' || op[1] == 'w')) ||
+             (len == 3 && op[0] == 'l' && op[2] == 'u' &&
+              (op[1] == 'b' || op[1] == 'h'));
+  return mem && memchr(args, '(', end - args) == nullptr ? 8 : 4;
+}
+
+// 一段代码 (从一个 .text 到下一个) 中的条件跳转放宽.
+// 这段代码的最大长度不超过跳转范围时原样输出
+void relax_chunk(const std::string &text, size_t begin, size_t end,
+                 int &counter, std::string &result) {
+  struct Line {
+    size_t begin;
+    size_t end;
+    int size;
+    // 条件跳转的目标所在的行, 没有时为 -1
+    int64_t target;
+  };
+  std::vector<Line> lines;
+  std::unordered_map<std::string, size_t> labels;
+  std::vector<std::pair<size_t, std::string>> branches;
+  int64_t total = 0;
+  const char *data = text.data();
+  for (size_t pos = begin; pos < end;) {
+    const char *nl = static_cast<const char *>(memchr(data + pos, '\n', end - pos));
+    size_t eol = nl == nullptr ? end : nl - data;
+    Line line = {pos, eol, 0, -1};
+    size_t first = pos;
+    while (first < eol && (data[first] == ' ' || data[first] == '\t')) {
+      ++first;
+    }
+    size_t last = eol;
+    while (last > first && (data[last - 1] == ' ' || data[last - 1] == '\t')) {
+      --last;
+    }
+    if (first < last && data[last - 1] == ':') {
+      labels[text.substr(first, last - 1 - first)] = lines.size();
+    } else if (first < last && data[first] != '.') {
+      size_t op_end = first;
+      while (op_end < last && data[op_end] != ' ' && data[op_end] != '\t') {
+        ++op_end;
+      }
+      line.size = max_size(data + first, op_end - first, data + op_end,
+                           data + last);
+      if (data[first] == 'b' &&
+          kInverseBranch.count(text.substr(first, op_end - first))) {
+        // 目标是最后一个操作数, 先记下名字, 所有标号收集完后再查
+        size_t comma = text.rfind(',', last);
+        if (comma != std::string::npos && comma > op_end) {
+          size_t name = text.find_first_not_of(" \t", comma + 1);
+          branches.push_back({lines.size(), text.substr(name, last - name)});
+        }
+      }
+      total += line.size;
+    }
+    lines.push_back(line);
+    pos = eol + 1;
+  }
+  if (total < 4096) {
+    result.append(text, begin, end - begin);
+    return;
+  }
+  for (const auto &branch : branches) {
+    auto target = labels.find(branch.second);
+    if (target != labels.end()) {
+      lines[branch.first].target = target->second;
+    }
+  }
+  // 改写会让代码变长, 反复估计直到没有新的超出范围的跳转
+  std::vector<bool> relaxed(lines.size(), false);
+  std::vector<int64_t> addr(lines.size());
+  bool changed = true;
+  bool any = false;
+  while (changed) {
+    changed = false;
+    int64_t pc = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+      addr[i] = pc;
+      pc += lines[i].size + (relaxed[i] ? 4 : 0);
+    }
+    for (const auto &branch : branches) {
+      size_t i = branch.first;
+      if (relaxed[i] || lines[i].target < 0) {
+        continue;
+      }
+      int64_t delta = addr[lines[i].target] - addr[i];
+      if (delta < -4096 || delta > 4094) {
+        relaxed[i] = true;
+        changed = any = true;
+      }
+    }
+  }
+  if (!any) {
+    result.append(text, begin, end - begin);
+    return;
+  }
+  for (size_t i = 0; i < lines.size(); ++i) {
+    const auto &line = lines[i];
+    if (!relaxed[i]) {
+      result.append(text, line.begin, line.end - line.begin);
+      if (line.end < end) {
+        result += '\n';
+      }
+      continue;
+    }
+    AsmLine inst =
+        parse_asm_line(text.substr(line.begin, line.end - line.begin));
+    std::string skip = ".Lrelax_" + std::to_string(counter++);
+    result += "  " + kInverseBranch.at(inst.op) + " ";
+    for (size_t j = 0; j + 1 < inst.args.size(); ++j) {
+      result += inst.args[j] + ", ";
+    }
+    result += skip + "\n";
+    result += "  j " + inst.args.back() + "\n";
+    result += skip + ":";
+    if (line.end < end) {
+      result += '\n';
+    }
+  }
+}
+} // namespace
+
+AsmLine parse_asm_line(const std::string &line) {
+  AsmLine result;
+  result.text = line;
+  std::string body = trim(line);
+  if (body.empty()) {
+    return result;
+  }
+  if (body.back() == ':') {
+    result.kind = AsmLine::Kind::LABEL;
+    result.op = body.substr(0, body.size() - 1);
+    return result;
+  }
+  size_t space = body.find_first_of(" \t");
+  result.op = body.substr(0, space);
+  result.kind = body[0] == '.' ? AsmLine::Kind::DIRECTIVE : AsmLine::Kind::INST;
+  if (space == std::string::npos) {
+    return result;
+  }
+  std::stringstream rest(body.substr(space + 1));
+  std::string arg;
+  while (std::getline(rest, arg, ',')) {
+    result.args.push_back(trim(arg));
+  }
+  return result;
+}
+
+std::vector<AsmLine> parse_asm(const std::string &asm_text) {
+  std::vector<AsmLine> lines;
+  std::stringstream ss(asm_text);
+  std::string line;
+  while (std::getline(ss, line)) {
+    lines.push_back(parse_asm_line(line));
+  }
+  return lines;
+}
+
+bool parse_mem_operand(const std::string &operand, int &offset,
+                       std::string &base) {
+  size_t lparen = operand.find('(');
+  size_t rparen = operand.find(')');
+  if (lparen == std::string::npos || rparen == std::string::npos ||
+      rparen < lparen) {
+    return false;
+  }
+  std::string off = operand.substr(0, lparen);
+  offset = off.empty() ? 0 : std::stoi(off);
+  base = operand.substr(lparen + 1, rparen - lparen - 1);
+  return true;
+}
+
+// 与 parse_asm_line 的分类一致, 但不拆出操作数
+size_t count_asm_insts(const std::string &asm_text) {
+  size_t count = 0;
+  size_t begin = 0;
+  while (begin < asm_text.size()) {
+    size_t end = asm_text.find('\n', begin);
+    if (end == std::string::npos) {
+      end = asm_text.size();
+    }
+    size_t first = asm_text.find_first_not_of(" \t", begin);
+    if (first < end && asm_text[first] != '.') {
+      size_t last = asm_text.find_last_not_of(" \t", end - 1);
+      count += asm_text[last] != ':';
+    }
+    begin = end + 1;
+  }
+  return count;
+}
+
+std::string relax_branches(const std::string &asm_text) {
+  std::string result;
+  result.reserve(asm_text.size());
+  int counter = 0;
+  // 按 .text 切分, 每个函数单独处理
+  size_t begin = 0;
+  while (begin < asm_text.size()) {
+    size_t next = asm_text.find("\n  .text\n", begin);
+    size_t end = next == std::string::npos ? asm_text.size() : next + 1;
+    relax_chunk(asm_text, begin, end, counter, result);
+    begin = end;
+  }
+  return result;
+}
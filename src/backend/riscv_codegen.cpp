@@ -1,13 +1,22 @@
 // riscv_codegen.cpp
+#include <chrono>
 #include <cstddef>
 #include <iostream>
+#include <set>
 #include <string>
 
+#include "block_placement.h"
+#include "cfg.h"
+#include "ir_util.h"
 #include "koopa.h"
+#include "liveness.h"
+#include "riscv_asm.h"
 #include "riscv_codegen.h"
+#include "type_table.h"
 #include "util.h"
 
-CodeGen::CodeGen(const std::string &koopa_ir) {
+CodeGen::CodeGen(const std::string &koopa_ir, const CodeGenOptions &options)
+    : options(options), passes(options.passes, options.latency) {
   push_addr_manager();
   push_stack_offset_manager();
   koopa_program_t program;
@@ -16,24 +25,69 @@ CodeGen::CodeGen(const std::string &koopa_ir) {
   builder = koopa_new_raw_program_builder();
   raw = koopa_build_raw_program(builder, program);
   koopa_delete_program(program);
+  passes.set_whole_program(options.whole_program);
+  if (options.source_map) {
+    passes.remarks().enable(options.source_map);
+  }
 }
 
-CodeGen::~CodeGen() { koopa_delete_raw_program_builder(builder); }
+CodeGen::~CodeGen() {
+  koopa_delete_raw_program_builder(builder);
+  TypeTable::getInstance().forget_raw_types();
+}
 
 std::string CodeGen::gererate() {
-  Visit(raw);
-  return oss.str();
+  passes.run_ir(raw);
+  if (passes.timing()) {
+    size_t insts = count_insts(raw);
+    auto begin = std::chrono::steady_clock::now();
+    Visit(raw);
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - begin;
+    passes.record("codegen", elapsed.count(), insts,
+                  count_asm_insts(oss.str()));
+  } else {
+    Visit(raw);
+  }
+  std::string result = passes.run_asm(oss.str());
+  if (options.collect_stats) {
+    count_asm_stats(result, func_stats);
+  }
+  return result;
 }
 
 // 访问 raw program
 void CodeGen::Visit(const koopa_raw_program_t &program) {
   // 执行一些其他的必要操作
-  oss << "  .data\n";
+  find_writable_globals(program);
   // 访问所有全局变量
-  Visit(program.values);
-  oss << "\n\n";
-  // 访问所有函数
-  Visit(program.funcs);
+  if (options.emit_globals) {
+    Visit(program.values);
+    oss << "\n\n";
+  }
+  // 访问所有函数. 有 profile 时没有执行过的函数放到代码段末尾
+  if (options.profile) {
+    for (bool hot : {true, false}) {
+      for (size_t i = 0; i < program.funcs.len; ++i) {
+        auto func =
+            reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+        if (options.profile->is_hot(func) == hot) {
+          Visit(func);
+        }
+      }
+    }
+  } else {
+    Visit(program.funcs);
+  }
+  if (options.profile_generate) {
+    bool has_main = false;
+    for (size_t i = 0; i < program.funcs.len; ++i) {
+      auto func =
+          reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+      has_main |= func->bbs.len != 0 && get_label(func->name) == "main";
+    }
+    EmitProfileRuntime(has_main);
+  }
 }
 
 // 访问 raw slice
@@ -67,20 +121,56 @@ void CodeGen::Visit(const koopa_raw_function_t &func) {
   if (func->bbs.len == 0) {
     return;
   }
+  cur_func = get_label(func->name);
+  cur_raw_func = func;
   oss << "  .text\n";
-  oss << "  .globl " << get_label(func->name) << "\n";
-  oss << get_label(func->name) << ":\n";
+  if (options.profile_generate && cur_func == "main") {
+    // 插桩时由生成的 main 调用原来的 main, 返回后写出计数
+    oss << ".Lprof_main:\n";
+  } else {
+    oss << "  .globl " << cur_func << "\n";
+    oss << cur_func << ":\n";
+  }
+  value_numbering.build(func);
   push_stack_offset_manager();
   push_addr_manager();
   AllocateStack(func);
-  modify_sp(-get_stack_offset_manager().final_stack_size, oss);
-  if (get_stack_offset_manager().r != 0) {
-    oss << "  li t6, " << get_stack_offset_manager().final_stack_size - 4
-        << "\n";
-    oss << "  add t6, sp, t6\n";
-    oss << "  sw ra, 0(t6)\n";
+  const Cfg &cfg = passes.analyses().cfg(func);
+  PlanFrame(func, cfg);
+  // 叶函数且没有栈上的值时不需要栈帧
+  if (get_stack_offset_manager().final_stack_size != 0) {
+    modify_sp(-get_stack_offset_manager().final_stack_size, oss);
+  }
+  // 按布局顺序生成基本块, 热路径尽量直接落入下一个块
+  const std::vector<uint32_t> *counts =
+      options.profile ? options.profile->find(func) : nullptr;
+  // 有恢复 ra 的 return 时, 尾声以恢复 ra 开始, 只有这些块能落入尾声
+  std::vector<bool> tail_returns;
+  if (counts != nullptr && frame.shared_epilogue) {
+    tail_returns.assign(cfg.size(), false);
+    for (size_t i = 0; i < cfg.size(); ++i) {
+      tail_returns[i] = cfg.ends_with_return(i) &&
+                        (frame.ra_restore_bbs.empty() ||
+                         frame.ra_restore_bbs.count(cfg.blocks[i]));
+    }
+  }
+  std::vector<koopa_raw_basic_block_t> bbs = cfg.blocks;
+  if (options.passes.block_placement) {
+    bbs = BlockPlacement(cfg, counts, std::move(tail_returns)).layout();
+  }
+  if (passes.remarks().enabled()) {
+    EmitLoopRemarks(func, cfg, bbs);
   }
-  Visit(func->bbs);
+  if (options.profile_generate) {
+    profiled_funcs.push_back({profile_hash(func), func->bbs.len});
+  }
+  for (size_t i = 0; i < bbs.size(); ++i) {
+    next_bb = i + 1 < bbs.size() ? bbs[i + 1] : nullptr;
+    cur_bb_counter = cfg.index(bbs[i]);
+    Visit(bbs[i]);
+  }
+  next_bb = nullptr;
+  EmitSharedEpilogue();
   pop_stack_offset_manager();
   pop_addr_manager();
   oss << "\n";
@@ -91,17 +181,179 @@ void CodeGen::Visit(const koopa_raw_basic_block_t &bb) {
   // 执行一些其他的必要操作
   // ...
   // 访问所有指令
-  std::string label = get_label(bb->name);
-  if (label != "entry") {
-    oss << label << ":\n";
+  if (get_label(bb->name) != "entry") {
+    oss << bb_label(bb) << ":\n";
+  }
+  cur_bb = bb;
+  if (options.profile_generate) {
+    EmitProfileCounter(cur_bb_counter);
+  }
+  if (bb == frame.ra_save_bb) {
+    emit_ra_access("sw");
+  }
+  for (size_t i = 0; i < bb->insts.len; ++i) {
+    auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i]);
+    // 比较结果只被紧随其后的 br 使用时, 直接融合成条件跳转
+    if (is_fused_with_branch(bb, i)) {
+      auto next = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[i + 1]);
+      cur_value = inst;
+      Visit(inst->kind.data.binary, next->kind.data.branch);
+      ++i;
+      continue;
+    }
+    Visit(inst);
   }
-  Visit(bb->insts);
+}
+
+// 每个循环的优化报告: 布局是否把循环的块排在一起, 以及循环中经由栈访问的值.
+// 后端没有寄存器分配, 局部变量和跨块活跃的值每次使用都要读写栈
+void CodeGen::EmitLoopRemarks(
+    const koopa_raw_function_t &func, const Cfg &cfg,
+    const std::vector<koopa_raw_basic_block_t> &layout) {
+  auto &remarks = passes.remarks();
+  const Liveness &liveness = passes.analyses().liveness(func);
+  for (const auto &loop : cfg.loops) {
+    const std::vector<bool> &body = loop.second;
+    int line = remarks.line(func, cfg.blocks[loop.first]);
+    if (options.passes.block_placement) {
+      // 布局中由循环的块组成的连续段数
+      int pieces = 0;
+      bool prev_in_loop = false;
+      for (auto bb : layout) {
+        bool in_loop = body[cfg.index(bb)];
+        pieces += in_loop && !prev_in_loop;
+        prev_in_loop = in_loop;
+      }
+      if (pieces == 1) {
+        remarks.emit(Remark::PASSED, "block-placement", "LoopContiguous", func,
+                     line, "loop blocks are laid out contiguously");
+      } else {
+        remarks.emit(Remark::MISSED, "block-placement", "LoopSplit", func,
+                     line,
+                     "loop blocks are split into " + std::to_string(pieces) +
+                         " pieces by the layout");
+      }
+    }
+    std::set<std::string> vars;
+    int loads = 0;
+    int stores = 0;
+    for (size_t i = 0; i < cfg.size(); ++i) {
+      if (!body[i]) {
+        continue;
+      }
+      auto bb = cfg.blocks[i];
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+        const auto &kind = inst->kind;
+        if (kind.tag == KOOPA_RVT_LOAD &&
+            kind.data.load.src->kind.tag == KOOPA_RVT_ALLOC) {
+          vars.insert(get_label(kind.data.load.src->name));
+          ++loads;
+        } else if (kind.tag == KOOPA_RVT_STORE &&
+                   kind.data.store.dest->kind.tag == KOOPA_RVT_ALLOC) {
+          vars.insert(get_label(kind.data.store.dest->name));
+          ++stores;
+        }
+      }
+    }
+    // 在循环头入口活跃的值来自循环外或上一次迭代, 每次使用都从栈上读取
+    size_t live = liveness.live_in(loop.first).size();
+    if (vars.empty() && live == 0) {
+      continue;
+    }
+    std::string message;
+    if (!vars.empty()) {
+      std::string names;
+      for (const auto &var : vars) {
+        names += (names.empty() ? "" : ", ") + var;
+      }
+      message = std::to_string(vars.size()) + " variables (" + names +
+                ") stay in stack slots, loads: " + std::to_string(loads) +
+                ", stores: " + std::to_string(stores);
+    }
+    if (live != 0) {
+      message += (message.empty() ? "" : "; ") + std::to_string(live) +
+                 " values live across iterations are reloaded from the stack";
+    }
+    remarks.emit(Remark::MISSED, "codegen", "LoopValuesOnStack", func, line,
+                 message);
+  }
+}
+
+// 计数器加一. 基本块入口处 t5/t6 不保存任何值
+void CodeGen::EmitProfileCounter(int index) {
+  int offset = index * 4;
+  oss << "  la t6, .Lprof_" << profiled_funcs.size() - 1 << "\n";
+  if (offset > 2047) {
+    oss << "  li t5, " << offset << "\n";
+    oss << "  add t6, t6, t5\n";
+    offset = 0;
+  }
+  oss << "  lw t5, " << offset << "(t6)\n";
+  oss << "  addi t5, t5, 1\n";
+  oss << "  sw t5, " << offset << "(t6)\n";
+}
+
+// 插桩程序的计数数据和新的 main: 调用原来的 main, 然后用
+// fopen/fwrite/fclose 按 Profile 的格式写出计数, 返回原来的返回值
+void CodeGen::EmitProfileRuntime(bool has_main) {
+  oss << "  .data\n";
+  oss << "  .align 2\n";
+  oss << ".Lprof_data:\n";
+  oss << "  .word " << (int32_t)Profile::kMagic << ", " << profiled_funcs.size()
+      << "\n";
+  size_t words = 2;
+  for (size_t i = 0; i < profiled_funcs.size(); ++i) {
+    const auto &func = profiled_funcs[i];
+    oss << "  .word " << (int32_t)func.first << ", " << func.second << "\n";
+    oss << ".Lprof_" << i << ":\n";
+    oss << "  .zero " << func.second * 4 << "\n";
+    words += 2 + func.second;
+  }
+  oss << ".Lprof_path:\n";
+  oss << "  .byte ";
+  for (char c : options.profile_path) {
+    oss << (int)(unsigned char)c << ", ";
+  }
+  oss << "0\n";
+  oss << ".Lprof_mode:\n";
+  oss << "  .byte " << (int)'w' << ", " << (int)'b' << ", 0\n";
+  oss << "\n";
+  if (!has_main) {
+    return;
+  }
+  oss << "  .text\n";
+  oss << "  .globl main\n";
+  oss << "main:\n";
+  oss << "  addi sp, sp, -16\n";
+  oss << "  sw ra, 12(sp)\n";
+  oss << "  call .Lprof_main\n";
+  oss << "  sw a0, 8(sp)\n";
+  oss << "  la a0, .Lprof_path\n";
+  oss << "  la a1, .Lprof_mode\n";
+  oss << "  call fopen\n";
+  oss << "  beqz a0, .Lprof_done\n";
+  oss << "  sw a0, 4(sp)\n";
+  oss << "  mv a3, a0\n";
+  oss << "  la a0, .Lprof_data\n";
+  oss << "  li a1, 4\n";
+  oss << "  li a2, " << words << "\n";
+  oss << "  call fwrite\n";
+  oss << "  lw a0, 4(sp)\n";
+  oss << "  call fclose\n";
+  oss << ".Lprof_done:\n";
+  oss << "  lw a0, 8(sp)\n";
+  oss << "  lw ra, 12(sp)\n";
+  oss << "  addi sp, sp, 16\n";
+  oss << "  ret\n";
+  oss << "\n";
 }
 
 // 访问指令
 void CodeGen::Visit(const koopa_raw_value_t &value) {
   // 根据指令类型判断后续需要如何访问
   const auto &kind = value->kind;
+  cur_value = value;
   switch (kind.tag) {
   case KOOPA_RVT_RETURN:
     // 访问 return 指令
@@ -140,7 +392,7 @@ void CodeGen::Visit(const koopa_raw_value_t &value) {
     break;
   case KOOPA_RVT_GLOBAL_ALLOC:
     // 访问 global_alloc 指令
-    Visit(kind.data.global_alloc, value->name);
+    Visit(kind.data.global_alloc, value);
     break;
   case KOOPA_RVT_GET_ELEM_PTR:
     // 访问 get_elem_ptr 指令
@@ -159,17 +411,8 @@ void CodeGen::Visit(const koopa_raw_value_t &value) {
 
 void CodeGen::Visit(const koopa_raw_return_t &ret) {
   if (ret.value == nullptr) {
-    if (get_stack_offset_manager().r != 0) {
-      oss << "  li t6, " << get_stack_offset_manager().final_stack_size - 4
-          << "\n";
-      oss << "  add t6, sp, t6\n";
-      oss << "  lw ra, 0(t6)\n";
-    }
-    modify_sp(get_stack_offset_manager().final_stack_size, oss);
-    oss << "  ret\n";
-    return;
-  }
-  if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
+    // 无返回值
+  } else if (ret.value->kind.tag == KOOPA_RVT_INTEGER) {
     oss << "  li a0, " << get_value(ret.value) << "\n";
   } else if (ret.value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     oss << "  la a0, " << get_label(ret.value->name) << "\n";
@@ -180,16 +423,152 @@ void CodeGen::Visit(const koopa_raw_return_t &ret) {
     oss << "  add t6, sp, t6\n";
     oss << "  lw a0, 0(t6)\n";
   }
-  if (get_stack_offset_manager().r != 0) {
-    oss << "  li t6, " << get_stack_offset_manager().final_stack_size - 4
-        << "\n";
-    oss << "  add t6, sp, t6\n";
-    oss << "  lw ra, 0(t6)\n";
+  bool restore_ra = frame.ra_restore_bbs.count(cur_bb) != 0;
+  if (!frame.shared_epilogue) {
+    EmitEpilogue(restore_ra);
+    return;
+  }
+  // 多个 return 共用函数末尾的尾声, 最后一个块直接落入
+  std::string target = restore_ra ? frame.epilogue_ra_label
+                                  : frame.epilogue_label;
+  bool falls_through =
+      next_bb == nullptr && target == (frame.epilogue_ra_used
+                                           ? frame.epilogue_ra_label
+                                           : frame.epilogue_label);
+  if (!falls_through) {
+    oss << "  j " << target << "\n";
+  }
+}
+
+void CodeGen::EmitEpilogue(bool restore_ra) {
+  if (restore_ra) {
+    emit_ra_access("lw");
+  }
+  if (get_stack_offset_manager().final_stack_size != 0) {
+    modify_sp(get_stack_offset_manager().final_stack_size, oss);
   }
-  modify_sp(get_stack_offset_manager().final_stack_size, oss);
   oss << "  ret\n";
 }
 
+void CodeGen::EmitSharedEpilogue() {
+  if (!frame.shared_epilogue) {
+    return;
+  }
+  if (frame.epilogue_ra_used) {
+    oss << frame.epilogue_ra_label << ":\n";
+    emit_ra_access("lw");
+  }
+  if (frame.epilogue_used) {
+    oss << frame.epilogue_label << ":\n";
+  }
+  EmitEpilogue(false);
+}
+
+// ra 存放在栈帧顶部, 偏移能放进立即数时直接用 sp 寻址
+void CodeGen::emit_ra_access(const std::string &op) {
+  int offset = get_stack_offset_manager().final_stack_size - 4;
+  if (offset >= -2048 && offset <= 2047) {
+    oss << "  " << op << " ra, " << offset << "(sp)\n";
+    return;
+  }
+  oss << "  li t6, " << offset << "\n";
+  oss << "  add t6, sp, t6\n";
+  oss << "  " << op << " ra, 0(t6)\n";
+}
+
+// 决定 ra 的保存位置和各个 return 是否需要恢复 ra, 以及是否共用尾声.
+// ra 保存在所有 call 所在块的最近公共支配者中 (并提到循环外);
+// 被它支配的 return 恢复 ra, 从它不可达的 return 不需要恢复.
+// 其余情况退回到在入口保存
+void CodeGen::PlanFrame(const koopa_raw_function_t &func, const Cfg &cfg) {
+  frame = FramePlan();
+  std::string name = get_label(func->name);
+  frame.epilogue_label = ".L" + name + "_epilogue";
+  frame.epilogue_ra_label = ".L" + name + "_epilogue_ra";
+
+  std::vector<size_t> returns;
+  size_t save = cfg.size();
+  bool call_in_entry = false;
+  for (size_t i = 0; i < cfg.size(); ++i) {
+    auto bb = cfg.blocks[i];
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      if (inst->kind.tag == KOOPA_RVT_RETURN) {
+        returns.push_back(i);
+      }
+      if (inst->kind.tag == KOOPA_RVT_CALL && cfg.reachable[i]) {
+        save = save == cfg.size() ? i : cfg.common_dominator(save, i);
+        call_in_entry |= i == 0;
+      }
+    }
+  }
+  if (get_stack_offset_manager().r != 0) {
+    // 退回到入口保存的原因, 用于优化报告
+    const char *missed = nullptr;
+    // 不做 shrink-wrap 时总在入口保存
+    if (save == cfg.size() || !options.passes.shrink_wrap) {
+      save = 0;
+    } else if (save == 0 && !call_in_entry) {
+      missed = "the calls have no common dominator other than the entry";
+    }
+    while (save != 0 && cfg.in_any_loop(save)) {
+      save = cfg.idom[save];
+      if (save == 0) {
+        missed = "hoisting the save out of the loop around the calls "
+                 "reaches the entry";
+      }
+    }
+    std::vector<bool> after_save(cfg.size(), false);
+    std::vector<size_t> worklist = {save};
+    while (!worklist.empty()) {
+      size_t bb = worklist.back();
+      worklist.pop_back();
+      if (after_save[bb]) {
+        continue;
+      }
+      after_save[bb] = true;
+      for (size_t succ : cfg.succs[bb]) {
+        worklist.push_back(succ);
+      }
+    }
+    for (size_t ret : returns) {
+      if (after_save[ret] && !cfg.dominates(save, ret)) {
+        save = 0;
+        missed = "a return reachable from the save point is not dominated "
+                 "by it";
+        break;
+      }
+    }
+    auto &remarks = passes.remarks();
+    if (remarks.enabled() && save != 0) {
+      remarks.emit(Remark::PASSED, "shrink-wrap", "ShrinkWrapped", func,
+                   remarks.line(func, cfg.blocks[save]),
+                   "ra is saved only on paths that reach a call");
+    } else if (remarks.enabled() && missed != nullptr) {
+      remarks.emit(Remark::MISSED, "shrink-wrap", "NotShrinkWrapped", func,
+                   remarks.line(func),
+                   std::string("ra is saved in the entry block: ") + missed);
+    }
+    frame.ra_save_bb = cfg.blocks[save];
+    for (size_t ret : returns) {
+      if (cfg.dominates(save, ret)) {
+        frame.ra_restore_bbs.insert(cfg.blocks[ret]);
+      }
+    }
+  }
+
+  // 没有栈帧时尾声只有一条 ret, 不值得共用
+  frame.shared_epilogue =
+      returns.size() > 1 && get_stack_offset_manager().final_stack_size != 0;
+  for (size_t ret : returns) {
+    if (frame.ra_restore_bbs.count(cfg.blocks[ret])) {
+      frame.epilogue_ra_used = true;
+    } else {
+      frame.epilogue_used = true;
+    }
+  }
+}
+
 // return int32_t value of koopa_raw_value_t
 int32_t CodeGen::get_value(const koopa_raw_value_t val) {
   return val->kind.data.integer.value;
@@ -197,13 +576,27 @@ int32_t CodeGen::get_value(const koopa_raw_value_t val) {
 
 void CodeGen::Visit(const koopa_raw_integer_t &i32) { oss << i32.value; }
 
+static bool is_compare_op(koopa_raw_binary_op_t op) {
+  switch (op) {
+  case KOOPA_RBO_EQ:
+  case KOOPA_RBO_NOT_EQ:
+  case KOOPA_RBO_LT:
+  case KOOPA_RBO_GT:
+  case KOOPA_RBO_LE:
+  case KOOPA_RBO_GE:
+    return true;
+  default:
+    return false;
+  }
+}
+
 void CodeGen::Visit(const koopa_raw_binary_t &binary) {
   auto &addr_manager = get_addr_manager();
-  std::string lhs_addr = addr_manager.getAddr(binary.lhs);
-  std::string rhs_addr = addr_manager.getAddr(binary.rhs);
+  Reg lhs_addr = addr_manager.getAddr(binary.lhs);
+  Reg rhs_addr = addr_manager.getAddr(binary.rhs);
   cmd_li(binary.lhs, lhs_addr);
   cmd_li(binary.rhs, rhs_addr);
-  std::string res_addr = addr_manager.getAddr(binary);
+  Reg res_addr = addr_manager.getAddr(cur_value);
 
   switch (binary.op) {
   case KOOPA_RBO_SUB:
@@ -253,13 +646,14 @@ void CodeGen::Visit(const koopa_raw_binary_t &binary) {
     std::cerr << "Unknown binary operation: " << binary.op << std::endl;
     assert(false);
   }
-  oss << "  li t6, " << get_stack_offset_manager().getOffset(binary) << "\n";
+  oss << "  li t6, " << get_stack_offset_manager().getOffset(cur_value)
+      << "\n";
   oss << "  add t6, sp, t6\n";
   oss << "  sw " << res_addr << ", 0(t6)\n";
   addr_manager.freeReg(res_addr);
   addr_manager.freeReg(lhs_addr);
   addr_manager.freeReg(rhs_addr);
-  addr_manager.freeId(binary);
+  addr_manager.freeId(cur_value);
   addr_manager.freeId(binary.lhs);
   addr_manager.freeId(binary.rhs);
 }
@@ -267,12 +661,11 @@ void CodeGen::Visit(const koopa_raw_binary_t &binary) {
 void CodeGen::Visit(const koopa_raw_load_t &load) {
   auto &stack_offset_manager = get_stack_offset_manager();
   auto &addr_manager = get_addr_manager();
-  std::string res_addr = addr_manager.getAddr(load);
+  Reg res_addr = addr_manager.getAddr(cur_value);
   if (load.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     oss << "  lw " << res_addr << ", " << get_label(load.src->name) << "\n";
   } else if (load.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
-    int src_offset =
-        stack_offset_manager.getOffset(load.src->kind.data.get_elem_ptr);
+    int src_offset = stack_offset_manager.getOffset(load.src);
     oss << "  li t6, " << src_offset << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
@@ -284,64 +677,129 @@ void CodeGen::Visit(const koopa_raw_load_t &load) {
     oss << "  lw " << res_addr << ", 0(t6)\n";
     oss << "  lw " << res_addr << ", 0(" << res_addr << ")\n";
   } else {
-    int src_offset = stack_offset_manager.getOffset(load.src->name);
+    int src_offset = stack_offset_manager.getOffset(load.src);
     oss << "  li t6, " << src_offset << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
   }
-  oss << "  li t5, " << stack_offset_manager.getOffset(load) << "\n";
+  oss << "  li t5, " << stack_offset_manager.getOffset(cur_value) << "\n";
   oss << "  add t5, sp, t5\n";
   oss << "  sw " << res_addr << ", 0(t5)\n";
   addr_manager.freeReg(res_addr);
-  addr_manager.freeId(load);
+  addr_manager.freeId(cur_value);
 }
 
-int CodeGen::store_aggregate(const koopa_raw_value_t &value, int dest_offset) {
-  auto agg = value->kind.data.aggregate;
-  for (int i = 0; i < agg.elems.len; ++i) {
-    auto elem = reinterpret_cast<koopa_raw_value_t>(agg.elems.buffer[i]);
-    if (elem->kind.tag == KOOPA_RVT_INTEGER) {
-      oss << "  li t6, " << dest_offset << "\n";
+// 局部数组初始化: 零比非零元素多时先用循环批量清零, 再只写非零元素;
+// 否则逐个写入所有元素. 这样代码量只随非零元素个数增长
+void CodeGen::store_aggregate(const koopa_raw_value_t &value, int dest_offset) {
+  std::vector<std::pair<int, int>> words;
+  collect_nonzero_words(value, 0, words);
+  int size = get_elem_size(value->ty);
+  int zero_words = size / 4 - (int)words.size();
+  int base = -1;
+  auto store_word = [&](int offset, int word) {
+    std::string reg = "x0";
+    if (word != 0) {
+      oss << "  li t5, " << word << "\n";
+      reg = "t5";
+    }
+    int addr = dest_offset + offset;
+    if (addr <= 2047) {
+      oss << "  sw " << reg << ", " << addr << "(sp)\n";
+      return;
+    }
+    if (base < 0 || addr - base > 2047) {
+      oss << "  li t6, " << addr << "\n";
       oss << "  add t6, sp, t6\n";
-      oss << "  li t5, " << get_value(elem) << "\n";
-      oss << "  sw t5, 0(t6)\n";
-      dest_offset += 4;
-    } else if (elem->kind.tag == KOOPA_RVT_BINARY) {
-      get_addr_manager().freeId(elem);
-      dest_offset += 4;
-    } else if (elem->kind.tag == KOOPA_RVT_AGGREGATE) {
-      dest_offset = store_aggregate(elem, dest_offset);
+      base = addr;
+    }
+    oss << "  sw " << reg << ", " << addr - base << "(t6)\n";
+  };
+  if (zero_words > (int)words.size()) {
+    emit_zero_fill(dest_offset, size);
+    for (const auto &word : words) {
+      store_word(word.first, word.second);
+    }
+    return;
+  }
+  size_t idx = 0;
+  for (int offset = 0; offset < size; offset += 4) {
+    if (idx < words.size() && words[idx].first == offset) {
+      store_word(offset, words[idx++].second);
     } else {
-      assert(false);
+      store_word(offset, 0);
     }
   }
-  return dest_offset;
+}
+
+// 按字节偏移递增的顺序收集聚合值中的非零元素
+void CodeGen::collect_nonzero_words(const koopa_raw_value_t &value, int offset,
+                                    std::vector<std::pair<int, int>> &words) {
+  if (value->kind.tag == KOOPA_RVT_ZERO_INIT) {
+    return;
+  }
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    if (get_value(value) != 0) {
+      words.push_back({offset, get_value(value)});
+    }
+    return;
+  }
+  assert(value->kind.tag == KOOPA_RVT_AGGREGATE);
+  auto agg = value->kind.data.aggregate;
+  int elem_size = get_elem_size(value->ty->data.array.base);
+  for (size_t i = 0; i < agg.elems.len; ++i) {
+    auto elem = reinterpret_cast<koopa_raw_value_t>(agg.elems.buffer[i]);
+    collect_nonzero_words(elem, offset + (int)i * elem_size, words);
+  }
+}
+
+// 基本块标签带上函数名, 这样每个函数的汇编互不冲突, 可以单独缓存复用
+std::string CodeGen::bb_label(const koopa_raw_basic_block_t &bb) {
+  return ".L" + cur_func + "." + get_label(bb->name);
+}
+
+// 用循环把 [sp + offset, sp + offset + size) 清零, 每次迭代写 4 个字
+void CodeGen::emit_zero_fill(int offset, int size) {
+  oss << "  li t6, " << offset << "\n";
+  oss << "  add t6, sp, t6\n";
+  int loop_size = size / 16 * 16;
+  if (loop_size > 0) {
+    std::string label =
+        ".L" + cur_func + ".zero_fill_" + std::to_string(zero_fill_counter++);
+    oss << "  li t5, " << loop_size << "\n";
+    oss << "  add t5, t6, t5\n";
+    oss << label << ":\n";
+    for (int i = 0; i < 16; i += 4) {
+      oss << "  sw x0, " << i << "(t6)\n";
+    }
+    oss << "  addi t6, t6, 16\n";
+    oss << "  bltu t6, t5, " << label << "\n";
+  }
+  for (int i = loop_size; i < size; i += 4) {
+    oss << "  sw x0, " << i - loop_size << "(t6)\n";
+  }
 }
 
 void CodeGen::Visit(const koopa_raw_store_t &store) {
-  if (store.value->kind.tag == KOOPA_RVT_AGGREGATE) {
-    auto dest_offset = get_stack_offset_manager().getOffset(store.dest->name);
+  if (store.value->kind.tag == KOOPA_RVT_AGGREGATE ||
+      store.value->kind.tag == KOOPA_RVT_ZERO_INIT) {
+    auto dest_offset = get_stack_offset_manager().getOffset(store.dest);
     store_aggregate(store.value, dest_offset);
     return;
   }
 
-  std::string val_addr = get_addr_manager().getAddr(store.value);
+  Reg val_addr = get_addr_manager().getAddr(store.value);
   cmd_li(store.value, val_addr);
 
-  std::string dest_name = "";
   std::string dest_str = "";
-  if (store.dest->name != nullptr) {
-    dest_name = store.dest->name;
-  }
   if (store.dest->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
-    std::string tmp_reg = get_addr_manager().getAddr(store);
+    Reg tmp_reg = get_addr_manager().getAddr(cur_value);
     oss << "  la " << tmp_reg << ", " << get_label(store.dest->name) << "\n";
-    dest_str = "0(" + tmp_reg + ")";
+    dest_str = std::string("0(") + reg_name(tmp_reg) + ")";
     get_addr_manager().freeReg(tmp_reg);
-    get_addr_manager().freeId(store.dest);
+    get_addr_manager().freeId(cur_value);
   } else if (store.dest->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
-    int dest_offset = get_stack_offset_manager().getOffset(
-        store.dest->kind.data.get_elem_ptr);
+    int dest_offset = get_stack_offset_manager().getOffset(store.dest);
     oss << "  li t6, " << dest_offset << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw t6, 0(t6)\n";
@@ -353,7 +811,7 @@ void CodeGen::Visit(const koopa_raw_store_t &store) {
     oss << "  lw t6, 0(t6)\n";
     dest_str = "0(t6)";
   } else {
-    int dest_offset = get_stack_offset_manager().getOffset(dest_name);
+    int dest_offset = get_stack_offset_manager().getOffset(store.dest);
     oss << "  li t6, " << dest_offset << "\n";
     oss << "  add t6, sp, t6\n";
     dest_str = "0(t6)";
@@ -366,18 +824,129 @@ void CodeGen::Visit(const koopa_raw_store_t &store) {
 }
 
 void CodeGen::Visit(const koopa_raw_branch_t &branch) {
+  // 融合的比较不走这里; 条件是比较时说明没能融合
+  auto &remarks = passes.remarks();
+  const auto &cond = branch.cond;
+  if (remarks.enabled() && options.passes.fuse_branch &&
+      cond->kind.tag == KOOPA_RVT_BINARY &&
+      is_compare_op(cond->kind.data.binary.op)) {
+    remarks.emit(Remark::MISSED, "fuse-branch", "CompareNotFused",
+                 cur_raw_func, remarks.line(cur_raw_func, cur_bb, cond),
+                 cond->used_by.len != 1
+                     ? "compare result has other uses and is kept in a stack "
+                       "slot"
+                     : "compare is not immediately before the branch");
+  }
   auto &addr_manager = get_addr_manager();
-  std::string cond_addr = addr_manager.getAddr(branch.cond);
+  Reg cond_addr = addr_manager.getAddr(branch.cond);
   cmd_li(branch.cond, cond_addr);
-  oss << "  bnez " << cond_addr << ", " << get_label(branch.true_bb->name)
-      << "\n";
-  oss << "  j " << get_label(branch.false_bb->name) << "\n";
+  emit_branch(KOOPA_RBO_NOT_EQ, cond_addr, Reg::X0, branch.true_bb,
+              branch.false_bb);
   addr_manager.freeReg(cond_addr);
   addr_manager.freeId(branch.cond);
 }
 
+// 融合 比较 + br: 不再把布尔值写回栈, 直接用 blt/bge/beq/bne 等跳转
+void CodeGen::Visit(const koopa_raw_binary_t &cmp,
+                    const koopa_raw_branch_t &branch) {
+  auto &addr_manager = get_addr_manager();
+  Reg lhs_addr = addr_manager.getAddr(cmp.lhs);
+  Reg rhs_addr = addr_manager.getAddr(cmp.rhs);
+  cmd_li(cmp.lhs, lhs_addr);
+  cmd_li(cmp.rhs, rhs_addr);
+  emit_branch(cmp.op, lhs_addr, rhs_addr, branch.true_bb, branch.false_bb);
+  addr_manager.freeReg(lhs_addr);
+  addr_manager.freeReg(rhs_addr);
+  addr_manager.freeId(cmp.lhs);
+  addr_manager.freeId(cmp.rhs);
+}
+
 void CodeGen::Visit(const koopa_raw_jump_t &jump) {
-  oss << "  j " << get_label(jump.target->name) << "\n";
+  // 目标就是下一个基本块时直接落入, 不需要跳转
+  if (jump.target == next_bb) {
+    return;
+  }
+  oss << "  j " << bb_label(jump.target) << "\n";
+}
+
+bool CodeGen::is_fused_with_branch(const koopa_raw_basic_block_t &bb,
+                                   size_t idx) {
+  if (!options.passes.fuse_branch || idx + 1 >= bb->insts.len) {
+    return false;
+  }
+  auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[idx]);
+  auto next = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[idx + 1]);
+  return is_fusible_compare(inst) && next->kind.tag == KOOPA_RVT_BRANCH &&
+         next->kind.data.branch.cond == inst;
+}
+
+bool CodeGen::is_fusible_compare(const koopa_raw_value_t &value) {
+  return value->kind.tag == KOOPA_RVT_BINARY && value->used_by.len == 1 &&
+         is_compare_op(value->kind.data.binary.op);
+}
+
+// 根据下一个基本块选择跳转方向: 能落入哪个分支就只跳另一个
+void CodeGen::emit_branch(koopa_raw_binary_op_t op, Reg lhs, Reg rhs,
+                          koopa_raw_basic_block_t true_bb,
+                          koopa_raw_basic_block_t false_bb) {
+  if (true_bb == next_bb) {
+    std::swap(true_bb, false_bb);
+    op = invert_compare(op);
+  }
+  const char *mnemonic = nullptr;
+  switch (op) {
+  case KOOPA_RBO_EQ:
+    mnemonic = "beq";
+    break;
+  case KOOPA_RBO_NOT_EQ:
+    mnemonic = "bne";
+    break;
+  case KOOPA_RBO_LT:
+    mnemonic = "blt";
+    break;
+  case KOOPA_RBO_GT:
+    mnemonic = "bgt";
+    break;
+  case KOOPA_RBO_LE:
+    mnemonic = "ble";
+    break;
+  case KOOPA_RBO_GE:
+    mnemonic = "bge";
+    break;
+  default:
+    std::cerr << "Unknown compare operation: " << op << std::endl;
+    assert(false);
+  }
+  if (rhs == Reg::X0 && (op == KOOPA_RBO_EQ || op == KOOPA_RBO_NOT_EQ)) {
+    oss << "  " << mnemonic << "z " << lhs << ", "
+        << bb_label(true_bb) << "\n";
+  } else {
+    oss << "  " << mnemonic << " " << lhs << ", " << rhs << ", "
+        << bb_label(true_bb) << "\n";
+  }
+  if (false_bb != next_bb) {
+    oss << "  j " << bb_label(false_bb) << "\n";
+  }
+}
+
+koopa_raw_binary_op_t CodeGen::invert_compare(koopa_raw_binary_op_t op) {
+  switch (op) {
+  case KOOPA_RBO_EQ:
+    return KOOPA_RBO_NOT_EQ;
+  case KOOPA_RBO_NOT_EQ:
+    return KOOPA_RBO_EQ;
+  case KOOPA_RBO_LT:
+    return KOOPA_RBO_GE;
+  case KOOPA_RBO_GE:
+    return KOOPA_RBO_LT;
+  case KOOPA_RBO_GT:
+    return KOOPA_RBO_LE;
+  case KOOPA_RBO_LE:
+    return KOOPA_RBO_GT;
+  default:
+    assert(false);
+  }
+  return op;
 }
 
 void CodeGen::Visit(const koopa_raw_call_t &call) {
@@ -386,17 +955,15 @@ void CodeGen::Visit(const koopa_raw_call_t &call) {
     auto arg = reinterpret_cast<koopa_raw_value_t>(ptr);
     if (i <= 7) {
       if (arg->kind.tag == KOOPA_RVT_INTEGER) {
-        oss << "  li " << "a" + std::to_string(i) << ", " << get_value(arg)
-            << "\n";
+        oss << "  li " << arg_reg(i) << ", " << get_value(arg) << "\n";
       } else {
         int offset = get_stack_offset_manager().getOffset(arg);
         oss << "  li t6, " << offset << "\n";
         oss << "  add t6, sp, t6\n";
-        oss << "  lw " << "a" + std::to_string(i) << ", 0(t6)\n";
-        std::string arg_addr = get_addr_manager().getAddr(arg);
+        oss << "  lw " << arg_reg(i) << ", 0(t6)\n";
       }
     } else {
-      std::string arg_addr = get_addr_manager().getAddr(arg);
+      Reg arg_addr = get_addr_manager().getAddr(arg);
       if (arg->kind.tag == KOOPA_RVT_INTEGER) {
         // 立即数参数
         cmd_li(arg, arg_addr);
@@ -418,101 +985,177 @@ void CodeGen::Visit(const koopa_raw_call_t &call) {
   }
   oss << "  call " << get_label(call.callee->name) << "\n";
   if (call.callee->ty->data.function.ret->tag != KOOPA_RTT_UNIT) {
-    oss << "  li t6, " << get_stack_offset_manager().getOffset(call) << "\n";
+    oss << "  li t6, " << get_stack_offset_manager().getOffset(cur_value)
+        << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  sw a0, 0(t6)\n";
   }
 }
 
+// 输出初始化数据, 连续的 0 合并成一条 .zero, 由 flush_zero 在遇到非零值时输出
 void CodeGen::alloc_aggregate(const koopa_raw_value_t &value) {
+  if (value->kind.tag == KOOPA_RVT_ZERO_INIT) {
+    pending_zero_bytes += get_elem_size(value->ty);
+    return;
+  }
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    if (get_value(value) == 0) {
+      pending_zero_bytes += 4;
+      return;
+    }
+    flush_zero();
+    oss << "  .word " << get_value(value) << "\n";
+    return;
+  }
+  assert(value->kind.tag == KOOPA_RVT_AGGREGATE);
   auto agg = value->kind.data.aggregate;
   auto len = value->ty->data.array.len;
   for (int i = 0; i < len; ++i) {
     if (i < agg.elems.len) {
-      auto elem = reinterpret_cast<koopa_raw_value_t>(agg.elems.buffer[i]);
-      if (elem->kind.tag == KOOPA_RVT_INTEGER) {
-        oss << "  .word " << get_value(elem) << "\n";
-      } else if (elem->kind.tag == KOOPA_RVT_ZERO_INIT) {
-        oss << "  .zero 4\n";
-      } else if (elem->kind.tag == KOOPA_RVT_AGGREGATE) {
-        alloc_aggregate(elem);
-      } else {
-        assert(false);
-      }
+      alloc_aggregate(reinterpret_cast<koopa_raw_value_t>(agg.elems.buffer[i]));
     } else {
-      oss << "  .zero 4\n";
+      pending_zero_bytes += get_elem_size(value->ty->data.array.base);
+    }
+  }
+}
+
+void CodeGen::flush_zero() {
+  if (pending_zero_bytes != 0) {
+    oss << "  .zero " << pending_zero_bytes << "\n";
+    pending_zero_bytes = 0;
+  }
+}
+
+bool CodeGen::is_zero_init(const koopa_raw_value_t &value) {
+  if (value->kind.tag == KOOPA_RVT_ZERO_INIT) {
+    return true;
+  }
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    return get_value(value) == 0;
+  }
+  if (value->kind.tag == KOOPA_RVT_AGGREGATE) {
+    auto agg = value->kind.data.aggregate;
+    for (size_t i = 0; i < agg.elems.len; ++i) {
+      if (!is_zero_init(
+              reinterpret_cast<koopa_raw_value_t>(agg.elems.buffer[i]))) {
+        return false;
+      }
     }
+    return true;
   }
+  return false;
 }
 
+// 沿 getelemptr/getptr 找到指针最终指向的全局变量
+static koopa_raw_value_t root_global(koopa_raw_value_t value) {
+  while (value->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
+         value->kind.tag == KOOPA_RVT_GET_PTR) {
+    value = value->kind.tag == KOOPA_RVT_GET_ELEM_PTR
+                ? value->kind.data.get_elem_ptr.src
+                : value->kind.data.get_ptr.src;
+  }
+  return value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC ? value : nullptr;
+}
+
+// 找出可能被写的全局变量: 作为 store 的目标, 或者地址被传给函数/存到内存里.
+// 其余全局变量是只读的, 可以放进 .rodata
+// 不在本次 IR 中的函数 (缓存命中) 写的全局变量由 options 按名字给出
+void CodeGen::find_writable_globals(const koopa_raw_program_t &program) {
+  writable_globals.clear();
+  func_written_globals.clear();
+  for (size_t i = 0; i < program.values.len; ++i) {
+    auto value = reinterpret_cast<koopa_raw_value_t>(program.values.buffer[i]);
+    if (options.writable_globals.count(get_label(value->name))) {
+      writable_globals.insert(value);
+    }
+  }
+  std::set<std::string> *written = nullptr;
+  auto mark = [&](koopa_raw_value_t value) {
+    if (auto global = root_global(value)) {
+      writable_globals.insert(global);
+      written->insert(get_label(global->name));
+    }
+  };
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    written = &func_written_globals[get_label(func->name)];
+    for (size_t j = 0; j < func->bbs.len; ++j) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+      for (size_t k = 0; k < bb->insts.len; ++k) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[k]);
+        if (inst->kind.tag == KOOPA_RVT_STORE) {
+          mark(inst->kind.data.store.dest);
+          mark(inst->kind.data.store.value);
+        } else if (inst->kind.tag == KOOPA_RVT_CALL) {
+          auto args = inst->kind.data.call.args;
+          for (size_t a = 0; a < args.len; ++a) {
+            mark(reinterpret_cast<koopa_raw_value_t>(args.buffer[a]));
+          }
+        }
+      }
+    }
+  }
+}
+
+// 全零的全局变量放进 .bss, 只读且非零的放进 .rodata, 其余在 .data
 void CodeGen::Visit(const koopa_raw_global_alloc_t &global_alloc,
-                    std::string var_name) {
+                    const koopa_raw_value_t &value) {
+  std::string var_name = value->name;
+  std::string section = "  .data";
+  koopa_raw_value_t init = global_alloc.init;
+  if (is_zero_init(init)) {
+    section = "  .bss";
+  } else if (writable_globals.count(value) == 0) {
+    section = "  .section .rodata";
+  }
+  if (section != cur_data_section) {
+    oss << section << "\n";
+    cur_data_section = section;
+  }
   oss << "  .global " << get_label(var_name) << "\n";
   oss << get_label(var_name) << ":\n";
-  if (global_alloc.init->kind.tag == KOOPA_RVT_INTEGER) {
-    oss << "  .word " << get_value(global_alloc.init) << "\n";
-  } else if (global_alloc.init->kind.tag == KOOPA_RVT_ZERO_INIT) {
-    if (global_alloc.init->ty->tag == KOOPA_RTT_ARRAY) {
-      // 递归计算整个数组所占字节数
-      int total_size = get_elem_size(global_alloc.init->ty);
-      oss << "  .zero " << total_size << "\n";
-    } else {
-      oss << "  .zero 4\n";
-    }
-  } else if (global_alloc.init->kind.tag == KOOPA_RVT_AGGREGATE) {
-    alloc_aggregate(global_alloc.init);
-  } else {
-    assert(false);
+  if (is_zero_init(init)) {
+    oss << "  .zero " << get_elem_size(init->ty) << "\n";
+    return;
   }
+  alloc_aggregate(init);
+  flush_zero();
 }
 
+// 类型的字节数, 指针类型取其指向的类型. 由类型表缓存, 不再逐层递归
 int CodeGen::get_elem_size(const koopa_raw_type_t &type) {
-  if (type->tag == KOOPA_RTT_INT32) {
-    return 4;
-  } else if (type->tag == KOOPA_RTT_ARRAY) {
-    return type->data.array.len * get_elem_size(type->data.array.base);
-  } else if (type->tag == KOOPA_RTT_POINTER) {
-    return get_elem_size(type->data.pointer.base);
-  } else {
-    assert(false);
-  }
+  return TypeTable::getInstance().of(type)->size_bytes();
 }
 
 void CodeGen::Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr) {
   if (get_elem_ptr.src->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
     auto &addr_manager = get_addr_manager();
-    std::string res_addr = addr_manager.getAddr(get_elem_ptr);
+    Reg res_addr = addr_manager.getAddr(cur_value);
     oss << "  la " << res_addr << ", " << get_label(get_elem_ptr.src->name)
         << "\n";
-    auto idx_addr = addr_manager.getAddr(get_elem_ptr.index);
+    Reg idx_addr = addr_manager.getAddr(get_elem_ptr.index);
     cmd_li(get_elem_ptr.index, idx_addr);
 
-    auto elem = get_elem_ptr.src->ty->data.pointer.base->data.array.base;
-    int elem_size = get_elem_size(elem);
+    int elem_size =
+        TypeTable::getInstance().of(get_elem_ptr.src->ty)->stride_bytes(0);
 
     oss << "  li t6, " << elem_size << "\n";
     oss << "  mul t6, " << idx_addr << ", t6\n";
     oss << "  add " << res_addr << ", " << res_addr << ", t6\n";
-    oss << "  li t6, " << get_stack_offset_manager().getOffset(get_elem_ptr)
+    oss << "  li t6, " << get_stack_offset_manager().getOffset(cur_value)
         << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  sw " << res_addr << ", 0(t6)\n";
     addr_manager.freeReg(res_addr);
     addr_manager.freeReg(idx_addr);
-    addr_manager.freeId(get_elem_ptr);
+    addr_manager.freeId(cur_value);
     addr_manager.freeId(get_elem_ptr.index);
     return;
   }
   auto &stack_offset_manager = get_stack_offset_manager();
   auto &addr_manager = get_addr_manager();
-  std::string res_addr = addr_manager.getAddr(get_elem_ptr);
-  int array_offset = -1;
-  if (get_elem_ptr.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
-      get_elem_ptr.src->kind.tag == KOOPA_RVT_GET_PTR) {
-    array_offset = stack_offset_manager.getOffset(get_elem_ptr.src);
-  } else {
-    array_offset = stack_offset_manager.getOffset(get_elem_ptr.src->name);
-  }
+  Reg res_addr = addr_manager.getAddr(cur_value);
+  int array_offset = stack_offset_manager.getOffset(get_elem_ptr.src);
   oss << "  li t6, " << array_offset << "\n";
   oss << "  add " << res_addr << ", sp, t6\n";
   if (get_elem_ptr.src->kind.tag == KOOPA_RVT_GET_ELEM_PTR) {
@@ -520,30 +1163,30 @@ void CodeGen::Visit(const koopa_raw_get_elem_ptr_t &get_elem_ptr) {
   } else if (get_elem_ptr.src->kind.tag == KOOPA_RVT_GET_PTR) {
     oss << "  lw " << res_addr << ", 0(" << res_addr << ")\n";
   }
-  std::string idx_addr = addr_manager.getAddr(get_elem_ptr.index);
+  Reg idx_addr = addr_manager.getAddr(get_elem_ptr.index);
   cmd_li(get_elem_ptr.index, idx_addr);
 
-  auto elem = get_elem_ptr.src->ty->data.pointer.base->data.array.base;
-  int elem_size = get_elem_size(elem);
+  int elem_size =
+      TypeTable::getInstance().of(get_elem_ptr.src->ty)->stride_bytes(0);
 
   oss << "  li t6, " << elem_size << "\n";
   oss << "  mul t6, " << idx_addr << ", t6\n";
   oss << "  add " << res_addr << ", " << res_addr << ", t6\n";
 
-  oss << "  li t6, " << stack_offset_manager.getOffset(get_elem_ptr) << "\n";
+  oss << "  li t6, " << stack_offset_manager.getOffset(cur_value) << "\n";
   oss << "  add t6, sp, t6\n";
   oss << "  sw " << res_addr << ", 0(t6)\n";
   addr_manager.freeReg(idx_addr);
   addr_manager.freeId(get_elem_ptr.index);
   addr_manager.freeReg(res_addr);
-  addr_manager.freeId(get_elem_ptr);
+  addr_manager.freeId(cur_value);
 }
 
 void CodeGen::Visit(const koopa_raw_get_ptr_t &get_ptr) {
   auto &stack_offset_manager = get_stack_offset_manager();
   auto &addr_manager = get_addr_manager();
 
-  std::string res_addr = addr_manager.getAddr(get_ptr);
+  Reg res_addr = addr_manager.getAddr(cur_value);
   int src_offset = stack_offset_manager.getOffset(get_ptr.src);
   oss << "  li t6, " << src_offset << "\n";
   oss << "  add t6, sp, t6\n";
@@ -567,36 +1210,34 @@ void CodeGen::Visit(const koopa_raw_get_ptr_t &get_ptr) {
 
   oss << "  add " << res_addr << ", " << res_addr << ", t6\n";
 
-  int ptr_offset = stack_offset_manager.getOffset(get_ptr);
+  int ptr_offset = stack_offset_manager.getOffset(cur_value);
   oss << "  li t6, " << ptr_offset << "\n";
   oss << "  add t6, sp, t6\n";
   oss << "  sw " << res_addr << ", 0(t6)\n";
 
   addr_manager.freeReg(res_addr);
-  addr_manager.freeId(get_ptr);
+  addr_manager.freeId(cur_value);
 }
-void CodeGen::cmd_li(const koopa_raw_value_t &value, std::string &res_addr) {
+void CodeGen::cmd_li(const koopa_raw_value_t &value, Reg &res_addr) {
   auto &stack_offset_manager = get_stack_offset_manager();
-  if (res_addr == "x0") {
+  if (res_addr == Reg::X0) {
     return;
   }
   if (value->kind.tag == KOOPA_RVT_INTEGER) {
     oss << "  li " << res_addr << ", " << get_value(value) << "\n";
   } else if (value->kind.tag == KOOPA_RVT_BINARY) {
-    oss << "  li t6, "
-        << stack_offset_manager.getOffset(value->kind.data.binary) << "\n";
+    oss << "  li t6, " << stack_offset_manager.getOffset(value) << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
   } else if (value->kind.tag == KOOPA_RVT_LOAD) {
-    oss << "  li t6, " << stack_offset_manager.getOffset(value->kind.data.load)
-        << "\n";
+    oss << "  li t6, " << stack_offset_manager.getOffset(value) << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
   } else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
     auto arg_ref = value->kind.data.func_arg_ref;
     if (arg_ref.index <= 7) {
       get_addr_manager().freeReg(res_addr);
-      res_addr = "a" + std::to_string(arg_ref.index);
+      res_addr = arg_reg(arg_ref.index);
       return;
     }
     oss << "  li t6, "
@@ -605,8 +1246,7 @@ void CodeGen::cmd_li(const koopa_raw_value_t &value, std::string &res_addr) {
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
   } else if (value->kind.tag == KOOPA_RVT_CALL) {
-    oss << "  li t6, " << stack_offset_manager.getOffset(value->kind.data.call)
-        << "\n";
+    oss << "  li t6, " << stack_offset_manager.getOffset(value) << "\n";
     oss << "  add t6, sp, t6\n";
     oss << "  lw " << res_addr << ", 0(t6)\n";
   } else if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
@@ -618,6 +1258,20 @@ void CodeGen::cmd_li(const koopa_raw_value_t &value, std::string &res_addr) {
   }
 }
 
+// 结果存放在栈上的指令, 使用时要从栈上读回
+static bool is_stack_result(koopa_raw_value_t value) {
+  switch (value->kind.tag) {
+  case KOOPA_RVT_BINARY:
+  case KOOPA_RVT_LOAD:
+  case KOOPA_RVT_CALL:
+  case KOOPA_RVT_GET_ELEM_PTR:
+  case KOOPA_RVT_GET_PTR:
+    return true;
+  default:
+    return false;
+  }
+}
+
 // 分配栈空间：为 alloc 和有返回值的指令分配 4 字节，并记录偏移
 void CodeGen::AllocateStack(const koopa_raw_function_t &func) {
   auto &stack_offset_manager = get_stack_offset_manager();
@@ -625,16 +1279,56 @@ void CodeGen::AllocateStack(const koopa_raw_function_t &func) {
   int call_num = 0;
   int max_param_num = 0;
   int total_stack_size = 0;
+  // 栈上着色: 只在一个块内活跃的值在最后一次使用后让出位置,
+  // 给之后定义的值复用; 跨块活跃的值和 alloc 各占一个位置
+  const Liveness *liveness = nullptr;
+  if (options.passes.stack_coloring) {
+    liveness = &passes.analyses().liveness(func);
+  }
+  std::vector<int> free_slots;
+  std::unordered_map<koopa_raw_value_t, size_t> last_use;
+  FunctionStats stats;
+  std::unordered_map<koopa_raw_value_t, int> colored;
+  int reused = 0;
   // 遍历所有基本块
   for (size_t i = 0; i < func->bbs.len; ++i) {
     auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    if (liveness != nullptr) {
+      last_use.clear();
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+        for_each_operand(inst, [&](koopa_raw_value_t value) {
+          last_use[value] = j;
+        });
+      }
+    }
     // 遍历基本块内所有指令
     for (size_t j = 0; j < bb->insts.len; ++j) {
       auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
-      // alloc 或有返回值的指令
-      if (inst->kind.tag == KOOPA_RVT_ALLOC ||
-          (inst->ty->tag != KOOPA_RTT_UNIT)) {
-        stack_offset_manager.setOffset(inst);
+      // alloc 或有返回值的指令; 与 br 融合的比较不需要栈空间
+      if ((inst->kind.tag == KOOPA_RVT_ALLOC ||
+           inst->ty->tag != KOOPA_RTT_UNIT) &&
+          !is_fused_with_branch(bb, j)) {
+        if (liveness == nullptr || inst->kind.tag == KOOPA_RVT_ALLOC ||
+            liveness->crosses_blocks(inst)) {
+          stack_offset_manager.setOffset(inst);
+        } else if (free_slots.empty()) {
+          colored[inst] = stack_offset_manager.current_stack_offset;
+          stack_offset_manager.setOffset(inst);
+        } else {
+          colored[inst] = free_slots.back();
+          free_slots.pop_back();
+          ++reused;
+          stack_offset_manager.setOffset(inst, colored[inst]);
+        }
+        stats.spill_stores += inst->kind.tag != KOOPA_RVT_ALLOC;
+      }
+      if (options.collect_stats) {
+        // 栈上的结果每次使用都要读回; 与 br 融合的比较在寄存器中
+        bool fused_branch = j > 0 && is_fused_with_branch(bb, j - 1);
+        for_each_operand(inst, [&](koopa_raw_value_t value) {
+          stats.reloads += is_stack_result(value) && !fused_branch;
+        });
       }
       if (inst->kind.tag == KOOPA_RVT_CALL) {
         call_num++;
@@ -642,21 +1336,59 @@ void CodeGen::AllocateStack(const koopa_raw_function_t &func) {
           max_param_num = (int)inst->kind.data.call.args.len;
         }
       }
+      if (liveness == nullptr) {
+        continue;
+      }
+      // 结果写入之后才释放操作数的位置, 结果不会和操作数共用位置
+      auto release = [&](koopa_raw_value_t value) {
+        auto it = colored.find(value);
+        if (it != colored.end()) {
+          free_slots.push_back(it->second);
+          colored.erase(it);
+        }
+      };
+      for_each_operand(inst, [&](koopa_raw_value_t value) {
+        if (last_use[value] == j) {
+          release(value);
+        }
+      });
+      if (!last_use.count(inst)) {
+        release(inst);
+      }
     }
   }
   // 计算总栈空间并 16 字节对齐
-  stack_offset_manager.r = std::max(call_num, 0) * 4;
+  // 只要有调用就需要一个保存 ra 的位置
+  stack_offset_manager.r = call_num > 0 ? 4 : 0;
   stack_offset_manager.a = std::max(max_param_num - 8, 0) * 4;
 
   total_stack_size = stack_offset_manager.current_stack_offset +
                      stack_offset_manager.r + stack_offset_manager.a;
   stack_offset_manager.final_stack_size = ((total_stack_size + 15) / 16) * 16;
+  if (options.collect_stats) {
+    stats.name = cur_func;
+    stats.label = options.profile_generate && cur_func == "main"
+                      ? ".Lprof_main"
+                      : cur_func;
+    stats.frame_size = stack_offset_manager.final_stack_size;
+    func_stats.push_back(stats);
+  }
+  auto &remarks = passes.remarks();
+  if (remarks.enabled() && reused != 0) {
+    remarks.emit(Remark::PASSED, "stack-coloring", "SlotsShared", func,
+                 remarks.line(func),
+                 std::to_string(reused) +
+                     " values reuse the stack slot of a dead value, " +
+                     std::to_string(reused * 4) + " bytes saved");
+  }
 }
 
-void CodeGen::push_addr_manager() { addr_managers.push_back(AddrManager()); }
+void CodeGen::push_addr_manager() {
+  addr_managers.push_back(AddrManager(&value_numbering));
+}
 
 void CodeGen::push_stack_offset_manager() {
-  stack_offset_managers.push_back(StackOffsetManager());
+  stack_offset_managers.push_back(StackOffsetManager(&value_numbering));
 }
 
 void CodeGen::pop_addr_manager() { addr_managers.pop_back(); }
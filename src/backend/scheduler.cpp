@@ -0,0 +1,402 @@
+// scheduler.cpp
+#include <cassert>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <unordered_map>
+#include <vector>
+
+#include "riscv_asm.h"
+#include "scheduler.h"
+
+namespace {
+// 调度窗口上限, 避免大块数组初始化时依赖图过大
+constexpr size_t kMaxRegion = 256;
+
+// 寄存器中已知的值: 常数, sp + 偏移, 或全局符号 + 偏移
+struct RegValue {
+  enum class Kind { UNKNOWN, CONST, STACK, GLOBAL };
+  Kind kind = Kind::UNKNOWN;
+  long long value = 0;
+  std::string symbol;
+};
+
+// 一次访存的地址范围, 用于判断两次访存是否可能重叠
+struct MemRef {
+  RegValue::Kind kind = RegValue::Kind::UNKNOWN;
+  long long offset = 0;
+  int size = 0;
+  std::string symbol;
+};
+
+struct SchedInst {
+  AsmLine line;
+  std::vector<std::string> defs;
+  std::vector<std::string> uses;
+  bool is_load = false;
+  bool is_store = false;
+  MemRef mem;
+  int latency = 1;
+};
+
+const std::set<std::string> kRegRegOps = {
+    "add",  "sub", "and", "or",   "xor",  "sll",   "srl", "sra",
+    "slt",  "sltu", "sgt", "sgtu", "mul", "mulh", "div", "divu",
+    "rem",  "remu"};
+const std::set<std::string> kRegImmOps = {"addi", "andi", "ori",  "xori",
+                                          "slli", "srli", "srai", "slti",
+                                          "sltiu"};
+const std::set<std::string> kUnaryOps = {"mv",   "neg",  "not", "seqz",
+                                         "snez", "sltz", "sgtz"};
+const std::set<std::string> kLoadOps = {"lw", "lh", "lhu", "lb", "lbu"};
+const std::set<std::string> kStoreOps = {"sw", "sh", "sb"};
+
+int access_size(const std::string &op) {
+  if (op[1] == 'b') {
+    return 1;
+  }
+  if (op[1] == 'h') {
+    return 2;
+  }
+  return 4;
+}
+
+bool is_number(const std::string &str) {
+  if (str.empty()) {
+    return false;
+  }
+  size_t i = str[0] == '-' ? 1 : 0;
+  if (i == str.size()) {
+    return false;
+  }
+  for (; i < str.size(); ++i) {
+    if (!isdigit(static_cast<unsigned char>(str[i]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 解析一条指令的定义/使用; 无法识别的指令返回 false, 作为调度边界
+bool classify(SchedInst &inst, const LatencyTable &latency) {
+  const auto &op = inst.line.op;
+  const auto &args = inst.line.args;
+  if (kRegRegOps.count(op) && args.size() == 3) {
+    inst.defs = {args[0]};
+    inst.uses = {args[1], args[2]};
+    if (op.compare(0, 3, "mul") == 0) {
+      inst.latency = latency.mul;
+    } else if (op.compare(0, 3, "div") == 0 || op.compare(0, 3, "rem") == 0) {
+      inst.latency = latency.div;
+    }
+  } else if (kRegImmOps.count(op) && args.size() == 3) {
+    inst.defs = {args[0]};
+    inst.uses = {args[1]};
+  } else if (kUnaryOps.count(op) && args.size() == 2) {
+    inst.defs = {args[0]};
+    inst.uses = {args[1]};
+  } else if ((op == "li" || op == "la" || op == "lui") && args.size() == 2) {
+    inst.defs = {args[0]};
+  } else if (kLoadOps.count(op) && args.size() == 2) {
+    int offset;
+    std::string base;
+    if (!parse_mem_operand(args[1], offset, base)) {
+      return false;
+    }
+    inst.defs = {args[0]};
+    inst.uses = {base};
+    inst.is_load = true;
+    inst.latency = latency.load;
+  } else if (kStoreOps.count(op) && args.size() == 2) {
+    int offset;
+    std::string base;
+    if (!parse_mem_operand(args[1], offset, base)) {
+      return false;
+    }
+    inst.uses = {args[0], base};
+    inst.is_store = true;
+  } else {
+    return false;
+  }
+  // 修改 sp 会使所有栈地址失效, 不参与调度
+  for (const auto &def : inst.defs) {
+    if (def == "sp") {
+      return false;
+    }
+  }
+  inst.latency = std::max(inst.latency, 1);
+  return true;
+}
+
+// 按原顺序模拟寄存器中的已知值, 计算每次访存的地址范围
+void track_values(std::vector<SchedInst> &insts) {
+  std::unordered_map<std::string, RegValue> values;
+  auto get = [&](const std::string &reg) {
+    RegValue val;
+    if (reg == "sp") {
+      val.kind = RegValue::Kind::STACK;
+    } else if (reg == "x0" || reg == "zero") {
+      val.kind = RegValue::Kind::CONST;
+    } else if (values.count(reg)) {
+      val = values[reg];
+    }
+    return val;
+  };
+  for (auto &inst : insts) {
+    const auto &op = inst.line.op;
+    const auto &args = inst.line.args;
+    if (inst.is_load || inst.is_store) {
+      int offset;
+      std::string base;
+      parse_mem_operand(args[1], offset, base);
+      RegValue addr = get(base);
+      if (addr.kind == RegValue::Kind::STACK ||
+          addr.kind == RegValue::Kind::GLOBAL) {
+        inst.mem.kind = addr.kind;
+        inst.mem.offset = addr.value + offset;
+        inst.mem.symbol = addr.symbol;
+      }
+      inst.mem.size = access_size(op);
+    }
+    if (inst.defs.empty()) {
+      continue;
+    }
+    RegValue result;
+    if (op == "li" && is_number(args[1])) {
+      result.kind = RegValue::Kind::CONST;
+      result.value = std::stoll(args[1]);
+    } else if (op == "la") {
+      result.kind = RegValue::Kind::GLOBAL;
+      result.symbol = args[1];
+    } else if (op == "mv") {
+      result = get(args[1]);
+    } else if (op == "add" || op == "addi") {
+      RegValue lhs = get(args[1]);
+      RegValue rhs;
+      if (op == "addi" && is_number(args[2])) {
+        rhs.kind = RegValue::Kind::CONST;
+        rhs.value = std::stoll(args[2]);
+      } else if (op == "add") {
+        rhs = get(args[2]);
+      }
+      if (lhs.kind == RegValue::Kind::CONST &&
+          rhs.kind != RegValue::Kind::UNKNOWN) {
+        std::swap(lhs, rhs);
+      }
+      if (rhs.kind == RegValue::Kind::CONST &&
+          lhs.kind != RegValue::Kind::UNKNOWN) {
+        result = lhs;
+        result.value += rhs.value;
+      }
+    }
+    values[inst.defs[0]] = result;
+  }
+}
+
+bool may_alias(const MemRef &lhs, const MemRef &rhs) {
+  if (lhs.kind == RegValue::Kind::UNKNOWN ||
+      rhs.kind == RegValue::Kind::UNKNOWN) {
+    return true;
+  }
+  if (lhs.kind != rhs.kind || lhs.symbol != rhs.symbol) {
+    return false;
+  }
+  return lhs.offset < rhs.offset + rhs.size &&
+         rhs.offset < lhs.offset + lhs.size;
+}
+
+bool is_zero_reg(const std::string &reg) { return reg == "x0" || reg == "zero"; }
+
+// 对一个区域内的指令做表调度, 返回新的顺序
+std::vector<size_t> schedule_region(std::vector<SchedInst> &insts) {
+  size_t n = insts.size();
+  struct Dep {
+    size_t to;
+    int latency;
+  };
+  std::vector<std::vector<Dep>> succs(n);
+  std::vector<int> num_preds(n, 0);
+  auto add_dep = [&](size_t from, size_t to, int latency) {
+    succs[from].push_back({to, latency});
+    ++num_preds[to];
+  };
+
+  track_values(insts);
+  std::unordered_map<std::string, size_t> last_def;
+  std::unordered_map<std::string, std::vector<size_t>> uses_since_def;
+  std::vector<size_t> loads, stores;
+  for (size_t i = 0; i < n; ++i) {
+    auto &inst = insts[i];
+    for (const auto &use : inst.uses) {
+      if (is_zero_reg(use)) {
+        continue;
+      }
+      if (last_def.count(use)) {
+        size_t def = last_def[use];
+        add_dep(def, i, insts[def].latency);
+      }
+      uses_since_def[use].push_back(i);
+    }
+    for (const auto &def : inst.defs) {
+      if (is_zero_reg(def)) {
+        continue;
+      }
+      for (size_t use : uses_since_def[def]) {
+        if (use != i) {
+          add_dep(use, i, 0);
+        }
+      }
+      if (last_def.count(def)) {
+        add_dep(last_def[def], i, 1);
+      }
+      last_def[def] = i;
+      uses_since_def[def].clear();
+    }
+    if (inst.is_load) {
+      for (size_t store : stores) {
+        if (may_alias(insts[store].mem, inst.mem)) {
+          add_dep(store, i, 1);
+        }
+      }
+      loads.push_back(i);
+    } else if (inst.is_store) {
+      for (size_t load : loads) {
+        if (may_alias(insts[load].mem, inst.mem)) {
+          add_dep(load, i, 0);
+        }
+      }
+      for (size_t store : stores) {
+        if (may_alias(insts[store].mem, inst.mem)) {
+          add_dep(store, i, 0);
+        }
+      }
+      stores.push_back(i);
+    }
+  }
+
+  // 关键路径长度作为优先级
+  std::vector<int> height(n, 0);
+  for (size_t i = n; i-- > 0;) {
+    height[i] = insts[i].latency;
+    for (const auto &dep : succs[i]) {
+      height[i] = std::max(height[i], dep.latency + height[dep.to]);
+    }
+  }
+
+  std::vector<int> earliest(n, 0);
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < n; ++i) {
+    if (num_preds[i] == 0) {
+      ready.push_back(i);
+    }
+  }
+  std::vector<size_t> order;
+  int cycle = 0;
+  while (!ready.empty()) {
+    // 优先选当前周期已就绪且关键路径最长的指令, 否则选最早就绪的
+    size_t best = 0;
+    for (size_t k = 1; k < ready.size(); ++k) {
+      size_t lhs = ready[k];
+      size_t rhs = ready[best];
+      bool lhs_ready = earliest[lhs] <= cycle;
+      bool rhs_ready = earliest[rhs] <= cycle;
+      bool better;
+      if (lhs_ready != rhs_ready) {
+        better = lhs_ready;
+      } else if (!lhs_ready && earliest[lhs] != earliest[rhs]) {
+        better = earliest[lhs] < earliest[rhs];
+      } else if (height[lhs] != height[rhs]) {
+        better = height[lhs] > height[rhs];
+      } else {
+        better = lhs < rhs;
+      }
+      if (better) {
+        best = k;
+      }
+    }
+    size_t inst = ready[best];
+    ready.erase(ready.begin() + best);
+    cycle = std::max(cycle, earliest[inst]);
+    order.push_back(inst);
+    for (const auto &dep : succs[inst]) {
+      earliest[dep.to] = std::max(earliest[dep.to], cycle + dep.latency);
+      if (--num_preds[dep.to] == 0) {
+        ready.push_back(dep.to);
+      }
+    }
+    ++cycle;
+  }
+  assert(order.size() == n);
+  return order;
+}
+} // namespace
+
+bool LatencyTable::parse(const std::string &spec, LatencyTable &table) {
+  LatencyTable result = table;
+  std::stringstream ss(spec);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    size_t eq = item.find('=');
+    if (eq == std::string::npos) {
+      std::cerr << "Bad latency entry: " << item
+                << ", expected CLASS=CYCLES" << std::endl;
+      return false;
+    }
+    std::string key = item.substr(0, eq);
+    std::string text = item.substr(eq + 1);
+    int *field = key == "alu"    ? &result.alu
+                 : key == "load" ? &result.load
+                 : key == "mul"  ? &result.mul
+                 : key == "div"  ? &result.div
+                                 : nullptr;
+    if (field == nullptr) {
+      std::cerr << "Unknown latency class: " << key
+                << ", available classes: alu load mul div" << std::endl;
+      return false;
+    }
+    // 只接受十进制数字, 长度限制保证不溢出
+    bool digits = !text.empty() && text.size() <= 4 &&
+                  text.find_first_not_of("0123456789") == std::string::npos;
+    int value = digits ? std::stoi(text) : 0;
+    if (value < 1 || value > kMaxLatency) {
+      std::cerr << "Bad latency for " << key << ": " << text
+                << ", expected an integer from 1 to " << kMaxLatency
+                << std::endl;
+      return false;
+    }
+    *field = value;
+  }
+  table = result;
+  return true;
+}
+
+std::string schedule_asm(const std::string &asm_text,
+                         const LatencyTable &latency) {
+  std::stringstream out;
+  std::vector<SchedInst> region;
+  auto flush = [&]() {
+    if (region.empty()) {
+      return;
+    }
+    for (size_t idx : schedule_region(region)) {
+      out << region[idx].line.text << "\n";
+    }
+    region.clear();
+  };
+  for (auto &line : parse_asm(asm_text)) {
+    SchedInst inst;
+    inst.line = line;
+    inst.latency = latency.alu;
+    if (line.kind == AsmLine::Kind::INST && classify(inst, latency)) {
+      region.push_back(std::move(inst));
+      if (region.size() >= kMaxRegion) {
+        flush();
+      }
+      continue;
+    }
+    flush();
+    out << line.text << "\n";
+  }
+  flush();
+  return out.str();
+}
@@ -0,0 +1,574 @@
+// simulator.cpp
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "simulator.h"
+
+namespace {
+constexpr uint32_t kMemorySize = 64 << 20;
+// 各节从这里开始依次放置, 之下的地址不可访问
+constexpr uint32_t kLoadBase = 0x10000;
+// 运行时库函数和 main 的返回地址, 跳到这些地址时由模拟器处理
+constexpr uint32_t kRuntimeBase = 0x1000;
+constexpr uint32_t kExitAddress = 0x2000;
+// fopen/fwrite/fclose 供 -fprofile-generate 的插桩程序写出 profile
+const char *const kRuntime[] = {"getint",    "getch",    "getarray",
+                                "putint",    "putch",    "putarray",
+                                "starttime", "stoptime", "fopen",
+                                "fwrite",    "fclose"};
+constexpr int kRuntimeCount = sizeof(kRuntime) / sizeof(kRuntime[0]);
+
+constexpr uint32_t SHT_SYMTAB = 2;
+constexpr uint32_t SHT_RELA = 4;
+constexpr uint32_t SHT_NOBITS = 8;
+constexpr uint32_t SHF_ALLOC = 0x2;
+
+constexpr uint32_t R_RISCV_32 = 1;
+constexpr uint32_t R_RISCV_BRANCH = 16;
+constexpr uint32_t R_RISCV_JAL = 17;
+constexpr uint32_t R_RISCV_CALL = 18;
+constexpr uint32_t R_RISCV_PCREL_HI20 = 23;
+constexpr uint32_t R_RISCV_PCREL_LO12_I = 24;
+constexpr uint32_t R_RISCV_PCREL_LO12_S = 25;
+
+uint32_t get16(const std::string &data, size_t offset) {
+  return (uint8_t)data[offset] | (uint8_t)data[offset + 1] << 8;
+}
+
+uint32_t get32(const std::string &data, size_t offset) {
+  return get16(data, offset) | get16(data, offset + 2) << 16;
+}
+
+// 把 pc 相对偏移拆成 auipc 的高 20 位和随后指令的低 12 位
+uint32_t hi20(int32_t offset) { return (uint32_t)(offset + 0x800) & 0xfffff000; }
+int32_t lo12(int32_t offset) { return offset - (int32_t)hi20(offset); }
+
+uint32_t b_imm(int32_t imm) {
+  return ((imm >> 12) & 1) << 31 | ((imm >> 5) & 0x3f) << 25 |
+         ((imm >> 1) & 0xf) << 8 | ((imm >> 11) & 1) << 7;
+}
+
+uint32_t j_imm(int32_t imm) {
+  return ((imm >> 20) & 1) << 31 | ((imm >> 1) & 0x3ff) << 21 |
+         ((imm >> 11) & 1) << 20 | ((imm >> 12) & 0xff) << 12;
+}
+
+uint32_t i_imm(int32_t imm) { return (uint32_t)imm << 20; }
+
+uint32_t s_imm(int32_t imm) {
+  return ((uint32_t)imm >> 5 & 0x7f) << 25 | ((uint32_t)imm & 0x1f) << 7;
+}
+} // namespace
+
+Simulator::Simulator(const LatencyTable &latency)
+    : latency(latency), memory(kMemorySize, 0) {}
+
+Simulator::~Simulator() {
+  for (const auto &file : files) {
+    fclose(file.second);
+  }
+}
+
+bool Simulator::valid(uint32_t addr, uint32_t size) const {
+  return addr >= kLoadBase && addr <= kMemorySize - size;
+}
+
+uint32_t Simulator::read32(uint32_t addr) const {
+  uint32_t value;
+  memcpy(&value, &memory[addr], 4);
+  return value;
+}
+
+void Simulator::write32(uint32_t addr, uint32_t value) {
+  memcpy(&memory[addr], &value, 4);
+}
+
+bool Simulator::read_string(uint32_t addr, std::string &str) const {
+  str.clear();
+  for (; valid(addr, 1); ++addr) {
+    if (memory[addr] == 0) {
+      return true;
+    }
+    str.push_back((char)memory[addr]);
+  }
+  return false;
+}
+
+bool Simulator::load(const std::string &object) {
+  if (object.size() < 52 || object.compare(0, 4, "\x7f"
+                                                  "ELF") != 0 ||
+      object[4] != 1 || get16(object, 18) != 243) {
+    std::cerr << "sim: not an RV32 ELF object" << std::endl;
+    return false;
+  }
+  uint32_t shoff = get32(object, 32);
+  uint32_t shnum = get16(object, 48);
+  if (shoff + shnum * 40 > object.size()) {
+    std::cerr << "sim: truncated object" << std::endl;
+    return false;
+  }
+  struct Section {
+    uint32_t type, flags, offset, size, link, info, align;
+  };
+  std::vector<Section> sections(shnum);
+  for (uint32_t i = 0; i < shnum; ++i) {
+    size_t header = shoff + i * 40;
+    sections[i] = {get32(object, header + 4),  get32(object, header + 8),
+                   get32(object, header + 16), get32(object, header + 20),
+                   get32(object, header + 24), get32(object, header + 28),
+                   get32(object, header + 32)};
+  }
+
+  // 放置需要载入内存的节
+  std::vector<uint32_t> base(shnum, 0);
+  uint32_t addr = kLoadBase;
+  for (uint32_t i = 0; i < shnum; ++i) {
+    const Section &sec = sections[i];
+    if (!(sec.flags & SHF_ALLOC)) {
+      continue;
+    }
+    uint32_t align = sec.align == 0 ? 1 : sec.align;
+    addr = (addr + align - 1) / align * align;
+    if (!valid(addr, sec.size) || addr + sec.size > kMemorySize / 2) {
+      std::cerr << "sim: program does not fit in memory" << std::endl;
+      return false;
+    }
+    base[i] = addr;
+    if (sec.type != SHT_NOBITS) {
+      memcpy(&memory[addr], object.data() + sec.offset, sec.size);
+    }
+    addr += sec.size;
+  }
+
+  // 符号地址; 未定义的符号只能是运行时库函数
+  int symtab = -1;
+  for (uint32_t i = 0; i < shnum; ++i) {
+    if (sections[i].type == SHT_SYMTAB) {
+      symtab = i;
+    }
+  }
+  if (symtab < 0) {
+    std::cerr << "sim: no symbol table" << std::endl;
+    return false;
+  }
+  const Section &syms = sections[symtab];
+  size_t strtab = sections[syms.link].offset;
+  std::vector<uint32_t> symbol_addrs(syms.size / 16, 0);
+  entry = 0;
+  for (size_t i = 1; i < symbol_addrs.size(); ++i) {
+    size_t sym = syms.offset + i * 16;
+    std::string name = object.c_str() + strtab + get32(object, sym);
+    uint32_t shndx = get16(object, sym + 14);
+    if (shndx == 0) {
+      int index = 0;
+      while (index < kRuntimeCount && name != kRuntime[index]) {
+        ++index;
+      }
+      if (index == kRuntimeCount) {
+        std::cerr << "sim: undefined symbol " << name << std::endl;
+        return false;
+      }
+      symbol_addrs[i] = kRuntimeBase + index * 4;
+    } else {
+      symbol_addrs[i] = base[shndx] + get32(object, sym + 4);
+    }
+    if (name == "main") {
+      entry = symbol_addrs[i];
+    }
+  }
+  if (entry == 0) {
+    std::cerr << "sim: no main function" << std::endl;
+    return false;
+  }
+
+  // 重定位. %pcrel_lo 指向对应 auipc 处的标签, 要先处理完所有 %pcrel_hi
+  pcrel_targets.clear();
+  for (int pass = 0; pass < 2; ++pass) {
+    for (uint32_t i = 0; i < shnum; ++i) {
+      const Section &rela = sections[i];
+      if (rela.type != SHT_RELA) {
+        continue;
+      }
+      uint32_t target = base[rela.info];
+      for (uint32_t off = 0; off + 12 <= rela.size; off += 12) {
+        size_t entry_offset = rela.offset + off;
+        uint32_t place = target + get32(object, entry_offset);
+        uint32_t info = get32(object, entry_offset + 4);
+        uint32_t type = info & 0xff;
+        uint32_t value =
+            symbol_addrs[info >> 8] + get32(object, entry_offset + 8);
+        bool is_lo = type == R_RISCV_PCREL_LO12_I ||
+                     type == R_RISCV_PCREL_LO12_S;
+        if (is_lo != (pass == 1)) {
+          continue;
+        }
+        int32_t delta = (int32_t)(value - place);
+        uint32_t inst = read32(place);
+        switch (type) {
+        case R_RISCV_32:
+          write32(place, value);
+          break;
+        case R_RISCV_BRANCH:
+          write32(place, (inst & 0x01fff07f) | b_imm(delta));
+          break;
+        case R_RISCV_JAL:
+          write32(place, (inst & 0xfff) | j_imm(delta));
+          break;
+        case R_RISCV_CALL:
+          write32(place, (inst & 0xfff) | hi20(delta));
+          write32(place + 4, (read32(place + 4) & 0xfffff) | i_imm(lo12(delta)));
+          break;
+        case R_RISCV_PCREL_HI20:
+          write32(place, (inst & 0xfff) | hi20(delta));
+          pcrel_targets[place] = value;
+          break;
+        default: {
+          // value 是 auipc 的地址
+          auto it = pcrel_targets.find(value);
+          if (it == pcrel_targets.end()) {
+            std::cerr << "sim: unsupported relocation " << type << std::endl;
+            return false;
+          }
+          int32_t offset = lo12((int32_t)(it->second - value));
+          write32(place, type == R_RISCV_PCREL_LO12_I
+                             ? (inst & 0xfffff) | i_imm(offset)
+                             : (inst & 0x01fff07f) | s_imm(offset));
+          break;
+        }
+        }
+      }
+    }
+  }
+  return true;
+}
+
+bool Simulator::call_runtime(int index, std::istream &in, std::ostream &out) {
+  uint32_t &a0 = regs[10];
+  uint32_t a1 = regs[11];
+  std::string name = kRuntime[index];
+  if (name == "getint") {
+    int value = 0;
+    in >> value;
+    a0 = value;
+  } else if (name == "getch") {
+    a0 = in.get();
+  } else if (name == "getarray") {
+    int n = 0;
+    in >> n;
+    if (n > 0 && !valid(a0, n * 4)) {
+      std::cerr << "sim: getarray out of bounds" << std::endl;
+      return false;
+    }
+    for (int i = 0; i < n; ++i) {
+      int value = 0;
+      in >> value;
+      write32(a0 + i * 4, value);
+    }
+    a0 = n;
+  } else if (name == "putint") {
+    out << (int32_t)a0;
+  } else if (name == "putch") {
+    out << (char)a0;
+  } else if (name == "putarray") {
+    int n = (int32_t)a0;
+    if (n > 0 && !valid(a1, n * 4)) {
+      std::cerr << "sim: putarray out of bounds" << std::endl;
+      return false;
+    }
+    out << n << ":";
+    for (int i = 0; i < n; ++i) {
+      out << " " << (int32_t)read32(a1 + i * 4);
+    }
+    out << "\n";
+  } else if (name == "fopen") {
+    // 打开宿主机上的文件, 返回的句柄是从 1 开始的编号, 失败时为 0
+    std::string path, mode;
+    if (!read_string(a0, path) || !read_string(a1, mode)) {
+      std::cerr << "sim: fopen argument out of bounds" << std::endl;
+      return false;
+    }
+    FILE *file = fopen(path.c_str(), mode.c_str());
+    a0 = 0;
+    if (file != nullptr) {
+      a0 = next_file++;
+      files[a0] = file;
+    }
+  } else if (name == "fwrite") {
+    uint32_t size = a1, count = regs[12];
+    auto it = files.find(regs[13]);
+    uint64_t bytes = (uint64_t)size * count;
+    if (it == files.end() || bytes > kMemorySize ||
+        (bytes != 0 && !valid(a0, bytes))) {
+      std::cerr << "sim: bad fwrite" << std::endl;
+      return false;
+    }
+    a0 = size == 0 ? 0 : fwrite(&memory[a0], size, count, it->second);
+  } else if (name == "fclose") {
+    auto it = files.find(a0);
+    if (it == files.end()) {
+      std::cerr << "sim: fclose of a file that is not open" << std::endl;
+      return false;
+    }
+    a0 = fclose(it->second) == 0 ? 0 : -1;
+    files.erase(it);
+  }
+  // starttime/stoptime 不做任何事, 性能由指令数和周期数衡量
+  return true;
+}
+
+bool Simulator::run(std::istream &in, std::ostream &out, int &exit_code) {
+  memset(regs, 0, sizeof(regs));
+  memset(ready, 0, sizeof(ready));
+  instret = 0;
+  cycle = 0;
+  regs[1] = kExitAddress;
+  regs[2] = kMemorySize - 16;
+  uint32_t pc = entry;
+  while (pc != kExitAddress) {
+    if (pc >= kRuntimeBase && pc < kRuntimeBase + kRuntimeCount * 4 &&
+        pc % 4 == 0) {
+      if (!call_runtime((pc - kRuntimeBase) / 4, in, out)) {
+        return false;
+      }
+      pc = regs[1];
+      continue;
+    }
+    if (!valid(pc, 4) || pc % 4 != 0) {
+      std::cerr << "sim: jump to invalid address " << std::hex << pc
+                << std::dec << std::endl;
+      return false;
+    }
+    uint32_t inst = read32(pc);
+    uint32_t opcode = inst & 0x7f;
+    uint32_t rd = (inst >> 7) & 31;
+    uint32_t funct3 = (inst >> 12) & 7;
+    uint32_t rs1 = (inst >> 15) & 31;
+    uint32_t rs2 = (inst >> 20) & 31;
+    uint32_t funct7 = inst >> 25;
+    int32_t imm_i = (int32_t)inst >> 20;
+    int32_t imm_s = ((int32_t)inst >> 25 << 5) | ((inst >> 7) & 31);
+    int32_t imm_b = ((int32_t)inst >> 31 << 12) | ((inst >> 7) & 1) << 11 |
+                    ((inst >> 25) & 0x3f) << 5 | ((inst >> 8) & 0xf) << 1;
+    int32_t imm_j = ((int32_t)inst >> 31 << 20) | (inst & 0xff000) |
+                    ((inst >> 20) & 1) << 11 | ((inst >> 21) & 0x3ff) << 1;
+    uint32_t a = regs[rs1];
+    uint32_t b = regs[rs2];
+    uint32_t next_pc = pc + 4;
+    uint32_t result = 0;
+    bool writes_rd = true;
+    bool uses_rs1 = true;
+    bool uses_rs2 = false;
+    int lat = latency.alu;
+    bool ok = true;
+    switch (opcode) {
+    case 0x37: // lui
+      result = inst & 0xfffff000;
+      uses_rs1 = false;
+      break;
+    case 0x17: // auipc
+      result = pc + (inst & 0xfffff000);
+      uses_rs1 = false;
+      break;
+    case 0x6f: // jal
+      result = pc + 4;
+      next_pc = pc + imm_j;
+      uses_rs1 = false;
+      break;
+    case 0x67: // jalr
+      result = pc + 4;
+      next_pc = (a + imm_i) & ~1u;
+      break;
+    case 0x63: { // 条件跳转
+      writes_rd = false;
+      uses_rs2 = true;
+      bool taken = false;
+      switch (funct3) {
+      case 0:
+        taken = a == b;
+        break;
+      case 1:
+        taken = a != b;
+        break;
+      case 4:
+        taken = (int32_t)a < (int32_t)b;
+        break;
+      case 5:
+        taken = (int32_t)a >= (int32_t)b;
+        break;
+      case 6:
+        taken = a < b;
+        break;
+      case 7:
+        taken = a >= b;
+        break;
+      default:
+        ok = false;
+      }
+      if (taken) {
+        next_pc = pc + imm_b;
+      }
+      break;
+    }
+    case 0x03: { // 读内存
+      uint32_t addr = a + imm_i;
+      uint32_t size = funct3 & 3 ? (funct3 & 3) * 2 : 1;
+      lat = latency.load;
+      if (!valid(addr, size)) {
+        ok = false;
+      } else if (funct3 == 0) {
+        result = (int8_t)memory[addr];
+      } else if (funct3 == 1) {
+        result = (int16_t)(memory[addr] | memory[addr + 1] << 8);
+      } else if (funct3 == 2) {
+        result = read32(addr);
+      } else if (funct3 == 4) {
+        result = memory[addr];
+      } else if (funct3 == 5) {
+        result = memory[addr] | memory[addr + 1] << 8;
+      } else {
+        ok = false;
+      }
+      break;
+    }
+    case 0x23: { // 写内存
+      uint32_t addr = a + imm_s;
+      uint32_t size = funct3 == 0 ? 1 : funct3 * 2;
+      writes_rd = false;
+      uses_rs2 = true;
+      if (funct3 > 2 || !valid(addr, size)) {
+        ok = false;
+      } else if (funct3 == 2) {
+        write32(addr, b);
+      } else {
+        memcpy(&memory[addr], &b, size);
+      }
+      break;
+    }
+    case 0x13: // 立即数运算
+      switch (funct3) {
+      case 0:
+        result = a + imm_i;
+        break;
+      case 1:
+        result = a << (imm_i & 31);
+        break;
+      case 2:
+        result = (int32_t)a < imm_i;
+        break;
+      case 3:
+        result = a < (uint32_t)imm_i;
+        break;
+      case 4:
+        result = a ^ imm_i;
+        break;
+      case 5:
+        result = funct7 & 0x20 ? (uint32_t)((int32_t)a >> (imm_i & 31))
+                               : a >> (imm_i & 31);
+        break;
+      case 6:
+        result = a | imm_i;
+        break;
+      case 7:
+        result = a & imm_i;
+        break;
+      }
+      break;
+    case 0x33: // 寄存器运算
+      uses_rs2 = true;
+      if (funct7 == 1) {
+        int32_t sa = a;
+        int32_t sb = b;
+        lat = funct3 < 4 ? latency.mul : latency.div;
+        switch (funct3) {
+        case 0:
+          result = a * b;
+          break;
+        case 1:
+          result = (uint32_t)(((int64_t)sa * sb) >> 32);
+          break;
+        case 2:
+          result = (uint32_t)(((int64_t)sa * (int64_t)b) >> 32);
+          break;
+        case 3:
+          result = (uint32_t)(((uint64_t)a * b) >> 32);
+          break;
+        // 除零和溢出的结果按 RISC-V 规范
+        case 4:
+          result = sb == 0                         ? -1
+                   : sa == INT32_MIN && sb == -1 ? sa
+                                                   : sa / sb;
+          break;
+        case 5:
+          result = b == 0 ? -1 : a / b;
+          break;
+        case 6:
+          result = sb == 0                         ? sa
+                   : sa == INT32_MIN && sb == -1 ? 0
+                                                   : sa % sb;
+          break;
+        case 7:
+          result = b == 0 ? a : a % b;
+          break;
+        }
+      } else {
+        switch (funct3) {
+        case 0:
+          result = funct7 == 0x20 ? a - b : a + b;
+          break;
+        case 1:
+          result = a << (b & 31);
+          break;
+        case 2:
+          result = (int32_t)a < (int32_t)b;
+          break;
+        case 3:
+          result = a < b;
+          break;
+        case 4:
+          result = a ^ b;
+          break;
+        case 5:
+          result = funct7 == 0x20 ? (uint32_t)((int32_t)a >> (b & 31))
+                                  : a >> (b & 31);
+          break;
+        case 6:
+          result = a | b;
+          break;
+        case 7:
+          result = a & b;
+          break;
+        }
+      }
+      break;
+    default:
+      ok = false;
+    }
+    if (!ok) {
+      std::cerr << "sim: bad instruction or memory access at " << std::hex
+                << pc << ": " << inst << std::dec << std::endl;
+      return false;
+    }
+    // 等操作数就绪后发射, 每周期最多一条
+    uint64_t issue = cycle;
+    if (uses_rs1 && rs1 != 0) {
+      issue = std::max(issue, ready[rs1]);
+    }
+    if (uses_rs2 && rs2 != 0) {
+      issue = std::max(issue, ready[rs2]);
+    }
+    cycle = issue + 1;
+    if (next_pc != pc + 4) {
+      cycle += 2;
+    }
+    if (writes_rd && rd != 0) {
+      regs[rd] = result;
+      ready[rd] = issue + lat;
+    }
+    ++instret;
+    pc = next_pc;
+  }
+  exit_code = regs[10] & 0xff;
+  return true;
+}
@@ -0,0 +1,70 @@
+// value_numbering.cpp
+#include <cassert>
+
+#include "ir_util.h"
+#include "value_numbering.h"
+
+void ValueNumbering::build(const koopa_raw_function_t &func) {
+  values.clear();
+  keys.assign(64, nullptr);
+  ids.assign(64, -1);
+  shift = 64 - 6;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+      add(inst);
+      add_operands(inst);
+    }
+  }
+}
+
+int ValueNumbering::id(koopa_raw_value_t value) const {
+  assert(!keys.empty());
+  size_t slot = find_slot(value);
+  assert(keys[slot] == value);
+  return ids[slot];
+}
+
+// 乘法散列取高位, 线性探测
+size_t ValueNumbering::find_slot(koopa_raw_value_t value) const {
+  uint64_t hash = reinterpret_cast<uintptr_t>(value) * 0x9e3779b97f4a7c15ull;
+  size_t mask = keys.size() - 1;
+  size_t slot = hash >> shift;
+  while (keys[slot] != nullptr && keys[slot] != value) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void ValueNumbering::add(koopa_raw_value_t value) {
+  if (value == nullptr) {
+    return;
+  }
+  size_t slot = find_slot(value);
+  if (keys[slot] == value) {
+    return;
+  }
+  keys[slot] = value;
+  ids[slot] = values.size();
+  values.push_back(value);
+  // 装载率不超过 1/2
+  if (values.size() * 2 > keys.size()) {
+    grow();
+  }
+}
+
+void ValueNumbering::grow() {
+  keys.assign(keys.size() * 2, nullptr);
+  ids.assign(keys.size(), -1);
+  shift--;
+  for (size_t i = 0; i < values.size(); ++i) {
+    size_t slot = find_slot(values[i]);
+    keys[slot] = values[i];
+    ids[slot] = i;
+  }
+}
+
+void ValueNumbering::add_operands(koopa_raw_value_t inst) {
+  for_each_operand(inst, [this](koopa_raw_value_t value) { add(value); });
+}
@@ -0,0 +1,263 @@
+// compile_cache.cpp
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "compile_cache.h"
+#include "lexer.h"
+
+namespace {
+// 缓存格式或代码生成有不兼容的改动时修改这个版本号
+const char *kCacheVersion = "# syskoopa-cache v1";
+constexpr uint64_t kFnvOffset = 1469598103934665603ull;
+constexpr uint64_t kFnvPrime = 1099511628211ull;
+
+uint64_t fnv1a(std::string_view data, uint64_t hash = kFnvOffset) {
+  for (char c : data) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= kFnvPrime;
+  }
+  // 分隔符, 避免 "ab"+"c" 与 "a"+"bc" 相同
+  hash ^= 0xff;
+  hash *= kFnvPrime;
+  return hash;
+}
+
+uint64_t fnv1a(uint64_t value, uint64_t hash) {
+  char bytes[8];
+  for (int i = 0; i < 8; ++i) {
+    bytes[i] = static_cast<char>(value >> (i * 8));
+  }
+  return fnv1a(std::string_view(bytes, 8), hash);
+}
+
+bool is_punct(const Token &tok, char c) {
+  return tok.kind == TokenKind::CHAR && tok.text.size() == 1 && tok.text[0] == c;
+}
+
+// CodeGen 输出的每个函数以 "  .text\n  .globl 名字" 开头
+bool is_func_start(const std::string &text, size_t pos, std::string &name) {
+  static const std::string head = "  .text\n  .globl ";
+  if (text.compare(pos, head.size(), head) != 0) {
+    return false;
+  }
+  size_t begin = pos + head.size();
+  size_t end = text.find('\n', begin);
+  name = text.substr(begin, end - begin);
+  return true;
+}
+} // namespace
+
+CompileCache::CompileCache(const std::string &dir, const std::string &flags)
+    : dir(dir), flags(flags) {
+  if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+    perror(dir.c_str());
+  }
+}
+
+// 顶层只有两种结构: "类型 名字 (" 开头的函数定义, 以及以 ';' 结尾的声明.
+// 按 token 而不是字节计算哈希, 空白和注释的改动不会使缓存失效
+void CompileCache::scan(std::string_view source,
+                        const std::map<std::string, std::string> &ir_names) {
+  Lexer lexer(source);
+  std::vector<Token> toks;
+  for (Token tok = lexer.next(); tok.kind != TokenKind::END;
+       tok = lexer.next()) {
+    toks.push_back(tok);
+  }
+  size_t i = 0;
+  while (i < toks.size()) {
+    Item item;
+    std::vector<std::string> names;
+    item.is_func = (toks[i].kind == TokenKind::INT ||
+                    toks[i].kind == TokenKind::VOID) &&
+                   i + 2 < toks.size() && toks[i + 1].kind == TokenKind::IDENT &&
+                   is_punct(toks[i + 2], '(');
+    int depth = 0;
+    bool in_body = false;
+    uint64_t hash = kFnvOffset;
+    for (; i < toks.size(); ++i) {
+      const Token &tok = toks[i];
+      if (item.is_func && !in_body && depth == 0 && is_punct(tok, '{')) {
+        item.signature_hash = hash;
+        in_body = true;
+      }
+      hash = fnv1a(tok.text, hash);
+      if (tok.kind == TokenKind::IDENT) {
+        item.refs.insert(std::string(tok.text));
+        // 声明中 "int" 或 "," 之后的标识符是被定义的名字
+        const Token &prev = i > 0 ? toks[i - 1] : tok;
+        if (item.is_func ? names.empty()
+                         : depth == 0 && (prev.kind == TokenKind::INT ||
+                                          is_punct(prev, ','))) {
+          names.push_back(std::string(tok.text));
+        }
+      } else if (is_punct(tok, '(') || is_punct(tok, '[') ||
+                 is_punct(tok, '{')) {
+        ++depth;
+      } else if (is_punct(tok, ')') || is_punct(tok, ']') ||
+                 is_punct(tok, '}')) {
+        --depth;
+        if (in_body && depth == 0) {
+          ++i;
+          break;
+        }
+      } else if (!item.is_func && depth == 0 && is_punct(tok, ';')) {
+        ++i;
+        break;
+      }
+    }
+    item.hash = hash;
+    for (const auto &name : names) {
+      item_of[name] = items.size();
+      item.refs.erase(name);
+    }
+    items.push_back(std::move(item));
+  }
+
+  for (const auto &entry : item_of) {
+    const Item &func = items[entry.second];
+    if (!func.is_func) {
+      continue;
+    }
+    // 收集依赖: 声明要传递地展开 (常量的初值可能引用其他常量),
+    // 函数只依赖签名
+    std::map<std::string, uint64_t> deps;
+    std::vector<std::string> worklist(func.refs.begin(), func.refs.end());
+    while (!worklist.empty()) {
+      std::string ref = worklist.back();
+      worklist.pop_back();
+      auto it = item_of.find(ref);
+      if (it == item_of.end() || ref == entry.first || deps.count(ref)) {
+        continue;
+      }
+      const Item &dep = items[it->second];
+      if (dep.is_func) {
+        deps[ref] = dep.signature_hash;
+        continue;
+      }
+      auto ir_name = ir_names.find(ref);
+      deps[ref] = ir_name == ir_names.end()
+                      ? dep.hash
+                      : fnv1a(ir_name->second, dep.hash);
+      worklist.insert(worklist.end(), dep.refs.begin(), dep.refs.end());
+    }
+    uint64_t key = fnv1a(kCacheVersion);
+    key = fnv1a(flags, key);
+    key = fnv1a(entry.first, key);
+    key = fnv1a(func.hash, key);
+    for (const auto &dep : deps) {
+      key = fnv1a(dep.first, key);
+      key = fnv1a(dep.second, key);
+    }
+    keys[entry.first] = key;
+  }
+}
+
+std::string CompileCache::path(const std::string &func) const {
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx",
+           static_cast<unsigned long long>(keys.at(func)));
+  return dir + "/" + func + "-" + hex + ".s";
+}
+
+bool CompileCache::lookup(const std::string &func, CachedFunction &entry) {
+  if (!keys.count(func)) {
+    ++misses;
+    return false;
+  }
+  std::ifstream is(path(func), std::ios::binary);
+  std::string version, writes;
+  if (!is || !std::getline(is, version) || version != kCacheVersion ||
+      !std::getline(is, writes) || writes.rfind("# writes:", 0) != 0) {
+    ++misses;
+    return false;
+  }
+  std::stringstream names(writes.substr(9));
+  std::string name;
+  while (names >> name) {
+    entry.written_globals.insert(name);
+  }
+  std::stringstream body;
+  body << is.rdbuf();
+  entry.asm_text = body.str();
+  hit_entries[func] = entry;
+  ++hits;
+  return true;
+}
+
+// 先写临时文件再改名, 并发编译时不会读到写了一半的缓存
+void CompileCache::store(const std::string &func, const CachedFunction &entry) {
+  std::string file = path(func);
+  std::string tmp = file + ".tmp" + std::to_string(getpid());
+  {
+    std::ofstream os(tmp, std::ios::binary);
+    os << kCacheVersion << "\n# writes:";
+    for (const auto &name : entry.written_globals) {
+      os << " " << name;
+    }
+    os << "\n" << entry.asm_text;
+    if (!os) {
+      std::remove(tmp.c_str());
+      return;
+    }
+  }
+  if (std::rename(tmp.c_str(), file.c_str()) != 0) {
+    std::remove(tmp.c_str());
+  }
+}
+
+std::string CompileCache::merge(
+    const std::string &asm_text, const std::vector<std::string> &funcs,
+    const std::map<std::string, std::set<std::string>> &written) {
+  // 切出数据段部分和每个新生成的函数
+  std::map<std::string, std::string> generated;
+  std::string prefix;
+  std::string cur_name;
+  size_t cur_begin = std::string::npos;
+  size_t pos = 0;
+  while (pos <= asm_text.size()) {
+    std::string name;
+    bool at_end = pos == asm_text.size();
+    if (at_end || is_func_start(asm_text, pos, name)) {
+      if (cur_begin == std::string::npos) {
+        prefix = asm_text.substr(0, pos);
+      } else {
+        generated[cur_name] = asm_text.substr(cur_begin, pos - cur_begin);
+      }
+      cur_name = name;
+      cur_begin = pos;
+    }
+    if (at_end) {
+      break;
+    }
+    size_t nl = asm_text.find('\n', pos);
+    pos = nl == std::string::npos ? asm_text.size() : nl + 1;
+  }
+
+  std::string result = prefix;
+  for (const auto &func : funcs) {
+    auto hit = hit_entries.find(func);
+    if (hit != hit_entries.end()) {
+      result += hit->second.asm_text;
+      continue;
+    }
+    auto it = generated.find(func);
+    assert(it != generated.end());
+    CachedFunction entry;
+    entry.asm_text = it->second;
+    auto writes = written.find(func);
+    if (writes != written.end()) {
+      entry.written_globals = writes->second;
+    }
+    if (keys.count(func)) {
+      store(func, entry);
+    }
+    result += entry.asm_text;
+  }
+  return result;
+}
@@ -0,0 +1,443 @@
+// driver.cpp
+#include <algorithm>
+#include <cassert>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+
+#include "ast.h"
+#include "compile_cache.h"
+#include "driver.h"
+#include "elf_writer.h"
+#include "lexer.h"
+
+using namespace std;
+
+extern FILE *yyin;
+extern int yyparse(unique_ptr<BaseAST> &ast);
+extern int yydebug;
+
+bool parse_driver_options(const vector<string> &args, DriverOptions &options) {
+  // -O 和 -passes= 替换整个流水线, 在其他选项之后应用; 两者都给出时用 -passes=
+  int level = -1;
+  bool has_passes = false;
+  string passes;
+  bool no_sched = false;
+  for (const auto &arg : args) {
+    if (arg == "-debug") {
+      yydebug = 1;
+    } else if (arg == "-fast-lex") {
+      options.fast_lex = true;
+    } else if (arg == "-lex-bench") {
+      options.lex_bench = true;
+    } else if (arg == "-stream") {
+      options.stream = true;
+    } else if (arg.rfind("-cache-dir=", 0) == 0) {
+      options.cache_dir = arg.substr(11);
+    } else if (arg == "-no-sched") {
+      no_sched = true;
+    } else if (arg == "-O0" || arg == "-O1" || arg == "-O2") {
+      level = arg[2] - '0';
+    } else if (arg.rfind("-passes=", 0) == 0) {
+      has_passes = true;
+      passes = arg.substr(8);
+    } else if (arg == "-time-passes") {
+      options.codegen.passes.time_passes = true;
+    } else if (arg.rfind("-remarks=", 0) == 0) {
+      options.remarks_path = arg.substr(9);
+    } else if (arg.rfind("-emit-stats=", 0) == 0) {
+      options.stats_path = arg.substr(12);
+      options.codegen.collect_stats = true;
+    } else if (arg.rfind("-sched-latency=", 0) == 0) {
+      if (!LatencyTable::parse(arg.substr(15), options.codegen.latency)) {
+        return false;
+      }
+    } else if (arg == "-fprofile-generate") {
+      options.codegen.profile_generate = true;
+      options.codegen.profile_path = "default.prof";
+    } else if (arg.rfind("-fprofile-generate=", 0) == 0) {
+      options.codegen.profile_generate = true;
+      options.codegen.profile_path = arg.substr(19);
+    } else if (arg.rfind("-fprofile-use=", 0) == 0) {
+      options.profile_use = arg.substr(14);
+    } else {
+      cerr << "Unknown option: " << arg << endl;
+      return false;
+    }
+  }
+  auto &pipeline = options.codegen.passes;
+  if (has_passes) {
+    if (!PassPipeline::parse(passes, pipeline)) {
+      return false;
+    }
+  } else if (level >= 0) {
+    bool time_passes = pipeline.time_passes;
+    pipeline = PassPipeline::level(level);
+    pipeline.time_passes = time_passes;
+  }
+  if (no_sched) {
+    auto &asm_passes = pipeline.asm_passes;
+    asm_passes.erase(remove(asm_passes.begin(), asm_passes.end(), "sched"),
+                     asm_passes.end());
+  }
+  return true;
+}
+
+// 需要优化报告时让前端记录源码行, 由 CodeGen 和 IR 遍查询
+static shared_ptr<SourceMap> begin_source_map(const DriverOptions &options) {
+  if (options.remarks_path.empty()) {
+    return nullptr;
+  }
+  auto source_map = make_shared<SourceMap>();
+  IRManager::getInstance().source_map = source_map.get();
+  return source_map;
+}
+
+static int write_remarks_file(const DriverOptions &options,
+                              const vector<Remark> &remarks) {
+  ofstream out(options.remarks_path);
+  if (!out) {
+    cerr << "Cannot open " << options.remarks_path << endl;
+    return 1;
+  }
+  write_remarks(out, options.source_name, remarks);
+  return 0;
+}
+
+static int write_stats_file(const DriverOptions &options,
+                            const vector<FunctionStats> &stats) {
+  ofstream out(options.stats_path);
+  if (!out) {
+    cerr << "Cannot open " << options.stats_path << endl;
+    return 1;
+  }
+  write_function_stats(out, options.source_name, stats);
+  return 0;
+}
+
+int compile(const DriverOptions &options, FILE *input, string_view source,
+            string &output) {
+  const string &mode = options.mode;
+  if (mode != "-koopa" && mode != "-riscv" && mode != "-obj") {
+    cerr << "Error arguments" << endl;
+    return 1;
+  }
+  if (!options.stats_path.empty() && mode == "-koopa") {
+    cerr << "-emit-stats requires -riscv or -obj" << endl;
+    return 1;
+  }
+  bool use_profile = options.codegen.profile_generate ||
+                     !options.profile_use.empty();
+  if (use_profile && !options.cache_dir.empty()) {
+    cerr << "-fprofile-* cannot be used with -cache-dir" << endl;
+    return 1;
+  }
+  if (options.stream) {
+    ostringstream out;
+    int status = compile_stream(options, input, source, out);
+    output = out.str();
+    return status;
+  }
+  unique_ptr<Lexer> lexer;
+  if (options.fast_lex) {
+    lexer = make_unique<Lexer>(source);
+    use_fast_lexer(lexer.get());
+  } else {
+    yyin = input;
+  }
+
+  unique_ptr<BaseAST> ast;
+  int parse_result = yyparse(ast);
+  use_fast_lexer(nullptr);
+  assert(!parse_result);
+
+  // 缓存命中的函数不再生成 IR 和汇编, 只需知道它们会写哪些全局变量.
+  // 缓存只保存汇编, -koopa 模式下不使用
+  CodeGenOptions codegen_options = options.codegen;
+  if (!options.profile_use.empty() && mode != "-koopa") {
+    auto profile = make_shared<Profile>();
+    if (!profile->load(options.profile_use)) {
+      return 1;
+    }
+    codegen_options.profile = profile;
+  }
+  unique_ptr<CompileCache> cache;
+  vector<string> func_names;
+  if (!options.cache_dir.empty() && mode != "-koopa") {
+    ostringstream flags;
+    flags << "passes=" << codegen_options.passes.str()
+          << ",alu=" << codegen_options.latency.alu
+          << ",load=" << codegen_options.latency.load
+          << ",mul=" << codegen_options.latency.mul
+          << ",div=" << codegen_options.latency.div;
+    cache = make_unique<CompileCache>(options.cache_dir, flags.str());
+    // 缓存命中的函数不在 IR 中, 看不到它们的调用
+    codegen_options.whole_program = false;
+    cache->scan(source,
+                SymbolTableManger::getInstance().get_back_table().lval_ident_map);
+    auto comp_unit = static_cast<CompUnitAST *>(ast.get());
+    for (auto &item : *comp_unit->func_def_list) {
+      auto func_def = dynamic_cast<FuncDefAST *>(item.get());
+      if (func_def == nullptr) {
+        continue;
+      }
+      func_names.push_back(func_def->ident);
+      CachedFunction entry;
+      if (cache->lookup(func_def->ident, entry)) {
+        IRManager::getInstance().cached_funcs.insert(func_def->ident);
+        codegen_options.writable_globals.insert(entry.written_globals.begin(),
+                                                entry.written_globals.end());
+      }
+    }
+  }
+
+  stringstream oss;
+  codegen_options.source_map = begin_source_map(options);
+  oss << *ast;
+  IRManager::getInstance().source_map = nullptr;
+  string irs = oss.str();
+  const auto &pipeline = codegen_options.passes;
+  if (mode == "-koopa") {
+    Remarks remarks;
+    if (codegen_options.source_map) {
+      remarks.enable(codegen_options.source_map);
+    }
+    if (!pipeline.ir_passes.empty()) {
+      vector<PassStat> stats;
+      irs = run_ir_passes(irs, pipeline, stats, remarks);
+      if (pipeline.time_passes) {
+        print_pass_stats(cerr, stats);
+      }
+    }
+    if (options.echo) {
+      cout << irs << endl;
+    }
+    output = irs;
+    if (!options.remarks_path.empty()) {
+      return write_remarks_file(options, remarks.list());
+    }
+    return 0;
+  }
+  if (options.echo) {
+    cout << irs << endl;
+  }
+  CodeGen codegen(irs, codegen_options);
+  string riscv_str = codegen.gererate();
+  if (pipeline.time_passes) {
+    print_pass_stats(cerr, codegen.pass_stats());
+  }
+  if (!options.remarks_path.empty() &&
+      write_remarks_file(options, codegen.remarks()) != 0) {
+    return 1;
+  }
+  if (!options.stats_path.empty() &&
+      write_stats_file(options, codegen.function_stats()) != 0) {
+    return 1;
+  }
+  if (cache) {
+    riscv_str = cache->merge(riscv_str, func_names, codegen.written_globals());
+    cerr << "cache: " << cache->hits << " hits, " << cache->misses
+         << " misses" << endl;
+  }
+  if (mode == "-riscv") {
+    output = riscv_str;
+    if (options.echo) {
+      cout << riscv_str << endl;
+    }
+  } else {
+    // 直接输出 ELF 目标文件, 不经过外部汇编器
+    output = ElfWriter(riscv_str).write();
+  }
+  return 0;
+}
+
+namespace {
+// 函数 IR 中用到的全局名字 (@ 开头), 不含局部的 % 名字
+set<string> referenced_names(const string &ir) {
+  set<string> names;
+  for (size_t i = 0; i < ir.size(); ++i) {
+    if (ir[i] != '@') {
+      continue;
+    }
+    size_t end = i + 1;
+    while (end < ir.size() && (isalnum(static_cast<unsigned char>(ir[end])) ||
+                               ir[end] == '_')) {
+      ++end;
+    }
+    names.insert(ir.substr(i, end - i));
+    i = end - 1;
+  }
+  return names;
+}
+
+// 输出的 IR 中函数 name (@ 开头) 的定义
+string function_ir(const string &ir, const string &name) {
+  size_t begin = ir.find("fun " + name + "(");
+  assert(begin != string::npos);
+  size_t end = ir.find("\n}", begin);
+  assert(end != string::npos);
+  return ir.substr(begin, end + 2 - begin) + "\n";
+}
+
+// 一条全局声明中定义的全局变量的 IR 名字和类型
+void collect_global_types(BaseAST *item, map<string, string> &types) {
+  auto decl = dynamic_cast<DeclAST *>(item);
+  if (decl == nullptr) {
+    return;
+  }
+  auto &table = SymbolTableManger::getInstance().get_back_table();
+  vector<unique_ptr<DefAST>> *defs = nullptr;
+  if (decl->kind == DeclAST::Kind::VAR_DECL) {
+    defs = static_cast<VarDeclAST *>(decl->var_decl.get())->var_def_list;
+  } else {
+    defs = static_cast<ConstDeclAST *>(decl->const_decl.get())->const_def_list;
+  }
+  for (auto &def : *defs) {
+    // 标量常量在编译期求值, 不占存储
+    if (def->kind == DefAST::Kind::CONST_DEF && def->array_type->dims.empty()) {
+      continue;
+    }
+    types["@" + table.lval_ident_map[def->ident]] = def->array_type->text;
+  }
+}
+} // namespace
+
+int compile_stream(const DriverOptions &options, FILE *input,
+                   string_view source, ostream &out) {
+  const string &mode = options.mode;
+  if (mode != "-koopa" && mode != "-riscv") {
+    cerr << "-stream only supports -koopa and -riscv" << endl;
+    return 1;
+  }
+  if (!options.stats_path.empty() && mode == "-koopa") {
+    cerr << "-emit-stats requires -riscv or -obj" << endl;
+    return 1;
+  }
+  if (!options.cache_dir.empty()) {
+    cerr << "-stream cannot be used with -cache-dir" << endl;
+    return 1;
+  }
+  if (options.codegen.profile_generate || !options.profile_use.empty()) {
+    cerr << "-stream cannot be used with -fprofile-*" << endl;
+    return 1;
+  }
+  unique_ptr<Lexer> lexer;
+  if (options.fast_lex) {
+    lexer = make_unique<Lexer>(source);
+    use_fast_lexer(lexer.get());
+  } else {
+    yyin = input;
+  }
+
+  // 全局变量的 IR 保留到最后生成数据段; 每个函数单独生成代码时,
+  // 只为它用到的全局变量和函数补上声明
+  ostringstream globals_ir;
+  map<string, string> global_decls;
+  map<string, string> func_decls;
+  set<string> written_globals;
+  vector<PassStat> stats;
+  Remarks remarks;
+  vector<FunctionStats> func_stats;
+  CodeGenOptions codegen_options = options.codegen;
+  codegen_options.emit_globals = false;
+  codegen_options.whole_program = false;
+  codegen_options.source_map = begin_source_map(options);
+  if (mode == "-koopa") {
+    decl_lib_functions(out);
+  }
+
+  const auto &pipeline = codegen_options.passes;
+  IRManager::getInstance().top_level_sink = [&](unique_ptr<BaseAST> item) {
+    auto func_def = dynamic_cast<FuncDefAST *>(item.get());
+    if (func_def == nullptr) {
+      if (mode == "-koopa") {
+        out << *item << "\n";
+      } else {
+        globals_ir << *item << "\n";
+      }
+      map<string, string> types;
+      collect_global_types(item.get(), types);
+      for (const auto &global : types) {
+        global_decls[global.first] =
+            "global " + global.first + " = alloc " + global.second +
+            ", zeroinit\n";
+      }
+      return;
+    }
+    if (mode == "-koopa" && pipeline.ir_passes.empty()) {
+      out << *item << "\n";
+      SymbolTableManger::getInstance().release_local_tables();
+      return;
+    }
+    ostringstream func_ir;
+    func_ir << *item << "\n";
+    string text = func_ir.str();
+    ostringstream chunk;
+    decl_lib_functions(chunk);
+    string self = "@" + func_def->ident;
+    for (const auto &name : referenced_names(text)) {
+      if (global_decls.count(name)) {
+        chunk << global_decls[name];
+      } else if (name != self && func_decls.count(name)) {
+        chunk << func_decls[name];
+      }
+    }
+    chunk << text;
+    ostringstream decl;
+    func_def->print_decl(decl);
+    func_decls[self] = decl.str();
+    SymbolTableManger::getInstance().release_local_tables();
+
+    if (mode == "-koopa") {
+      // 只对这个函数运行 IR 遍, 输出结果中它的定义
+      Remarks func_remarks;
+      if (codegen_options.source_map) {
+        func_remarks.enable(codegen_options.source_map);
+      }
+      vector<PassStat> func_pass_stats;
+      string ir = run_ir_passes(chunk.str(), pipeline, func_pass_stats,
+                                func_remarks, false);
+      out << function_ir(ir, self) << "\n";
+      merge_pass_stats(stats, func_pass_stats);
+      remarks.append(func_remarks.list());
+      return;
+    }
+    CodeGen codegen(chunk.str(), codegen_options);
+    out << codegen.gererate();
+    merge_pass_stats(stats, codegen.pass_stats());
+    remarks.append(codegen.remarks());
+    func_stats.insert(func_stats.end(), codegen.function_stats().begin(),
+                      codegen.function_stats().end());
+    for (const auto &written : codegen.written_globals()) {
+      written_globals.insert(written.second.begin(), written.second.end());
+    }
+  };
+  unique_ptr<BaseAST> ast;
+  int parse_result = yyparse(ast);
+  IRManager::getInstance().top_level_sink = nullptr;
+  IRManager::getInstance().source_map = nullptr;
+  use_fast_lexer(nullptr);
+  assert(!parse_result);
+
+  if (mode == "-riscv" && !global_decls.empty()) {
+    CodeGenOptions data_options = options.codegen;
+    data_options.writable_globals = written_globals;
+    CodeGen codegen(globals_ir.str(), data_options);
+    out << codegen.gererate();
+  }
+  if (options.codegen.passes.time_passes) {
+    print_pass_stats(cerr, stats);
+  }
+  if (!options.stats_path.empty() &&
+      write_stats_file(options, func_stats) != 0) {
+    return 1;
+  }
+  if (!options.remarks_path.empty()) {
+    return write_remarks_file(options, remarks.list());
+  }
+  return 0;
+}
@@ -3,14 +3,21 @@
 #include "util.h"
 #include <string>
 
-std::string generate_fparam_array_type(
-    std::vector<std::unique_ptr<ExpAST>> *array_dims);
-
 std::ostream &operator<<(std::ostream &os, BaseAST &ast) {
   ast.print(os);
   return os;
 };
 
+void init_global_symbols() {
+  static bool initialized = false;
+  if (initialized) {
+    return;
+  }
+  initialized = true;
+  SymbolTableManger::getInstance().push_symbol_table();
+  decl_lib_symbols();
+}
+
 void decl_lib_symbols() {
   SymbolTableManger::getInstance().alloc_ident("getint");
   SymbolTableManger::getInstance().alloc_func_has_fparams("getint", false);
@@ -73,24 +80,44 @@ void decl_lib_functions(std::ostream &os) {
   os << "\n\n";
 }
 
+std::vector<std::unique_ptr<BaseAST>> *
+add_top_level(std::vector<std::unique_ptr<BaseAST>> *list, BaseAST *item) {
+  auto &sink = IRManager::getInstance().top_level_sink;
+  if (sink) {
+    sink(std::unique_ptr<BaseAST>(item));
+  } else {
+    list->push_back(std::unique_ptr<BaseAST>(item));
+  }
+  return list;
+}
+
 void CompUnitAST::print(std::ostream &os) {
   decl_lib_functions(os);
   for (auto &item : *func_def_list) {
-    item->print(os);
+    // 函数体已经在编译缓存中时只输出声明, 供其他函数调用
+    auto func_def = dynamic_cast<FuncDefAST *>(item.get());
+    if (func_def != nullptr &&
+        IRManager::getInstance().cached_funcs.count(func_def->ident)) {
+      func_def->print_decl(os);
+    } else {
+      item->print(os);
+    }
     os << "\n";
   }
 }
 
-void FuncDefAST::print(std::ostream &os) {
-  os << "fun @" << this->ident << "(";
+void FuncDefAST::print_signature(std::ostream &os, bool with_names) {
+  os << "@" << this->ident << "(";
   if (func_fparam_list != nullptr) {
     auto func_fparams =
         SymbolTableManger::getInstance().get_func_fparams(this->ident);
     int n = func_fparams.size();
     for (int i = 0; i < n; i++) {
-      os << "@" << func_fparams[i].ident << ": ";
+      if (with_names) {
+        os << "@" << func_fparams[i].ident << ": ";
+      }
       if (func_fparams[i].array_dims != nullptr) {
-        os << generate_fparam_array_type(func_fparams[i].array_dims);
+        os << func_fparams[i].array_type->ptr_text;
       } else if (func_fparams[i].b_type == "int") {
         os << "i32";
       } else {
@@ -105,10 +132,23 @@ void FuncDefAST::print(std::ostream &os) {
   if (func_type == "int") {
     os << ": i32";
   }
+}
+
+void FuncDefAST::print_decl(std::ostream &os) {
+  os << "decl ";
+  print_signature(os, false);
+  os << "\n";
+}
+
+void FuncDefAST::print(std::ostream &os) {
+  auto source_map = IRManager::getInstance().source_map;
+  if (source_map != nullptr) {
+    source_map->begin_function(ident, line);
+  }
+  os << "fun ";
+  print_signature(os, true);
   os << " {\n";
-  os << "%"
-     << "entry"
-     << ":\n";
+  IRManager::getInstance().begin_block(os, "%entry");
   SymbolTableManger::getInstance().use_stmt_table(this->block.get());
   if (func_fparam_list != nullptr) {
     auto func_fparams =
@@ -123,22 +163,16 @@ void FuncDefAST::print(std::ostream &os) {
                 ? SymbolTable::DefType::VAR_ARRAY
                 : SymbolTable::DefType::VAR_IDENT;
         if (func_fparams[i].array_dims != nullptr) {
-          std::vector<int> dims;
-          for (auto &d : *func_fparams[i].array_dims) {
-            dims.push_back(d->calc_number());
-          }
-          SymbolTableManger::getInstance().set_array_dims(
-              func_fparams[i].ident, dims);
+          SymbolTableManger::getInstance().set_array_type(
+              func_fparams[i].ident, func_fparams[i].array_type);
         }
       SymbolTableManger::getInstance()
           .get_back_table()
           .lval_ident_map[func_fparams[i].ident] =
           this->ident + "_" + func_fparams[i].ident;
       if (func_fparams[i].array_dims != nullptr) {
-        std::string param_type =
-            generate_fparam_array_type(func_fparams[i].array_dims);
         os << "  @" << this->ident << "_" << func_fparams[i].ident
-           << " = alloc " << param_type << "\n";
+           << " = alloc " << func_fparams[i].array_type->ptr_text << "\n";
       } else {
         os << "  @" << this->ident << "_" << func_fparams[i].ident
            << " = alloc i32\n";
@@ -149,13 +183,17 @@ void FuncDefAST::print(std::ostream &os) {
   }
   block->print(os);
   SymbolTableManger::getInstance().pop_symbol_table();
-  if (!IRManager::getInstance().is_return_map[os.tellp()]) {
-    os << "  ret\n";
+  if (!IRManager::getInstance().is_block_terminated()) {
+    IRManager::getInstance().emit_ret(os);
   }
   os << "}\n";
+  if (source_map != nullptr) {
+    source_map->end_function();
+  }
 }
 
 void DeclAST::print(std::ostream &os) {
+  IRManager::getInstance().set_line(line);
   if (kind == DeclAST::Kind::VAR_DECL) {
     var_decl->print(os);
   } else if (kind == DeclAST::Kind::CONST_DECL) {
@@ -199,214 +237,160 @@ void ConstInitValAST::print(std::ostream &os) {
   }
 }
 
-// 计算数组总大小的辅助函数
-int calc_array_total_size(std::vector<std::unique_ptr<ExpAST>> *array_dims,
-                          int start_dim = 0) {
-  int total = 1;
-  for (int i = start_dim; i < array_dims->size(); i++) {
-    total *= array_dims->at(i)->calc_number();
-  }
-  return total;
-}
-
-// 生成多维数组类型字符串的辅助函数
-std::string
-generate_array_type(std::vector<std::unique_ptr<ExpAST>> *array_dims) {
-  if (array_dims->empty()) {
-    return "i32";
-  }
-
-  std::string type = "i32";
-  for (int i = array_dims->size() - 1; i >= 0; i--) {
-    int dim_size = array_dims->at(i)->calc_number();
-    type = "[" + type + ", " + std::to_string(dim_size) + "]";
-  }
-  return type;
-}
-
-// Generate pointer type string for function array parameter
-std::string generate_fparam_array_type(
-    std::vector<std::unique_ptr<ExpAST>> *array_dims) {
-  std::string base = "i32";
-  for (int i = array_dims->size() - 1; i >= 0; --i) {
-    int dim = array_dims->at(i)->calc_number();
-    base = "[" + base + ", " + std::to_string(dim) + "]";
-  }
-  return "*" + base;
-}
-
-// 计算各维度大小的辅助函数
-std::vector<int>
-calc_dims_size(std::vector<std::unique_ptr<ExpAST>> *array_dims) {
+const ArrayType *
+intern_array_type(std::vector<std::unique_ptr<ExpAST>> *array_dims) {
   std::vector<int> dims;
   for (auto &dim : *array_dims) {
     dims.push_back(dim->calc_number());
   }
-  return dims;
-}
-
-// 输出嵌套数组结构的辅助函数
-void output_nested_array(std::ostream &os, const std::vector<int> &data,
-                         const std::vector<int> &dims, int current_dim,
-                         int &index) {
-  if (current_dim == dims.size() - 1) {
-    // 最后一维，直接输出数据
-    os << "{";
-    for (int i = 0; i < dims[current_dim]; i++) {
-      os << data[index++];
-      if (i != dims[current_dim] - 1) {
-        os << ", ";
-      }
-    }
-    os << "}";
-  } else {
-    // 中间维度，递归输出
-    os << "{";
-    for (int i = 0; i < dims[current_dim]; i++) {
-      output_nested_array(os, data, dims, current_dim + 1, index);
-      if (i != dims[current_dim] - 1) {
-        os << ", ";
-      }
-    }
-    os << "}";
-  }
+  return TypeTable::getInstance().get(dims);
 }
 
-// 填充初始化列表，转换为已经填好0的形式
-void flatten_init_list(InitValAST *init_val, std::vector<int> &result,
-                       const std::vector<int> &dims, int &pos,
-                       int current_dim = 0) {
-  if (init_val->kind == InitValAST::Kind::EXP) {
-    // 遇到整数，从最后一维开始填充数据
-    if (pos < result.size()) {
-      result[pos++] = init_val->exp->calc_number();
-    }
-  } else if (init_val->kind == InitValAST::Kind::LIST) {
-    // 遇到初始化列表时
-    if (current_dim >= dims.size()) {
-      return; // 维度越界
+// 数组初始化列表的稀疏形式: 按行主序展开后显式给出的元素 (位置, 表达式),
+// 位置递增. 未给出的元素都是 0, 不展开成稠密数组
+using SparseInit = std::vector<std::pair<int, ExpAST *>>;
+
+// 收集一个初始化列表, 它初始化从 pos 开始的 dims[level..] 子数组.
+// 遇到嵌套列表时, 选择当前位置能对齐的最大子数组作为它的初始化对象,
+// 处理完后把 pos 补齐到该子数组末尾. 嵌套列表用显式栈展开,
+// 嵌套深度不受调用栈限制
+template <typename InitVal>
+void collect_sparse_init(InitVal *init_val, const ArrayType *type,
+                         size_t level, int &pos, SparseInit &result) {
+  struct Frame {
+    InitVal *init_val;
+    size_t level;
+    size_t index;
+    int start;
+    int size;
+  };
+  const auto &dims = type->dims;
+  std::vector<Frame> stack;
+  stack.push_back({init_val, level, 0, pos, type->sub_sizes[level]});
+  while (!stack.empty()) {
+    auto &frame = stack.back();
+    auto list = frame.init_val->list;
+    // 列表处理完或多余的初始值
+    if (!list || frame.index >= list->size() ||
+        pos >= frame.start + frame.size) {
+      pos = frame.start + frame.size;
+      stack.pop_back();
+      continue;
     }
-
-    // 对齐到边界：检查当前对齐到了哪一个边界
-    int aligned_dim = current_dim;
-    for (int dim = 0; dim <= current_dim; dim++) {
-      int dim_boundary = 1;
-      for (int i = dim; i < dims.size(); i++) {
-        dim_boundary *= dims[i];
-      }
-      if (pos % dim_boundary == 0) {
-        aligned_dim = dim;
-        break;
-      }
+    auto item = list->at(frame.index++).get();
+    if (item->kind == InitVal::Kind::EXP) {
+      result.push_back({pos++, item->exp.get()});
+      continue;
     }
-
-    // 将当前初始化列表视作这个边界所对应的最长维度的数组的初始化列表
-    // 递归处理列表中的每个元素
-    if (init_val->list) {
-      for (auto &item : *init_val->list) {
-        flatten_init_list(item.get(), result, dims, pos, aligned_dim + 1);
-      }
+    size_t sub = frame.level + 1;
+    while (sub < dims.size() && pos % type->sub_sizes[sub] != 0) {
+      sub++;
     }
+    sub = std::min(sub, dims.size());
+    stack.push_back({item, sub, 0, pos, type->sub_sizes[sub]});
   }
 }
 
-void init_array_val(std::ostream &os, InitValAST *init_val,
-                    std::vector<std::unique_ptr<ExpAST>> *array_dims, int dim) {
-  if (dim == 0) {
-    // 首次调用，将初始化列表转换为已经填好0的平坦数组
-    std::vector<int> dims = calc_dims_size(array_dims);
-    int total_size = calc_array_total_size(array_dims);
-    std::vector<int> flattened(total_size, 0); // 初始化为0
-
+template <typename InitVal>
+SparseInit get_sparse_init(InitVal *init_val, const ArrayType *type) {
+  SparseInit result;
+  if (init_val && init_val->kind == InitVal::Kind::LIST) {
     int pos = 0;
-    if (init_val) {
-      flatten_init_list(init_val, flattened, dims, pos, 0);
-    }
-
-    // 递归输出多维数组结构
-    int index = 0;
-    output_nested_array(os, flattened, dims, 0, index);
+    collect_sparse_init(init_val, type, 0, pos, result);
   }
+  return result;
 }
 
-// 填充常量初始化列表，转换为已经填好0的形式
-void flatten_const_init_list(ConstInitValAST *const_init_val,
-                             std::vector<int> &result,
-                             const std::vector<int> &dims, int &pos,
-                             int current_dim = 0) {
-  if (const_init_val->kind == ConstInitValAST::Kind::EXP) {
-    // 遇到整数，从最后一维开始填充数据
-    if (pos < result.size()) {
-      result[pos++] = const_init_val->exp->calc_number();
-    }
-  } else if (const_init_val->kind == ConstInitValAST::Kind::LIST) {
-    // 遇到初始化列表时
-    if (current_dim >= dims.size()) {
-      return; // 维度越界
+// 编译期求值, 只保留非零元素
+std::vector<std::pair<int, int>> calc_sparse_init(const SparseInit &init) {
+  std::vector<std::pair<int, int>> values;
+  for (const auto &elem : init) {
+    int value = elem.second->calc_number();
+    if (value != 0) {
+      values.push_back({elem.first, value});
     }
+  }
+  return values;
+}
 
-    // 对齐到边界：检查当前对齐到了哪一个边界
-    int aligned_dim = current_dim;
-    for (int dim = 0; dim <= current_dim; dim++) {
-      int dim_boundary = 1;
-      for (int i = dim; i < dims.size(); i++) {
-        dim_boundary *= dims[i];
-      }
-      if (pos % dim_boundary == 0) {
-        aligned_dim = dim;
-        break;
-      }
+// 按数组维度输出稀疏初始化, 全零的子数组直接输出 zeroinit
+void output_sparse_array(std::ostream &os,
+                         const std::vector<std::pair<int, int>> &values,
+                         const ArrayType *type, size_t level, int base,
+                         size_t &idx) {
+  const auto &dims = type->dims;
+  int size = type->sub_sizes[level];
+  if (idx == values.size() || values[idx].first >= base + size) {
+    os << "zeroinit";
+    return;
+  }
+  os << "{";
+  int child_size = type->sub_sizes[level + 1];
+  for (int i = 0; i < dims[level]; i++) {
+    if (i != 0) {
+      os << ", ";
     }
-
-    // 将当前初始化列表视作这个边界所对应的最长维度的数组的初始化列表
-    // 递归处理列表中的每个元素
-    if (const_init_val->list) {
-      for (auto &item : *const_init_val->list) {
-        flatten_const_init_list(item.get(), result, dims, pos, aligned_dim + 1);
+    int child_base = base + i * child_size;
+    if (level == dims.size() - 1) {
+      if (idx < values.size() && values[idx].first == child_base) {
+        os << values[idx++].second;
+      } else {
+        os << 0;
       }
+    } else {
+      output_sparse_array(os, values, type, level + 1, child_base, idx);
     }
   }
+  os << "}";
 }
 
-// 计算常量数组总大小的辅助函数
-int calc_const_array_total_size(const std::vector<int> &array_dims,
-                                int start_dim = 0) {
-  int total = 1;
-  for (int i = start_dim; i < array_dims.size(); i++) {
-    total *= array_dims[i];
-  }
-  return total;
+template <typename InitVal>
+void init_array_val(std::ostream &os, InitVal *init_val,
+                    const ArrayType *type) {
+  auto values = calc_sparse_init(get_sparse_init(init_val, type));
+  size_t idx = 0;
+  output_sparse_array(os, values, type, 0, 0, idx);
 }
 
-// 生成常量多维数组类型字符串的辅助函数
-std::string generate_const_array_type(const std::vector<int> &array_dims) {
-  if (array_dims.empty()) {
-    return "i32";
-  }
-
-  std::string type = "i32";
-  for (int i = array_dims.size() - 1; i >= 0; i--) {
-    int dim_size = array_dims[i];
-    type = "[" + type + ", " + std::to_string(dim_size) + "]";
+// 局部数组初始化: 编译期常量部分作为一个稀疏的聚合值整体 store,
+// 后端据此先批量清零再只写非零元素; 运行时才能求值的元素
+// 逐个用 getelemptr + store 写入
+template <typename InitVal>
+void init_local_array(std::ostream &os, const std::string &ident,
+                      InitVal *init_val, const ArrayType *type,
+                      bool is_const) {
+  SparseInit runtime;
+  std::vector<std::pair<int, int>> values;
+  for (const auto &elem : get_sparse_init(init_val, type)) {
+    if (!is_const) {
+      elem.second->print(os);
+    }
+    if (is_const || elem.second->is_number()) {
+      int value = elem.second->calc_number();
+      if (value != 0) {
+        values.push_back({elem.first, value});
+      }
+    } else {
+      runtime.push_back(elem);
+    }
   }
-  return type;
-}
-
-void init_const_array_val(std::ostream &os, ConstInitValAST *const_init_val,
-                          const std::vector<int> &array_dims, int dim) {
-  if (dim == 0) {
-    // 首次调用，将初始化列表转换为已经填好0的平坦数组
-    int total_size = calc_const_array_total_size(array_dims);
-    std::vector<int> flattened(total_size, 0); // 初始化为0
-
-    int pos = 0;
-    if (const_init_val) {
-      flatten_const_init_list(const_init_val, flattened, array_dims, pos, 0);
+  os << "  store ";
+  size_t idx = 0;
+  output_sparse_array(os, values, type, 0, 0, idx);
+  os << ", @" << ident << "\n";
+  for (const auto &elem : runtime) {
+    std::string last_ptr = "@" + ident;
+    int pos = elem.first;
+    for (size_t level = 0; level < type->dims.size(); level++) {
+      int child_size = type->sub_sizes[level + 1];
+      int reg = IRManager::getInstance().getNextReg();
+      os << "  %" << reg << " = getelemptr " << last_ptr << ", "
+         << pos / child_size << "\n";
+      pos %= child_size;
+      last_ptr = "%" + std::to_string(reg);
     }
-
-    // 递归输出多维数组结构
-    int index = 0;
-    output_nested_array(os, flattened, array_dims, 0, index);
+    os << "  store " << get_koopa_exp_reg(elem.second) << ", " << last_ptr
+       << "\n";
   }
 }
 
@@ -425,12 +409,11 @@ void VarDefAST::print(std::ostream &os) {
       os << "global @" + ident << " = alloc i32, "
          << get_koopa_exp_reg(init_val ? init_val->exp.get() : nullptr) << "\n";
     } else if (kind == DefAST::Kind::VAR_ARRAY_IDENT) {
-      std::string array_type = generate_array_type(array_dims);
-      os << "global @" + ident << " = alloc " << array_type << ", zeroinit\n";
+      os << "global @" + ident << " = alloc " << array_type->text
+         << ", zeroinit\n";
     } else if (kind == DefAST::Kind::VAR_ARRAY_DEF) {
-      std::string array_type = generate_array_type(array_dims);
-      os << "global @" + ident << " = alloc " << array_type << ", ";
-      init_array_val(os, init_val.get(), array_dims, 0);
+      os << "global @" + ident << " = alloc " << array_type->text << ", ";
+      init_array_val(os, init_val.get(), array_type);
       os << "\n";
     } else {
       assert(false);
@@ -442,12 +425,9 @@ void VarDefAST::print(std::ostream &os) {
       os << "  @" + ident << " = alloc i32\n";
     } else if ((kind == DefAST::Kind::VAR_ARRAY_IDENT ||
                 kind == DefAST::Kind::VAR_ARRAY_DEF)) {
-      std::string array_type = generate_array_type(array_dims);
-      os << "  @" + ident << " = alloc " << array_type << "\n";
+      os << "  @" + ident << " = alloc " << array_type->text << "\n";
       if (kind == DefAST::Kind::VAR_ARRAY_DEF && init_val) {
-        os << "  store ";
-        init_array_val(os, init_val.get(), array_dims, 0);
-        os << ", @" + ident << "\n";
+        init_local_array(os, ident, init_val.get(), array_type, false);
       }
     } else {
       assert(false);
@@ -470,24 +450,21 @@ void ConstDefAST::print(std::ostream &os) {
 
   if (SymbolTableManger::getInstance().get_def_type(this->ident) ==
           SymbolTable::DefType::CONST_ARRAY &&
-      !array_dims.empty()) {
+      !array_type->dims.empty()) {
     // 支持多维常量数组
-    std::string array_type = generate_const_array_type(array_dims);
-
     if (is_global) {
-      os << "global @" << ident << " = alloc " << array_type << ", ";
+      os << "global @" << ident << " = alloc " << array_type->text << ", ";
       if (const_init_val_ast) {
-        init_const_array_val(os, const_init_val_ast.get(), array_dims, 0);
+        init_array_val(os, const_init_val_ast.get(), array_type);
       } else {
         os << "zeroinit";
       }
       os << "\n";
     } else {
-      os << "  @" << ident << " = alloc " << array_type << "\n";
+      os << "  @" << ident << " = alloc " << array_type->text << "\n";
       if (const_init_val_ast) {
-        os << "  store ";
-        init_const_array_val(os, const_init_val_ast.get(), array_dims, 0);
-        os << ", @" << ident << "\n";
+        init_local_array(os, ident, const_init_val_ast.get(), array_type,
+                         true);
       }
     }
   } else if (SymbolTableManger::getInstance().get_def_type(this->ident) ==
@@ -542,23 +519,20 @@ void LValAST::print(std::ostream &os) {
 }
 
 void StmtAST::print(std::ostream &os) {
-  if (IRManager::getInstance().is_in_while &&
-      IRManager::getInstance().is_return_map[os.tellp()]) {
+  // 当前块已经结束, 剩下的语句都不可达
+  if (IRManager::getInstance().is_block_terminated()) {
     return;
   }
+  IRManager::getInstance().set_line(line);
   if (kind == StmtAST::Kind::RETURN_STMT) {
-    if (IRManager::getInstance().is_return_map[os.tellp()]) {
-      return;
-    }
     if (exp != nullptr) {
       exp->print(os);
-      os << "  ret " << get_koopa_exp_reg(exp.get()) << "\n";
+      IRManager::getInstance().emit_ret(os, get_koopa_exp_reg(exp.get()));
     } else {
-      os << "  ret\n";
+      IRManager::getInstance().emit_ret(os);
     }
-    IRManager::getInstance().is_return_map[os.tellp()] = true;
   } else if (kind == StmtAST::Kind::ASSIGN_STMT) {
-    r_exp->print(os);
+    exp->print(os);
     std::string ident =
         SymbolTableManger::getInstance().get_ident(l_val->ident);
     if (SymbolTableManger::getInstance().get_def_type(l_val->ident) ==
@@ -591,191 +565,248 @@ void StmtAST::print(std::ostream &os) {
           }
           last_ptr = "%" + std::to_string(now_reg);
         }
-      os << "  store " << get_koopa_exp_reg(r_exp.get()) << ", " << last_ptr
+      os << "  store " << get_koopa_exp_reg(exp.get()) << ", " << last_ptr
          << "\n";
     } else {
-      os << "  store " << get_koopa_exp_reg(r_exp.get()) << ", @" + ident
+      os << "  store " << get_koopa_exp_reg(exp.get()) << ", @" + ident
          << "\n";
     }
   } else if (kind == StmtAST::Kind::BLOCK_STMT) {
-    SymbolTableManger::getInstance().use_stmt_table(block.get());
-    block->print(os);
+    SymbolTableManger::getInstance().use_stmt_table(body.get());
+    body->print(os);
     SymbolTableManger::getInstance().pop_symbol_table();
   } else if (kind == StmtAST::Kind::EXP_STMT) {
     exp->print(os);
   } else if (kind == StmtAST::Kind::EMPTY_STMT) {
   } else if (kind == StmtAST::Kind::IF_STMT) {
     IRManager::getInstance().is_in_if = true;
-    if_exp->print(os);
+    exp->print(os);
     IRManager::getInstance().is_in_if = false;
-    int if_count = IRManager::getInstance().getNextIfCount();
-    os << "  br " << get_koopa_exp_reg(if_exp.get()) << ", %then_" << if_count
-       << ", %end_" << if_count << "\n";
-    os << "%then_" << if_count << ":\n";
-    if_stmt->print(os);
-    if (!IRManager::getInstance().is_return_map[os.tellp()]) {
-      os << "  jump %end_" << if_count << "\n";
+    std::string if_count =
+        std::to_string(IRManager::getInstance().getNextIfCount());
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(exp.get()),
+                                     "%then_" + if_count, "%end_" + if_count);
+    IRManager::getInstance().begin_block(os, "%then_" + if_count);
+    body->print(os);
+    if (!IRManager::getInstance().is_block_terminated()) {
+      IRManager::getInstance().emit_jump(os, "%end_" + if_count);
     }
-    os << "%end_" << if_count << ":\n";
+    IRManager::getInstance().set_line(line);
+    IRManager::getInstance().begin_block(os, "%end_" + if_count);
   } else if (kind == StmtAST::Kind::IF_ELSE_STMT) {
     IRManager::getInstance().is_in_if = true;
     IRManager::getInstance().is_in_if_else = true;
-    if_exp->print(os);
+    exp->print(os);
     IRManager::getInstance().is_in_if = false;
     IRManager::getInstance().is_in_if_else = false;
     int return_count = 0;
-    int if_count = IRManager::getInstance().getNextIfCount();
-    os << "  br " << get_koopa_exp_reg(if_exp.get()) << ", %then_" << if_count
-       << ", %else_" << if_count << "\n";
-    os << "%then_" << if_count << ":\n";
-    if_stmt->print(os);
-    if (!IRManager::getInstance().is_return_map[os.tellp()]) {
-      os << "  jump %end_" << if_count << "\n";
+    std::string if_count =
+        std::to_string(IRManager::getInstance().getNextIfCount());
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(exp.get()),
+                                     "%then_" + if_count, "%else_" + if_count);
+    IRManager::getInstance().begin_block(os, "%then_" + if_count);
+    body->print(os);
+    if (!IRManager::getInstance().is_block_terminated()) {
+      IRManager::getInstance().emit_jump(os, "%end_" + if_count);
       return_count++;
     }
-    os << "%else_" << if_count << ":\n";
+    IRManager::getInstance().set_line(line);
+    IRManager::getInstance().begin_block(os, "%else_" + if_count);
     else_stmt->print(os);
-    if (!IRManager::getInstance().is_return_map[os.tellp()]) {
-      os << "  jump %end_" << if_count << "\n";
+    if (!IRManager::getInstance().is_block_terminated()) {
+      IRManager::getInstance().emit_jump(os, "%end_" + if_count);
       return_count++;
     }
+    // 两个分支都已结束时不需要 end 块, 当前块保持结束状态
     if (return_count != 0) {
-      os << "%end_" << if_count << ":\n";
+      IRManager::getInstance().set_line(line);
+      IRManager::getInstance().begin_block(os,
+                                           "%end_" + if_count);
     }
   } else if (kind == StmtAST::Kind::WHILE_STMT) {
     IRManager::getInstance().enter_while();
-    int while_count = IRManager::getInstance().getNextWhileCount();
-    os << "  jump %entry_while_" << while_count << "\n";
-    os << "%entry_while_" << while_count << ":\n";
-    while_exp->print(os);
-    os << "  br " << get_koopa_exp_reg(while_exp.get()) << ", %while_body_"
-       << while_count << ", %while_end_" << while_count << "\n";
-    os << "%while_body_" << while_count << ":\n";
-    while_stmt->print(os);
-    if (!IRManager::getInstance().is_return_map[os.tellp()]) {
-      os << "  jump %entry_while_" << while_count << "\n";
+    std::string while_count =
+        std::to_string(IRManager::getInstance().getNextWhileCount());
+    IRManager::getInstance().emit_jump(os, "%entry_while_" + while_count);
+    IRManager::getInstance().begin_block(
+        os, "%entry_while_" + while_count);
+    exp->print(os);
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(exp.get()),
+                                     "%while_body_" + while_count,
+                                     "%while_end_" + while_count);
+    IRManager::getInstance().begin_block(
+        os, "%while_body_" + while_count);
+    body->print(os);
+    if (!IRManager::getInstance().is_block_terminated()) {
+      IRManager::getInstance().emit_jump(os, "%entry_while_" + while_count);
     }
-    os << "%while_end_" << while_count << ":\n";
+    IRManager::getInstance().set_line(line);
+    IRManager::getInstance().begin_block(
+        os, "%while_end_" + while_count);
     IRManager::getInstance().exit_while();
   } else if (kind == StmtAST::Kind::BREAK_STMT) {
-    os << "  jump %while_end_" << IRManager::getInstance().getNowWhileCount()
-       << "\n";
-    IRManager::getInstance().is_return_map[os.tellp()] = true;
+    IRManager::getInstance().emit_jump(
+        os, "%while_end_" +
+                std::to_string(IRManager::getInstance().getNowWhileCount()));
   } else if (kind == StmtAST::Kind::CONTINUE_STMT) {
-    os << "  jump %entry_while_" << IRManager::getInstance().getNowWhileCount()
-       << "\n";
-    IRManager::getInstance().is_return_map[os.tellp()] = true;
+    IRManager::getInstance().emit_jump(
+        os, "%entry_while_" +
+                std::to_string(IRManager::getInstance().getNowWhileCount()));
+  }
+}
+
+namespace {
+std::vector<std::unique_ptr<ExpAST>> pending_exps;
+bool releasing_exps = false;
+} // namespace
+
+void release_exp(std::unique_ptr<ExpAST> &exp) {
+  if (exp) {
+    pending_exps.push_back(std::move(exp));
   }
 }
 
+ExpAST::~ExpAST() {
+  if (releasing_exps) {
+    return;
+  }
+  releasing_exps = true;
+  while (!pending_exps.empty()) {
+    auto exp = std::move(pending_exps.back());
+    pending_exps.pop_back();
+    exp.reset();
+  }
+  releasing_exps = false;
+}
+
 void ExpAST::print(std::ostream &os) {
-  // unary_exp->print(os);
-  // if (unary_exp->is_number()) {
-  //   number = unary_exp->get_number();
-  //   kind = ExpAST::Kind::NUMBER;
-  // } else {
-  //   reg = unary_exp->get_reg();
-  // }
-  // add_exp->print(os);
-  // if (add_exp->is_number()) {
-  //   number = add_exp->get_number();
-  //   kind = ExpAST::Kind::NUMBER;
-  // } else {
-  //   reg = add_exp->get_reg();
-  // }
-  l_or_exp->print(os);
-  pushup_exp_reg(l_or_exp.get(), this);
+  std::vector<ExpFrame> stack;
+  stack.push_back(ExpFrame{this});
+  while (!stack.empty()) {
+    ExpAST *child = stack.back().node->print_step(os, stack.back());
+    if (child != nullptr) {
+      stack.push_back(ExpFrame{child});
+    } else {
+      stack.pop_back();
+    }
+  }
 }
 
-void PrimaryExpAST::print(std::ostream &os) {
-  if (kind == Kind::EXP) {
-    exp->print(os);
-    reg = exp->get_reg();
-  } else if (kind == Kind::L_VAL) {
-    auto l_val = this->l_val.get();
-      if (l_val->kind == LValAST::Kind::ARRAY_ACCESS) {
-        bool has_dims =
-            SymbolTableManger::getInstance().has_array_dims(l_val->ident) &&
-            !SymbolTableManger::getInstance().get_array_dims(l_val->ident).empty();
-        std::string ident =
-            SymbolTableManger::getInstance().get_ident(l_val->ident);
-        std::string last_ptr;
-        int load_reg = -1;
-        bool is_param =
-            SymbolTableManger::getInstance().is_func_param(l_val->ident);
-        if (has_dims && !is_param) {
-          last_ptr = "@" + ident;
-        } else {
-          load_reg = IRManager::getInstance().getNextReg();
-          os << "  %" << load_reg << " = load @" << ident << "\n";
-          last_ptr = "%" + std::to_string(load_reg);
-        }
-        int last_reg = -1;
-        for (int i = 0; i < l_val->array_index_list->size(); i++) {
-          int now_reg = IRManager::getInstance().getNextReg();
-          l_val->array_index_list->at(i)->print(os);
-          std::string idx = get_koopa_exp_reg(l_val->array_index_list->at(i).get());
-          if (i == 0 && (!has_dims || is_param)) {
-            os << "  %" << now_reg << " = getptr " << last_ptr << ", " << idx << "\n";
-          } else {
-            os << "  %" << now_reg << " = getelemptr " << last_ptr << ", " << idx << "\n";
-          }
-          last_ptr = "%" + std::to_string(now_reg);
-          last_reg = now_reg;
-        }
-        if (IRManager::getInstance().need_addr) {
-          int addr_reg = last_reg;
-          if (addr_reg == -1) {
-            addr_reg = IRManager::getInstance().getNextReg();
-            os << "  %" << addr_reg << " = getelemptr " << last_ptr << ", 0\n";
-          } else {
-            int tmp = IRManager::getInstance().getNextReg();
-            os << "  %" << tmp << " = getelemptr " << last_ptr << ", 0\n";
-            addr_reg = tmp;
-          }
-          reg = addr_reg;
-        } else {
-          reg = IRManager::getInstance().getNextReg();
-          os << "  %" << reg << " = load " << last_ptr << "\n";
-        }
+int ExpAST::calc_number() {
+  std::vector<ExpFrame> stack;
+  stack.push_back(ExpFrame{this});
+  while (!stack.empty()) {
+    auto &frame = stack.back();
+    // 已经求过值的子表达式直接使用
+    if (frame.step == 0 && frame.node->kind == Kind::NUMBER) {
+      stack.pop_back();
+      continue;
+    }
+    ExpAST *child = frame.node->calc_step(frame);
+    if (child != nullptr) {
+      stack.push_back(ExpFrame{child});
+    } else {
+      frame.node->kind = Kind::NUMBER;
+      stack.pop_back();
+    }
+  }
+  return number;
+}
+
+ExpAST *PrimaryExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  auto l_val = this->l_val.get();
+  if (frame.step == 1) {
+    // 数组访问: 逐个求下标, 每求完一个输出一条 getptr/getelemptr
+    if (frame.index > 0) {
+      auto index = l_val->array_index_list->at(frame.index - 1).get();
+      std::string idx = get_koopa_exp_reg(index);
+      if (frame.index == 1 && frame.use_getptr) {
+        os << "  %" << frame.reg << " = getptr " << frame.last_ptr << ", "
+           << idx << "\n";
       } else {
-        auto dtype =
-            SymbolTableManger::getInstance().get_def_type(l_val->ident);
-        if (dtype == SymbolTable::DefType::CONST) {
-          number = SymbolTableManger::getInstance().get_val(l_val->ident);
-          kind = ExpAST::Kind::NUMBER;
-        } else if (dtype == SymbolTable::DefType::VAR_ARRAY) {
-          std::string ident =
-              SymbolTableManger::getInstance().get_ident(l_val->ident);
-          bool has_dims =
-              SymbolTableManger::getInstance().has_array_dims(l_val->ident) &&
-              !SymbolTableManger::getInstance()
-                   .get_array_dims(l_val->ident)
-                   .empty();
-          bool is_param =
-              SymbolTableManger::getInstance().is_func_param(l_val->ident);
-          reg = IRManager::getInstance().getNextReg();
-          if (has_dims && !is_param) {
-            os << "  %" << reg << " = getelemptr @" << ident << ", 0\n";
-          } else {
-            os << "  %" << reg << " = load @" << ident << "\n";
-          }
-        } else {
-          reg = IRManager::getInstance().getNextReg();
-          std::string ident =
-              SymbolTableManger::getInstance().get_ident(l_val->ident);
-          os << "  %" << reg << " = load @" + ident << "\n";
-        }
+        os << "  %" << frame.reg << " = getelemptr " << frame.last_ptr << ", "
+           << idx << "\n";
+      }
+      frame.last_ptr = "%" + std::to_string(frame.reg);
+      frame.last_reg = frame.reg;
+    }
+    if (frame.index < l_val->array_index_list->size()) {
+      frame.reg = IRManager::getInstance().getNextReg();
+      return l_val->array_index_list->at(frame.index++).get();
+    }
+    if (IRManager::getInstance().need_addr) {
+      int addr_reg = frame.last_reg;
+      if (addr_reg == -1) {
+        addr_reg = IRManager::getInstance().getNextReg();
+        os << "  %" << addr_reg << " = getelemptr " << frame.last_ptr
+           << ", 0\n";
+      } else {
+        int tmp = IRManager::getInstance().getNextReg();
+        os << "  %" << tmp << " = getelemptr " << frame.last_ptr << ", 0\n";
+        addr_reg = tmp;
       }
+      reg = addr_reg;
+    } else {
+      reg = IRManager::getInstance().getNextReg();
+      os << "  %" << reg << " = load " << frame.last_ptr << "\n";
+    }
+    return nullptr;
+  }
+
+  if (kind != Kind::L_VAL) {
+    return nullptr;
   }
+  if (l_val->kind == LValAST::Kind::ARRAY_ACCESS) {
+    bool has_dims =
+        SymbolTableManger::getInstance().has_array_dims(l_val->ident) &&
+        !SymbolTableManger::getInstance().get_array_dims(l_val->ident).empty();
+    std::string ident =
+        SymbolTableManger::getInstance().get_ident(l_val->ident);
+    bool is_param =
+        SymbolTableManger::getInstance().is_func_param(l_val->ident);
+    if (has_dims && !is_param) {
+      frame.last_ptr = "@" + ident;
+    } else {
+      int load_reg = IRManager::getInstance().getNextReg();
+      os << "  %" << load_reg << " = load @" << ident << "\n";
+      frame.last_ptr = "%" + std::to_string(load_reg);
+    }
+    frame.use_getptr = !has_dims || is_param;
+    frame.step = 1;
+    return print_step(os, frame);
+  }
+  auto dtype = SymbolTableManger::getInstance().get_def_type(l_val->ident);
+  if (dtype == SymbolTable::DefType::CONST) {
+    number = SymbolTableManger::getInstance().get_val(l_val->ident);
+    kind = ExpAST::Kind::NUMBER;
+  } else if (dtype == SymbolTable::DefType::VAR_ARRAY) {
+    std::string ident =
+        SymbolTableManger::getInstance().get_ident(l_val->ident);
+    bool has_dims =
+        SymbolTableManger::getInstance().has_array_dims(l_val->ident) &&
+        !SymbolTableManger::getInstance().get_array_dims(l_val->ident).empty();
+    bool is_param =
+        SymbolTableManger::getInstance().is_func_param(l_val->ident);
+    reg = IRManager::getInstance().getNextReg();
+    if (has_dims && !is_param) {
+      os << "  %" << reg << " = getelemptr @" << ident << ", 0\n";
+    } else {
+      os << "  %" << reg << " = load @" << ident << "\n";
+    }
+  } else {
+    reg = IRManager::getInstance().getNextReg();
+    std::string ident =
+        SymbolTableManger::getInstance().get_ident(l_val->ident);
+    os << "  %" << reg << " = load @" + ident << "\n";
+  }
+  return nullptr;
 }
 
-void UnaryExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::PRIMARY_EXP) {
-    primary_exp->print(os);
-    pushup_exp_reg(primary_exp.get(), this);
-  } else if (kind == ExpAST::Kind::UNARY_OP_EXP) {
-    unary_exp->print(os);
+ExpAST *UnaryExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  switch (frame.step) {
+  case 0:
+    break;
+  case 1:
     switch (unary_op) {
     case UnaryOpKind::Plus:
       pushup_exp_reg(unary_exp.get(), this);
@@ -791,6 +822,43 @@ void UnaryExpAST::print(std::ostream &os) {
          << ", 0\n";
       break;
     }
+    return nullptr;
+  case 2: {
+    // 带参数的调用: 逐个求实参, 数组参数要取地址而不是取值
+    if (frame.index > 0) {
+      if (frame.ptr_args[frame.index - 1]) {
+        IRManager::getInstance().need_addr = false;
+      }
+      frame.args.push_back(
+          get_koopa_exp_reg(func_rparam_list->at(frame.index - 1).get()));
+    }
+    if (frame.index < func_rparam_list->size()) {
+      if (frame.ptr_args[frame.index]) {
+        IRManager::getInstance().need_addr = true;
+      }
+      return func_rparam_list->at(frame.index++).get();
+    }
+    auto DType = SymbolTableManger::getInstance().get_def_type(ident);
+    if (DType == SymbolTable::DefType::FUNC_VOID) {
+      os << "  call @" << ident << "(";
+    } else if (DType == SymbolTable::DefType::FUNC_INT) {
+      reg = IRManager::getInstance().getNextReg();
+      os << "  %" << reg << " = call @" << ident << "(";
+    }
+    for (int i = 0; i < frame.args.size(); i++) {
+      os << frame.args[i];
+      if (i != frame.args.size() - 1) {
+        os << ", ";
+      }
+    }
+    os << ")\n";
+    return nullptr;
+  }
+  }
+
+  if (kind == ExpAST::Kind::UNARY_OP_EXP) {
+    frame.step = 1;
+    return unary_exp.get();
   } else if (kind == ExpAST::Kind::FUNC_CALL_WITHOUT_PARAMS) {
     auto DType = SymbolTableManger::getInstance().get_def_type(ident);
     if (DType == SymbolTable::DefType::FUNC_VOID) {
@@ -808,59 +876,47 @@ void UnaryExpAST::print(std::ostream &os) {
           << std::endl;
       exit(1);
     }
-    std::vector<std::string> reg_list;
-    for (int i = 0; i < func_rparam_list->size(); ++i) {
-      auto &item = func_rparam_list->at(i);
-      bool expect_ptr = func_fparams[i].array_dims != nullptr ||
-                        (!func_fparams[i].b_type.empty() &&
-                         func_fparams[i].b_type[0] == '*');
-      if (expect_ptr) {
-        IRManager::getInstance().need_addr = true;
-        item->print(os);
-        IRManager::getInstance().need_addr = false;
-      } else {
-        item->print(os);
-      }
-      reg_list.push_back(get_koopa_exp_reg(item.get()));
-    }
-    auto DType = SymbolTableManger::getInstance().get_def_type(ident);
-    if (DType == SymbolTable::DefType::FUNC_VOID) {
-      os << "  call @" << ident << "(";
-    } else if (DType == SymbolTable::DefType::FUNC_INT) {
-      reg = IRManager::getInstance().getNextReg();
-      os << "  %" << reg << " = call @" << ident << "(";
-    }
-    for (int i = 0; i < reg_list.size(); i++) {
-      os << reg_list[i];
-      if (i != reg_list.size() - 1) {
-        os << ", ";
-      }
+    for (auto &fparam : func_fparams) {
+      frame.ptr_args.push_back(fparam.array_dims != nullptr ||
+                               (!fparam.b_type.empty() &&
+                                fparam.b_type[0] == '*'));
     }
-    os << ")\n";
+    frame.step = 2;
+    return print_step(os, frame);
   }
+  return nullptr;
 }
 
-void AddExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::MUL_EXP) {
-    mul_exp->print(os);
-    pushup_exp_reg(mul_exp.get(), this);
-  } else {
-    mul_exp->print(os);
-    add_exp->print(os);
+// 二元运算的 IR: 先后求两个操作数, 再输出一条运算指令
+template <typename EmitFn>
+ExpAST *print_binary_step(ExpFrame &frame, ExpAST *first, ExpAST *second,
+                          EmitFn emit) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return first;
+  case 1:
+    frame.step = 2;
+    return second;
+  default:
+    emit();
+    return nullptr;
+  }
+}
+
+ExpAST *AddExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  // 右操作数先于左操作数输出
+  return print_binary_step(frame, mul_exp.get(), add_exp.get(), [&]() {
     reg = IRManager::getInstance().getNextReg();
     const char *op = add_op == AddOpKind::Plus ? "add" : "sub";
-    os << "  %" << reg << " = " << op << " " << get_koopa_exp_reg(add_exp.get())
-       << ", " << get_koopa_exp_reg(mul_exp.get()) << "\n";
-  }
+    os << "  %" << reg << " = " << op << " "
+       << get_koopa_exp_reg(add_exp.get()) << ", "
+       << get_koopa_exp_reg(mul_exp.get()) << "\n";
+  });
 }
 
-void MulExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::UNARY_EXP) {
-    unary_exp->print(os);
-    pushup_exp_reg(unary_exp.get(), this);
-  } else {
-    mul_exp->print(os);
-    unary_exp->print(os);
+ExpAST *MulExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  return print_binary_step(frame, mul_exp.get(), unary_exp.get(), [&]() {
     reg = IRManager::getInstance().getNextReg();
     const char *op = "mul";
     switch (mul_op) {
@@ -874,98 +930,96 @@ void MulExpAST::print(std::ostream &os) {
       op = "mod";
       break;
     }
-    os << "  %" << reg << " = " << op << " " << get_koopa_exp_reg(mul_exp.get())
-       << ", " << get_koopa_exp_reg(unary_exp.get()) << "\n";
-  }
+    os << "  %" << reg << " = " << op << " "
+       << get_koopa_exp_reg(mul_exp.get()) << ", "
+       << get_koopa_exp_reg(unary_exp.get()) << "\n";
+  });
 }
 
-void LOrExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::L_AND_EXP) {
-    l_and_exp->print(os);
-    pushup_exp_reg(l_and_exp.get(), this);
-  } else {
-    l_or_exp->print(os);
-
+ExpAST *LOrExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return l_or_exp.get();
+  case 1: {
     reg = IRManager::getInstance().getNextReg();
 
     std::string tmp_var_name = "Or" + std::to_string(reg) + "_tmp_var";
     std::string lhs_false = "%lhs_false" + std::to_string(reg);
-    std::string rhs_false = "%rhs_false" + std::to_string(reg);
     std::string end = "%end_or_" + std::to_string(reg);
 
     os << "  @" + tmp_var_name << " = alloc i32\n";
     os << "  store 1, @" + tmp_var_name << "\n";
-    os << "  br " << get_koopa_exp_reg(l_or_exp.get()) << ", " << end << ", "
-       << lhs_false << "\n";
-
-    os << lhs_false << ":\n";
-    l_and_exp->print(os);
-    os << "  br " << get_koopa_exp_reg(l_and_exp.get()) << ", " << end << ", "
-       << rhs_false << "\n";
-
-    os << rhs_false << ":\n";
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(l_or_exp.get()),
+                                     end, lhs_false);
+    IRManager::getInstance().begin_block(os, lhs_false);
+    frame.step = 2;
+    return l_and_exp.get();
+  }
+  default: {
+    std::string tmp_var_name = "Or" + std::to_string(reg) + "_tmp_var";
+    std::string rhs_false = "%rhs_false" + std::to_string(reg);
+    std::string end = "%end_or_" + std::to_string(reg);
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(l_and_exp.get()),
+                                     end, rhs_false);
+    IRManager::getInstance().begin_block(os, rhs_false);
     os << "  store 0, @" + tmp_var_name << "\n";
-    os << "  jump " << end << "\n";
-
-    os << end << ":\n";
+    IRManager::getInstance().emit_jump(os, end);
+    IRManager::getInstance().begin_block(os, end);
     os << "  %" << reg << " = load @" + tmp_var_name << "\n";
+    return nullptr;
+  }
   }
 }
 
-void LAndExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::EQ_EXP) {
-    eq_exp->print(os);
-    pushup_exp_reg(eq_exp.get(), this);
-  } else {
-    l_and_exp->print(os);
-
+ExpAST *LAndExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return l_and_exp.get();
+  case 1: {
     reg = IRManager::getInstance().getNextReg();
 
     std::string tmp_var_name = "And" + std::to_string(reg) + "_tmp_var";
     std::string lhs_true = "%lhs_true" + std::to_string(reg);
     std::string rhs_false = "%rhs_false" + std::to_string(reg);
-    std::string end = "%end_and_" + std::to_string(reg);
 
     os << "  @" + tmp_var_name << " = alloc i32\n";
     os << "  store 1, @" + tmp_var_name << "\n";
-    os << "  br " << get_koopa_exp_reg(l_and_exp.get()) << ", " << lhs_true
-       << ", " << rhs_false << "\n";
-
-    os << lhs_true << ":\n";
-    eq_exp->print(os);
-    os << "  br " << get_koopa_exp_reg(eq_exp.get()) << ", " << end << ", "
-       << rhs_false << "\n";
-
-    os << rhs_false << ":\n";
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(l_and_exp.get()),
+                                     lhs_true, rhs_false);
+    IRManager::getInstance().begin_block(os, lhs_true);
+    frame.step = 2;
+    return eq_exp.get();
+  }
+  default: {
+    std::string tmp_var_name = "And" + std::to_string(reg) + "_tmp_var";
+    std::string rhs_false = "%rhs_false" + std::to_string(reg);
+    std::string end = "%end_and_" + std::to_string(reg);
+    IRManager::getInstance().emit_br(os, get_koopa_exp_reg(eq_exp.get()), end,
+                                     rhs_false);
+    IRManager::getInstance().begin_block(os, rhs_false);
     os << "  store 0, @" + tmp_var_name << "\n";
-    os << "  jump " << end << "\n";
-
-    os << end << ":\n";
+    IRManager::getInstance().emit_jump(os, end);
+    IRManager::getInstance().begin_block(os, end);
     os << "  %" << reg << " = load @" + tmp_var_name << "\n";
+    return nullptr;
+  }
   }
 }
 
-void EqExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::REL_EXP) {
-    rel_exp->print(os);
-    pushup_exp_reg(rel_exp.get(), this);
-  } else {
-    eq_exp->print(os);
-    rel_exp->print(os);
+ExpAST *EqExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  return print_binary_step(frame, eq_exp.get(), rel_exp.get(), [&]() {
     reg = IRManager::getInstance().getNextReg();
     const char *op = logical_op == LogicalOpKind::Equal ? "eq" : "ne";
-    os << "  %" << reg << " = " << op << " " << get_koopa_exp_reg(eq_exp.get())
-       << ", " << get_koopa_exp_reg(rel_exp.get()) << "\n";
-  }
+    os << "  %" << reg << " = " << op << " "
+       << get_koopa_exp_reg(eq_exp.get()) << ", "
+       << get_koopa_exp_reg(rel_exp.get()) << "\n";
+  });
 }
 
-void RelExpAST::print(std::ostream &os) {
-  if (kind == ExpAST::Kind::ADD_EXP) {
-    add_exp->print(os);
-    pushup_exp_reg(add_exp.get(), this);
-  } else {
-    rel_exp->print(os);
-    add_exp->print(os);
+ExpAST *RelExpAST::print_step(std::ostream &os, ExpFrame &frame) {
+  return print_binary_step(frame, rel_exp.get(), add_exp.get(), [&]() {
     reg = IRManager::getInstance().getNextReg();
     const char *op = nullptr;
     switch (logical_op) {
@@ -988,156 +1042,131 @@ void RelExpAST::print(std::ostream &os) {
       os << "  %" << reg << " = " << op << " "
          << get_koopa_exp_reg(rel_exp.get()) << ", "
          << get_koopa_exp_reg(add_exp.get()) << "\n";
-  }
+  });
 }
 
-namespace {
-template <typename Node, typename Fn>
-int calc_number_impl(Node &node, Fn compute) {
-  if (node.kind != ExpAST::Kind::NUMBER) {
-    node.number = compute();
-    node.kind = ExpAST::Kind::NUMBER;
-  }
-  return node.number;
+ExpAST *PrimaryExpAST::calc_step(ExpFrame &frame) {
+  assert(kind == Kind::L_VAL);
+  number = SymbolTableManger::getInstance().get_back_table().val_map[l_val->ident];
+  return nullptr;
 }
-} // namespace
 
-int ExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::L_OR_EXP) {
-      return l_or_exp->calc_number();
-    }
-    assert(false);
-    return 0;
-  });
+ExpAST *UnaryExpAST::calc_step(ExpFrame &frame) {
+  assert(kind == ExpAST::Kind::UNARY_OP_EXP);
+  assert(unary_op == UnaryOpKind::Minus || unary_op == UnaryOpKind::Plus);
+  if (frame.step == 0) {
+    frame.step = 1;
+    return unary_exp.get();
+  }
+  number =
+      unary_op == UnaryOpKind::Minus ? -unary_exp->number : unary_exp->number;
+  return nullptr;
 }
 
-int PrimaryExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == Kind::EXP) {
-      return exp->calc_number();
-    }
-    if (kind == Kind::L_VAL) {
-      return SymbolTableManger::getInstance()
-          .get_back_table()
-          .val_map[l_val->ident];
-    }
-    assert(false);
-    return 0;
-  });
+// 二元运算的编译期求值: 先求两个操作数, 再由 combine 算出结果
+template <typename CombineFn>
+ExpAST *calc_binary_step(ExpFrame &frame, ExpAST *self, ExpAST *first,
+                         ExpAST *second, CombineFn combine) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return first;
+  case 1:
+    frame.step = 2;
+    return second;
+  default:
+    self->number = combine(first->number, second->number);
+    return nullptr;
+  }
 }
 
-int UnaryExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::PRIMARY_EXP) {
-      return primary_exp->calc_number();
-    }
-    if (unary_op == UnaryOpKind::Minus) {
-      return -unary_exp->calc_number();
-    }
-    if (unary_op == UnaryOpKind::Plus) {
-      return unary_exp->calc_number();
-    }
-    assert(false);
-    return 0;
-  });
+ExpAST *MulExpAST::calc_step(ExpFrame &frame) {
+  return calc_binary_step(frame, this, mul_exp.get(), unary_exp.get(),
+                          [&](int lhs, int rhs) {
+                            switch (mul_op) {
+                            case MulOpKind::Mul:
+                              return lhs * rhs;
+                            case MulOpKind::Div:
+                              return lhs / rhs;
+                            case MulOpKind::Mod:
+                              return lhs % rhs;
+                            }
+                            assert(false);
+                            return 0;
+                          });
 }
 
-int MulExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::UNARY_EXP) {
-      return unary_exp->calc_number();
-    }
-    if (mul_op == MulOpKind::Mul) {
-      return mul_exp->calc_number() * unary_exp->calc_number();
-    }
-    if (mul_op == MulOpKind::Div) {
-      return mul_exp->calc_number() / unary_exp->calc_number();
-    }
-    if (mul_op == MulOpKind::Mod) {
-      return mul_exp->calc_number() % unary_exp->calc_number();
-    }
-    assert(false);
-    return 0;
-  });
+ExpAST *AddExpAST::calc_step(ExpFrame &frame) {
+  return calc_binary_step(frame, this, add_exp.get(), mul_exp.get(),
+                          [&](int lhs, int rhs) {
+                            return add_op == AddOpKind::Plus ? lhs + rhs
+                                                             : lhs - rhs;
+                          });
 }
 
-int AddExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::MUL_EXP) {
-      return mul_exp->calc_number();
-    }
-    if (add_op == AddOpKind::Plus) {
-      return add_exp->calc_number() + mul_exp->calc_number();
-    }
-    if (add_op == AddOpKind::Minus) {
-      return add_exp->calc_number() - mul_exp->calc_number();
-    }
-    assert(false);
-    return 0;
-  });
+ExpAST *RelExpAST::calc_step(ExpFrame &frame) {
+  return calc_binary_step(frame, this, rel_exp.get(), add_exp.get(),
+                          [&](int lhs, int rhs) {
+                            switch (logical_op) {
+                            case LogicalOpKind::Greater:
+                              return lhs > rhs ? 1 : 0;
+                            case LogicalOpKind::Less:
+                              return lhs < rhs ? 1 : 0;
+                            case LogicalOpKind::GreaterEqual:
+                              return lhs >= rhs ? 1 : 0;
+                            case LogicalOpKind::LessEqual:
+                              return lhs <= rhs ? 1 : 0;
+                            default:
+                              assert(false);
+                              return 0;
+                            }
+                          });
 }
 
-int RelExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::ADD_EXP) {
-      return add_exp->calc_number();
-    }
-    if (logical_op == LogicalOpKind::Greater) {
-      return rel_exp->calc_number() > add_exp->calc_number() ? 1 : 0;
-    }
-    if (logical_op == LogicalOpKind::Less) {
-      return rel_exp->calc_number() < add_exp->calc_number() ? 1 : 0;
-    }
-    if (logical_op == LogicalOpKind::GreaterEqual) {
-      return rel_exp->calc_number() >= add_exp->calc_number() ? 1 : 0;
-    }
-    if (logical_op == LogicalOpKind::LessEqual) {
-      return rel_exp->calc_number() <= add_exp->calc_number() ? 1 : 0;
-    }
-    assert(false);
-    return 0;
-  });
+ExpAST *EqExpAST::calc_step(ExpFrame &frame) {
+  return calc_binary_step(frame, this, eq_exp.get(), rel_exp.get(),
+                          [&](int lhs, int rhs) {
+                            if (logical_op == LogicalOpKind::Equal) {
+                              return lhs == rhs ? 1 : 0;
+                            }
+                            assert(logical_op == LogicalOpKind::NotEqual);
+                            return lhs != rhs ? 1 : 0;
+                          });
 }
 
-int EqExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::REL_EXP) {
-      return rel_exp->calc_number();
-    }
-    if (logical_op == LogicalOpKind::Equal) {
-      return rel_exp->calc_number() == eq_exp->calc_number() ? 1 : 0;
+// 逻辑运算短路: 左操作数已经决定结果时不再求右操作数
+ExpAST *LAndExpAST::calc_step(ExpFrame &frame) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return l_and_exp.get();
+  case 1:
+    if (!l_and_exp->number) {
+      number = 0;
+      return nullptr;
     }
-    if (logical_op == LogicalOpKind::NotEqual) {
-      return rel_exp->calc_number() != eq_exp->calc_number() ? 1 : 0;
-    }
-    assert(false);
-    return 0;
-  });
+    frame.step = 2;
+    return eq_exp.get();
+  default:
+    number = eq_exp->number ? 1 : 0;
+    return nullptr;
+  }
 }
 
-int LAndExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::EQ_EXP) {
-      return eq_exp->calc_number();
-    }
-    if (kind == ExpAST::Kind::L_AND_EXP) {
-      return l_and_exp->calc_number() && eq_exp->calc_number() ? 1 : 0;
+ExpAST *LOrExpAST::calc_step(ExpFrame &frame) {
+  switch (frame.step) {
+  case 0:
+    frame.step = 1;
+    return l_or_exp.get();
+  case 1:
+    if (l_or_exp->number) {
+      number = 1;
+      return nullptr;
     }
-    assert(false);
-    return 0;
-  });
+    frame.step = 2;
+    return l_and_exp.get();
+  default:
+    number = l_and_exp->number ? 1 : 0;
+    return nullptr;
+  }
 }
-
-int LOrExpAST::calc_number() {
-  return calc_number_impl(*this, [&]() {
-    if (kind == ExpAST::Kind::L_AND_EXP) {
-      return l_and_exp->calc_number();
-    }
-    if (kind == ExpAST::Kind::L_OR_EXP) {
-      return l_or_exp->calc_number() || l_and_exp->calc_number() ? 1 : 0;
-    }
-    assert(false);
-    return 0;
-  });
-}
\ No newline at end of file
@@ -0,0 +1,278 @@
+// lexer.cpp
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "lexer.h"
+
+MappedFile::~MappedFile() {
+  if (mapped) {
+    munmap(const_cast<char *>(base), size);
+  }
+}
+
+bool MappedFile::open(const char *path) {
+  int fd = ::open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      madvise(addr, st.st_size, MADV_SEQUENTIAL);
+      base = static_cast<const char *>(addr);
+      size = st.st_size;
+      mapped = true;
+      close(fd);
+      return true;
+    }
+  }
+  // 空文件或管道等无法映射的输入, 直接读进内存
+  char chunk[4096];
+  ssize_t len;
+  while ((len = read(fd, chunk, sizeof(chunk))) > 0) {
+    buffer.append(chunk, len);
+  }
+  close(fd);
+  base = buffer.data();
+  size = buffer.size();
+  return len == 0;
+}
+
+namespace {
+bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+bool is_ident_start(char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+bool is_ident_char(char c) { return is_ident_start(c) || (c >= '0' && c <= '9'); }
+
+bool is_hex_digit(char c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') ||
+         (c >= 'A' && c <= 'F');
+}
+
+int hex_value(char c) {
+  if (c <= '9') {
+    return c - '0';
+  }
+  return (c | 0x20) - 'a' + 10;
+}
+
+#if defined(__SSE2__)
+// 返回 16 字节中第一个不满足条件的位置, 全部满足时返回 16
+int first_zero(int mask) {
+  mask = ~mask & 0xffff;
+  return mask == 0 ? 16 : __builtin_ctz(mask);
+}
+
+int space_mask(__m128i v) {
+  __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                           _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+  m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  return _mm_movemask_epi8(m);
+}
+
+// 大于 0x7f 的字节按有符号比较是负数, 不会被当成标识符字符
+int ident_mask(__m128i v) {
+  __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+  __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), lower));
+  __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), v));
+  __m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+  return _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+}
+#endif
+
+// 跳过空白, 顺便把跳过的换行数加到 lines 上
+const char *skip_spaces(const char *p, const char *end, int &lines) {
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int n = first_zero(space_mask(v));
+    int newlines = _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    lines += __builtin_popcount(newlines & ((1 << n) - 1));
+    p += n;
+    if (n < 16) {
+      return p;
+    }
+  }
+#endif
+  while (p < end && is_space(*p)) {
+    lines += *p == '\n';
+    ++p;
+  }
+  return p;
+}
+
+const char *skip_ident(const char *p, const char *end) {
+#if defined(__SSE2__)
+  while (end - p >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    int n = first_zero(ident_mask(v));
+    p += n;
+    if (n < 16) {
+      return p;
+    }
+  }
+#endif
+  while (p < end && is_ident_char(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+// 找 "*/", 返回其后的位置; 没有找到返回 nullptr
+const char *find_comment_end(const char *p, const char *end) {
+  while (p < end) {
+    // memchr 在 libc 中已经按字长/向量扫描
+    auto star = static_cast<const char *>(std::memchr(p, '*', end - p));
+    if (star == nullptr || star + 1 >= end) {
+      return nullptr;
+    }
+    if (star[1] == '/') {
+      return star + 2;
+    }
+    p = star + 1;
+  }
+  return nullptr;
+}
+
+TokenKind keyword_kind(std::string_view word) {
+  switch (word.size()) {
+  case 2:
+    return word == "if" ? TokenKind::IF : TokenKind::IDENT;
+  case 3:
+    return word == "int" ? TokenKind::INT : TokenKind::IDENT;
+  case 4:
+    if (word == "void") {
+      return TokenKind::VOID;
+    }
+    return word == "else" ? TokenKind::ELSE : TokenKind::IDENT;
+  case 5:
+    if (word == "const") {
+      return TokenKind::CONST;
+    }
+    if (word == "while") {
+      return TokenKind::WHILE;
+    }
+    return word == "break" ? TokenKind::BREAK : TokenKind::IDENT;
+  case 6:
+    return word == "return" ? TokenKind::RETURN : TokenKind::IDENT;
+  case 8:
+    return word == "continue" ? TokenKind::CONTINUE : TokenKind::IDENT;
+  default:
+    return TokenKind::IDENT;
+  }
+}
+} // namespace
+
+void Lexer::skip_space_and_comments() {
+  while (true) {
+    pos = skip_spaces(pos, end, cur_line);
+    if (end - pos < 2 || pos[0] != '/') {
+      return;
+    }
+    if (pos[1] == '/') {
+      auto nl = static_cast<const char *>(std::memchr(pos, '\n', end - pos));
+      pos = nl == nullptr ? end : nl;
+    } else if (pos[1] == '*') {
+      // 未闭合的块注释与 flex 一致, 按单个字符 '/' 处理
+      const char *after = find_comment_end(pos + 2, end);
+      if (after == nullptr) {
+        return;
+      }
+      cur_line += std::count(pos, after, '\n');
+      pos = after;
+    } else {
+      return;
+    }
+  }
+}
+
+Token Lexer::next() {
+  skip_space_and_comments();
+  Token tok;
+  if (pos >= end) {
+    return tok;
+  }
+  const char *start = pos;
+  char c = *pos;
+  if (is_ident_start(c)) {
+    pos = skip_ident(pos + 1, end);
+    tok.text = std::string_view(start, pos - start);
+    tok.kind = keyword_kind(tok.text);
+    return tok;
+  }
+  if (c >= '0' && c <= '9') {
+    // 与 strtol(text, nullptr, 0) 一致: 溢出时饱和到 long 的最大值
+    const unsigned long long limit = std::numeric_limits<long>::max();
+    unsigned long long value = 0;
+    auto accumulate = [&](unsigned base, unsigned digit) {
+      value = value > (limit - digit) / base ? limit : value * base + digit;
+    };
+    if (c != '0') {
+      while (pos < end && *pos >= '0' && *pos <= '9') {
+        accumulate(10, *pos++ - '0');
+      }
+    } else if (end - pos > 2 && (pos[1] | 0x20) == 'x' && is_hex_digit(pos[2])) {
+      pos += 2;
+      while (pos < end && is_hex_digit(*pos)) {
+        accumulate(16, hex_value(*pos++));
+      }
+    } else {
+      ++pos;
+      while (pos < end && *pos >= '0' && *pos <= '7') {
+        accumulate(8, *pos++ - '0');
+      }
+    }
+    tok.kind = TokenKind::INT_CONST;
+    tok.text = std::string_view(start, pos - start);
+    tok.value = static_cast<int>(static_cast<long>(value));
+    return tok;
+  }
+  char n = end - pos > 1 ? pos[1] : '\0';
+  tok.kind = TokenKind::CHAR;
+  if (n == '=') {
+    if (c == '>') {
+      tok.kind = TokenKind::GREATER_EQUAL;
+    } else if (c == '<') {
+      tok.kind = TokenKind::LESS_EQUAL;
+    } else if (c == '=') {
+      tok.kind = TokenKind::EQUAL;
+    } else if (c == '!') {
+      tok.kind = TokenKind::NOT_EQUAL;
+    }
+  } else if (c == '|' && n == '|') {
+    tok.kind = TokenKind::OR;
+  } else if (c == '&' && n == '&') {
+    tok.kind = TokenKind::AND;
+  }
+  if (tok.kind != TokenKind::CHAR) {
+    pos += 2;
+  } else {
+    if (c == '>') {
+      tok.kind = TokenKind::GREATER;
+    } else if (c == '<') {
+      tok.kind = TokenKind::LESS;
+    }
+    ++pos;
+  }
+  tok.text = std::string_view(start, pos - start);
+  tok.value = c;
+  return tok;
+}
@@ -0,0 +1,88 @@
+// source_map.cpp
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+
+#include "source_map.h"
+
+void SourceMap::begin_function(const std::string &name, int line) {
+  cur = &funcs[name];
+  *cur = FunctionLines();
+  cur_block = nullptr;
+  cur->line = line;
+  cur_line = line;
+}
+
+void SourceMap::set_line(int next_reg, int line) {
+  cur_line = line;
+  if (cur == nullptr) {
+    return;
+  }
+  auto &values = cur->values;
+  // 同一编号处只保留最后设置的行, 连续的相同行合并
+  if (!values.empty() && values.back().first == next_reg) {
+    values.pop_back();
+  }
+  if (values.empty() || values.back().second != line) {
+    values.push_back({next_reg, line});
+  }
+}
+
+void SourceMap::add_block(const std::string &label) {
+  if (cur != nullptr) {
+    cur_block = &cur->blocks[label];
+    *cur_block = {cur_line, cur_line};
+  }
+}
+
+void SourceMap::end_block() {
+  if (cur_block != nullptr) {
+    cur_block->second = cur_line;
+  }
+}
+
+const SourceMap::FunctionLines *
+SourceMap::find(const std::string &func) const {
+  auto it = funcs.find(func);
+  return it == funcs.end() ? nullptr : &it->second;
+}
+
+int SourceMap::function_line(const std::string &func) const {
+  auto lines = find(func);
+  return lines == nullptr ? 0 : lines->line;
+}
+
+int SourceMap::block_line(const std::string &func,
+                          const std::string &label) const {
+  auto lines = find(func);
+  if (lines == nullptr) {
+    return 0;
+  }
+  auto it = lines->blocks.find(label);
+  return it == lines->blocks.end() ? 0 : it->second.first;
+}
+
+int SourceMap::terminator_line(const std::string &func,
+                               const std::string &label) const {
+  auto lines = find(func);
+  if (lines == nullptr) {
+    return 0;
+  }
+  auto it = lines->blocks.find(label);
+  return it == lines->blocks.end() ? 0 : it->second.second;
+}
+
+int SourceMap::value_line(const std::string &func,
+                          const std::string &name) const {
+  auto lines = find(func);
+  if (lines == nullptr || name.size() < 2 || name[0] != '%' ||
+      name[1] < '0' || name[1] > '9') {
+    return 0;
+  }
+  int reg = std::atoi(name.c_str() + 1);
+  const auto &values = lines->values;
+  auto it = std::upper_bound(
+      values.begin(), values.end(), reg,
+      [](int reg, const std::pair<int, int> &run) { return reg < run.first; });
+  return it == values.begin() ? 0 : std::prev(it)->second;
+}
@@ -63,7 +63,11 @@ std::string SymbolTableManger::get_lval_ident(const std::string &ident) {
 }
 
 void SymbolTableManger::push_symbol_table() {
-  symbol_table_stack.push_back(new SymbolTable());
+  auto table = new SymbolTable();
+  if (!symbol_table_stack.empty()) {
+    local_tables.push_back(table);
+  }
+  symbol_table_stack.push_back(table);
 }
 
 void SymbolTableManger::alloc_stmt_table(BaseAST *stmt) {
@@ -78,6 +82,15 @@ void SymbolTableManger::pop_symbol_table() {
   symbol_table_stack.pop_back();
 }
 
+void SymbolTableManger::release_local_tables() {
+  assert(is_global_table());
+  for (auto table : local_tables) {
+    delete table;
+  }
+  local_tables.clear();
+  stmt_table_map.clear();
+}
+
 bool SymbolTableManger::is_var_defined(const std::string &ident) {
   for (auto table = symbol_table_stack.rbegin();
        table != symbol_table_stack.rend(); ++table) {
@@ -99,22 +112,25 @@ std::vector<int> SymbolTableManger::get_const_array_val(const std::string &ident
   return table->const_array_val_map[ident];
 }
 
-std::vector<int> SymbolTableManger::get_array_dims(const std::string &ident) {
+const std::vector<int> &
+SymbolTableManger::get_array_dims(const std::string &ident) {
   auto table = find_table(ident);
   assert(table);
-  return table->array_dims_map[ident];
+  auto it = table->array_type_map.find(ident);
+  assert(it != table->array_type_map.end());
+  return it->second->dims;
 }
 
 bool SymbolTableManger::has_array_dims(const std::string &ident) {
   auto table = find_table(ident);
   if (!table)
     return false;
-  return table->array_dims_map.find(ident) != table->array_dims_map.end();
+  return table->array_type_map.find(ident) != table->array_type_map.end();
 }
 
-void SymbolTableManger::set_array_dims(const std::string &ident,
-                                       const std::vector<int> &dims) {
-  get_back_table().array_dims_map[ident] = dims;
+void SymbolTableManger::set_array_type(const std::string &ident,
+                                       const ArrayType *type) {
+  get_back_table().array_type_map[ident] = type;
 }
 
 std::vector<FuncFParamAST>
@@ -15,6 +15,13 @@
 #include "ast.h"
 #include "symbol_table.h"
 
+// 语义值都是指针和整数, 解析栈可以直接按字节搬移 (bison 已定义
+// YYSTYPE_IS_TRIVIAL). 括号和语句嵌套很深的生成代码需要更大的上限
+#define YYMAXDEPTH 10000000
+
+// 位置只记录行号, 产生式的位置是它第一个符号所在的行 (空产生式取前一个符号的行)
+#define YYLLOC_DEFAULT(Cur, Rhs, N) ((Cur) = YYRHSLOC(Rhs, (N) ? 1 : 0))
+
 // 声明 lexer 函数和错误处理函数
 int yylex();
 void yyerror(std::unique_ptr<std::string> &ast, const char *s);
@@ -30,6 +37,10 @@ using namespace std;
 // %parse-param { std::unique_ptr<std::string> &ast }
 %parse-param { std::unique_ptr<BaseAST> &ast }
 
+// 语句, 声明和函数定义记录所在的源码行, 用于优化报告 (-remarks)
+%locations
+%define api.location.type {int}
+
 // yylval 的定义, 我们把它定义成了一个联合体 (union)
 // 因为 token 的值有的是字符串指针, 有的是整数
 // 之前我们在 lexer 中用到的 str_val 和 int_val 就是在这里被定义的
@@ -85,8 +96,7 @@ using namespace std;
 // CompUnit ::= [CompUnit] (FuncDef | Decl) ;
 CompUnit
   : {
-    SymbolTableManger::getInstance().push_symbol_table();
-    decl_lib_symbols();
+    init_global_symbols();
   }
   CompUnitList {
     auto comp_unit = make_unique<CompUnitAST>();
@@ -98,24 +108,16 @@ CompUnit
 // CompUnitList ::= CompUnitList (FuncDef | Decl);
 CompUnitList
   : FuncDef {
-    auto vec = new vector<unique_ptr<BaseAST>>();
-    vec->push_back(unique_ptr<BaseAST>($1));
-    $$ = vec;
+    $$ = add_top_level(new vector<unique_ptr<BaseAST>>(), $1);
   }
   | Decl {
-    auto vec = new vector<unique_ptr<BaseAST>>();
-    vec->push_back(unique_ptr<BaseAST>($1));
-    $$ = vec;
+    $$ = add_top_level(new vector<unique_ptr<BaseAST>>(), $1);
   }
   | CompUnitList FuncDef {
-    auto vec = $1;
-    vec->push_back(unique_ptr<BaseAST>($2));
-    $$ = vec;
+    $$ = add_top_level($1, $2);
   }
   | CompUnitList Decl {
-    auto vec = $1;
-    vec->push_back(unique_ptr<BaseAST>($2));
-    $$ = vec;
+    $$ = add_top_level($1, $2);
   }
   ;
 
@@ -123,12 +125,12 @@ CompUnitList
 FuncFParamList
   : FuncFParam {
     auto vec = new vector<FuncFParamAST>();
-    vec->push_back(*((FuncFParamAST *)$1));
+    vec->push_back(*unique_ptr<FuncFParamAST>((FuncFParamAST *)$1));
     $$ = vec;
   }
   | FuncFParamList ',' FuncFParam {
     auto vec = $1;
-    vec->push_back(*((FuncFParamAST *)$3));
+    vec->push_back(*unique_ptr<FuncFParamAST>((FuncFParamAST *)$3));
     $$ = vec;
   }
   ;
@@ -148,6 +150,7 @@ FuncFParam
     ast->b_type = *unique_ptr<string>($1);
     ast->ident = *unique_ptr<string>($2);
     ast->array_dims = $5;
+    ast->array_type = intern_array_type($5);
     $$ = ast;
   }
   ;
@@ -167,6 +170,7 @@ FuncDef
       SymbolTableManger::getInstance().push_symbol_table();
     } Block {
       auto ast = new FuncDefAST();
+      ast->line = @2;
       ast->func_type = *unique_ptr<string>($1);
       ast->ident = *unique_ptr<string>($2);
       ast->func_fparam_list = nullptr;
@@ -189,11 +193,7 @@ FuncDef
             std::string(*$2) + "_" + param.ident;
         SymbolTableManger::getInstance().set_func_param(param.ident);
         if (param.array_dims != nullptr) {
-          std::vector<int> dims;
-          for (auto &d : *param.array_dims) {
-            dims.push_back(d->calc_number());
-          }
-          SymbolTableManger::getInstance().set_array_dims(param.ident, dims);
+          SymbolTableManger::getInstance().set_array_type(param.ident, param.array_type);
           SymbolTableManger::getInstance().get_back_table().def_type_map[param.ident] = SymbolTable::DefType::VAR_ARRAY;
         } else {
           SymbolTableManger::getInstance().get_back_table().def_type_map[param.ident] = SymbolTable::DefType::VAR_IDENT;
@@ -201,6 +201,7 @@ FuncDef
       }
     } Block {
       auto ast = new FuncDefAST();
+      ast->line = @2;
       ast->func_type = *unique_ptr<string>($1);
       ast->ident = *unique_ptr<string>($2);
       ast->func_fparam_list = $4;
@@ -232,12 +233,14 @@ Type
 Decl
   : ConstDecl {
     auto ast = new DeclAST();
+    ast->line = @$;
     ast->kind = DeclAST::Kind::CONST_DECL;
     ast->const_decl = unique_ptr<BaseAST>($1);
     $$ = ast;
   }
   | VarDecl {
     auto ast = new DeclAST();
+    ast->line = @$;
     ast->kind = DeclAST::Kind::VAR_DECL;
     ast->var_decl = unique_ptr<BaseAST>($1);
     $$ = ast;
@@ -279,13 +282,9 @@ VarDefList
     vec->push_back(unique_ptr<DefAST>($1));
     $$ = vec;
   }
-  | VarDef ',' VarDefList {
-    auto vec = new vector<unique_ptr<DefAST>>();
-    vec->push_back(unique_ptr<DefAST>($1));
-    for (auto &item : *$3) {
-      vec->push_back(std::move(item));
-    }
-    delete $3;
+  | VarDefList ',' VarDef {
+    auto vec = $1;
+    vec->push_back(unique_ptr<DefAST>($3));
     $$ = vec;
   }
   ;
@@ -296,13 +295,13 @@ VarDef
     auto ast = new VarDefAST();
     ast->ident = *unique_ptr<string>($1);
     ast->array_dims = $2;
+    ast->array_type = intern_array_type($2);
     if ($2->empty()) {
       ast->kind = DefAST::Kind::VAR_IDENT;
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::VAR_IDENT;
     } else {
       ast->kind = DefAST::Kind::VAR_ARRAY_IDENT;
-      std::vector<int> dims; for(auto &d:*$2) dims.push_back(d->calc_number());
-      SymbolTableManger::getInstance().set_array_dims(ast->ident, dims);
+      SymbolTableManger::getInstance().set_array_type(ast->ident, ast->array_type);
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::VAR_ARRAY;
     }
     SymbolTableManger::getInstance().get_back_table().lval_ident_map[ast->ident] = SymbolTableManger::getInstance().get_lval_ident(ast->ident);
@@ -312,14 +311,14 @@ VarDef
     auto ast = new VarDefAST();
     ast->ident = *unique_ptr<string>($1);
     ast->array_dims = $2;
+    ast->array_type = intern_array_type($2);
     ast->init_val = std::unique_ptr<InitValAST>($4);
     if ($2->empty()) {
       ast->kind = DefAST::Kind::VAR_DEF;
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::VAR_EXP;
     } else {
       ast->kind = DefAST::Kind::VAR_ARRAY_DEF;
-      std::vector<int> dims; for(auto &d:*$2) dims.push_back(d->calc_number());
-      SymbolTableManger::getInstance().set_array_dims(ast->ident, dims);
+      SymbolTableManger::getInstance().set_array_type(ast->ident, ast->array_type);
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::VAR_ARRAY;
     }
     SymbolTableManger::getInstance().get_back_table().lval_ident_map[ast->ident] = SymbolTableManger::getInstance().get_lval_ident(ast->ident);
@@ -382,12 +381,9 @@ ConstDefList
     vec->push_back(unique_ptr<DefAST>($1));
     $$ = vec;
   }
-  | ConstDef ',' ConstDefList {
-    auto vec = new vector<unique_ptr<DefAST>>();
-    vec->push_back(unique_ptr<DefAST>($1));
-    for (auto &item : *$3) {
-      vec->push_back(std::move(item));
-    }
+  | ConstDefList ',' ConstDef {
+    auto vec = $1;
+    vec->push_back(unique_ptr<DefAST>($3));
     $$ = vec;
   }
   ;
@@ -397,16 +393,17 @@ ConstDef
   : IDENT DimList '=' ConstInitVal {
     auto ast = new ConstDefAST();
     ast->ident = *unique_ptr<string>($1);
-    for (auto &d : *$2) ast->array_dims.push_back(d->calc_number());
+    ast->array_type = intern_array_type($2);
+    delete $2;
     ast->const_init_val_ast = std::unique_ptr<ConstInitValAST>($4);
-    if (ast->array_dims.empty()) {
+    if (ast->array_type->dims.empty()) {
       ast->kind = DefAST::Kind::CONST_DEF;
       ast->const_init_val = ast->const_init_val_ast->exp->calc_number();
       SymbolTableManger::getInstance().get_back_table().val_map[ast->ident] = ast->const_init_val;
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::CONST;
     } else {
       ast->kind = DefAST::Kind::CONST_DEF;
-      SymbolTableManger::getInstance().set_array_dims(ast->ident, ast->array_dims);
+      SymbolTableManger::getInstance().set_array_type(ast->ident, ast->array_type);
       SymbolTableManger::getInstance().get_back_table().def_type_map[ast->ident] = SymbolTable::DefType::CONST_ARRAY;
     }
     SymbolTableManger::getInstance().get_back_table().lval_ident_map[ast->ident] = SymbolTableManger::getInstance().get_lval_ident(ast->ident);
@@ -467,19 +464,17 @@ Block
   }
   ;
 
-// BlockItemList ::= BlockItem | BlockItem BlockItemList;
+// BlockItemList ::= BlockItem | BlockItemList BlockItem;
+// 列表都写成左递归, 解析栈深度不随元素个数增长
 BlockItemList
   : BlockItem {
     auto vec = new vector<unique_ptr<BaseAST>>();
     vec->push_back(unique_ptr<BaseAST>($1));
     $$ = vec;
   }
-  | BlockItem BlockItemList {
-    auto vec = new vector<unique_ptr<BaseAST>>();
-    vec->push_back(unique_ptr<BaseAST>($1));
-    for (auto &item : *$2) {
-      vec->push_back(std::move(item));
-    }
+  | BlockItemList BlockItem {
+    auto vec = $1;
+    vec->push_back(unique_ptr<BaseAST>($2));
     $$ = vec;
   }
   ;
@@ -513,21 +508,24 @@ BlockItem
 Stmt
   : RETURN Exp ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::RETURN_STMT;
     ast->exp = unique_ptr<ExpAST>($2);
     $$ = ast;
   }
   | RETURN ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::RETURN_STMT;
     ast->exp = nullptr;
     $$ = ast;
   }
   | LVal '=' Exp ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::ASSIGN_STMT;
     ast->l_val = unique_ptr<LValAST>($1);
-    ast->r_exp = unique_ptr<ExpAST>($3);
+    ast->exp = unique_ptr<ExpAST>($3);
     if (!SymbolTableManger::getInstance().is_var_defined(ast->l_val->ident)) {
       assert(false);
     } else {
@@ -537,72 +535,75 @@ Stmt
   }
   | Block {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::BLOCK_STMT;
-    ast->block = unique_ptr<BaseAST>($1);
+    ast->body = unique_ptr<BaseAST>($1);
     $$ = ast;
   }
   | Exp ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::EXP_STMT;
     ast->exp = unique_ptr<ExpAST>($1);
     $$ = ast;
   }
   | ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::EMPTY_STMT;
     $$ = ast;
   }
   | IF '(' Exp ')' Stmt %prec LOWER_THAN_ELSE {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::IF_STMT;
-    ast->if_exp = unique_ptr<ExpAST>($3);
-    ast->if_stmt = unique_ptr<BaseAST>($5);
+    ast->exp = unique_ptr<ExpAST>($3);
+    ast->body = unique_ptr<BaseAST>($5);
     $$ = ast;
   }
   | IF '(' Exp ')' Stmt ELSE Stmt {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::IF_ELSE_STMT;
-    ast->if_exp = unique_ptr<ExpAST>($3);
-    ast->if_stmt = unique_ptr<BaseAST>($5);
+    ast->exp = unique_ptr<ExpAST>($3);
+    ast->body = unique_ptr<BaseAST>($5);
     ast->else_stmt = unique_ptr<BaseAST>($7);
     $$ = ast;
   }
   | WHILE '(' Exp ')' Stmt {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::WHILE_STMT;
-    ast->while_exp = unique_ptr<ExpAST>($3);
-    ast->while_stmt = unique_ptr<BaseAST>($5);
+    ast->exp = unique_ptr<ExpAST>($3);
+    ast->body = unique_ptr<BaseAST>($5);
     $$ = ast;
   }
   | BREAK ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::BREAK_STMT;
     $$ = ast;
   }
   | CONTINUE ';' {
     auto ast = new StmtAST();
+    ast->line = @$;
     ast->kind = StmtAST::Kind::CONTINUE_STMT;
     $$ = ast;
   }
   ;
 
 // Exp ::= LOrExp;
+// 只包了一层的产生式直接沿用子节点, 表达式树中只留下真正的运算
 Exp
   : LOrExp {
-    auto ast = new ExpAST();
-    ast->kind = ExpAST::Kind::L_OR_EXP;
-    ast->l_or_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   ;
 
 // UnaryExp ::= PrimaryExp | UnaryOp UnaryExp | IDENT "(" [FuncRParams] ")" ;
 UnaryExp
   : PrimaryExp {
-    auto ast = new UnaryExpAST();
-    ast->kind = ExpAST::Kind::PRIMARY_EXP;
-    ast->primary_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | UnaryOp UnaryExp {
     auto ast = new UnaryExpAST();
@@ -643,10 +644,7 @@ FuncRParamList
 // PrimaryExp ::= "(" Exp ")" | LVal | Number;
 PrimaryExp
   : '(' Exp ')' {
-    auto ast = new PrimaryExpAST();
-    ast->kind = ExpAST::Kind::EXP;
-    ast->exp = unique_ptr<ExpAST>($2);
-    $$ = ast;
+    $$ = $2;
   }
   | LVal {
     auto ast = new PrimaryExpAST();
@@ -704,13 +702,11 @@ UnaryOp
 // AddExp ::= MulExp | AddExp ("+" | "-") MulExp;
 AddExp
   : MulExp {
-    auto ast = new AddExpAST();
-    ast->kind = ExpAST::Kind::MUL_EXP;
-    ast->mul_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | AddExp '+' MulExp {
     auto ast = new AddExpAST();
+    ast->kind = ExpAST::Kind::ADD_EXP;
     ast->add_exp = unique_ptr<ExpAST>($1);
     ast->add_op = AddOpKind::Plus;
     ast->mul_exp = unique_ptr<ExpAST>($3);
@@ -718,6 +714,7 @@ AddExp
   }
   | AddExp '-' MulExp { 
     auto ast = new AddExpAST();
+    ast->kind = ExpAST::Kind::ADD_EXP;
     ast->add_exp = unique_ptr<ExpAST>($1);
     ast->add_op = AddOpKind::Minus;
     ast->mul_exp = unique_ptr<ExpAST>($3);
@@ -728,13 +725,11 @@ AddExp
 // MulExp ::= UnaryExp | MulExp ("*" | "/" | "%") UnaryExp;
 MulExp
   : UnaryExp {
-    auto ast = new MulExpAST();
-    ast->kind = ExpAST::Kind::UNARY_EXP;
-    ast->unary_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | MulExp '*' UnaryExp {
     auto ast = new MulExpAST();
+    ast->kind = ExpAST::Kind::MUL_EXP;
     ast->mul_exp = unique_ptr<ExpAST>($1);
     ast->mul_op = MulOpKind::Mul;
     ast->unary_exp = unique_ptr<ExpAST>($3);
@@ -742,6 +737,7 @@ MulExp
   }
   | MulExp '/' UnaryExp {
     auto ast = new MulExpAST();
+    ast->kind = ExpAST::Kind::MUL_EXP;
     ast->mul_exp = unique_ptr<ExpAST>($1);
     ast->mul_op = MulOpKind::Div;
     ast->unary_exp = unique_ptr<ExpAST>($3);
@@ -749,6 +745,7 @@ MulExp
   }
   | MulExp '%' UnaryExp { 
     auto ast = new MulExpAST();
+    ast->kind = ExpAST::Kind::MUL_EXP;
     ast->mul_exp = unique_ptr<ExpAST>($1);
     ast->mul_op = MulOpKind::Mod;
     ast->unary_exp = unique_ptr<ExpAST>($3);
@@ -759,10 +756,7 @@ MulExp
 // LOrExp ::= LAndExp | LOrExp "||" LAndExp;
 LOrExp
   : LAndExp {
-    auto ast = new LOrExpAST();
-    ast->kind = ExpAST::Kind::L_AND_EXP;
-    ast->l_and_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LOrExp LOGICAL_OP_OR LAndExp {
     auto ast = new LOrExpAST();
@@ -777,10 +771,7 @@ LOrExp
 // LAndExp ::= EqExp | LAndExp "&&" EqExp;
 LAndExp
   : EqExp {
-    auto ast = new LAndExpAST();
-    ast->kind = ExpAST::Kind::EQ_EXP;
-    ast->eq_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | LAndExp LOGICAL_OP_AND EqExp {
     auto ast = new LAndExpAST();
@@ -795,13 +786,11 @@ LAndExp
 // EqExp ::= RelExp | EqExp "==" RelExp | EqExp "!=" RelExp;
 EqExp
   : RelExp {
-    auto ast = new EqExpAST();
-    ast->kind = ExpAST::Kind::REL_EXP;
-    ast->rel_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | EqExp LOGICAL_OP_EQUAL RelExp {
     auto ast = new EqExpAST();
+    ast->kind = ExpAST::Kind::EQ_EXP;
     ast->eq_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::Equal;
     ast->rel_exp = unique_ptr<ExpAST>($3);
@@ -809,6 +798,7 @@ EqExp
   }
   | EqExp LOGICAL_OP_NOT_EQUAL RelExp {
     auto ast = new EqExpAST();
+    ast->kind = ExpAST::Kind::EQ_EXP;
     ast->eq_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::NotEqual;
     ast->rel_exp = unique_ptr<ExpAST>($3);
@@ -819,13 +809,11 @@ EqExp
 // RelExp ::= AddExp | RelExp (">" | "<" | ">=" | "<=") AddExp;
 RelExp
   : AddExp {
-    auto ast = new RelExpAST();
-    ast->kind = ExpAST::Kind::ADD_EXP;
-    ast->add_exp = unique_ptr<ExpAST>($1);
-    $$ = ast;
+    $$ = $1;
   }
   | RelExp LOGICAL_OP_GREATER AddExp {
     auto ast = new RelExpAST();
+    ast->kind = ExpAST::Kind::REL_EXP;
     ast->rel_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::Greater; 
     ast->add_exp = unique_ptr<ExpAST>($3);
@@ -833,6 +821,7 @@ RelExp
   }
   | RelExp LOGICAL_OP_LESS AddExp {
     auto ast = new RelExpAST();
+    ast->kind = ExpAST::Kind::REL_EXP;
     ast->rel_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::Less;
     ast->add_exp = unique_ptr<ExpAST>($3);
@@ -840,6 +829,7 @@ RelExp
   }
   | RelExp LOGICAL_OP_GREATER_EQUAL AddExp {
     auto ast = new RelExpAST();
+    ast->kind = ExpAST::Kind::REL_EXP;
     ast->rel_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::GreaterEqual;
     ast->add_exp = unique_ptr<ExpAST>($3);
@@ -847,6 +837,7 @@ RelExp
   }
   | RelExp LOGICAL_OP_LESS_EQUAL AddExp {
     auto ast = new RelExpAST();
+    ast->kind = ExpAST::Kind::REL_EXP;
     ast->rel_exp = unique_ptr<ExpAST>($1);
     ast->logical_op = LogicalOpKind::LessEqual;
     ast->add_exp = unique_ptr<ExpAST>($3);
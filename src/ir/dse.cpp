@@ -0,0 +1,361 @@
+// dse.cpp
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ir_passes.h"
+#include "ir_util.h"
+
+namespace {
+koopa_raw_basic_block_t block_at(const koopa_raw_function_t &func, size_t i) {
+  return reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+}
+
+koopa_raw_value_t value_at(const koopa_raw_slice_t &slice, size_t i) {
+  return reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+}
+
+// 数据流跟踪的标量位置: 地址不逃逸的局部标量 alloc (只被 load 和作为
+// store 的目标使用), 以及 i32 全局变量 (SysY 中不能取它们的地址).
+// 全局变量在调用和返回时视为被读
+struct Locations {
+  std::unordered_map<koopa_raw_value_t, size_t> index;
+  std::vector<bool> is_global;
+
+  void add(const koopa_raw_value_t &value, bool global) {
+    if (index.emplace(value, is_global.size()).second) {
+      is_global.push_back(global);
+    }
+  }
+  // 指针 ptr 对应的位置, 不跟踪时返回 size()
+  size_t find(const koopa_raw_value_t &ptr) const {
+    auto it = index.find(ptr);
+    return it == index.end() ? is_global.size() : it->second;
+  }
+  size_t size() const { return is_global.size(); }
+};
+
+bool is_scalar_slot(const koopa_raw_value_t &alloc) {
+  if (pointee(alloc->ty)->tag == KOOPA_RTT_ARRAY) {
+    return false;
+  }
+  for (size_t i = 0; i < alloc->used_by.len; ++i) {
+    auto user = value_at(alloc->used_by, i);
+    bool ok = (user->kind.tag == KOOPA_RVT_LOAD) ||
+              (user->kind.tag == KOOPA_RVT_STORE &&
+               user->kind.data.store.dest == alloc &&
+               user->kind.data.store.value != alloc);
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Locations find_locations(const koopa_raw_function_t &func) {
+  Locations locs;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = value_at(bb->insts, j);
+      if (inst->kind.tag == KOOPA_RVT_ALLOC && is_scalar_slot(inst)) {
+        locs.add(inst, false);
+      }
+      for_each_operand(inst, [&](koopa_raw_value_t value) {
+        if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC &&
+            pointee(value->ty)->tag == KOOPA_RTT_INT32) {
+          locs.add(value, true);
+        }
+      });
+    }
+  }
+  return locs;
+}
+
+// 逆着执行一条指令对活跃位置的影响. 返回 store 是否是死的
+bool transfer(const koopa_raw_value_t &inst, const Locations &locs,
+              std::vector<bool> &live) {
+  switch (inst->kind.tag) {
+  case KOOPA_RVT_STORE: {
+    size_t loc = locs.find(inst->kind.data.store.dest);
+    if (loc == locs.size()) {
+      return false;
+    }
+    bool dead = !live[loc];
+    live[loc] = false;
+    return dead;
+  }
+  case KOOPA_RVT_LOAD: {
+    size_t loc = locs.find(inst->kind.data.load.src);
+    if (loc != locs.size()) {
+      live[loc] = true;
+    }
+    return false;
+  }
+  case KOOPA_RVT_CALL:
+  case KOOPA_RVT_RETURN:
+    for (size_t loc = 0; loc < locs.size(); ++loc) {
+      if (locs.is_global[loc]) {
+        live[loc] = true;
+      }
+    }
+    return false;
+  default:
+    return false;
+  }
+}
+
+// 对标量位置做逆向活跃分析, 找出写入后到被覆盖或函数返回前都没有被读的 store
+void find_dead_scalar_stores(const koopa_raw_function_t &func, const Cfg &cfg,
+                             std::vector<koopa_raw_value_t> &dead) {
+  Locations locs = find_locations(func);
+  if (locs.size() == 0) {
+    return;
+  }
+  size_t n = cfg.size();
+  std::vector<std::vector<bool>> live_in(n, std::vector<bool>(locs.size()));
+  auto live_out = [&](size_t idx) {
+    std::vector<bool> live(locs.size());
+    for (size_t succ : cfg.succs[idx]) {
+      for (size_t loc = 0; loc < locs.size(); ++loc) {
+        live[loc] = live[loc] || live_in[succ][loc];
+      }
+    }
+    return live;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    // 逆后序倒过来遍历, 后继通常先于前驱算好
+    for (auto it = cfg.rpo.rbegin(); it != cfg.rpo.rend(); ++it) {
+      auto bb = cfg.blocks[*it];
+      auto live = live_out(*it);
+      for (size_t j = bb->insts.len; j-- > 0;) {
+        transfer(value_at(bb->insts, j), locs, live);
+      }
+      if (live != live_in[*it]) {
+        live_in[*it] = live;
+        changed = true;
+      }
+    }
+  }
+  for (size_t idx : cfg.rpo) {
+    auto bb = cfg.blocks[idx];
+    auto live = live_out(idx);
+    for (size_t j = bb->insts.len; j-- > 0;) {
+      if (transfer(value_at(bb->insts, j), locs, live)) {
+        dead.push_back(value_at(bb->insts, j));
+      }
+    }
+  }
+}
+
+// 局部数组和它派生出的元素指针 (getelemptr/getptr 链).
+// 只被写入, 从未读取也没有传给调用的数组, 所有写入都是死的
+void find_unread_arrays(const koopa_raw_function_t &func,
+                        std::vector<koopa_raw_value_t> &dead) {
+  // 前端在声明处生成 alloc, 不一定在入口块
+  std::vector<koopa_raw_value_t> arrays;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = value_at(bb->insts, j);
+      if (inst->kind.tag == KOOPA_RVT_ALLOC &&
+          pointee(inst->ty)->tag == KOOPA_RTT_ARRAY) {
+        arrays.push_back(inst);
+      }
+    }
+  }
+  for (auto alloc : arrays) {
+    std::vector<koopa_raw_value_t> stores;
+    std::vector<koopa_raw_value_t> worklist = {alloc};
+    bool read = false;
+    while (!worklist.empty() && !read) {
+      auto ptr = worklist.back();
+      worklist.pop_back();
+      for (size_t j = 0; j < ptr->used_by.len && !read; ++j) {
+        auto user = value_at(ptr->used_by, j);
+        if (is_address(user) && address_src(user) == ptr) {
+          worklist.push_back(user);
+        } else if (user->kind.tag == KOOPA_RVT_STORE &&
+                   user->kind.data.store.dest == ptr &&
+                   user->kind.data.store.value != ptr) {
+          stores.push_back(user);
+        } else {
+          read = true;
+        }
+      }
+    }
+    if (!read) {
+      dead.insert(dead.end(), stores.begin(), stores.end());
+    }
+  }
+}
+
+// ptr 相对数组 alloc 起点的字偏移; 下标不是常数或不是从 alloc 派生时返回 false
+bool word_offset(koopa_raw_value_t ptr, const koopa_raw_value_t &alloc,
+                 size_t &offset) {
+  offset = 0;
+  while (ptr != alloc) {
+    if (!is_address(ptr)) {
+      return false;
+    }
+    auto index = ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR
+                     ? ptr->kind.data.get_elem_ptr.index
+                     : ptr->kind.data.get_ptr.index;
+    if (index->kind.tag != KOOPA_RVT_INTEGER ||
+        index->kind.data.integer.value < 0) {
+      return false;
+    }
+    offset += index->kind.data.integer.value * type_words(pointee(ptr->ty));
+    ptr = address_src(ptr);
+  }
+  return true;
+}
+
+// ptr 是否指向 alloc 内部
+bool derived_from(koopa_raw_value_t ptr, const koopa_raw_value_t &alloc) {
+  while (is_address(ptr)) {
+    ptr = address_src(ptr);
+  }
+  return ptr == alloc;
+}
+
+// 把 value 中 offsets 里的元素换成 0 后的初始化值, 没有变化时返回 value
+koopa_raw_value_t clear_words(const koopa_raw_value_t &value, size_t base,
+                              const std::set<size_t> &offsets,
+                              IRArena &arena) {
+  if (value->kind.tag == KOOPA_RVT_INTEGER) {
+    if (value->kind.data.integer.value != 0 && offsets.count(base)) {
+      return make_integer(arena, 0, value->ty);
+    }
+    return value;
+  }
+  if (value->kind.tag != KOOPA_RVT_AGGREGATE) {
+    return value;
+  }
+  const auto &elems = value->kind.data.aggregate.elems;
+  std::vector<const void *> items;
+  bool changed = false;
+  for (size_t i = 0; i < elems.len; ++i) {
+    auto elem = value_at(elems, i);
+    auto cleared =
+        clear_words(elem, base + i * type_words(elem->ty), offsets, arena);
+    changed = changed || cleared != elem;
+    items.push_back(cleared);
+  }
+  if (!changed) {
+    return value;
+  }
+  auto data = arena.value();
+  *data = *value;
+  data->used_by = arena.slice({}, KOOPA_RSIK_VALUE);
+  data->kind.data.aggregate.elems = arena.slice(items, KOOPA_RSIK_VALUE);
+  return data;
+}
+
+// 局部数组的初始化 (store 聚合常量) 之后, 同一块中在数组被读之前用常数下标
+// 覆盖的元素不必初始化: 初始化值中这些元素换成 0 (生成代码时全零的部分
+// 一起清零), 全部被覆盖时删除初始化. 返回是否有改动
+bool trim_initializers(const koopa_raw_function_t &func, IRArena &arena,
+                       std::vector<koopa_raw_value_t> &dead) {
+  bool changed = false;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto init = value_at(bb->insts, j);
+      if (init->kind.tag != KOOPA_RVT_STORE) {
+        continue;
+      }
+      auto alloc = init->kind.data.store.dest;
+      auto value = init->kind.data.store.value;
+      if (alloc->kind.tag != KOOPA_RVT_ALLOC ||
+          (value->kind.tag != KOOPA_RVT_AGGREGATE &&
+           value->kind.tag != KOOPA_RVT_ZERO_INIT)) {
+        continue;
+      }
+      std::set<size_t> overwritten;
+      for (size_t k = j + 1; k < bb->insts.len; ++k) {
+        auto inst = value_at(bb->insts, k);
+        if (is_address(inst)) {
+          continue;
+        }
+        size_t offset;
+        if (inst->kind.tag == KOOPA_RVT_STORE &&
+            !derived_from(inst->kind.data.store.value, alloc) &&
+            derived_from(inst->kind.data.store.dest, alloc)) {
+          // 下标不是常数的写入不读数组, 但也不知道覆盖了哪个元素
+          if (word_offset(inst->kind.data.store.dest, alloc, offset) &&
+              offset < type_words(pointee(alloc->ty))) {
+            overwritten.insert(offset);
+          }
+          continue;
+        }
+        bool uses_array = false;
+        for_each_operand(inst, [&](koopa_raw_value_t operand) {
+          uses_array = uses_array || derived_from(operand, alloc);
+        });
+        if (uses_array || inst->kind.tag == KOOPA_RVT_CALL) {
+          break;
+        }
+      }
+      if (overwritten.empty()) {
+        continue;
+      }
+      if (overwritten.size() == type_words(pointee(alloc->ty))) {
+        dead.push_back(init);
+        continue;
+      }
+      auto cleared = clear_words(value, 0, overwritten, arena);
+      if (cleared != value) {
+        drop_uses(arena, {init});
+        mut(init)->kind.data.store.value = cleared;
+        add_uses(arena, init);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+} // namespace
+
+bool DeadStoreElim::run_on_function(const koopa_raw_function_t &func,
+                                    PassContext &ctx) {
+  bool changed = false;
+  // 删除 store 后它的值可能不再被使用, 删掉的 load 又可能让更早的 store 变死
+  for (bool again = true; again;) {
+    std::vector<koopa_raw_value_t> dead;
+    again = trim_initializers(func, ctx.arena, dead);
+    find_unread_arrays(func, dead);
+    find_dead_scalar_stores(func, ctx.analyses.cfg(func), dead);
+    std::vector<koopa_raw_value_t> stores;
+    std::unordered_set<koopa_raw_value_t> seen;
+    for (auto store : dead) {
+      if (seen.insert(store).second) {
+        stores.push_back(store);
+      }
+    }
+    if (!stores.empty()) {
+      if (ctx.remarks.enabled()) {
+        std::set<int> lines;
+        for (size_t i = 0; i < func->bbs.len; ++i) {
+          auto bb = block_at(func, i);
+          for (size_t j = 0; j < bb->insts.len; ++j) {
+            if (seen.count(value_at(bb->insts, j))) {
+              lines.insert(
+                  ctx.remarks.line(func, bb, value_at(bb->insts, j)));
+            }
+          }
+        }
+        for (int line : lines) {
+          ctx.remarks.emit(Remark::PASSED, "dse", "DeadStore", func, line,
+                           "store is overwritten or never read, removed");
+        }
+      }
+      remove_with_operands(ctx.arena, func, stores);
+      again = true;
+    }
+    changed = changed || again;
+  }
+  return changed;
+}
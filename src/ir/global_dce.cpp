@@ -0,0 +1,102 @@
+// global_dce.cpp
+#include <string>
+#include <unordered_set>
+
+#include "ir_passes.h"
+#include "ir_util.h"
+#include "util.h"
+
+namespace {
+koopa_raw_function_t function_at(const koopa_raw_program_t &program,
+                                 size_t i) {
+  return reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+}
+
+koopa_raw_basic_block_t block_at(const koopa_raw_function_t &func, size_t i) {
+  return reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+}
+
+koopa_raw_value_t value_at(const koopa_raw_slice_t &slice, size_t i) {
+  return reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+}
+
+// 函数中的所有指令
+std::vector<koopa_raw_value_t> insts_of(const koopa_raw_function_t &func) {
+  std::vector<koopa_raw_value_t> insts;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      insts.push_back(value_at(bb->insts, j));
+    }
+  }
+  return insts;
+}
+} // namespace
+
+bool GlobalDce::run(koopa_raw_program_t &program, PassContext &ctx) {
+  if (!ctx.whole_program) {
+    return false;
+  }
+  koopa_raw_function_t main_func = nullptr;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    if (get_label(function_at(program, i)->name) == "main") {
+      main_func = function_at(program, i);
+    }
+  }
+  if (main_func == nullptr) {
+    return false;
+  }
+  // 从 main 出发沿调用找到所有用到的函数, 顺带记下它们用到的全局变量
+  std::unordered_set<koopa_raw_function_t> live_funcs = {main_func};
+  std::unordered_set<koopa_raw_value_t> live_globals;
+  std::vector<koopa_raw_function_t> worklist = {main_func};
+  while (!worklist.empty()) {
+    auto func = worklist.back();
+    worklist.pop_back();
+    for (auto inst : insts_of(func)) {
+      if (inst->kind.tag == KOOPA_RVT_CALL &&
+          live_funcs.insert(inst->kind.data.call.callee).second) {
+        worklist.push_back(inst->kind.data.call.callee);
+      }
+      for_each_operand(inst, [&](koopa_raw_value_t value) {
+        if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) {
+          live_globals.insert(value);
+        }
+      });
+    }
+  }
+  if (live_funcs.size() == program.funcs.len &&
+      live_globals.size() == program.values.len) {
+    return false;
+  }
+
+  std::vector<const void *> funcs;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = function_at(program, i);
+    if (live_funcs.count(func)) {
+      funcs.push_back(func);
+      continue;
+    }
+    if (func->bbs.len == 0) {
+      continue;
+    }
+    // 保留下来的全局变量的 used_by 中不应再有被删除的指令
+    drop_uses(ctx.arena, insts_of(func));
+    ctx.analyses.invalidate(func);
+    if (ctx.remarks.enabled()) {
+      ctx.remarks.emit(Remark::PASSED, "globaldce", "FunctionRemoved", func,
+                       ctx.remarks.line(func),
+                       "function " + get_label(func->name) +
+                           " is never called from main, removed");
+    }
+  }
+  std::vector<const void *> values;
+  for (size_t i = 0; i < program.values.len; ++i) {
+    if (live_globals.count(value_at(program.values, i))) {
+      values.push_back(program.values.buffer[i]);
+    }
+  }
+  program.funcs = ctx.arena.slice(funcs, KOOPA_RSIK_FUNCTION);
+  program.values = ctx.arena.slice(values, KOOPA_RSIK_VALUE);
+  return true;
+}
@@ -0,0 +1,479 @@
+// ipcp.cpp
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ir_passes.h"
+#include "ir_util.h"
+#include "util.h"
+
+namespace {
+// 克隆超过这个指令数的函数得不偿失
+const size_t kMaxCloneInsts = 150;
+// 每个函数最多的特化版本数
+const int kMaxClones = 3;
+
+struct CallSite {
+  koopa_raw_value_t call;
+  koopa_raw_function_t caller;
+  koopa_raw_basic_block_t bb;
+};
+
+// 每个 i32 参数的常数实参, 不是常数的参数为空
+using Binding = std::vector<std::optional<int32_t>>;
+
+koopa_raw_function_t function_at(const koopa_raw_program_t &program,
+                                 size_t i) {
+  return reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+}
+
+koopa_raw_basic_block_t block_at(const koopa_raw_function_t &func, size_t i) {
+  return reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+}
+
+koopa_raw_value_t value_at(const koopa_raw_slice_t &slice, size_t i) {
+  return reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+}
+
+bool is_main(const koopa_raw_function_t &func) {
+  return get_label(func->name) == "main";
+}
+
+// 被调用函数 -> 调用处 (只收集有函数体的被调用函数)
+std::unordered_map<koopa_raw_function_t, std::vector<CallSite>>
+collect_calls(const koopa_raw_program_t &program) {
+  std::unordered_map<koopa_raw_function_t, std::vector<CallSite>> calls;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = function_at(program, i);
+    for (size_t j = 0; j < func->bbs.len; ++j) {
+      auto bb = block_at(func, j);
+      for (size_t k = 0; k < bb->insts.len; ++k) {
+        auto inst = value_at(bb->insts, k);
+        if (inst->kind.tag == KOOPA_RVT_CALL &&
+            inst->kind.data.call.callee->bbs.len != 0) {
+          calls[inst->kind.data.call.callee].push_back({inst, func, bb});
+        }
+      }
+    }
+  }
+  return calls;
+}
+
+// 前端把参数存进入口块的 alloc 后按需 load. 参数 index 的 alloc 只被这一次
+// store 写入且其余使用都是 load 时返回它, 否则为 nullptr
+koopa_raw_value_t param_slot(const koopa_raw_function_t &func, size_t index) {
+  auto param = value_at(func->params, index);
+  auto entry = block_at(func, 0);
+  for (size_t i = 0; i < entry->insts.len; ++i) {
+    auto inst = value_at(entry->insts, i);
+    if (inst->kind.tag != KOOPA_RVT_STORE ||
+        inst->kind.data.store.value != param) {
+      continue;
+    }
+    auto slot = inst->kind.data.store.dest;
+    if (slot->kind.tag != KOOPA_RVT_ALLOC) {
+      return nullptr;
+    }
+    for (size_t j = 0; j < slot->used_by.len; ++j) {
+      auto user = value_at(slot->used_by, j);
+      if (user != inst && user->kind.tag != KOOPA_RVT_LOAD) {
+        return nullptr;
+      }
+    }
+    return slot;
+  }
+  return nullptr;
+}
+
+// 递归调用把参数 index 原样传下去
+bool passes_through(const koopa_raw_function_t &func, size_t index,
+                    koopa_raw_value_t arg) {
+  if (arg == value_at(func->params, index)) {
+    return true;
+  }
+  auto slot = param_slot(func, index);
+  return slot != nullptr && arg->kind.tag == KOOPA_RVT_LOAD &&
+         arg->kind.data.load.src == slot;
+}
+
+// 把参数 index 换成常数 value. 参数的 alloc 只写入一次时其中的 load
+// 也换成常数, 并删除 alloc 和 store
+void bind_param(const koopa_raw_function_t &func, size_t index, int32_t value,
+                IRArena &arena) {
+  auto param = value_at(func->params, index);
+  auto slot = param_slot(func, index);
+  if (slot != nullptr) {
+    std::vector<koopa_raw_value_t> dead = {slot};
+    for (size_t i = 0; i < slot->used_by.len; ++i) {
+      auto user = value_at(slot->used_by, i);
+      if (user->kind.tag == KOOPA_RVT_LOAD) {
+        replace_all_uses(arena, user, make_integer(arena, value, user->ty));
+      }
+      dead.push_back(user);
+    }
+    remove_insts(arena, func, dead);
+  }
+  if (param->used_by.len != 0) {
+    replace_all_uses(arena, param, make_integer(arena, value, param->ty));
+  }
+  fold_constants(func, arena);
+}
+
+// 参数在函数体中还有用 (没有换成常数) 的 i32 参数
+bool bindable(const koopa_raw_function_t &func, size_t index) {
+  auto param = value_at(func->params, index);
+  return param->ty->tag == KOOPA_RTT_INT32 && param->used_by.len != 0;
+}
+
+// 所有调用处都传同一个常数 (递归调用原样传下去也算) 的参数换成常数
+bool propagate(koopa_raw_program_t &program, PassContext &ctx) {
+  bool changed = false;
+  for (bool again = true; again;) {
+    again = false;
+    auto calls = collect_calls(program);
+    for (size_t f = 0; f < program.funcs.len; ++f) {
+      auto func = function_at(program, f);
+      auto it = calls.find(func);
+      if (it == calls.end() || is_main(func)) {
+        continue;
+      }
+      for (size_t i = 0; i < func->params.len; ++i) {
+        if (!bindable(func, i)) {
+          continue;
+        }
+        std::optional<int32_t> value;
+        bool same = true;
+        for (const auto &site : it->second) {
+          auto arg = value_at(site.call->kind.data.call.args, i);
+          if (site.caller == func && passes_through(func, i, arg)) {
+            continue;
+          }
+          if (arg->kind.tag != KOOPA_RVT_INTEGER ||
+              (value && *value != arg->kind.data.integer.value)) {
+            same = false;
+            break;
+          }
+          value = arg->kind.data.integer.value;
+        }
+        if (!same || !value) {
+          continue;
+        }
+        bind_param(func, i, *value, ctx.arena);
+        ctx.analyses.invalidate(func);
+        if (ctx.remarks.enabled()) {
+          ctx.remarks.emit(Remark::PASSED, "ipcp", "ConstantArgument", func,
+                           ctx.remarks.line(func),
+                           "argument " +
+                               get_label(value_at(func->params, i)->name) +
+                               " is always " + std::to_string(*value) +
+                               ", propagated into the body");
+        }
+        changed = again = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// 递归函数中在递归调用里原样传下去的参数; 不递归时所有参数都算
+std::vector<bool> invariant_params(const koopa_raw_function_t &func,
+                                   const std::vector<CallSite> &sites) {
+  std::vector<bool> invariant(func->params.len, true);
+  for (const auto &site : sites) {
+    if (site.caller != func) {
+      continue;
+    }
+    for (size_t i = 0; i < func->params.len; ++i) {
+      auto arg = value_at(site.call->kind.data.call.args, i);
+      if (!passes_through(func, i, arg)) {
+        invariant[i] = false;
+      }
+    }
+  }
+  return invariant;
+}
+
+Binding binding_of(const koopa_raw_function_t &func,
+                   const koopa_raw_value_t &call,
+                   const std::vector<bool> &invariant) {
+  Binding binding(func->params.len);
+  for (size_t i = 0; i < func->params.len; ++i) {
+    auto arg = value_at(call->kind.data.call.args, i);
+    if (invariant[i] && bindable(func, i) &&
+        arg->kind.tag == KOOPA_RVT_INTEGER) {
+      binding[i] = arg->kind.data.integer.value;
+    }
+  }
+  return binding;
+}
+
+bool binds_anything(const Binding &binding) {
+  for (const auto &value : binding) {
+    if (value) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// 调用处在循环中, 或者被调用的函数递归 (绑定的参数在递归中不变)
+bool is_hot(const CallSite &site, const std::vector<CallSite> &sites,
+            PassContext &ctx) {
+  auto func = site.call->kind.data.call.callee;
+  for (const auto &other : sites) {
+    if (other.caller == func) {
+      return true;
+    }
+  }
+  const Cfg &cfg = ctx.analyses.cfg(site.caller);
+  return cfg.in_any_loop(cfg.index(site.bb));
+}
+
+size_t count_function_insts(const koopa_raw_function_t &func) {
+  size_t count = 0;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    count += block_at(func, i)->insts.len;
+  }
+  return count;
+}
+
+// 函数中没有用过的名字 func_spec_N
+std::string clone_name(const koopa_raw_program_t &program,
+                       const koopa_raw_function_t &func, int &counter) {
+  std::unordered_set<std::string> used;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    used.insert(function_at(program, i)->name);
+  }
+  for (size_t i = 0; i < program.values.len; ++i) {
+    auto value = value_at(program.values, i);
+    if (value->name != nullptr) {
+      used.insert(value->name);
+    }
+  }
+  std::string name;
+  do {
+    name = std::string(func->name) + "_spec_" + std::to_string(++counter);
+  } while (used.count(name));
+  return name;
+}
+
+// 复制函数体. 值和基本块保留原来的名字 (局部名字只在函数内有效),
+// 常数操作数各自复制一份, 全局变量和被调用函数不变
+koopa_raw_function_t clone_function(const koopa_raw_function_t &func,
+                                    const std::string &name, IRArena &arena) {
+  std::unordered_map<const void *, const void *> values;
+  std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> blocks;
+  auto empty = arena.slice({}, KOOPA_RSIK_VALUE);
+  auto copy_value = [&](koopa_raw_value_t value) {
+    auto data = arena.value();
+    *data = *value;
+    data->used_by = empty;
+    values[value] = data;
+    return data;
+  };
+  auto copy_values = [&](const koopa_raw_slice_t &slice) {
+    std::vector<const void *> items;
+    for (size_t i = 0; i < slice.len; ++i) {
+      items.push_back(copy_value(value_at(slice, i)));
+    }
+    return arena.slice(items, KOOPA_RSIK_VALUE);
+  };
+  auto clone = arena.function();
+  clone->ty = func->ty;
+  clone->name = arena.name(name);
+  clone->params = copy_values(func->params);
+  std::vector<const void *> bbs;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    auto data = arena.block();
+    data->name = bb->name;
+    data->params = copy_values(bb->params);
+    data->used_by = empty;
+    data->insts = copy_values(bb->insts);
+    blocks[bb] = data;
+    bbs.push_back(data);
+  }
+  clone->bbs = arena.slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+
+  auto map = [&](koopa_raw_value_t &value) {
+    auto it = values.find(value);
+    if (it != values.end()) {
+      value = reinterpret_cast<koopa_raw_value_t>(it->second);
+    } else if (value->kind.tag == KOOPA_RVT_INTEGER) {
+      value = make_integer(arena, value->kind.data.integer.value, value->ty);
+    }
+  };
+  auto map_slice = [&](koopa_raw_slice_t &slice) {
+    std::vector<const void *> items;
+    for (size_t i = 0; i < slice.len; ++i) {
+      auto value = value_at(slice, i);
+      map(value);
+      items.push_back(value);
+    }
+    slice = arena.slice(items, KOOPA_RSIK_VALUE);
+  };
+  for (size_t i = 0; i < clone->bbs.len; ++i) {
+    auto bb = block_at(clone, i);
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = value_at(bb->insts, j);
+      auto &kind = mut(inst)->kind;
+      switch (kind.tag) {
+      case KOOPA_RVT_RETURN:
+        if (kind.data.ret.value != nullptr) {
+          map(kind.data.ret.value);
+        }
+        break;
+      case KOOPA_RVT_BINARY:
+        map(kind.data.binary.lhs);
+        map(kind.data.binary.rhs);
+        break;
+      case KOOPA_RVT_LOAD:
+        map(kind.data.load.src);
+        break;
+      case KOOPA_RVT_STORE:
+        map(kind.data.store.value);
+        map(kind.data.store.dest);
+        break;
+      case KOOPA_RVT_BRANCH:
+        map(kind.data.branch.cond);
+        kind.data.branch.true_bb = blocks.at(kind.data.branch.true_bb);
+        kind.data.branch.false_bb = blocks.at(kind.data.branch.false_bb);
+        map_slice(kind.data.branch.true_args);
+        map_slice(kind.data.branch.false_args);
+        break;
+      case KOOPA_RVT_JUMP:
+        kind.data.jump.target = blocks.at(kind.data.jump.target);
+        map_slice(kind.data.jump.args);
+        break;
+      case KOOPA_RVT_CALL:
+        map_slice(kind.data.call.args);
+        break;
+      case KOOPA_RVT_GET_ELEM_PTR:
+        map(kind.data.get_elem_ptr.src);
+        map(kind.data.get_elem_ptr.index);
+        break;
+      case KOOPA_RVT_GET_PTR:
+        map(kind.data.get_ptr.src);
+        map(kind.data.get_ptr.index);
+        break;
+      default:
+        break;
+      }
+      add_uses(arena, inst);
+    }
+  }
+  return clone;
+}
+
+std::string describe(const koopa_raw_function_t &func,
+                     const Binding &binding) {
+  std::string result;
+  for (size_t i = 0; i < binding.size(); ++i) {
+    if (binding[i]) {
+      result += (result.empty() ? "" : ", ") +
+                get_label(value_at(func->params, i)->name) + " = " +
+                std::to_string(*binding[i]);
+    }
+  }
+  return result;
+}
+
+// 为热的常数实参组合克隆特化版本, 把同样实参的调用都改到克隆上
+bool specialize(koopa_raw_program_t &program, PassContext &ctx) {
+  auto calls = collect_calls(program);
+  std::vector<const void *> funcs;
+  bool changed = false;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = function_at(program, i);
+    funcs.push_back(func);
+    auto it = calls.find(func);
+    if (it == calls.end() || is_main(func) ||
+        count_function_insts(func) > kMaxCloneInsts) {
+      continue;
+    }
+    const auto &sites = it->second;
+    auto invariant = invariant_params(func, sites);
+    // 按实参组合分组, 保持调用出现的顺序
+    std::map<Binding, std::vector<CallSite>> groups;
+    std::vector<Binding> order;
+    std::set<Binding> hot;
+    for (const auto &site : sites) {
+      if (site.caller == func) {
+        continue;
+      }
+      auto binding = binding_of(func, site.call, invariant);
+      if (!binds_anything(binding)) {
+        continue;
+      }
+      auto &group = groups[binding];
+      if (group.empty()) {
+        order.push_back(binding);
+      }
+      group.push_back(site);
+      if (is_hot(site, sites, ctx)) {
+        hot.insert(binding);
+      }
+    }
+    int clones = 0, counter = 0;
+    for (const auto &binding : order) {
+      if (!hot.count(binding) || clones == kMaxClones) {
+        continue;
+      }
+      auto clone = clone_function(func, clone_name(program, func, counter),
+                                  ctx.arena);
+      ++clones;
+      funcs.push_back(clone);
+      for (const auto &site : groups[binding]) {
+        mut(site.call)->kind.data.call.callee = clone;
+        ctx.analyses.invalidate(site.caller);
+        if (ctx.remarks.enabled()) {
+          ctx.remarks.emit(Remark::PASSED, "ipcp", "Specialized", site.caller,
+                           ctx.remarks.line(site.caller, site.bb, site.call),
+                           "call to " + get_label(func->name) +
+                               " specialized as " + get_label(clone->name) +
+                               " with " + describe(func, binding));
+        }
+      }
+      for (size_t j = 0; j < binding.size(); ++j) {
+        if (binding[j]) {
+          bind_param(clone, j, *binding[j], ctx.arena);
+        }
+      }
+      // 递归调用在绑定后实参相同, 也改到克隆上
+      for (size_t j = 0; j < clone->bbs.len; ++j) {
+        auto bb = block_at(clone, j);
+        for (size_t k = 0; k < bb->insts.len; ++k) {
+          auto inst = value_at(bb->insts, k);
+          if (inst->kind.tag == KOOPA_RVT_CALL &&
+              inst->kind.data.call.callee == func &&
+              binding_of(func, inst, invariant) == binding) {
+            mut(inst)->kind.data.call.callee = clone;
+          }
+        }
+      }
+      changed = true;
+    }
+  }
+  if (changed) {
+    program.funcs = ctx.arena.slice(funcs, KOOPA_RSIK_FUNCTION);
+  }
+  return changed;
+}
+} // namespace
+
+bool Ipcp::run(koopa_raw_program_t &program, PassContext &ctx) {
+  if (!ctx.whole_program) {
+    return false;
+  }
+  bool changed = propagate(program, ctx);
+  if (specialize(program, ctx)) {
+    // 特化后剩下的调用处可能都传同样的常数
+    propagate(program, ctx);
+    changed = true;
+  }
+  return changed;
+}
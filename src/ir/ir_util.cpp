@@ -0,0 +1,448 @@
+// ir_util.cpp
+#include <algorithm>
+#include <cassert>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "ir_util.h"
+
+koopa_raw_slice_t IRArena::slice(const std::vector<const void *> &items,
+                                 koopa_raw_slice_item_kind_t kind) {
+  koopa_raw_slice_t slice;
+  slice.len = items.size();
+  slice.kind = kind;
+  slice.buffer = nullptr;
+  if (!items.empty()) {
+    buffers.emplace_back(new const void *[items.size()]);
+    std::copy(items.begin(), items.end(), buffers.back().get());
+    slice.buffer = buffers.back().get();
+  }
+  return slice;
+}
+
+koopa_raw_value_data_t *IRArena::value() {
+  values.emplace_back(new koopa_raw_value_data_t());
+  return values.back().get();
+}
+
+koopa_raw_basic_block_data_t *IRArena::block() {
+  blocks.emplace_back(new koopa_raw_basic_block_data_t());
+  return blocks.back().get();
+}
+
+koopa_raw_function_data_t *IRArena::function() {
+  functions.emplace_back(new koopa_raw_function_data_t());
+  return functions.back().get();
+}
+
+const char *IRArena::name(const std::string &name) {
+  names.emplace_back(new std::string(name));
+  return names.back()->c_str();
+}
+
+bool is_local_value(const koopa_raw_value_t &value) {
+  switch (value->kind.tag) {
+  case KOOPA_RVT_FUNC_ARG_REF:
+  case KOOPA_RVT_BLOCK_ARG_REF:
+  case KOOPA_RVT_LOAD:
+  case KOOPA_RVT_BINARY:
+  case KOOPA_RVT_GET_PTR:
+  case KOOPA_RVT_GET_ELEM_PTR:
+    return true;
+  case KOOPA_RVT_CALL:
+    return value->ty->tag != KOOPA_RTT_UNIT;
+  default:
+    return false;
+  }
+}
+
+std::vector<koopa_raw_basic_block_t>
+branch_targets(const koopa_raw_value_t &inst) {
+  if (inst->kind.tag == KOOPA_RVT_BRANCH) {
+    return {inst->kind.data.branch.true_bb, inst->kind.data.branch.false_bb};
+  }
+  if (inst->kind.tag == KOOPA_RVT_JUMP) {
+    return {inst->kind.data.jump.target};
+  }
+  return {};
+}
+
+namespace {
+std::optional<int32_t> fold(koopa_raw_binary_op_t op, int32_t lhs,
+                            int32_t rhs) {
+  // 按补码回绕计算, 与生成的代码一致
+  uint32_t l = lhs, r = rhs;
+  switch (op) {
+  case KOOPA_RBO_NOT_EQ:
+    return lhs != rhs;
+  case KOOPA_RBO_EQ:
+    return lhs == rhs;
+  case KOOPA_RBO_GT:
+    return lhs > rhs;
+  case KOOPA_RBO_LT:
+    return lhs < rhs;
+  case KOOPA_RBO_GE:
+    return lhs >= rhs;
+  case KOOPA_RBO_LE:
+    return lhs <= rhs;
+  case KOOPA_RBO_ADD:
+    return static_cast<int32_t>(l + r);
+  case KOOPA_RBO_SUB:
+    return static_cast<int32_t>(l - r);
+  case KOOPA_RBO_MUL:
+    return static_cast<int32_t>(l * r);
+  case KOOPA_RBO_DIV:
+  case KOOPA_RBO_MOD:
+    // 除零和溢出留到运行时
+    if (rhs == 0 || (lhs == INT32_MIN && rhs == -1)) {
+      return std::nullopt;
+    }
+    return op == KOOPA_RBO_DIV ? lhs / rhs : lhs % rhs;
+  case KOOPA_RBO_AND:
+    return lhs & rhs;
+  case KOOPA_RBO_OR:
+    return lhs | rhs;
+  case KOOPA_RBO_XOR:
+    return lhs ^ rhs;
+  case KOOPA_RBO_SHL:
+    return static_cast<int32_t>(l << (r & 31));
+  case KOOPA_RBO_SHR:
+    return static_cast<int32_t>(l >> (r & 31));
+  case KOOPA_RBO_SAR:
+    return lhs >> (rhs & 31);
+  }
+  return std::nullopt;
+}
+
+// 重建 used_by, 去掉 users 中的使用者; 没有变化时不分配新缓冲区
+void remove_users(IRArena &arena, koopa_raw_slice_t &used_by,
+                  const std::unordered_set<const void *> &users) {
+  std::vector<const void *> kept;
+  kept.reserve(used_by.len);
+  for (size_t i = 0; i < used_by.len; ++i) {
+    if (!users.count(used_by.buffer[i])) {
+      kept.push_back(used_by.buffer[i]);
+    }
+  }
+  if (kept.size() != used_by.len) {
+    used_by = arena.slice(kept, KOOPA_RSIK_VALUE);
+  }
+}
+// 依次对指令的每个值操作数调用 fn(operand), fn 可以修改操作数
+template <typename Fn> void rewrite_operands(const koopa_raw_value_t &inst,
+                                             Fn &&fn) {
+  auto &kind = mut(inst)->kind;
+  auto each = [&](const koopa_raw_slice_t &slice) {
+    for (size_t i = 0; i < slice.len; ++i) {
+      auto value = reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+      fn(value);
+      slice.buffer[i] = value;
+    }
+  };
+  switch (kind.tag) {
+  case KOOPA_RVT_RETURN:
+    if (kind.data.ret.value != nullptr) {
+      fn(kind.data.ret.value);
+    }
+    break;
+  case KOOPA_RVT_BINARY:
+    fn(kind.data.binary.lhs);
+    fn(kind.data.binary.rhs);
+    break;
+  case KOOPA_RVT_LOAD:
+    fn(kind.data.load.src);
+    break;
+  case KOOPA_RVT_STORE:
+    fn(kind.data.store.value);
+    fn(kind.data.store.dest);
+    break;
+  case KOOPA_RVT_BRANCH:
+    fn(kind.data.branch.cond);
+    each(kind.data.branch.true_args);
+    each(kind.data.branch.false_args);
+    break;
+  case KOOPA_RVT_JUMP:
+    each(kind.data.jump.args);
+    break;
+  case KOOPA_RVT_CALL:
+    each(kind.data.call.args);
+    break;
+  case KOOPA_RVT_GET_ELEM_PTR:
+    fn(kind.data.get_elem_ptr.src);
+    fn(kind.data.get_elem_ptr.index);
+    break;
+  case KOOPA_RVT_GET_PTR:
+    fn(kind.data.get_ptr.src);
+    fn(kind.data.get_ptr.index);
+    break;
+  default:
+    break;
+  }
+}
+} // namespace
+
+void retarget(IRArena &arena, const koopa_raw_value_t &inst,
+              koopa_raw_basic_block_t from, koopa_raw_basic_block_t to) {
+  auto &kind = mut(inst)->kind;
+  if (kind.tag == KOOPA_RVT_BRANCH) {
+    if (kind.data.branch.true_bb == from) {
+      kind.data.branch.true_bb = to;
+    }
+    if (kind.data.branch.false_bb == from) {
+      kind.data.branch.false_bb = to;
+    }
+  } else {
+    assert(kind.tag == KOOPA_RVT_JUMP && kind.data.jump.target == from);
+    kind.data.jump.target = to;
+  }
+  remove_users(arena, mut(from)->used_by, {inst});
+  add_uses(arena, inst);
+}
+
+void drop_uses(IRArena &arena, const std::vector<koopa_raw_value_t> &insts) {
+  // 先按被使用者归组, 每个 used_by 只重建一次
+  std::unordered_map<koopa_raw_value_t, std::unordered_set<const void *>>
+      values;
+  std::unordered_map<koopa_raw_basic_block_t, std::unordered_set<const void *>>
+      blocks;
+  for (auto inst : insts) {
+    for_each_operand(inst, [&](koopa_raw_value_t value) {
+      values[value].insert(inst);
+    });
+    for (auto target : branch_targets(inst)) {
+      blocks[target].insert(inst);
+    }
+  }
+  for (const auto &entry : values) {
+    remove_users(arena, mut(entry.first)->used_by, entry.second);
+  }
+  for (const auto &entry : blocks) {
+    remove_users(arena, mut(entry.first)->used_by, entry.second);
+  }
+}
+
+void add_uses(IRArena &arena, const koopa_raw_value_t &inst) {
+  auto append = [&](koopa_raw_slice_t &used_by) {
+    std::vector<const void *> users(used_by.buffer,
+                                    used_by.buffer + used_by.len);
+    if (std::find(users.begin(), users.end(), inst) == users.end()) {
+      users.push_back(inst);
+      used_by = arena.slice(users, KOOPA_RSIK_VALUE);
+    }
+  };
+  for_each_operand(inst, [&](koopa_raw_value_t value) {
+    append(mut(value)->used_by);
+  });
+  for (auto target : branch_targets(inst)) {
+    append(mut(target)->used_by);
+  }
+}
+
+void replace_uses(IRArena &arena, const Replacements &replacements) {
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> target;
+  std::vector<koopa_raw_value_t> users;
+  std::unordered_set<koopa_raw_value_t> seen;
+  for (const auto &entry : replacements) {
+    target[entry.first] = entry.second;
+    for (size_t i = 0; i < entry.first->used_by.len; ++i) {
+      auto user =
+          reinterpret_cast<koopa_raw_value_t>(entry.first->used_by.buffer[i]);
+      if (seen.insert(user).second) {
+        users.push_back(user);
+      }
+    }
+  }
+  // 先改写所有使用者的操作数, 再按替代值归组, 每个 used_by 只重建一次
+  std::unordered_map<koopa_raw_value_t, std::vector<const void *>> added;
+  std::vector<koopa_raw_value_t> values;
+  for (auto user : users) {
+    rewrite_operands(user, [&](koopa_raw_value_t &operand) {
+      auto it = target.find(operand);
+      if (it == target.end()) {
+        return;
+      }
+      operand = it->second;
+      auto &list = added[operand];
+      if (list.empty()) {
+        values.push_back(operand);
+      }
+      list.push_back(user);
+    });
+  }
+  for (auto value : values) {
+    auto &used_by = mut(value)->used_by;
+    std::vector<const void *> items(used_by.buffer,
+                                    used_by.buffer + used_by.len);
+    std::unordered_set<const void *> present(items.begin(), items.end());
+    for (auto user : added[value]) {
+      if (present.insert(user).second) {
+        items.push_back(user);
+      }
+    }
+    used_by = arena.slice(items, KOOPA_RSIK_VALUE);
+  }
+  for (const auto &entry : replacements) {
+    mut(entry.first)->used_by = arena.slice({}, KOOPA_RSIK_VALUE);
+  }
+}
+
+void replace_all_uses(IRArena &arena, const koopa_raw_value_t &from,
+                      const koopa_raw_value_t &to) {
+  replace_uses(arena, {{from, to}});
+}
+
+koopa_raw_value_t make_integer(IRArena &arena, int32_t value,
+                               koopa_raw_type_t ty) {
+  auto data = arena.value();
+  data->ty = ty;
+  data->name = nullptr;
+  data->used_by = arena.slice({}, KOOPA_RSIK_VALUE);
+  data->kind.tag = KOOPA_RVT_INTEGER;
+  data->kind.data.integer.value = value;
+  return data;
+}
+
+void remove_insts(IRArena &arena, const koopa_raw_function_t &func,
+                  const std::vector<koopa_raw_value_t> &dead) {
+  if (dead.empty()) {
+    return;
+  }
+  std::unordered_set<const void *> removed(dead.begin(), dead.end());
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    std::vector<const void *> insts;
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      if (!removed.count(bb->insts.buffer[j])) {
+        insts.push_back(bb->insts.buffer[j]);
+      }
+    }
+    if (insts.size() != bb->insts.len) {
+      mut(bb)->insts = arena.slice(insts, KOOPA_RSIK_VALUE);
+    }
+  }
+  drop_uses(arena, dead);
+}
+
+bool is_pure(const koopa_raw_value_t &inst) {
+  switch (inst->kind.tag) {
+  case KOOPA_RVT_ALLOC:
+  case KOOPA_RVT_LOAD:
+  case KOOPA_RVT_BINARY:
+  case KOOPA_RVT_GET_ELEM_PTR:
+  case KOOPA_RVT_GET_PTR:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void remove_with_operands(IRArena &arena, const koopa_raw_function_t &func,
+                          std::vector<koopa_raw_value_t> dead) {
+  std::unordered_set<koopa_raw_value_t> removed(dead.begin(), dead.end());
+  // 整批调用 drop_uses, 每个 used_by 每轮只重建一次
+  while (!dead.empty()) {
+    drop_uses(arena, dead);
+    std::vector<koopa_raw_value_t> unused;
+    for (auto inst : dead) {
+      for_each_operand(inst, [&](koopa_raw_value_t operand) {
+        if (is_pure(operand) && operand->used_by.len == 0 &&
+            removed.insert(operand).second) {
+          unused.push_back(operand);
+        }
+      });
+    }
+    dead = std::move(unused);
+  }
+  // 按原来的顺序从基本块中删除; used_by 已经更新过
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+    std::vector<const void *> insts;
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      if (!removed.count(
+              reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]))) {
+        insts.push_back(bb->insts.buffer[j]);
+      }
+    }
+    if (insts.size() != bb->insts.len) {
+      mut(bb)->insts = arena.slice(insts, KOOPA_RSIK_VALUE);
+    }
+  }
+}
+
+size_t count_insts(const koopa_raw_program_t &program) {
+  size_t count = 0;
+  for (size_t i = 0; i < program.funcs.len; ++i) {
+    auto func = reinterpret_cast<koopa_raw_function_t>(program.funcs.buffer[i]);
+    for (size_t j = 0; j < func->bbs.len; ++j) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[j]);
+      count += bb->insts.len;
+    }
+  }
+  return count;
+}
+
+koopa_raw_type_t pointee(const koopa_raw_type_t &type) {
+  return type->data.pointer.base;
+}
+
+size_t type_words(const koopa_raw_type_t &type) {
+  if (type->tag == KOOPA_RTT_ARRAY) {
+    return type->data.array.len * type_words(type->data.array.base);
+  }
+  return 1;
+}
+
+bool is_address(const koopa_raw_value_t &value) {
+  return value->kind.tag == KOOPA_RVT_GET_ELEM_PTR ||
+         value->kind.tag == KOOPA_RVT_GET_PTR;
+}
+
+koopa_raw_value_t address_src(const koopa_raw_value_t &value) {
+  return value->kind.tag == KOOPA_RVT_GET_ELEM_PTR
+             ? value->kind.data.get_elem_ptr.src
+             : value->kind.data.get_ptr.src;
+}
+
+bool fold_constants(const koopa_raw_function_t &func, IRArena &arena) {
+  bool folded = false;
+  for (bool changed = true; changed;) {
+    // 本轮折叠出的常数; 后面的指令直接看到它们, 一条运算链一轮就能折完
+    std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> constant;
+    auto integer = [&](koopa_raw_value_t value) -> koopa_raw_value_t {
+      auto it = constant.find(value);
+      value = it == constant.end() ? value : it->second;
+      return value->kind.tag == KOOPA_RVT_INTEGER ? value : nullptr;
+    };
+    Replacements replacements;
+    std::vector<koopa_raw_value_t> dead;
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        auto inst = reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]);
+        if (inst->kind.tag != KOOPA_RVT_BINARY) {
+          continue;
+        }
+        const auto &binary = inst->kind.data.binary;
+        auto lhs = integer(binary.lhs), rhs = integer(binary.rhs);
+        if (lhs == nullptr || rhs == nullptr) {
+          continue;
+        }
+        auto result = fold(binary.op, lhs->kind.data.integer.value,
+                           rhs->kind.data.integer.value);
+        if (result) {
+          auto value = make_integer(arena, *result, inst->ty);
+          constant[inst] = value;
+          replacements.emplace_back(inst, value);
+          dead.push_back(inst);
+        }
+      }
+    }
+    replace_uses(arena, replacements);
+    remove_insts(arena, func, dead);
+    changed = !dead.empty();
+    folded = folded || changed;
+  }
+  return folded;
+}
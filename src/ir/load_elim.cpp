@@ -0,0 +1,282 @@
+// load_elim.cpp
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "ir_passes.h"
+#include "ir_util.h"
+
+namespace {
+koopa_raw_value_t value_at(const koopa_raw_slice_t &slice, size_t i) {
+  return reinterpret_cast<koopa_raw_value_t>(slice.buffer[i]);
+}
+
+// 内存位置: 标量为 (alloc 或全局变量, -1), 数组元素为 (数组, 字偏移)
+using Location = std::pair<koopa_raw_value_t, int64_t>;
+// 每个位置当前在内存中的值
+using Available = std::map<Location, koopa_raw_value_t>;
+
+// 指针指向哪里: 确定的位置, 只知道是哪个数组 (下标不是常数),
+// 或者完全不知道 (经由参数或读出的指针)
+struct Address {
+  enum Kind { EXACT, ROOT, UNKNOWN } kind = UNKNOWN;
+  Location loc = {nullptr, 0};
+};
+
+bool is_array_root(const koopa_raw_value_t &value) {
+  return (value->kind.tag == KOOPA_RVT_ALLOC ||
+          value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC) &&
+         pointee(value->ty)->tag == KOOPA_RTT_ARRAY;
+}
+
+// 一个函数中各个指针的别名信息. 不同的 alloc 和全局变量互不重叠;
+// 标量全局变量不能取地址, 地址不逃逸的局部标量只被 load/store 直接使用.
+// 经由参数或读出的指针可能指向全局数组和逃逸的局部数组
+class AliasInfo {
+public:
+  explicit AliasInfo(const koopa_raw_function_t &func) {
+    for (size_t i = 0; i < func->bbs.len; ++i) {
+      auto bb = reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        auto inst = value_at(bb->insts, j);
+        if (inst->kind.tag == KOOPA_RVT_ALLOC) {
+          classify_alloc(inst);
+        }
+        for_each_operand(inst, [&](koopa_raw_value_t value) {
+          if (value->kind.tag == KOOPA_RVT_GLOBAL_ALLOC &&
+              pointee(value->ty)->tag == KOOPA_RTT_INT32) {
+            scalars.insert(value);
+          }
+        });
+      }
+    }
+  }
+
+  Address resolve(koopa_raw_value_t ptr) const {
+    Address addr;
+    if (scalars.count(ptr)) {
+      addr.kind = Address::EXACT;
+      addr.loc = {ptr, -1};
+      return addr;
+    }
+    int64_t offset = 0;
+    bool exact = true;
+    while (is_address(ptr)) {
+      auto index = ptr->kind.tag == KOOPA_RVT_GET_ELEM_PTR
+                       ? ptr->kind.data.get_elem_ptr.index
+                       : ptr->kind.data.get_ptr.index;
+      if (index->kind.tag == KOOPA_RVT_INTEGER) {
+        offset += int64_t(index->kind.data.integer.value) *
+                  type_words(pointee(ptr->ty));
+      } else {
+        exact = false;
+      }
+      ptr = address_src(ptr);
+    }
+    if (!is_array_root(ptr)) {
+      return addr;
+    }
+    addr.kind = exact ? Address::EXACT : Address::ROOT;
+    addr.loc = {ptr, exact ? offset : 0};
+    return addr;
+  }
+
+  // 调用和经由未知指针的写入可能改到的位置
+  bool clobbered_by_call(const Location &loc) const {
+    return loc.first->kind.tag == KOOPA_RVT_GLOBAL_ALLOC ||
+           escaped.count(loc.first);
+  }
+  bool clobbered_by_unknown_store(const Location &loc) const {
+    return is_array_root(loc.first) && clobbered_by_call(loc);
+  }
+
+private:
+  void classify_alloc(const koopa_raw_value_t &alloc) {
+    if (pointee(alloc->ty)->tag != KOOPA_RTT_ARRAY) {
+      for (size_t i = 0; i < alloc->used_by.len; ++i) {
+        auto user = value_at(alloc->used_by, i);
+        bool ok = user->kind.tag == KOOPA_RVT_LOAD ||
+                  (user->kind.tag == KOOPA_RVT_STORE &&
+                   user->kind.data.store.dest == alloc &&
+                   user->kind.data.store.value != alloc);
+        if (!ok) {
+          return;
+        }
+      }
+      scalars.insert(alloc);
+      return;
+    }
+    // 数组的地址传给调用或存进内存后, 别处的指针可能指向它
+    std::vector<koopa_raw_value_t> worklist = {alloc};
+    while (!worklist.empty()) {
+      auto ptr = worklist.back();
+      worklist.pop_back();
+      for (size_t i = 0; i < ptr->used_by.len; ++i) {
+        auto user = value_at(ptr->used_by, i);
+        if (is_address(user) && address_src(user) == ptr) {
+          worklist.push_back(user);
+        } else if (user->kind.tag == KOOPA_RVT_CALL ||
+                   (user->kind.tag == KOOPA_RVT_STORE &&
+                    user->kind.data.store.value == ptr)) {
+          escaped.insert(alloc);
+          return;
+        }
+      }
+    }
+  }
+
+  std::unordered_set<koopa_raw_value_t> scalars;
+  std::unordered_set<koopa_raw_value_t> escaped;
+};
+
+template <typename Pred> void kill_if(Available &avail, Pred &&pred) {
+  for (auto it = avail.begin(); it != avail.end();) {
+    it = pred(it->first) ? avail.erase(it) : std::next(it);
+  }
+}
+
+// 正向执行一条指令. load 的位置已知当前值时返回该值, 否则返回 nullptr
+koopa_raw_value_t transfer(const koopa_raw_value_t &inst,
+                           const AliasInfo &alias, Available &avail) {
+  switch (inst->kind.tag) {
+  case KOOPA_RVT_LOAD: {
+    auto addr = alias.resolve(inst->kind.data.load.src);
+    if (addr.kind != Address::EXACT) {
+      return nullptr;
+    }
+    auto it = avail.find(addr.loc);
+    if (it != avail.end()) {
+      return it->second;
+    }
+    avail[addr.loc] = inst;
+    return nullptr;
+  }
+  case KOOPA_RVT_STORE: {
+    auto addr = alias.resolve(inst->kind.data.store.dest);
+    auto value = inst->kind.data.store.value;
+    bool aggregate = value->kind.tag == KOOPA_RVT_AGGREGATE ||
+                     value->kind.tag == KOOPA_RVT_ZERO_INIT;
+    if (addr.kind == Address::UNKNOWN) {
+      kill_if(avail, [&](const Location &loc) {
+        return alias.clobbered_by_unknown_store(loc);
+      });
+    } else if (addr.kind == Address::ROOT || aggregate) {
+      auto root = addr.loc.first;
+      kill_if(avail, [&](const Location &loc) { return loc.first == root; });
+    } else if (value->kind.tag == KOOPA_RVT_FUNC_ARG_REF) {
+      // 后端只在参数存进 alloc 时读参数寄存器, 参数不能转发到别处
+      avail.erase(addr.loc);
+    } else {
+      avail[addr.loc] = value;
+    }
+    return nullptr;
+  }
+  case KOOPA_RVT_CALL:
+    kill_if(avail, [&](const Location &loc) {
+      return alias.clobbered_by_call(loc);
+    });
+    return nullptr;
+  default:
+    return nullptr;
+  }
+}
+
+// 所有前驱出口都有的 (位置, 值)
+Available meet(const Available &lhs, const Available &rhs) {
+  Available result;
+  for (const auto &entry : lhs) {
+    auto it = rhs.find(entry.first);
+    if (it != rhs.end() && it->second == entry.second) {
+      result.insert(entry);
+    }
+  }
+  return result;
+}
+} // namespace
+
+bool LoadElim::run_on_function(const koopa_raw_function_t &func,
+                               PassContext &ctx) {
+  const Cfg &cfg = ctx.analyses.cfg(func);
+  AliasInfo alias(func);
+  // 正向的必经可用值分析: 入口为空, 其余块是已算出的前驱出口的交集.
+  // 值在所有路径上都相同, 因此它的定义支配这个块
+  size_t n = cfg.size();
+  std::vector<Available> out(n);
+  std::vector<bool> computed(n, false);
+  auto block_in = [&](size_t idx) {
+    Available in;
+    bool first = true;
+    if (idx != 0) {
+      for (size_t pred : cfg.preds[idx]) {
+        if (!cfg.reachable[pred] || !computed[pred]) {
+          continue;
+        }
+        in = first ? out[pred] : meet(in, out[pred]);
+        first = false;
+      }
+    }
+    return in;
+  };
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (size_t idx : cfg.rpo) {
+      auto avail = block_in(idx);
+      auto bb = cfg.blocks[idx];
+      for (size_t j = 0; j < bb->insts.len; ++j) {
+        transfer(value_at(bb->insts, j), alias, avail);
+      }
+      if (!computed[idx] || avail != out[idx]) {
+        out[idx] = std::move(avail);
+        computed[idx] = true;
+        changed = true;
+      }
+    }
+  }
+
+  // 冗余的 load -> 替代它的值. 替代值本身可能也是被替代的 load
+  std::unordered_map<koopa_raw_value_t, koopa_raw_value_t> replaced;
+  std::vector<koopa_raw_value_t> loads;
+  auto canonical = [&](koopa_raw_value_t value) {
+    for (auto it = replaced.find(value); it != replaced.end();
+         it = replaced.find(value)) {
+      value = it->second;
+    }
+    return value;
+  };
+  std::set<int> lines;
+  for (size_t idx : cfg.rpo) {
+    auto avail = block_in(idx);
+    auto bb = cfg.blocks[idx];
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      auto inst = value_at(bb->insts, j);
+      auto value = transfer(inst, alias, avail);
+      if (value == nullptr) {
+        continue;
+      }
+      replaced[inst] = canonical(value);
+      loads.push_back(inst);
+      if (ctx.remarks.enabled()) {
+        lines.insert(ctx.remarks.line(func, bb, inst));
+      }
+    }
+  }
+  if (loads.empty()) {
+    return false;
+  }
+  for (int line : lines) {
+    ctx.remarks.emit(Remark::PASSED, "load-elim", "RedundantLoad", func, line,
+                     "load reuses a value already stored or loaded, removed");
+  }
+  Replacements replacements;
+  for (auto load : loads) {
+    replacements.emplace_back(load, canonical(load));
+  }
+  replace_uses(ctx.arena, replacements);
+  // 删掉的 load 的地址计算可能不再有用
+  remove_with_operands(ctx.arena, func, loads);
+  // 转发来的常数可能让运算变成常数
+  fold_constants(func, ctx.arena);
+  return true;
+}
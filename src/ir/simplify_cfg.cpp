@@ -0,0 +1,224 @@
+// simplify_cfg.cpp
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "ir_passes.h"
+#include "ir_util.h"
+
+namespace {
+koopa_raw_basic_block_t block_at(const koopa_raw_function_t &func, size_t i) {
+  return reinterpret_cast<koopa_raw_basic_block_t>(func->bbs.buffer[i]);
+}
+
+koopa_raw_value_t terminator(koopa_raw_basic_block_t bb) {
+  if (bb->insts.len == 0) {
+    return nullptr;
+  }
+  return reinterpret_cast<koopa_raw_value_t>(
+      bb->insts.buffer[bb->insts.len - 1]);
+}
+
+// 不带参数的 jump 的目标, 否则为 nullptr
+koopa_raw_basic_block_t plain_jump_target(koopa_raw_basic_block_t bb) {
+  auto last = terminator(bb);
+  if (last == nullptr || last->kind.tag != KOOPA_RVT_JUMP ||
+      last->kind.data.jump.args.len != 0) {
+    return nullptr;
+  }
+  return last->kind.data.jump.target;
+}
+
+// 只保留 keep 中的基本块, 保持原来的顺序
+void keep_blocks(const koopa_raw_function_t &func, IRArena &arena,
+                 const std::unordered_set<koopa_raw_basic_block_t> &keep) {
+  std::vector<const void *> bbs;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    if (keep.count(block_at(func, i))) {
+      bbs.push_back(block_at(func, i));
+    }
+  }
+  mut(func)->bbs = arena.slice(bbs, KOOPA_RSIK_BASIC_BLOCK);
+}
+
+// 条件为常数或两个目标相同的 br 原地改成 jump,
+// 不走的目标在之后作为不可达块删除
+bool fold_branches(const koopa_raw_function_t &func, PassContext &ctx) {
+  bool changed = false;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    auto last = terminator(bb);
+    if (last == nullptr || last->kind.tag != KOOPA_RVT_BRANCH) {
+      continue;
+    }
+    const auto &branch = last->kind.data.branch;
+    bool same = branch.true_bb == branch.false_bb &&
+                branch.true_args.len == 0 && branch.false_args.len == 0;
+    if (branch.cond->kind.tag != KOOPA_RVT_INTEGER && !same) {
+      continue;
+    }
+    bool taken = same || branch.cond->kind.data.integer.value != 0;
+    if (!same && ctx.remarks.enabled()) {
+      ctx.remarks.emit(Remark::PASSED, "simplify-cfg", "BranchFolded", func,
+                       ctx.remarks.line(func, bb, last),
+                       std::string("condition is always ") +
+                           (taken ? "true" : "false") +
+                           ", branch replaced by a jump");
+    }
+    koopa_raw_jump_t jump;
+    jump.target = taken ? branch.true_bb : branch.false_bb;
+    jump.args = taken ? branch.true_args : branch.false_args;
+    drop_uses(ctx.arena, {last});
+    mut(last)->kind.tag = KOOPA_RVT_JUMP;
+    mut(last)->kind.data.jump = jump;
+    add_uses(ctx.arena, last);
+    changed = true;
+  }
+  return changed;
+}
+
+// 跳到转发块 (只含一条 jump 的非入口块) 的边直接连到最终目标
+bool thread_jumps(const koopa_raw_function_t &func, IRArena &arena) {
+  auto entry = block_at(func, 0);
+  std::unordered_map<koopa_raw_basic_block_t, koopa_raw_basic_block_t> forward;
+  for (size_t i = 1; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    auto target = plain_jump_target(bb);
+    if (bb->insts.len == 1 && bb->params.len == 0 && target != nullptr &&
+        target != bb) {
+      forward[bb] = target;
+    }
+  }
+  if (forward.empty()) {
+    return false;
+  }
+  // 沿转发链找到最终目标; 只由转发块组成的环保持不变
+  auto resolve = [&](koopa_raw_basic_block_t bb) {
+    auto target = bb;
+    for (size_t steps = 0; steps <= forward.size(); ++steps) {
+      auto it = forward.find(target);
+      if (it == forward.end()) {
+        return target;
+      }
+      target = it->second;
+    }
+    return bb;
+  };
+  bool changed = false;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto last = terminator(block_at(func, i));
+    if (last == nullptr) {
+      continue;
+    }
+    for (auto target : branch_targets(last)) {
+      auto final_target = resolve(target);
+      if (final_target != target && final_target != entry) {
+        retarget(arena, last, target, final_target);
+        changed = true;
+      }
+    }
+  }
+  return changed;
+}
+
+// 删除从入口不可达的块, 并从它们用到的值的 used_by 中去掉其中的指令
+bool remove_unreachable(const koopa_raw_function_t &func, PassContext &ctx) {
+  std::unordered_set<koopa_raw_basic_block_t> reachable = {block_at(func, 0)};
+  std::vector<koopa_raw_basic_block_t> worklist = {block_at(func, 0)};
+  while (!worklist.empty()) {
+    auto last = terminator(worklist.back());
+    worklist.pop_back();
+    if (last == nullptr) {
+      continue;
+    }
+    for (auto target : branch_targets(last)) {
+      if (reachable.insert(target).second) {
+        worklist.push_back(target);
+      }
+    }
+  }
+  if (reachable.size() == func->bbs.len) {
+    return false;
+  }
+  std::vector<koopa_raw_value_t> dead;
+  std::set<int> dead_lines;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    if (reachable.count(bb)) {
+      continue;
+    }
+    // 只剩一条跳转的块是前端生成的转发块, 不是源码中的代码
+    if (ctx.remarks.enabled() && bb->insts.len > 1) {
+      dead_lines.insert(ctx.remarks.line(func, bb));
+    }
+    for (size_t j = 0; j < bb->insts.len; ++j) {
+      dead.push_back(reinterpret_cast<koopa_raw_value_t>(bb->insts.buffer[j]));
+    }
+  }
+  for (int line : dead_lines) {
+    ctx.remarks.emit(Remark::PASSED, "simplify-cfg", "UnreachableRemoved",
+                     func, line, "unreachable code removed");
+  }
+  drop_uses(ctx.arena, dead);
+  keep_blocks(func, ctx.arena, reachable);
+  return true;
+}
+
+// 以 jump 结尾的块与它唯一前驱的目标块合并
+bool merge_blocks(const koopa_raw_function_t &func, IRArena &arena) {
+  auto entry = block_at(func, 0);
+  std::unordered_map<koopa_raw_basic_block_t, int> pred_count;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto last = terminator(block_at(func, i));
+    if (last != nullptr) {
+      for (auto target : branch_targets(last)) {
+        pred_count[target]++;
+      }
+    }
+  }
+  std::unordered_set<koopa_raw_basic_block_t> removed;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    auto bb = block_at(func, i);
+    if (removed.count(bb)) {
+      continue;
+    }
+    for (auto next = plain_jump_target(bb);
+         next != nullptr && next != bb && next != entry &&
+         pred_count[next] == 1 && next->params.len == 0;
+         next = plain_jump_target(bb)) {
+      auto jump = terminator(bb);
+      std::vector<const void *> insts(bb->insts.buffer,
+                                      bb->insts.buffer + bb->insts.len - 1);
+      insts.insert(insts.end(), next->insts.buffer,
+                   next->insts.buffer + next->insts.len);
+      drop_uses(arena, {jump});
+      mut(bb)->insts = arena.slice(insts, KOOPA_RSIK_VALUE);
+      removed.insert(next);
+    }
+  }
+  if (removed.empty()) {
+    return false;
+  }
+  std::unordered_set<koopa_raw_basic_block_t> keep;
+  for (size_t i = 0; i < func->bbs.len; ++i) {
+    if (!removed.count(block_at(func, i))) {
+      keep.insert(block_at(func, i));
+    }
+  }
+  keep_blocks(func, arena, keep);
+  return true;
+}
+} // namespace
+
+bool SimplifyCfg::run_on_function(const koopa_raw_function_t &func,
+                                  PassContext &ctx) {
+  // 一步化简可能带来新的机会 (如转发后 br 的两个目标相同), 重复到不再变化
+  bool changed = false;
+  while (fold_branches(func, ctx) | thread_jumps(func, ctx.arena) |
+         remove_unreachable(func, ctx) |
+         merge_blocks(func, ctx.arena)) {
+    changed = true;
+  }
+  return changed;
+}
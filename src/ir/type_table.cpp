@@ -0,0 +1,49 @@
+// type_table.cpp
+#include <cassert>
+
+#include "type_table.h"
+
+TypeTable &TypeTable::getInstance() {
+  static TypeTable instance;
+  return instance;
+}
+
+const ArrayType *TypeTable::get(const std::vector<int> &dims) {
+  auto it = types.find(dims);
+  if (it != types.end()) {
+    return it->second.get();
+  }
+  auto type = std::make_unique<ArrayType>();
+  type->dims = dims;
+  type->sub_sizes.assign(dims.size() + 1, 1);
+  for (size_t i = dims.size(); i > 0; --i) {
+    type->sub_sizes[i - 1] = type->sub_sizes[i] * dims[i - 1];
+  }
+  if (dims.empty()) {
+    type->text = "i32";
+  } else {
+    type->elem = get(std::vector<int>(dims.begin() + 1, dims.end()));
+    type->text = "[" + type->elem->text + ", " + std::to_string(dims[0]) + "]";
+  }
+  type->ptr_text = "*" + type->text;
+  return (types[dims] = std::move(type)).get();
+}
+
+const ArrayType *TypeTable::of(koopa_raw_type_t type) {
+  auto it = raw_types.find(type);
+  if (it != raw_types.end()) {
+    return it->second;
+  }
+  auto base = type;
+  if (base->tag == KOOPA_RTT_POINTER) {
+    base = base->data.pointer.base;
+  }
+  std::vector<int> dims;
+  while (base->tag == KOOPA_RTT_ARRAY) {
+    dims.push_back(base->data.array.len);
+    base = base->data.array.base;
+  }
+  // 元素只能是 i32, 或是数组参数的指针 (和 i32 一样占 4 字节)
+  assert(base->tag == KOOPA_RTT_INT32 || base->tag == KOOPA_RTT_POINTER);
+  return raw_types[type] = get(dims);
+}
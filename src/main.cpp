@@ -1,52 +1,121 @@
 #include <cassert>
+#include <chrono>
 #include <cstdio>
+#include <fstream>
 #include <iostream>
-#include <memory>
-#include <sstream>
 #include <string>
+#include <vector>
 
-#include "ast.h"
-#include "riscv_codegen.h"
+#include "driver.h"
+#include "lexer.h"
+#include "server.h"
+#include "simulator.h"
 #include "util.h"
 
 using namespace std;
 
-extern FILE *yyin;
-extern int yyparse(unique_ptr<BaseAST> &ast);
-extern int yydebug;
+// 分别用 flex 和手写词法分析器扫描输入若干遍, 输出吞吐量
+static void lex_bench(const char *input, string_view source) {
+  const int rounds = 5;
+  auto measure = [&](const char *name, auto lex_once) {
+    auto begin = chrono::steady_clock::now();
+    size_t tokens = 0;
+    for (int i = 0; i < rounds; ++i) {
+      tokens = lex_once();
+    }
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - begin;
+    double mb = source.size() * rounds / 1e6;
+    cout << name << ": " << tokens << " tokens, " << elapsed.count() / rounds * 1e3
+         << " ms/round, " << mb / elapsed.count() << " MB/s" << endl;
+  };
+  measure("flex", [&]() {
+    FILE *file = fopen(input, "r");
+    assert(file);
+    size_t tokens = flex_count_tokens(file);
+    fclose(file);
+    return tokens;
+  });
+  measure("fast", [&]() {
+    Lexer lexer(source);
+    size_t tokens = 0;
+    while (lexer.next().kind != TokenKind::END) {
+      ++tokens;
+    }
+    return tokens;
+  });
+}
+
+// 在模拟器中运行目标文件, 程序的输入输出就是编译器的标准输入输出,
+// 退出码是程序的退出码. 指令数和估计的周期数写到标准错误
+static int run_program(const string &object, const LatencyTable &latency) {
+  Simulator simulator(latency);
+  int exit_code = 0;
+  if (!simulator.load(object) || !simulator.run(cin, cout, exit_code)) {
+    return 1;
+  }
+  cout.flush();
+  cerr << "sim: " << simulator.instructions() << " instructions, "
+       << simulator.cycles() << " cycles" << endl;
+  return exit_code;
+}
 
 int main(int argc, const char *argv[]) {
-  // compiler 模式 输入文件 -o 输出文件
-  assert(argc == 5 or argc == 6);
-  auto mode = argv[1];
+  // compiler --serve 套接字路径
+  if (argc == 3 && string(argv[1]) == "--serve") {
+    return serve(argv[2]);
+  }
+  // compiler 模式 输入文件 -o 输出文件 [选项...]
+  assert(argc >= 5);
   auto input = argv[2];
   auto output = argv[4];
-  if (argc == 6 and string(argv[5]) == "-debug") {
-    yydebug = 1;
-  }
-
-  yyin = fopen(input, "r");
-  assert(yyin);
-
-  unique_ptr<BaseAST> ast;
-  assert(!yyparse(ast));
-
-
-  stringstream oss;
-  oss << *ast;
-  string irs = oss.str();
-  cout << irs << endl;
-  if (string(mode) == "-koopa") {
-    write_file(output, irs);
-  } else if (string(mode) == "-riscv") {
-    CodeGen *codegen = new CodeGen(irs);
-    string riscv_str = codegen->gererate();
-    write_file(output, riscv_str);
-    cout << riscv_str << endl;
-  } else {
-    cerr << "Error arguments" << endl;
+  DriverOptions options;
+  options.mode = argv[1];
+  options.source_name = input;
+  if (!parse_driver_options(vector<string>(argv + 5, argv + argc), options)) {
+    return 1;
+  }
+  // -run 按 -obj 编译, 再在模拟器中运行生成的目标文件
+  bool run = options.mode == "-run";
+  if (run) {
+    options.mode = "-obj";
+    options.echo = false;
+  }
+
+  MappedFile source;
+  bool need_source = options.lex_bench || options.fast_lex ||
+                     (!options.cache_dir.empty() && options.mode != "-koopa");
+  if (need_source && !source.open(input)) {
+    cerr << "Cannot open " << input << endl;
     return 1;
   }
+  if (options.lex_bench) {
+    lex_bench(input, source.data());
+    return 0;
+  }
+  FILE *file = nullptr;
+  if (!options.fast_lex) {
+    file = fopen(input, "r");
+    assert(file);
+  }
+
+  // 流水线模式直接写输出文件, 不在内存中保留完整的结果
+  if (options.stream) {
+    ofstream out(output);
+    if (!out || compile_stream(options, file, source.data(), out) != 0) {
+      return 1;
+    }
+    cout << "success compile!" << endl;
+    return 0;
+  }
+
+  string result;
+  if (compile(options, file, source.data(), result) != 0) {
+    return 1;
+  }
+  write_file(output, result);
+  if (run) {
+    return run_program(result, options.codegen.latency);
+  }
   cout << "success compile!" << endl;
   return 0;
 }
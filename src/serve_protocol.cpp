@@ -0,0 +1,93 @@
+// serve_protocol.cpp
+#include <cerrno>
+#include <cstdint>
+#include <unistd.h>
+
+#include "serve_protocol.h"
+
+namespace {
+// 单个字段的上限, 防止错误的长度导致分配过多内存
+constexpr uint32_t kMaxFieldSize = 1u << 30;
+
+bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+bool read_all(int fd, char *data, size_t size) {
+  while (size > 0) {
+    ssize_t n = read(fd, data, size);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+void put_u32(std::string &buf, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    buf.push_back(static_cast<char>(value >> (i * 8)));
+  }
+}
+
+bool read_u32(int fd, uint32_t &value) {
+  unsigned char bytes[4];
+  if (!read_all(fd, reinterpret_cast<char *>(bytes), 4)) {
+    return false;
+  }
+  value = bytes[0] | bytes[1] << 8 | bytes[2] << 16 |
+          static_cast<uint32_t>(bytes[3]) << 24;
+  return true;
+}
+} // namespace
+
+bool write_message(int fd, const std::vector<std::string> &fields) {
+  std::string header;
+  put_u32(header, fields.size());
+  if (!write_all(fd, header.data(), header.size())) {
+    return false;
+  }
+  for (const auto &field : fields) {
+    header.clear();
+    put_u32(header, field.size());
+    if (!write_all(fd, header.data(), header.size()) ||
+        !write_all(fd, field.data(), field.size())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool read_message(int fd, std::vector<std::string> &fields) {
+  uint32_t count;
+  if (!read_u32(fd, count) || count > 4096) {
+    return false;
+  }
+  fields.assign(count, "");
+  for (auto &field : fields) {
+    uint32_t size;
+    if (!read_u32(fd, size) || size > kMaxFieldSize) {
+      return false;
+    }
+    field.resize(size);
+    if (!read_all(fd, &field[0], size)) {
+      return false;
+    }
+  }
+  return true;
+}
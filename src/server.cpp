@@ -0,0 +1,223 @@
+// server.cpp
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <map>
+#include <poll.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "ast.h"
+#include "driver.h"
+#include "serve_protocol.h"
+#include "server.h"
+
+namespace {
+const char *listen_path = nullptr;
+
+void stop_server(int) {
+  if (listen_path != nullptr) {
+    unlink(listen_path);
+  }
+  _exit(0);
+}
+
+std::string read_log(FILE *log) {
+  std::string text;
+  std::cerr.flush();
+  if (log == nullptr) {
+    return text;
+  }
+  fflush(log);
+  rewind(log);
+  char chunk[4096];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), log)) > 0) {
+    text.append(chunk, len);
+  }
+  return text;
+}
+
+// 在 fork 出的 worker 进程中处理一个请求, 诊断信息写到 log, 随响应一起返回.
+// 相对路径按客户端的工作目录解析. worker 没有正常回复就退出时 (assert
+// 失败或被信号终止), 由服务器把 log 中的诊断信息发回客户端
+[[noreturn]] void run_worker(int conn, FILE *log) {
+  std::vector<std::string> request;
+  if (!read_message(conn, request) || request.size() < 3) {
+    _exit(0);
+  }
+  if (log != nullptr) {
+    dup2(fileno(log), STDERR_FILENO);
+  }
+  int null_fd = open("/dev/null", O_WRONLY);
+  if (null_fd >= 0) {
+    dup2(null_fd, STDOUT_FILENO);
+  }
+
+  DriverOptions options;
+  options.mode = request[0];
+  options.echo = false;
+  std::string output;
+  int status = 1;
+  std::vector<std::string> args(request.begin() + 3, request.end());
+  if (chdir(request[2].c_str()) != 0) {
+    std::cerr << "Cannot change to the client directory " << request[2]
+              << ": " << strerror(errno) << std::endl;
+  } else if (options.mode == "-run") {
+    std::cerr << "-run is not supported in server mode, "
+                 "run compiler -run directly"
+              << std::endl;
+  } else if (parse_driver_options(args, options)) {
+    if (options.lex_bench) {
+      std::cerr << "-lex-bench is not supported in server mode" << std::endl;
+    } else {
+      std::string &source = request[1];
+      FILE *input = fmemopen(&source[0], source.size(), "r");
+      status = compile(options, input, source, output);
+    }
+  }
+  write_message(conn, {std::to_string(status), output, read_log(log)});
+  _exit(0);
+}
+
+// 正在处理请求的 worker: 连接和诊断信息文件
+struct Worker {
+  int conn;
+  FILE *log;
+};
+
+// worker 退出后回收它的连接; 异常退出时由服务器回复
+void finish_worker(const Worker &worker, int wstatus) {
+  if (!WIFEXITED(wstatus) || WEXITSTATUS(wstatus) != 0) {
+    std::string diagnostics = read_log(worker.log);
+    if (WIFSIGNALED(wstatus)) {
+      diagnostics += "compiler terminated by signal " +
+                     std::to_string(WTERMSIG(wstatus)) + "\n";
+    }
+    write_message(worker.conn, {"1", "", diagnostics});
+  }
+  close(worker.conn);
+  if (worker.log != nullptr) {
+    fclose(worker.log);
+  }
+}
+
+// SIGCHLD 时写一个字节, 唤醒等在 poll 上的主循环去回收 worker
+int child_pipe[2] = {-1, -1};
+
+void on_child_exit(int) {
+  int saved = errno;
+  char byte = 0;
+  if (write(child_pipe[1], &byte, 1) < 0) {
+    // 管道已满时主循环一定会被唤醒, 丢掉这个字节即可
+  }
+  errno = saved;
+}
+} // namespace
+
+int serve(const char *socket_path) {
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    std::cerr << "Socket path too long: " << socket_path << std::endl;
+    return 1;
+  }
+  strcpy(addr.sun_path, socket_path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0) {
+    perror("socket");
+    return 1;
+  }
+  unlink(socket_path);
+  if (bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, 128) != 0) {
+    perror(socket_path);
+    return 1;
+  }
+  if (pipe(child_pipe) != 0) {
+    perror("pipe");
+    return 1;
+  }
+  fcntl(child_pipe[0], F_SETFL, O_NONBLOCK);
+  fcntl(child_pipe[1], F_SETFL, O_NONBLOCK);
+  listen_path = socket_path;
+  signal(SIGINT, stop_server);
+  signal(SIGTERM, stop_server);
+  // 客户端提前断开时 write 返回错误, 不让服务器退出
+  signal(SIGPIPE, SIG_IGN);
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_child_exit;
+  action.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+  sigaction(SIGCHLD, &action, nullptr);
+
+  // 所有请求共用的初始化, 子进程 fork 后直接继承
+  init_global_symbols();
+  std::cerr << "serving on " << socket_path << std::endl;
+  std::map<pid_t, Worker> workers;
+  while (true) {
+    pollfd fds[2] = {{fd, POLLIN, 0}, {child_pipe[0], POLLIN, 0}};
+    if (poll(fds, 2, -1) < 0) {
+      if (errno != EINTR) {
+        perror("poll");
+      }
+      continue;
+    }
+    if (fds[1].revents & POLLIN) {
+      char buffer[64];
+      while (read(child_pipe[0], buffer, sizeof(buffer)) > 0) {
+      }
+      int wstatus = 0;
+      pid_t pid;
+      while ((pid = waitpid(-1, &wstatus, WNOHANG)) > 0) {
+        auto it = workers.find(pid);
+        if (it != workers.end()) {
+          finish_worker(it->second, wstatus);
+          workers.erase(it);
+        }
+      }
+    }
+    if (!(fds[0].revents & POLLIN)) {
+      continue;
+    }
+    int conn = accept(fd, nullptr, nullptr);
+    if (conn < 0) {
+      if (errno != EINTR) {
+        perror("accept");
+      }
+      continue;
+    }
+    FILE *log = tmpfile();
+    pid_t pid = fork();
+    if (pid == 0) {
+      // worker 只保留自己的连接, 信号恢复默认处理
+      close(fd);
+      close(child_pipe[0]);
+      close(child_pipe[1]);
+      for (const auto &entry : workers) {
+        close(entry.second.conn);
+      }
+      signal(SIGINT, SIG_DFL);
+      signal(SIGTERM, SIG_DFL);
+      signal(SIGCHLD, SIG_DFL);
+      run_worker(conn, log);
+    }
+    if (pid < 0) {
+      perror("fork");
+      close(conn);
+      if (log != nullptr) {
+        fclose(log);
+      }
+      continue;
+    }
+    workers[pid] = {conn, log};
+  }
+}
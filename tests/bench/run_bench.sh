@@ -0,0 +1,94 @@
+#!/bin/bash
+# 运行时性能测试: 每个内核用 -run 编译并在内置模拟器中运行, 检查输出
+# 和退出码与参考输出 (.out, 最后一行是 "exit 退出码") 一致, 再把动态
+# 指令数和估计的周期数与 baseline.txt 比较, 任何一项比基线多出
+# THRESHOLD% (默认 2) 以上即失败. 墙钟时间只作参考, 不参与比较
+#
+# 用法: tests/bench/run_bench.sh <compiler> [内核.sy...]
+# UPDATE=1 时把本次的结果写入 baseline.txt; FLAGS 给出额外的编译选项
+# (基线按默认选项记录). 内核旁的同名 .in 文件作为输入
+set -u
+
+compiler=${1:?usage: run_bench.sh <compiler> [kernels...]}
+shift
+dir=$(cd "$(dirname "$0")" && pwd)
+if [ $# -eq 0 ]; then
+  set -- "$dir"/*.sy
+fi
+baseline="$dir/baseline.txt"
+threshold=${THRESHOLD:-2}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+declare -A base_insts base_cycles
+if [ -f "$baseline" ]; then
+  while read -r name insts cycles; do
+    case "$name" in '#'* | '') continue ;; esac
+    base_insts[$name]=$insts
+    base_cycles[$name]=$cycles
+  done < "$baseline"
+fi
+
+# 相对基线的变化百分比, 保留一位小数
+delta() {
+  awk -v new="$1" -v old="$2" 'BEGIN { printf "%+.1f", (new - old) * 100 / old }'
+}
+# 变化是否超过阈值
+exceeds() {
+  awk -v new="$1" -v old="$2" -v t="$threshold" \
+    'BEGIN { exit !(new > old * (1 + t / 100)) }'
+}
+
+pass=0
+fail=0
+printf "%-10s %12s %12s %8s %8s %8s\n" kernel instructions cycles d_insts d_cycles ms
+for src in "$@"; do
+  name=$(basename "$src" .sy)
+  input=${src%.sy}.in
+  [ -f "$input" ] || input=/dev/null
+  begin=$(date +%s%N)
+  # shellcheck disable=SC2086
+  "$compiler" -run "$src" -o "$work/$name.o" ${FLAGS:-} < "$input" \
+    > "$work/$name.out" 2> "$work/$name.err"
+  echo "exit $?" >> "$work/$name.out"
+  ms=$(( ($(date +%s%N) - begin) / 1000000 ))
+  if ! cmp -s "$work/$name.out" "${src%.sy}.out"; then
+    echo "FAIL $name: output differs from reference"
+    grep -v '^sim: [0-9]' "$work/$name.err" | head -3
+    fail=$((fail + 1))
+    continue
+  fi
+  read -r insts cycles < <(sed -n \
+    's/^sim: \([0-9]*\) instructions, \([0-9]*\) cycles$/\1 \2/p' \
+    "$work/$name.err")
+  base_i=${base_insts[$name]:-}
+  base_c=${base_cycles[$name]:-}
+  if [ "${UPDATE:-0}" = 1 ] || [ -z "$base_i" ]; then
+    printf "%-10s %12s %12s %8s %8s %8s\n" "$name" "$insts" "$cycles" - - "$ms"
+    base_insts[$name]=$insts
+    base_cycles[$name]=$cycles
+    pass=$((pass + 1))
+    continue
+  fi
+  printf "%-10s %12s %12s %8s %8s %8s\n" "$name" "$insts" "$cycles" \
+    "$(delta "$insts" "$base_i")%" "$(delta "$cycles" "$base_c")%" "$ms"
+  if exceeds "$insts" "$base_i" || exceeds "$cycles" "$base_c"; then
+    echo "FAIL $name: regressed more than $threshold% against baseline" \
+      "($base_i instructions, $base_c cycles)"
+    fail=$((fail + 1))
+    continue
+  fi
+  pass=$((pass + 1))
+done
+
+if [ "${UPDATE:-0}" = 1 ] && [ $fail -eq 0 ]; then
+  {
+    echo "# kernel instructions cycles (run_bench.sh, default options)"
+    for name in $(printf "%s\n" "${!base_insts[@]}" | sort); do
+      echo "$name ${base_insts[$name]} ${base_cycles[$name]}"
+    done
+  } > "$baseline"
+  echo "updated $baseline"
+fi
+echo "passed $pass, failed $fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,81 @@
+#!/bin/bash
+# 大输入回归测试: 生成机器生成规模的程序, 在每个 -O 级别下限制内存和时间
+# 编译并用 -run 运行, 检查输出. 用于发现各个 pass 中随函数大小平方增长的开销
+#
+# 用法: tests/large/check_large.sh <compiler> [规模]
+# 规模默认 200000: 长表达式有这么多项, 数组程序的语句数是它的十分之一
+# (每条语句生成约 8 条 IR 指令). MEM_KB (默认 4194304) 和 TIME_LIMIT
+# (秒, 默认 60) 限制每次编译
+set -u
+
+compiler=${1:?usage: check_large.sh <compiler> [size]}
+size=${2:-200000}
+mem_kb=${MEM_KB:-4194304}
+time_limit=${TIME_LIMIT:-60}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# 一个很长的表达式, 每一项都从同一个变量读 (load-elim 转发全部 load)
+gen_long_sum() {
+  awk -v n="$size" 'BEGIN {
+    printf "int main() {\n  int x = 1;\n  int y = x"
+    for (k = 1; k < n; k++) {
+      printf "%s", (k % 16 == 0 ? "\n    + x" : " + x")
+    }
+    print ";\n  putint(y);\n  putch(10);\n  return 0;\n}"
+    print n > "/dev/stderr"
+  }'
+}
+# 一长串覆盖写入从不读取的局部数组 (dse 删除全部写入)
+gen_dead_array() {
+  awk -v n="$((size / 10))" 'BEGIN {
+    print "int main() {\n  int x = 0;\n  int a[4];\n  int i = 0;"
+    for (k = 0; k < n; k++) {
+      printf "  x = x + %d; a[i %% 4] = x;\n", k % 7 + 1
+      sum += k % 7 + 1
+    }
+    print "  putint(x);\n  putch(10);\n  return 0;\n}"
+    print sum > "/dev/stderr"
+  }'
+}
+# 同上, 但数组最后传给 putarray, 写入都要保留
+gen_live_array() {
+  awk -v n="$((size / 10))" 'BEGIN {
+    print "int main() {\n  int x = 0;\n  int a[4];\n  int i = 0;"
+    for (k = 0; k < n; k++) {
+      printf "  x = x + %d; a[i %% 4] = x;\n", k % 7 + 1
+      sum += k % 7 + 1
+    }
+    print "  putarray(1, a);\n  putint(x);\n  putch(10);\n  return 0;\n}"
+    printf "1: %d\n%d\n", sum, sum > "/dev/stderr"
+  }'
+}
+
+pass=0
+fail=0
+for kind in long_sum dead_array live_array; do
+  src="$work/$kind.sy"
+  "gen_$kind" > "$src" 2> "$work/$kind.expected"
+  echo "exit 0" >> "$work/$kind.expected"
+  for level in -O0 -O1 -O2; do
+    begin=$(date +%s%N)
+    (
+      ulimit -v "$mem_kb"
+      exec timeout "$time_limit" "$compiler" -run "$src" -o "$work/$kind.o" \
+        "$level"
+    ) > "$work/$kind.out" 2> "$work/$kind.err"
+    status=$?
+    ms=$(( ($(date +%s%N) - begin) / 1000000 ))
+    echo "exit $status" >> "$work/$kind.out"
+    if ! cmp -s "$work/$kind.out" "$work/$kind.expected"; then
+      echo "FAIL $kind $level (${ms} ms)"
+      grep -v '^sim: [0-9]' "$work/$kind.err" | head -3
+      fail=$((fail + 1))
+      continue
+    fi
+    printf "%-12s %-4s %8s ms\n" "$kind" "$level" "$ms"
+    pass=$((pass + 1))
+  done
+done
+echo "passed $pass, failed $fail"
+[ $fail -eq 0 ]
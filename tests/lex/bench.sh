@@ -0,0 +1,39 @@
+#!/bin/bash
+# 词法分析吞吐量对比: 把测试用例重复拼接成数 MB 的输入,
+# 先检查 flex 与 -fast-lex 生成的 Koopa IR 和优化报告中的源码行一致,
+# 再用 -lex-bench 计时
+#
+# 用法: tests/lex/bench.sh <compiler> [目标大小 MB]
+set -eu
+
+compiler=${1:?usage: bench.sh <compiler> [size-mb]}
+size_mb=${2:-8}
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+for src in "$dir"/../basic/*.sy; do
+  "$compiler" -koopa "$src" -o "$work/flex.koopa" > /dev/null
+  "$compiler" -koopa "$src" -o "$work/fast.koopa" -fast-lex > /dev/null
+  if ! cmp -s "$work/flex.koopa" "$work/fast.koopa"; then
+    echo "FAIL $(basename "$src"): -fast-lex output differs"
+    exit 1
+  fi
+  "$compiler" -riscv "$src" -o "$work/flex.s" -remarks="$work/flex.yaml" > /dev/null
+  "$compiler" -riscv "$src" -o "$work/fast.s" -fast-lex \
+    -remarks="$work/fast.yaml" > /dev/null
+  if ! cmp -s "$work/flex.yaml" "$work/fast.yaml"; then
+    echo "FAIL $(basename "$src"): -fast-lex source lines differ"
+    exit 1
+  fi
+done
+
+# 只做词法分析, 不要求拼接后的程序能通过语义检查
+cat "$dir"/../basic/*.sy > "$work/unit.sy"
+target=$((size_mb * 1000000))
+while [ "$(wc -c < "$work/unit.sy")" -lt "$target" ]; do
+  cat "$work/unit.sy" "$work/unit.sy" > "$work/big.sy"
+  mv "$work/big.sy" "$work/unit.sy"
+done
+echo "input: $(wc -c < "$work/unit.sy") bytes"
+"$compiler" -koopa "$work/unit.sy" -o /dev/null -lex-bench
@@ -0,0 +1,48 @@
+#!/bin/bash
+# 比较 -obj 直接生成的目标文件与 "汇编 -> 外部汇编器" 得到的目标文件:
+# 反汇编 + 重定位 (objdump -dr) 以及符号表 (objdump -t) 必须一致
+#
+# 用法: tests/obj/check_obj.sh <compiler> [测试文件...]
+# 环境变量 AS / OBJDUMP 可以覆盖默认的 llvm-mc / llvm-objdump
+set -u
+
+compiler=${1:?usage: check_obj.sh <compiler> [files...]}
+shift
+dir=$(cd "$(dirname "$0")" && pwd)
+if [ $# -eq 0 ]; then
+  set -- "$dir"/../basic/*.sy
+fi
+AS=${AS:-"llvm-mc -triple=riscv32 -mattr=+m -filetype=obj"}
+OBJDUMP=${OBJDUMP:-llvm-objdump}
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+pass=0
+fail=0
+for src in "$@"; do
+  name=$(basename "$src" .sy)
+  if ! "$compiler" -riscv "$src" -o "$work/$name.s" > /dev/null ||
+     ! "$compiler" -obj "$src" -o "$work/$name.o" > /dev/null ||
+     ! $AS "$work/$name.s" -o "$work/$name.ref.o"; then
+    echo "FAIL $name: compile/assemble error"
+    fail=$((fail + 1))
+    continue
+  fi
+  ok=1
+  for flags in -dr -t; do
+    $OBJDUMP $flags "$work/$name.o" | tail -n +3 | sort > "$work/$name.obj.txt"
+    $OBJDUMP $flags "$work/$name.ref.o" | tail -n +3 | sort > "$work/$name.ref.txt"
+    if ! diff -u "$work/$name.ref.txt" "$work/$name.obj.txt" > "$work/$name.diff"; then
+      echo "FAIL $name: objdump $flags differs"
+      head -20 "$work/$name.diff"
+      ok=0
+    fi
+  done
+  if [ $ok -eq 1 ]; then
+    pass=$((pass + 1))
+  else
+    fail=$((fail + 1))
+  fi
+done
+echo "passed $pass, failed $fail"
+[ $fail -eq 0 ]
@@ -0,0 +1,66 @@
+#!/bin/bash
+# 检查 profile 引导的编译: 插桩程序运行后写出 profile, 用它重新编译的程序
+# 输出和退出码与普通编译一致
+#
+# 用法: tests/pgo/check_pgo.sh <compiler> [测试文件...]
+# 默认用 -run 在内置模拟器中运行程序 (插桩程序的 profile 写到宿主机上).
+# 设置 RUN=<运行器> 时改为 -obj 编译, 由 RUN 链接运行时库并运行目标文件.
+# 程序从标准输入读输入, 测试文件旁的同名 .in 文件作为输入
+set -u
+
+compiler=${1:?usage: [RUN=<runner>] check_pgo.sh <compiler> [files...]}
+shift
+RUN=${RUN:-}
+dir=$(cd "$(dirname "$0")" && pwd)
+if [ $# -eq 0 ]; then
+  set -- "$dir"/../basic/*.sy
+fi
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# 编译并运行 src, 输出和退出码写到 <obj>.out; 编译失败时返回非 0
+# 用法: build_and_run <src> <input> <obj> [编译选项...]
+build_and_run() {
+  local src=$1 input=$2 obj=$3
+  shift 3
+  if [ -z "$RUN" ]; then
+    "$compiler" -run "$src" -o "$obj" "$@" < "$input" > "$obj.out" 2> /dev/null
+    echo "exit $?" >> "$obj.out"
+    return 0
+  fi
+  "$compiler" -obj "$src" -o "$obj" "$@" > /dev/null || return 1
+  $RUN "$obj" < "$input" > "$obj.out" 2> /dev/null
+  echo "exit $?" >> "$obj.out"
+}
+
+pass=0
+fail=0
+for src in "$@"; do
+  name=$(basename "$src" .sy)
+  input=${src%.sy}.in
+  [ -f "$input" ] || input=/dev/null
+  prof="$work/$name.prof"
+  if ! build_and_run "$src" "$input" "$work/$name.o" ||
+     ! build_and_run "$src" "$input" "$work/$name.gen.o" \
+         "-fprofile-generate=$prof"; then
+    echo "FAIL $name: compile error"
+    fail=$((fail + 1))
+    continue
+  fi
+  if [ ! -f "$prof" ] ||
+     ! build_and_run "$src" "$input" "$work/$name.use.o" \
+         "-fprofile-use=$prof"; then
+    echo "FAIL $name: no profile written or profile rejected"
+    fail=$((fail + 1))
+    continue
+  fi
+  if ! cmp -s "$work/$name.o.out" "$work/$name.gen.o.out" ||
+     ! cmp -s "$work/$name.o.out" "$work/$name.use.o.out"; then
+    echo "FAIL $name: output differs"
+    fail=$((fail + 1))
+    continue
+  fi
+  pass=$((pass + 1))
+done
+echo "passed $pass, failed $fail"
+[ $fail -eq 0 ]
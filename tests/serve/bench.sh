@@ -0,0 +1,76 @@
+#!/bin/bash
+# 编译服务器对比: 检查 compiler-client 的输出与直接运行 compiler 一致,
+# 选项中的相对路径按客户端的工作目录解析, 再分别统计反复编译小文件的耗时.
+# 服务器不比直接编译快时失败
+#
+# 用法: tests/serve/bench.sh <compiler> <compiler-client> [轮数]
+set -eu
+
+compiler=${1:?usage: bench.sh <compiler> <compiler-client> [rounds]}
+client=${2:?usage: bench.sh <compiler> <compiler-client> [rounds]}
+rounds=${3:-20}
+dir=$(cd "$(dirname "$0")" && pwd)
+work=$(mktemp -d)
+socket="$work/compiler.sock"
+
+"$compiler" --serve "$socket" 2> "$work/server.log" &
+server=$!
+trap 'kill $server 2> /dev/null; rm -rf "$work"' EXIT
+for _ in $(seq 50); do
+  [ -S "$socket" ] && break
+  sleep 0.1
+done
+
+for src in "$dir"/../basic/*.sy; do
+  for mode in -koopa -riscv -obj; do
+    "$compiler" $mode "$src" -o "$work/direct.out" > /dev/null
+    "$client" "$socket" $mode "$src" -o "$work/served.out"
+    if ! cmp -s "$work/direct.out" "$work/served.out"; then
+      echo "FAIL $(basename "$src") $mode: served output differs"
+      exit 1
+    fi
+  done
+done
+
+# 报告文件写到客户端的工作目录, 而不是服务器的
+mkdir "$work/sub"
+src=$(ls "$dir"/../basic/*.sy | head -n 1)
+(
+  cd "$work/sub"
+  "$client" "$socket" -riscv "$src" -o out.s -emit-stats=stats.json \
+    -remarks=remarks.yaml
+)
+for file in out.s stats.json remarks.yaml; do
+  if [ ! -f "$work/sub/$file" ]; then
+    echo "FAIL relative path: $file not written to the client directory"
+    exit 1
+  fi
+done
+if "$client" "$socket" -run "$src" -o "$work/out.o" 2> "$work/run.err" ||
+   ! grep -q "not supported in server mode" "$work/run.err"; then
+  echo "FAIL -run: expected a clear rejection"
+  exit 1
+fi
+
+time_loop() {
+  local start end
+  start=$(date +%s%N)
+  for _ in $(seq "$rounds"); do
+    for src in "$dir"/../basic/*.sy; do
+      "$@" -riscv "$src" -o "$work/out.s" > /dev/null
+    done
+  done
+  end=$(date +%s%N)
+  echo $(((end - start) / 1000000))
+}
+count=$((rounds * $(ls "$dir"/../basic/*.sy | wc -l)))
+direct=$(time_loop "$compiler")
+served=$(time_loop "$client" "$socket")
+echo "direct: $direct ms for $count compiles"
+echo "served: $served ms for $count compiles"
+awk -v d="$direct" -v s="$served" \
+  'BEGIN { printf "speedup: %.2fx\n", d / (s > 0 ? s : 1) }'
+if [ "$served" -ge "$direct" ]; then
+  echo "FAIL served compiles are not faster than direct ones"
+  exit 1
+fi
@@ -0,0 +1,91 @@
+// client.cpp
+// 编译服务器的客户端, 参数与 compiler 相同:
+//   compiler-client 套接字路径 模式 输入文件 -o 输出文件 [选项...]
+// 只做文件读写和套接字通信, 不链接编译器本身. 每次编译都要启动一次客户端,
+// 所以只用 stdio, 不引入 iostream 的初始化开销
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <vector>
+
+#include "serve_protocol.h"
+
+namespace {
+bool read_file(const char *path, std::string &data) {
+  FILE *file = fopen(path, "rb");
+  if (file == nullptr) {
+    return false;
+  }
+  char chunk[65536];
+  size_t len;
+  while ((len = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data.append(chunk, len);
+  }
+  fclose(file);
+  return true;
+}
+} // namespace
+
+int main(int argc, const char *argv[]) {
+  if (argc < 6 || strcmp(argv[4], "-o") != 0) {
+    fprintf(stderr,
+            "usage: %s <socket> <mode> <input> -o <output> [options...]\n",
+            argv[0]);
+    return 1;
+  }
+  std::string source;
+  if (!read_file(argv[3], source)) {
+    fprintf(stderr, "Cannot open %s\n", argv[3]);
+    return 1;
+  }
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(argv[1]) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", argv[1]);
+    return 1;
+  }
+  strcpy(addr.sun_path, argv[1]);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  // 选项中的相对路径由服务器按客户端的工作目录解析
+  std::vector<char> cwd(4096);
+  if (getcwd(cwd.data(), cwd.size()) == nullptr) {
+    perror("getcwd");
+    return 1;
+  }
+  std::vector<std::string> request = {argv[2], source, cwd.data()};
+  for (int i = 6; i < argc; ++i) {
+    request.push_back(argv[i]);
+  }
+  std::vector<std::string> response;
+  if (!write_message(fd, request) || !read_message(fd, response) ||
+      response.size() != 3) {
+    fprintf(stderr,
+            "compile server closed the connection (compiler crashed?)\n");
+    return 1;
+  }
+  close(fd);
+  fwrite(response[2].data(), 1, response[2].size(), stderr);
+  int status = atoi(response[0].c_str());
+  if (status == 0) {
+    FILE *out = fopen(argv[5], "wb");
+    if (out == nullptr) {
+      fprintf(stderr, "Cannot open %s\n", argv[5]);
+      return 1;
+    }
+    fwrite(response[1].data(), 1, response[1].size(), out);
+    fclose(out);
+  }
+  return status;
+}